@@ -33,19 +33,29 @@
 #define RC_INIT2 Code = 0; Range = 0xFFFFFFFF; \
   { int i; for(i = 0; i < 5; i++) { RC_TEST; Code = (Code << 8) | RC_READ_BYTE; }}
 
+/* CILO: the progress ticker is checked once per input refill rather than
+   once per symbol, keeping it out of the decode loop */
+#define RC_TICK if (nowPos >= lzma_tick_at) lzma_tick(nowPos);
+
 #ifdef _LZMA_IN_CB
 
 #define RC_TEST { if (Buffer == BufferLim) \
   { SizeT size; int result = InCallback->Read(InCallback, &Buffer, &size); if (result != LZMA_RESULT_OK) return result; \
-  BufferLim = Buffer + size; if (size == 0) return LZMA_RESULT_DATA_ERROR; }}
+  BufferLim = Buffer + size; if (size == 0) return LZMA_RESULT_DATA_ERROR; RC_TICK }}
 
 #define RC_INIT Buffer = BufferLim = 0; RC_INIT2
 
 #else
 
-#define RC_TEST { if (Buffer == BufferLim) return LZMA_RESULT_DATA_ERROR; }
+/* CILO: a flat input buffer is handed out LZMA_MEM_STEP bytes at a time,
+   so the ticker gets the same once-per-refill check */
+#define LZMA_MEM_STEP 4096
+
+#define RC_TEST { if (Buffer == BufferLim) \
+  { if (BufferLim == BufferEnd) return LZMA_RESULT_DATA_ERROR; \
+  BufferLim = (SizeT)(BufferEnd - BufferLim) > LZMA_MEM_STEP ? BufferLim + LZMA_MEM_STEP : BufferEnd; RC_TICK }}
 
-#define RC_INIT(buffer, bufferSize) Buffer = buffer; BufferLim = buffer + bufferSize; RC_INIT2
+#define RC_INIT(buffer, bufferSize) Buffer = BufferLim = buffer; BufferEnd = buffer + bufferSize; RC_INIT2
  
 #endif
 
@@ -177,6 +187,7 @@ int LzmaDecode(CLzmaDecoderState *vs,
   #else
   const Byte *Buffer = inStream;
   const Byte *BufferLim = inStream + inSize;
+  const Byte *BufferEnd = BufferLim;
   #endif
   int state = vs->State;
   UInt32 rep0 = vs->Reps[0], rep1 = vs->Reps[1], rep2 = vs->Reps[2], rep3 = vs->Reps[3];
@@ -247,6 +258,9 @@ int LzmaDecode(CLzmaDecoderState *vs,
   int len = 0;
   const Byte *Buffer;
   const Byte *BufferLim;
+  #ifndef _LZMA_IN_CB
+  const Byte *BufferEnd;
+  #endif
   UInt32 Range;
   UInt32 Code;
 
@@ -0,0 +1,17 @@
+/*
+ * LZMA decoder without the input callback
+ *
+ * Licensed under the GNU General Public License v.2.
+ * See COPYING in the root directory of this source distribution for more
+ * details.
+ *
+ * LzmaDecode.c built to read its input from a flat buffer, so a kernel on
+ * mapped flash is decoded from where it sits with no refill calls. The
+ * entry points are renamed so both builds can be linked together.
+ */
+
+#define LZMA_NO_IN_CB
+#define LzmaDecode LzmaDecodeMem
+#define LzmaDecodeProperties LzmaDecodePropertiesMem
+
+#include "LzmaDecode.c"
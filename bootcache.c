@@ -0,0 +1,146 @@
+/* Boot location cache
+ * Licensed under the GNU General Public License v2
+ *
+ * After a kernel has been loaded and checked, CILO records in NVRAM which
+ * device and file it came from, where the file's header is and the
+ * command line it was booted with. On the next boot the header at that
+ * one offset is checked against the record, and if it still matches the
+ * kernel is loaded without scanning any device, and without a prompt.
+ *
+ * The slot is NVRAM that IOS owns, so the cache is only built in with
+ * -DBOOT_CACHE, on platforms that define BOOT_CACHE_NVRAM to the address
+ * of the slot, and provide platform_key_wait(). Booting with the config
+ * register set to ignore NVRAM, as with "confreg 0x2142", leaves the cache
+ * alone and goes to the prompt. So does a key pressed in the few seconds
+ * CILO waits before using a record, which doesn't depend on ROMMON
+ * handing over the config register.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <crc32.h>
+#include <bootcache.h>
+#include <storage/storage.h>
+#include <promlib.h>
+
+#include <platform.h>
+
+#if defined(BOOT_CACHE) && defined(BOOT_CACHE_NVRAM)
+
+#define BOOT_RECORD_CRC_OFFSET (2 * sizeof(uint32_t))
+
+/* seconds to wait for a key before booting from a record */
+#ifndef BOOT_CACHE_WAIT
+#define BOOT_CACHE_WAIT 2
+#endif
+
+/**
+ * Compute the checksum of a record
+ */
+static uint32_t boot_cache_crc(struct boot_record *rec)
+{
+    return crc32_update(0, (uint8_t *)rec + BOOT_RECORD_CRC_OFFSET,
+        sizeof(struct boot_record) - BOOT_RECORD_CRC_OFFSET);
+}
+
+/**
+ * Check whether the config register says to keep out of NVRAM
+ * @returns non-zero if the cache is not to be used
+ */
+static int boot_cache_skip(void)
+{
+    return c_confreg() & CONFREG_IGNORE_NVRAM;
+}
+
+/**
+ * Read the boot record out of NVRAM. NVRAM is read and written a byte at
+ * a time, as not every box decodes wider accesses to it.
+ * @param rec record to fill in
+ * @returns 0 if there is a valid record to boot from, -1 if not or if a
+ * key was pressed to skip it
+ */
+int boot_cache_load(struct boot_record *rec)
+{
+    volatile uint8_t *nv = (volatile uint8_t *)BOOT_CACHE_NVRAM;
+    uint8_t *p = (uint8_t *)rec;
+    uint32_t i;
+
+    if (boot_cache_skip()) {
+        printf("Config register is set to ignore NVRAM; not using the "
+            "boot cache.\n");
+        return -1;
+    }
+
+    for (i = 0; i < sizeof(struct boot_record); i++) {
+        p[i] = nv[i];
+    }
+
+    if (rec->magic != BOOT_CACHE_MAGIC || rec->crc != boot_cache_crc(rec)) {
+        return -1;
+    }
+
+    /* never trust the strings to be terminated */
+    rec->device[sizeof(rec->device) - 1] = '\0';
+    rec->filename[sizeof(rec->filename) - 1] = '\0';
+    rec->cmd_line[sizeof(rec->cmd_line) - 1] = '\0';
+
+    printf("Press a key within %d seconds to skip the boot cache.\n",
+        BOOT_CACHE_WAIT);
+
+    if (platform_key_wait(BOOT_CACHE_WAIT)) {
+        printf("Not using the boot cache.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Record where a kernel that is about to be booted came from. Nothing is
+ * recorded for devices that can't locate a file by its header offset, and
+ * NVRAM is only written if the record has changed.
+ * @param fp the kernel file, loaded and checked
+ * @param cmd_line the command line it is booted with
+ */
+void boot_cache_save(struct file *fp, const char *cmd_line)
+{
+    volatile uint8_t *nv = (volatile uint8_t *)BOOT_CACHE_NVRAM;
+    struct boot_record rec;
+    uint8_t *p = (uint8_t *)&rec;
+    uint32_t i;
+
+    if (fp->sto->ops->record == NULL || fp->sto->ops->locate == NULL ||
+        boot_cache_skip())
+    {
+        return;
+    }
+
+    memzero(&rec, sizeof(rec));
+
+    rec.magic = BOOT_CACHE_MAGIC;
+    strncpy(rec.device, fp->sto->dev_name, sizeof(rec.device) - 1);
+    strncpy(rec.filename, fp->filename, sizeof(rec.filename) - 1);
+    strncpy(rec.cmd_line, cmd_line, sizeof(rec.cmd_line) - 1);
+    fp->sto->ops->record(fp, &rec);
+    rec.crc = boot_cache_crc(&rec);
+
+    for (i = 0; i < sizeof(rec) && nv[i] == p[i]; i++);
+
+    for (; i < sizeof(rec); i++) {
+        nv[i] = p[i];
+    }
+}
+
+#else
+
+int boot_cache_load(struct boot_record *rec)
+{
+    return -1;
+}
+
+void boot_cache_save(struct file *fp, const char *cmd_line)
+{
+}
+
+#endif
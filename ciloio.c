@@ -4,26 +4,264 @@
 
 #include <types.h>
 #include <ciloio.h>
+#include <string.h>
+#include <printf.h>
 
-/* Platform-specific file I/O operations */
-#include <platio.h>
+/* storage devices registered by the platform */
+#include <storage/storage.h>
+#include <bootcache.h>
+
+/* HEAP_RESERVE and LOAD_LIMIT */
+#include <platform.h>
+#include <promlib.h>
+
+/* holds cilo_map() ranges for devices that can't be addressed directly */
+static uint32_t map_bounce[CILO_MAP_BOUNCE / sizeof(uint32_t)];
+
+/* read-ahead cache: a window of the file held in RAM */
+struct cilo_ra {
+    uint8_t in_use;
+    uint32_t win_off; /* file offset of the first byte in buf */
+    uint32_t win_len; /* number of valid bytes in buf */
+    uint32_t next; /* offset just past the previous read */
+
+    uint32_t hits; /* reads served entirely from the window */
+    uint32_t misses; /* reads that had to go to the device */
+
+    uint32_t buf[CILO_RA_BLOCK * CILO_RA_DEPTH / sizeof(uint32_t)];
+};
+
+static struct cilo_ra *ra_pool;
+
+/* bytes of the heap handed out by cilo_alloc() */
+static uint32_t heap_used;
+
+/**
+ * Allocate memory for the rest of the boot. CILO only has the RAM between
+ * TEXTADDR and LOADADDR to itself, so buffers too big for its BSS come
+ * from the HEAP_RESERVE bytes between LOAD_LIMIT and the stack, which no
+ * image is loaded or staged in. Nothing is ever freed.
+ * @param len number of bytes
+ * @returns zeroed, 32-byte aligned memory, or NULL if the heap is used up
+ */
+void *cilo_alloc(uint32_t len)
+{
+    uint8_t *p;
+
+    len = (len + 31) & ~31;
+
+    if (len > HEAP_RESERVE - heap_used) {
+        printf("Out of memory: %d bytes wanted, %d free. Raise "
+            "HEAP_RESERVE.\n", len, HEAP_RESERVE - heap_used);
+        return NULL;
+    }
+
+    p = (uint8_t *)LOAD_LIMIT + heap_used;
+    heap_used += len;
+    memzero(p, len);
+
+    return p;
+}
+
+/**
+ * Take a free read-ahead cache from the pool, allocating the pool the
+ * first time
+ * @returns the cache, or NULL if all are in use
+ */
+static struct cilo_ra *cilo_ra_alloc(void)
+{
+    int i;
+
+    if (ra_pool == NULL &&
+        (ra_pool = cilo_alloc(CILO_RA_FILES * sizeof(*ra_pool))) == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < CILO_RA_FILES; i++) {
+        if (!ra_pool[i].in_use) {
+            ra_pool[i].in_use = 1;
+            ra_pool[i].win_off = 0;
+            ra_pool[i].win_len = 0;
+            ra_pool[i].next = 0;
+            ra_pool[i].hits = 0;
+            ra_pool[i].misses = 0;
+            return &ra_pool[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Read directly from the device at a given offset, leaving the file
+ * position alone
+ * @param fp the file
+ * @param buf destination
+ * @param offset file offset to read from
+ * @param len number of bytes
+ */
+static void cilo_ra_device_read(struct file *fp, void *buf, uint32_t offset,
+    uint32_t len)
+{
+    uint32_t pos = fp->file_pos;
+
+    fp->file_pos = offset;
+    fp->sto->ops->read(buf, len, 1, fp);
+    fp->file_pos = pos;
+}
+
+/**
+ * Read through the read-ahead cache. Whole blocks are read straight into
+ * the caller's buffer; partial blocks are served from the window, which is
+ * refilled with one block for random access or CILO_RA_DEPTH blocks when
+ * the reads are sequential.
+ * @param fp the file
+ * @param pbuf destination
+ * @param len number of bytes, already clipped to the end of the file
+ */
+static void cilo_ra_read(struct file *fp, uint8_t *pbuf, uint32_t len)
+{
+    struct cilo_ra *ra = fp->ra;
+    uint32_t pos = fp->file_pos;
+    uint32_t n;
+    int missed = 0;
+
+    while (len) {
+        if (pos >= ra->win_off && pos < ra->win_off + ra->win_len) {
+            n = ra->win_off + ra->win_len - pos;
+            if (n > len) n = len;
+            memcpy(pbuf, (uint8_t *)ra->buf + (pos - ra->win_off), n);
+        } else if ((pos & (CILO_RA_BLOCK - 1)) == 0 && len >= CILO_RA_BLOCK) {
+            /* no point in staging whole blocks through the window */
+            n = len & ~(CILO_RA_BLOCK - 1);
+            cilo_ra_device_read(fp, pbuf, pos, n);
+            missed = 1;
+        } else {
+            ra->win_off = pos & ~(CILO_RA_BLOCK - 1);
+            ra->win_len = (pos == ra->next) ?
+                CILO_RA_BLOCK * CILO_RA_DEPTH : CILO_RA_BLOCK;
+
+            if (ra->win_len > fp->file_len - ra->win_off) {
+                ra->win_len = fp->file_len - ra->win_off;
+            }
+
+            cilo_ra_device_read(fp, ra->buf, ra->win_off, ra->win_len);
+            missed = 1;
+            continue;
+        }
+
+        pbuf += n;
+        pos += n;
+        len -= n;
+    }
+
+    if (missed) ra->misses++;
+    else ra->hits++;
+
+    ra->next = pos;
+    fp->file_pos = pos;
+}
+
+/**
+ * Finish setting up a file the device has filled in
+ * @param fp the file
+ */
+static void cilo_setup(struct file *fp)
+{
+    fp->dev = fp->sto->dev_id;
+    fp->code = 1;
+
+    /* devices that can't be mapped are read through a read-ahead cache */
+    fp->mapped = fp->sto->ops->map != NULL &&
+        fp->sto->ops->map(fp, 0, 0) != NULL;
+    if (!fp->mapped) fp->ra = cilo_ra_alloc();
+}
 
 struct file cilo_open(const char *filename) 
 {
     struct file fp;
-    if (!platio_find_file(filename)) {
+    fp.ra = NULL;
+    fp.mapped = 0;
+    fp.crc = 0;
+    fp.crc_pos = 0;
+
+    if ((fp.sto = storage_open(filename, &fp)) == NULL) {
         fp.code = -1;
         return fp;
     }
 
-    platio_file_open(&fp, filename);
+    cilo_setup(&fp);
+
+    return fp;
+}
+
+/**
+ * Open the file a boot record names, without searching the device for it
+ * @param rec the boot record
+ * @returns the file; code is -1 if the record no longer matches the device
+ */
+struct file cilo_locate(const struct boot_record *rec)
+{
+    struct file fp;
+    fp.ra = NULL;
+    fp.mapped = 0;
+    fp.crc = 0;
+    fp.crc_pos = 0;
+    fp.code = -1;
+
+    fp.sto = storage_find_class(rec->device, strlen(rec->device));
+
+    if (fp.sto == NULL || fp.sto->ops->locate == NULL ||
+        !fp.sto->ops->locate(fp.sto, &fp, rec))
+    {
+        return fp;
+    }
+
+    cilo_setup(&fp);
 
     return fp;
 }
 
 int32_t cilo_read(void *pbuf, uint32_t size, uint32_t nmemb, struct file *fp)
 {
-    return platio_read(pbuf, size, nmemb, fp);
+    uint32_t len = size * nmemb;
+
+    if (fp->ra == NULL) {
+        return fp->sto->ops->read(pbuf, size, nmemb, fp);
+    }
+
+    if (fp->file_pos >= fp->file_len) {
+        return 0;
+    }
+
+    if (len > fp->file_len - fp->file_pos) {
+        len = fp->file_len - fp->file_pos;
+    }
+
+    cilo_ra_read(fp, pbuf, len);
+
+    return len;
+}
+
+/**
+ * Release any resources held by an open file.
+ * @param fp the file
+ */
+void cilo_close(struct file *fp)
+{
+    if (fp->sto != NULL && fp->sto->ops->close != NULL) {
+        fp->sto->ops->close(fp);
+    }
+
+    if (fp->ra != NULL) {
+#ifdef DEBUG
+        printf("%s: read-ahead %d hits, %d misses\n", fp->filename,
+            fp->ra->hits, fp->ra->misses);
+#endif
+        fp->ra->in_use = 0;
+        fp->ra = NULL;
+    }
 }
 
 int32_t cilo_seek(struct file *fp, uint32_t offset, uint8_t whence)
@@ -46,3 +284,146 @@ int32_t cilo_seek(struct file *fp, uint32_t offset, uint8_t whence)
 
     return 0;
 }
+
+/**
+ * Get a pointer to a range of a file without copying it, if the device
+ * allows. Otherwise the range is read into a bounce buffer that stays valid
+ * until the next call. The file position is not changed.
+ * @param fp file to map
+ * @param offset offset of the first byte within the file
+ * @param len number of bytes required
+ * @returns pointer to the data, or NULL if the range is invalid or too large
+ *          to bounce
+ */
+void *cilo_map(struct file *fp, uint32_t offset, uint32_t len)
+{
+    void *p;
+    uint32_t pos;
+
+    if (offset > fp->file_len || len > fp->file_len - offset) {
+        return NULL;
+    }
+
+    if (fp->mapped && (p = fp->sto->ops->map(fp, offset, len)) != NULL) {
+        return p;
+    }
+
+    if (len > CILO_MAP_BOUNCE) {
+        return NULL;
+    }
+
+    pos = cilo_tell(fp);
+    cilo_seek(fp, offset, SEEK_SET);
+    cilo_read(map_bounce, len, 1, fp);
+    cilo_seek(fp, pos, SEEK_SET);
+
+    return map_bounce;
+}
+
+/**
+ * Start reading len bytes at the current file position into pbuf, and
+ * advance the position. The device driver may start a transfer (DMA, a
+ * FIFO engine) and return straight away; the caller can then get on with
+ * other work and check for completion with cilo_poll(). pbuf must not be
+ * touched until the request is done. Async reads bypass the read-ahead
+ * cache, since they are meant for bulk transfers. Devices without an async
+ * handler complete the read before returning.
+ * @param req request state, owned by the caller until the read completes
+ * @param pbuf destination
+ * @param len number of bytes
+ * @param fp file to read from
+ * @returns number of bytes that will be read, or < 0 on error
+ */
+int32_t cilo_read_async(struct cilo_req *req, void *pbuf, uint32_t len,
+    struct file *fp)
+{
+    int r;
+
+    if (fp->file_pos >= fp->file_len) {
+        len = 0;
+    } else if (len > fp->file_len - fp->file_pos) {
+        len = fp->file_len - fp->file_pos;
+    }
+
+    req->fp = fp;
+    req->buf = pbuf;
+    req->offset = fp->file_pos;
+    req->len = len;
+    req->private = NULL;
+    req->state = CILO_REQ_PENDING;
+
+    fp->file_pos += len;
+
+    if (len == 0) {
+        req->state = CILO_REQ_DONE;
+        return 0;
+    }
+
+    if (fp->sto->ops->read_async == NULL) {
+        cilo_ra_device_read(fp, pbuf, req->offset, len);
+        req->state = CILO_REQ_DONE;
+        return len;
+    }
+
+    if ((r = fp->sto->ops->read_async(req)) < 0) {
+        req->state = CILO_REQ_ERROR;
+        return -1;
+    }
+
+    if (r) req->state = CILO_REQ_DONE;
+
+    return len;
+}
+
+/**
+ * Check whether an asynchronous read has finished
+ * @param req the request
+ * @returns CILO_REQ_DONE, CILO_REQ_PENDING or CILO_REQ_ERROR
+ */
+int cilo_poll(struct cilo_req *req)
+{
+    int r;
+
+    if (req->state != CILO_REQ_PENDING) {
+        return req->state;
+    }
+
+    if ((r = req->fp->sto->ops->poll(req)) < 0) {
+        req->state = CILO_REQ_ERROR;
+    } else if (r) {
+        req->state = CILO_REQ_DONE;
+    }
+
+    return req->state;
+}
+
+/**
+ * Check a file against the checksum its device stores for it, before it is
+ * booted. Devices that compute the CRC as the file is read only have to
+ * cover what hasn't been read yet. A mismatch is reported; with
+ * -DREQUIRE_CRC it, or a file that can't be checked at all, stops the boot.
+ * @param fp the file
+ * @returns 0 if the file may be used, -1 if not
+ */
+int cilo_verify(struct file *fp)
+{
+    int r = 0;
+
+    if (fp->sto->ops->verify != NULL) {
+        r = fp->sto->ops->verify(fp);
+    }
+
+    if (r < 0) {
+        printf("%s: CRC32 mismatch, the file is corrupt.\n", fp->filename);
+    }
+
+#ifdef REQUIRE_CRC
+    if (r == 0) {
+        printf("%s: no CRC32 to check the file against.\n", fp->filename);
+    }
+
+    return r > 0 ? 0 : -1;
+#else
+    return 0;
+#endif
+}
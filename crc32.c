@@ -0,0 +1,127 @@
+/* CRC-32 (IEEE 802.3, as used by zlib), slicing-by-8
+ * Licensed under the GNU General Public License v2
+ *
+ * Eight bytes are folded in per step with eight table lookups. The tables
+ * are generated at build time by mkcrc32. Big endian targets use tables
+ * with every entry byte swapped and keep the CRC byte swapped as they go,
+ * so words are used just as they were loaded.
+ */
+
+#include <types.h>
+#include <crc32.h>
+
+#if defined(__MIPSEB__) || defined(__powerpc__) || defined(__BIG_ENDIAN__)
+#define CRC32_BIG_ENDIAN
+#endif
+
+#include <crc32_table.h>
+
+#ifdef CRC32_BIG_ENDIAN
+#define crc32_swab(x) (((x) >> 24) | (((x) >> 8) & 0xff00) | \
+    (((x) << 8) & 0xff0000) | ((x) << 24))
+
+/* the CRC in the working (byte swapped) form */
+#define CRC32_IN(c) crc32_swab(~(c))
+#define CRC32_OUT(c) (~crc32_swab(c))
+
+#define CRC32_BYTE(c, b) \
+    (((c) << 8) ^ crc32_table[0][((c) >> 24) ^ (b)])
+
+#define CRC32_SLICE8(one, two) \
+    (crc32_table[7][(one) >> 24] ^ crc32_table[6][((one) >> 16) & 0xff] ^ \
+     crc32_table[5][((one) >> 8) & 0xff] ^ crc32_table[4][(one) & 0xff] ^ \
+     crc32_table[3][(two) >> 24] ^ crc32_table[2][((two) >> 16) & 0xff] ^ \
+     crc32_table[1][((two) >> 8) & 0xff] ^ crc32_table[0][(two) & 0xff])
+#else
+#define CRC32_IN(c) (~(c))
+#define CRC32_OUT(c) (~(c))
+
+#define CRC32_BYTE(c, b) \
+    (((c) >> 8) ^ crc32_table[0][((c) ^ (b)) & 0xff])
+
+#define CRC32_SLICE8(one, two) \
+    (crc32_table[7][(one) & 0xff] ^ crc32_table[6][((one) >> 8) & 0xff] ^ \
+     crc32_table[5][((one) >> 16) & 0xff] ^ crc32_table[4][(one) >> 24] ^ \
+     crc32_table[3][(two) & 0xff] ^ crc32_table[2][((two) >> 8) & 0xff] ^ \
+     crc32_table[1][((two) >> 16) & 0xff] ^ crc32_table[0][(two) >> 24])
+#endif
+
+/**
+ * Add a buffer to a CRC
+ * @param crc CRC of the data so far, 0 to start
+ * @param buf data
+ * @param len number of bytes
+ * @returns CRC of the data so far followed by buf
+ */
+uint32_t crc32_update(uint32_t crc, const void *buf, uint32_t len)
+{
+    const uint8_t *p = buf;
+    uint32_t c = CRC32_IN(crc);
+    uint32_t one, two;
+
+    while (len && ((uint32_t)p & 3)) {
+        c = CRC32_BYTE(c, *p++);
+        len--;
+    }
+
+    while (len >= 8) {
+        one = ((const uint32_t *)p)[0] ^ c;
+        two = ((const uint32_t *)p)[1];
+        c = CRC32_SLICE8(one, two);
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        c = CRC32_BYTE(c, *p++);
+    }
+
+    return CRC32_OUT(c);
+}
+
+/**
+ * Copy a buffer and add it to a CRC in the same pass, so the source is
+ * only read once. Word copies are used when src and dst can be aligned
+ * together.
+ * @param dst destination
+ * @param src source
+ * @param len number of bytes
+ * @param crc CRC of the data so far, 0 to start
+ * @returns CRC of the data so far followed by src
+ */
+uint32_t crc32_copy(void *dst, const void *src, uint32_t len, uint32_t crc)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    uint32_t c = CRC32_IN(crc);
+    uint32_t one, two;
+
+    while (len && ((uint32_t)s & 3)) {
+        c = CRC32_BYTE(c, *s);
+        *d++ = *s++;
+        len--;
+    }
+
+    if (((uint32_t)d & 3) == 0) {
+        while (len >= 8) {
+            one = ((const uint32_t *)s)[0];
+            two = ((const uint32_t *)s)[1];
+            ((uint32_t *)d)[0] = one;
+            ((uint32_t *)d)[1] = two;
+
+            one ^= c;
+            c = CRC32_SLICE8(one, two);
+
+            s += 8;
+            d += 8;
+            len -= 8;
+        }
+    }
+
+    while (len--) {
+        c = CRC32_BYTE(c, *s);
+        *d++ = *s++;
+    }
+
+    return CRC32_OUT(c);
+}
@@ -0,0 +1,71 @@
+/* CRC-64 (ECMA-182, as used by xz)
+ * Licensed under the GNU General Public License v2
+ *
+ * Byte at a time, with the 64-bit CRC and table entries split into 32-bit
+ * halves so no 64-bit arithmetic is needed. Only .xz images use it, so the
+ * table is built the first time it's needed rather than at build time.
+ */
+
+#include <types.h>
+#include <crc64.h>
+
+/* reflected polynomial 0xC96C5795D7870F42 */
+#define CRC64_POLY_HI 0xC96C5795
+#define CRC64_POLY_LO 0xD7870F42
+
+static uint32_t crc64_table_lo[256];
+static uint32_t crc64_table_hi[256];
+static int crc64_ready;
+
+static void crc64_init(void)
+{
+    uint32_t lo, hi, carry;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        lo = i;
+        hi = 0;
+
+        for (j = 0; j < 8; j++) {
+            carry = lo & 1;
+            lo = (lo >> 1) | (hi << 31);
+            hi >>= 1;
+
+            if (carry) {
+                lo ^= CRC64_POLY_LO;
+                hi ^= CRC64_POLY_HI;
+            }
+        }
+
+        crc64_table_lo[i] = lo;
+        crc64_table_hi[i] = hi;
+    }
+
+    crc64_ready = 1;
+}
+
+/**
+ * Add a buffer to a CRC
+ * @param crc CRC of the data so far, {0, 0} to start; updated in place
+ * @param buf data
+ * @param len number of bytes
+ */
+void crc64_update(struct crc64 *crc, const void *buf, uint32_t len)
+{
+    const uint8_t *p = buf;
+    uint32_t lo = ~crc->lo, hi = ~crc->hi;
+    uint8_t i;
+
+    if (!crc64_ready) {
+        crc64_init();
+    }
+
+    while (len--) {
+        i = (lo ^ *p++) & 0xff;
+        lo = ((lo >> 8) | (hi << 24)) ^ crc64_table_lo[i];
+        hi = (hi >> 8) ^ crc64_table_hi[i];
+    }
+
+    crc->lo = ~lo;
+    crc->hi = ~hi;
+}
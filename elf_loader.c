@@ -9,30 +9,124 @@
 #include <promlib.h>
 #include <printf.h>
 #include <ciloio.h>
+#include <bootcache.h>
+#include <pipeline.h>
+#include <string.h>
 
 /* platform-specific defines */
 #include <platform.h>
 
+/* most PT_LOAD segments a 32-bit image may have */
+#define ELF_MAX_SEGMENTS 16
+
+/* a transfer from the file into memory, built from one or more PT_LOADs */
+struct elf32_load {
+    uint32_t offset;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+};
+
 /**
- * load a single ELF section into memory at address. Assumes ELF data is
- * contiguous in memory.
- * @param base location (in memory) of the ELF file
- * @param address address at which the ELF section will be loaded
- * @param file_offset offset (in bytes) in the ELF file where the section is
- * @param length Length of the section (in bytes)
+ * Build the list of transfers needed to load an image: PT_LOAD segments
+ * sorted by file offset, with segments that are contiguous both in the
+ * file and in memory merged into a single transfer.
+ * @param phdr program header table
+ * @param phnum number of program headers
+ * @param loads array of ELF_MAX_SEGMENTS transfers to fill in
+ * @returns number of transfers, or -1 if there are too many segments
  */
-void load_elf32_section(struct file *fp, uint32_t address, 
-    uint32_t file_offset, uint32_t length)
+static int elf32_plan_loads(struct elf32_phdr *phdr, int phnum,
+    struct elf32_load *loads)
 {
-    uint8_t *elf_loc = (uint8_t *)address;
+    int i, j, n = 0;
+
+    for (i = 0; i < phnum; i++, phdr++) {
+        /* skip unloadable segments */
+        if (phdr->type != ELF_PT_LOAD) continue;
+
+        if (n == ELF_MAX_SEGMENTS) return -1;
+
+        /* insertion sort on file offset */
+        for (j = n; j > 0 && loads[j - 1].offset > phdr->offset; j--) {
+            loads[j] = loads[j - 1];
+        }
+
+        loads[j].offset = phdr->offset;
+        loads[j].paddr = phdr->paddr;
+        loads[j].filesz = phdr->filesz;
+        loads[j].memsz = phdr->memsz;
+        n++;
+    }
+
+    /* coalesce neighbours; a segment with .bss can't absorb the next one */
+    for (i = 0, j = 1; j < n; j++) {
+        struct elf32_load *a = &loads[i], *b = &loads[j];
+
+        if (a->memsz == a->filesz &&
+            a->offset + a->filesz == b->offset &&
+            a->paddr + a->filesz == b->paddr)
+        {
+            a->filesz += b->filesz;
+            a->memsz += b->memsz;
+        } else {
+            loads[++i] = *b;
+        }
+    }
+
+    return n ? i + 1 : 0;
+}
+
+/**
+ * load a single ELF section into memory at address. The image is streamed
+ * forward, so bytes the stream has already passed are copied from the
+ * earlier section that holds them.
+ * @param rd cursor on the image, positioned at the end of the last section
+ * @param loads transfers sorted by file offset
+ * @param i index of the transfer to load
+ * @returns 0 on success, -1 if the image ends first
+ */
+static int load_elf32_section(struct pipe_reader *rd,
+    struct elf32_load *loads, int i)
+{
+    uint32_t address = loads[i].paddr;
+    uint32_t file_offset = loads[i].offset;
+    uint32_t length = loads[i].filesz;
+    uint32_t n;
+    int j;
 
 #ifdef DEBUG
     printf("Init data: %08x length %08x\n", address, length);
 #endif
 
-    cilo_seek(fp, (uint32_t)file_offset, SEEK_SET);
-    cilo_read(elf_loc, (uint32_t)length, 1, fp); 
+    while (length && file_offset < rd->pos) {
+        /* the stream got this far by reading an earlier section that
+         * reaches past file_offset; loads[0] if no later one does */
+        for (j = i - 1; j > 0; j--) {
+            if (file_offset < loads[j].offset + loads[j].filesz) break;
+        }
+
+        n = loads[j].offset + loads[j].filesz - file_offset;
+        if (n > rd->pos - file_offset) n = rd->pos - file_offset;
+        if (n > length) n = length;
+
+        memcpy((void *)address,
+            (void *)(loads[j].paddr + file_offset - loads[j].offset), n);
+
+        address += n;
+        file_offset += n;
+        length -= n;
+    }
 
+    if (length == 0) {
+        return 0;
+    }
+
+    if (pipe_read(rd, NULL, file_offset - rd->pos) < 0) {
+        return -1;
+    }
+
+    return pipe_read(rd, (void *)address, length);
 }
 
 
@@ -43,16 +137,11 @@ void load_elf32_section(struct file *fp, uint32_t address,
  */
 void load_elf32_uninitialized_memory(uint32_t address, uint32_t length)
 {
-    int i = 0;
-    uint8_t *p = (uint8_t *)address;
-
 #ifdef DEBUG
     printf("Uninit data: %08x, len %08x\n", address, length); 
 #endif
 
-    for (i = 0; i < length; i++) {
-        p[i] = 0;
-    }
+    memzero((void *)address, length);
 }
 
 /**
@@ -65,82 +154,120 @@ void load_elf32_uninitialized_memory(uint32_t address, uint32_t length)
  */
 void load_elf32_file(struct file *fp, char *cmd_line)
 {
-    struct elf32_header hdr;
+    struct elf32_header *hdr;
     uint32_t mem_sz = 0;
+    uint32_t entry;
+
+    /* parse the header in place */
+    hdr = cilo_map(fp, 0, sizeof(struct elf32_header));
 
-    /* read in header entries */
-    cilo_read(&hdr, sizeof(struct elf32_header), 1, fp);
+    if (hdr == NULL) {
+        printf("File too short to contain an ELF header. Aborting load.\n");
+        return;
+    }
 
     /* check the file magic */
-    if (hdr.ident[0] != ELF_MAGIC_1 || hdr.ident[1] != ELF_MAGIC_2 ||
-        hdr.ident[2] != ELF_MAGIC_3 || hdr.ident[3] != ELF_MAGIC_4)
+    if (hdr->ident[0] != ELF_MAGIC_1 || hdr->ident[1] != ELF_MAGIC_2 ||
+        hdr->ident[2] != ELF_MAGIC_3 || hdr->ident[3] != ELF_MAGIC_4)
     {
         printf("Bad ELF magic found. Found: %#2x %#2x %#2x %#2x.\n",
-            hdr.ident[0], hdr.ident[1], hdr.ident[2], hdr.ident[3]);
+            hdr->ident[0], hdr->ident[1], hdr->ident[2], hdr->ident[3]);
         return;
     }
     /* check machine class: */
-    if (!hdr.ident[ELF_INDEX_CLASS] == ELF_CLASS_32)
+    if (!hdr->ident[ELF_INDEX_CLASS] == ELF_CLASS_32)
     {
         printf("Invalid ELF machine class found. Found: %2x.\n",
-            hdr.ident[ELF_INDEX_CLASS]);
+            hdr->ident[ELF_INDEX_CLASS]);
         return;
     }
 
     /* check endianess: */
-    if (hdr.ident[ELF_INDEX_DATA] != ELF_DATA_MSB) {
+    if (hdr->ident[ELF_INDEX_DATA] != ELF_DATA_MSB) {
         printf("Non-big endian ELF file detected. Aborting load.\n");
         return;
     }
 
-    if (hdr.ehsize != 52 /* bytes */) {
+    if (hdr->ehsize != 52 /* bytes */) {
         printf("Warning: ELF header greater than 52 bytes found. Found: %u\n",
-            hdr.ehsize);
+            hdr->ehsize);
     }
 
-    if (hdr.phnum == 0) {
+    if (hdr->phnum == 0) {
         printf("Found zero segments in ELF file. Aborting load.\n");
         return;
     }
 
     int i;
-    struct elf32_phdr phdr;
+    int phnum = hdr->phnum;
+    struct elf32_phdr *phdr;
 
-    cilo_seek(fp, hdr.phoff, SEEK_SET);
+    /* mapping the program headers may reuse the header's bounce buffer */
+    entry = hdr->entry;
+    phdr = cilo_map(fp, hdr->phoff, sizeof(struct elf32_phdr) * phnum);
 
-    /* read the PT_LOAD segments into memory at paddr + mem_sz */
-    cilo_seek(fp, hdr.phoff, SEEK_SET);
-    for (i = 0; i < hdr.phnum; i++) {
-        cilo_read(&phdr, sizeof(struct elf32_phdr), 1, fp);
+    if (phdr == NULL) {
+        printf("Unable to read ELF program headers. Aborting load.\n");
+        return;
+    }
 
-        /* skip unloadable segments */
-        if (phdr.type != ELF_PT_LOAD) continue;
+    struct elf32_load loads[ELF_MAX_SEGMENTS];
+    struct pipe_file src;
+    struct pipe_reader rd;
+    int nloads = elf32_plan_loads(phdr, phnum, loads);
 
-        load_elf32_section(fp, phdr.paddr,
-            phdr.offset, phdr.filesz);
+    if (nloads < 0) {
+        printf("More than %d loadable segments in ELF file. Aborting load.\n",
+            ELF_MAX_SEGMENTS);
+        return;
+    }
 
-        mem_sz += phdr.memsz;
+    /* stream the image from the start of the file to the end of the last
+     * segment in it: file -> segments */
+    uint32_t end = 0;
 
-        if (phdr.memsz - phdr.filesz > 0) {
-            load_elf32_uninitialized_memory(phdr.paddr +
-                phdr.filesz, phdr.memsz - phdr.filesz);
+    for (i = 0; i < nloads; i++) {
+        if (loads[i].offset + loads[i].filesz > end) {
+            end = loads[i].offset + loads[i].filesz;
         }
+    }
 
-        cilo_seek(fp, hdr.phoff + sizeof(struct elf32_phdr) * (i + 1), 
-            SEEK_SET);
+    pipe_file_init(&src, fp, 0, end, NULL, 0);
+    pipe_reader_init(&rd, &src.st);
+
+    /* read the segments in file order, so the file is only read forward */
+    for (i = 0; i < nloads; i++) {
+        if (load_elf32_section(&rd, loads, i) < 0) {
+            printf("ELF file is truncated. Aborting load.\n");
+            return;
+        }
+
+        mem_sz += loads[i].memsz;
+
+        if (loads[i].memsz > loads[i].filesz) {
+            load_elf32_uninitialized_memory(loads[i].paddr +
+                loads[i].filesz, loads[i].memsz - loads[i].filesz);
+        }
     }
 
     /* assume the entry point is the smallest address we're loading */
     printf("Loaded %d bytes.\n", mem_sz);
 
+    if (cilo_verify(fp) < 0) {
+        printf("Refusing to boot an unverified kernel.\n");
+        return;
+    }
+
+    boot_cache_save(fp, cmd_line);
+
     printf("Kicking into Linux.\n");
 
 #ifdef DEBUG
-    printf("hdr.entry = 0x%08x\n", hdr.entry);
+    printf("hdr.entry = 0x%08x\n", entry);
     printf("mem_sz = 0x%08x\n", mem_sz);
 #endif
 
-    ((void (*)(uint32_t mem_sz, char *cmd_line))(hdr.entry))
+    ((void (*)(uint32_t mem_sz, char *cmd_line))(entry))
         (c_memsz(), cmd_line);
 }
 
@@ -173,75 +300,81 @@ void load_elf64_section(struct file *fp, uint64_t address,
  */
 void load_elf64_uninitialized_memory(uint64_t address, uint64_t length)
 {
-    int i = 0;
-    uint8_t *p = (uint8_t *)address;
-
 #ifdef DEBUG
     printf("Uninit data: %016x, len %016x\n", address, length); 
 #endif
 
-    for (i = 0; i < length; i++) {
-        p[i] = 0;
-    }
+    memzero((void *)address, (uint32_t)length);
 }
 
 void load_elf64_file(struct file *fp, char *cmd_line)
 {
-    struct elf64_hdr hdr;
+    struct elf64_hdr *hdr;
     uint32_t mem_sz = 0;
 
-    cilo_seek(fp, 0, SEEK_SET);
+    /* parse the header in place */
+    hdr = cilo_map(fp, 0, sizeof(struct elf64_hdr));
 
-    /* read in header entries */
-    cilo_read(&hdr, sizeof(struct elf64_hdr), 1, fp);
+    if (hdr == NULL) {
+        printf("File too short to contain an ELF header. Aborting load.\n");
+        return;
+    }
 
     /* check the file magic */
-    if (hdr.e_ident[0] != ELF_MAGIC_1 || hdr.e_ident[1] != ELF_MAGIC_2 ||
-        hdr.e_ident[2] != ELF_MAGIC_3 || hdr.e_ident[3] != ELF_MAGIC_4)
+    if (hdr->e_ident[0] != ELF_MAGIC_1 || hdr->e_ident[1] != ELF_MAGIC_2 ||
+        hdr->e_ident[2] != ELF_MAGIC_3 || hdr->e_ident[3] != ELF_MAGIC_4)
     {
         printf("Bad ELF magic found. Found: %#2x %#2x %#2x %#2x.\n",
-            hdr.e_ident[0], hdr.e_ident[1], hdr.e_ident[2], hdr.e_ident[3]);
+            hdr->e_ident[0], hdr->e_ident[1], hdr->e_ident[2],
+            hdr->e_ident[3]);
         return;
     }
     /* check machine class: */
-    if (!hdr.e_ident[ELF_INDEX_CLASS] == ELF_CLASS_64)
+    if (!hdr->e_ident[ELF_INDEX_CLASS] == ELF_CLASS_64)
     {
         printf("Invalid ELF machine class found. Found: %2x.\n",
-            hdr.e_ident[ELF_INDEX_CLASS]);
+            hdr->e_ident[ELF_INDEX_CLASS]);
         return;
     }
 
     /* check endianess: */
-    if (hdr.e_ident[ELF_INDEX_DATA] != ELF_DATA_MSB) {
+    if (hdr->e_ident[ELF_INDEX_DATA] != ELF_DATA_MSB) {
         printf("Non-big endian ELF file detected. Aborting load.\n");
         return;
     }
 
-    if (hdr.e_ehsize != 52 /* bytes */) {
+    if (hdr->e_ehsize != 52 /* bytes */) {
         printf("Warning: ELF header greater than 52 bytes found. Found: %u\n",
-            hdr.e_ehsize);
+            hdr->e_ehsize);
     }
 
-    if (hdr.e_phnum == 0) {
+    if (hdr->e_phnum == 0) {
         printf("Found zero segments in ELF file. Aborting load.\n");
         return;
     }
 
-    cilo_seek(fp, hdr.e_phoff, SEEK_SET);
-
-    struct elf64_phdr phdr;
+    int phnum = hdr->e_phnum;
+    struct elf64_phdr *phdr;
     int i;
-    for (i = 0; i < hdr.e_phnum; i++) {
-        cilo_read(&phdr, sizeof(struct elf64_phdr), 1, fp);
 
-        if (phdr.p_type != ELF_PT_LOAD) continue;
-        load_elf64_section(fp, phdr.p_paddr, phdr.p_offset, phdr.p_filesz);
-        mem_sz += phdr.p_memsz;
+    phdr = cilo_map(fp, (uint32_t)hdr->e_phoff,
+        sizeof(struct elf64_phdr) * phnum);
+
+    if (phdr == NULL) {
+        printf("Unable to read ELF program headers. Aborting load.\n");
+        return;
+    }
+
+    for (i = 0; i < phnum; i++, phdr++) {
+        if (phdr->p_type != ELF_PT_LOAD) continue;
+        load_elf64_section(fp, phdr->p_paddr, phdr->p_offset,
+            phdr->p_filesz);
+        mem_sz += phdr->p_memsz;
 
-        if (phdr.p_memsz - phdr.p_filesz > 0)
+        if (phdr->p_memsz - phdr->p_filesz > 0)
         {
-            load_elf64_uninitialized_memory(phdr.p_paddr + phdr.p_filesz, 
-                phdr.p_memsz - phdr.p_filesz);
+            load_elf64_uninitialized_memory(phdr->p_paddr + phdr->p_filesz, 
+                phdr->p_memsz - phdr->p_filesz);
         }
     }
 
@@ -0,0 +1,606 @@
+/* Read-only FAT16/FAT32 filesystem
+ * Licensed under the GNU General Public License v2
+ *
+ * Opening a file walks its cluster chain once and records it as a list of
+ * extents, runs of clusters that are contiguous on the device. Reads then
+ * go straight to the block device, one transfer per extent, without
+ * touching the FAT again.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <storage/block.h>
+#include <filesys/fat.h>
+
+/* on-disk values are little endian */
+#define fat_le16(p) ((p)[0] | ((p)[1] << 8))
+#define fat_le32(p) (fat_le16(p) | (fat_le16((p) + 2) << 16))
+
+/* boot sector / BPB fields */
+#define BPB_BYTES_PER_SEC   11
+#define BPB_SEC_PER_CLUS    13
+#define BPB_RSVD_SEC_CNT    14
+#define BPB_NUM_FATS        16
+#define BPB_ROOT_ENT_CNT    17
+#define BPB_TOT_SEC16       19
+#define BPB_FAT_SZ16        22
+#define BPB_TOT_SEC32       32
+#define BPB_FAT_SZ32        36
+#define BPB_ROOT_CLUS       44
+
+/* MBR partition table */
+#define MBR_PART_TABLE      446
+#define MBR_PART_TYPE       4
+#define MBR_PART_LBA        8
+
+/* directory entries */
+#define DIR_ENT_SIZE        32
+#define DIR_ATTR            11
+#define DIR_CLUS_HI         20
+#define DIR_CLUS_LO         26
+#define DIR_SIZE            28
+
+#define ATTR_VOLUME_ID      0x08
+#define ATTR_DIRECTORY      0x10
+#define ATTR_LFN            0x0F
+
+#define FAT16_EOC           0xFFF8
+#define FAT32_EOC           0x0FFFFFF8
+#define FAT32_MASK          0x0FFFFFFF
+
+static struct fat_fs fat_volumes[FAT_VOLUMES];
+static struct fat_file fat_files[FAT_FILES];
+
+/* position in a directory, see fat_dir_next() */
+struct fat_dir {
+    struct fat_fs *fs;
+    uint32_t clus; /* current cluster, 0 for the FAT16 root directory */
+    uint32_t lba; /* next sector to read */
+    uint32_t left; /* sectors left in the cluster or root directory */
+    uint32_t idx; /* next entry in buf */
+
+    /* long file name being assembled */
+    char lfn[FAT_NAME_LEN + 1];
+    uint8_t lfn_valid; /* entries seen so far are consistent */
+    uint8_t lfn_seq; /* sequence number of the next expected LFN entry */
+    uint8_t lfn_sum; /* checksum of the short name it belongs to */
+
+    uint8_t buf[BLOCK_SIZE];
+};
+
+/**
+ * Check whether a sector holds a FAT boot sector
+ * @param b the sector
+ * @returns non-zero if it does
+ */
+static int fat_is_boot_sector(const uint8_t *b)
+{
+    return (b[0] == 0xEB || b[0] == 0xE9) &&
+        fat_le16(b + BPB_BYTES_PER_SEC) == BLOCK_SIZE &&
+        b[BPB_SEC_PER_CLUS] != 0 && b[BPB_NUM_FATS] != 0 &&
+        b[510] == 0x55 && b[511] == 0xAA;
+}
+
+/**
+ * Get the FAT entry for a cluster
+ * @param fs the volume
+ * @param clus the cluster
+ * @returns the next cluster in the chain, 0 at the end of the chain or -1
+ *          on an error
+ */
+static int32_t fat_next(struct fat_fs *fs, uint32_t clus)
+{
+    uint32_t off = clus * (fs->type / 8);
+    uint32_t lba = fs->fat_lba + off / BLOCK_SIZE;
+    uint8_t *p;
+    uint32_t next;
+
+    if (lba != fs->fat_cache_lba) {
+        if (fs->bdev->read(fs->bdev, lba, 1, fs->fat_cache) < 0) {
+            return -1;
+        }
+        fs->fat_cache_lba = lba;
+    }
+
+    p = (uint8_t *)fs->fat_cache + off % BLOCK_SIZE;
+
+    if (fs->type == 16) {
+        next = fat_le16(p);
+        if (next >= FAT16_EOC) return 0;
+    } else {
+        next = fat_le32(p) & FAT32_MASK;
+        if (next >= FAT32_EOC) return 0;
+    }
+
+    if (next < 2 || next >= fs->clusters + 2) {
+        printf("FAT: bad cluster %d in chain\n", next);
+        return -1;
+    }
+
+    return next;
+}
+
+/**
+ * First sector of a cluster
+ */
+static uint32_t fat_clus_lba(struct fat_fs *fs, uint32_t clus)
+{
+    return fs->data_lba + (clus - 2) * fs->sec_per_clus;
+}
+
+/**
+ * Mount the FAT16 or FAT32 volume on a block device. The device may hold
+ * the volume directly or in its first FAT partition.
+ * @param bdev the device
+ * @returns the volume, or NULL if there isn't one
+ */
+struct fat_fs *fat_mount(struct block_dev *bdev)
+{
+    struct fat_fs *fs = NULL;
+    uint32_t buf[BLOCK_SIZE / sizeof(uint32_t)];
+    uint8_t *b = (uint8_t *)buf;
+    uint32_t part = 0, i, type;
+    uint32_t rsvd, fat_sz, total, root_ents, data_sec;
+
+    if (bdev->read(bdev, 0, 1, buf) < 0) {
+        return NULL;
+    }
+
+    /* not a volume; look for a FAT partition in the MBR */
+    if (!fat_is_boot_sector(b)) {
+        if (b[510] != 0x55 || b[511] != 0xAA) return NULL;
+
+        for (i = 0; i < 4; i++) {
+            uint8_t *e = b + MBR_PART_TABLE + i * 16;
+            type = e[MBR_PART_TYPE];
+
+            if (type == 0x04 || type == 0x06 || type == 0x0E ||
+                type == 0x0B || type == 0x0C)
+            {
+                part = fat_le32(e + MBR_PART_LBA);
+                break;
+            }
+        }
+
+        if (i == 4 || bdev->read(bdev, part, 1, buf) < 0 ||
+            !fat_is_boot_sector(b))
+        {
+            return NULL;
+        }
+    }
+
+    for (i = 0; i < FAT_VOLUMES; i++) {
+        if (!fat_volumes[i].in_use) {
+            fs = &fat_volumes[i];
+            break;
+        }
+    }
+
+    if (fs == NULL) {
+        return NULL;
+    }
+
+    rsvd = fat_le16(b + BPB_RSVD_SEC_CNT);
+    root_ents = fat_le16(b + BPB_ROOT_ENT_CNT);
+    fat_sz = fat_le16(b + BPB_FAT_SZ16);
+    if (fat_sz == 0) fat_sz = fat_le32(b + BPB_FAT_SZ32);
+    total = fat_le16(b + BPB_TOT_SEC16);
+    if (total == 0) total = fat_le32(b + BPB_TOT_SEC32);
+
+    fs->bdev = bdev;
+    fs->sec_per_clus = b[BPB_SEC_PER_CLUS];
+    fs->fat_lba = part + rsvd;
+    fs->root_lba = fs->fat_lba + b[BPB_NUM_FATS] * fat_sz;
+    fs->root_sectors = (root_ents * DIR_ENT_SIZE + BLOCK_SIZE - 1) /
+        BLOCK_SIZE;
+    fs->data_lba = fs->root_lba + fs->root_sectors;
+
+    if (fs->data_lba - part >= total) {
+        return NULL;
+    }
+
+    data_sec = total - (fs->data_lba - part);
+    fs->clusters = data_sec / fs->sec_per_clus;
+
+    /* the FAT type is decided by the cluster count alone */
+    if (fs->clusters < 4085) {
+        printf("FAT: FAT12 volumes aren't supported\n");
+        return NULL;
+    } else if (fs->clusters < 65525) {
+        fs->type = 16;
+        fs->root_clus = 0;
+    } else {
+        fs->type = 32;
+        fs->root_clus = fat_le32(b + BPB_ROOT_CLUS);
+    }
+
+    fs->fat_cache_lba = 0xFFFFFFFF;
+    fs->in_use = 1;
+
+    return fs;
+}
+
+/**
+ * Start reading a directory
+ * @param d directory position to set up
+ * @param fs the volume
+ * @param clus first cluster of the directory, 0 for the root directory
+ */
+static void fat_dir_open(struct fat_dir *d, struct fat_fs *fs, uint32_t clus)
+{
+    d->fs = fs;
+
+    if (clus == 0 && fs->type == 32) {
+        clus = fs->root_clus;
+    }
+
+    d->clus = clus;
+
+    if (clus == 0) {
+        d->lba = fs->root_lba;
+        d->left = fs->root_sectors;
+    } else {
+        d->lba = fat_clus_lba(fs, clus);
+        d->left = fs->sec_per_clus;
+    }
+
+    d->idx = BLOCK_SIZE / DIR_ENT_SIZE;
+    d->lfn_valid = 0;
+}
+
+/**
+ * Checksum of a short name, as recorded in its long name entries
+ */
+static uint8_t fat_lfn_sum(const uint8_t *name)
+{
+    uint8_t sum = 0;
+    int i;
+
+    for (i = 0; i < 11; i++) {
+        sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+    }
+
+    return sum;
+}
+
+/**
+ * Add a long file name entry to the name being assembled
+ * @param d directory position
+ * @param e the entry
+ */
+static void fat_lfn_add(struct fat_dir *d, const uint8_t *e)
+{
+    /* offsets of the 13 UTF-16 characters in an LFN entry */
+    static const uint8_t lfn_chars[13] = {
+        1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30
+    };
+    uint32_t seq = e[0] & 0x1f, pos, i;
+    uint16_t c;
+
+    /* the entries come last part first, the first flagged with 0x40 */
+    if (e[0] & 0x40) {
+        d->lfn_valid = 1;
+        d->lfn_sum = e[13];
+    } else if (!d->lfn_valid || seq != d->lfn_seq || e[13] != d->lfn_sum) {
+        d->lfn_valid = 0;
+        return;
+    }
+
+    if (seq == 0 || seq * 13 > FAT_NAME_LEN) {
+        d->lfn_valid = 0;
+        return;
+    }
+
+    pos = (seq - 1) * 13;
+
+    for (i = 0; i < 13; i++) {
+        c = fat_le16(e + lfn_chars[i]);
+
+        if (c == 0x0000 || c == 0xFFFF) break;
+
+        d->lfn[pos + i] = c < 0x80 ? c : '?';
+    }
+
+    if (e[0] & 0x40) d->lfn[pos + i] = '\0';
+
+    d->lfn_seq = seq - 1;
+}
+
+/**
+ * Read the next file in a directory
+ * @param d directory position
+ * @param name receives the long name, or the short name as NAME.EXT
+ * @param ent receives a pointer to the directory entry, valid until the
+ *        next call
+ * @returns 1 if a file was read, 0 at the end of the directory, -1 on an
+ *          error
+ */
+static int fat_dir_next(struct fat_dir *d, char *name, uint8_t **ent)
+{
+    uint8_t *e;
+    int32_t next;
+    int i, n;
+
+    for (;;) {
+        if (d->idx == BLOCK_SIZE / DIR_ENT_SIZE) {
+            if (d->left == 0) {
+                if (d->clus == 0) return 0;
+
+                if ((next = fat_next(d->fs, d->clus)) <= 0) return next;
+
+                d->clus = next;
+                d->lba = fat_clus_lba(d->fs, d->clus);
+                d->left = d->fs->sec_per_clus;
+            }
+
+            if (d->fs->bdev->read(d->fs->bdev, d->lba, 1, d->buf) < 0) {
+                return -1;
+            }
+
+            d->lba++;
+            d->left--;
+            d->idx = 0;
+        }
+
+        e = d->buf + d->idx++ * DIR_ENT_SIZE;
+
+        if (e[0] == 0x00) return 0; /* end of directory */
+
+        if (e[0] == 0xE5) { /* deleted */
+            d->lfn_valid = 0;
+            continue;
+        }
+
+        if (e[DIR_ATTR] == ATTR_LFN) {
+            fat_lfn_add(d, e);
+            continue;
+        }
+
+        if (e[DIR_ATTR] & ATTR_VOLUME_ID) {
+            d->lfn_valid = 0;
+            continue;
+        }
+
+        /* a complete long name belonging to this entry */
+        if (d->lfn_valid && d->lfn_seq == 0 && d->lfn_sum == fat_lfn_sum(e))
+        {
+            strcpy(name, d->lfn);
+        } else {
+            n = 0;
+            for (i = 0; i < 8 && e[i] != ' '; i++) name[n++] = e[i];
+            if (e[8] != ' ') {
+                name[n++] = '.';
+                for (i = 8; i < 11 && e[i] != ' '; i++) name[n++] = e[i];
+            }
+            name[n] = '\0';
+
+            /* 0x05 stands for a leading 0xE5 */
+            if ((uint8_t)name[0] == 0x05) name[0] = 0xE5;
+        }
+
+        d->lfn_valid = 0;
+        *ent = e;
+
+        return 1;
+    }
+}
+
+/**
+ * Compare a file name with a path component, ignoring case
+ * @param name file name
+ * @param s path component, not NUL terminated
+ * @param len length of the path component
+ * @returns 0 if they match
+ */
+static int fat_namecmp(const char *name, const char *s, uint32_t len)
+{
+    uint32_t i;
+    char a, b;
+
+    for (i = 0; i < len; i++) {
+        a = name[i];
+        b = s[i];
+
+        if (a >= 'a' && a <= 'z') a -= 'a' - 'A';
+        if (b >= 'a' && b <= 'z') b -= 'a' - 'A';
+
+        if (a != b) return -1;
+    }
+
+    return name[len] == '\0' ? 0 : -1;
+}
+
+/**
+ * First cluster of the file a directory entry describes
+ */
+static uint32_t fat_ent_clus(struct fat_fs *fs, const uint8_t *e)
+{
+    uint32_t clus = fat_le16(e + DIR_CLUS_LO);
+
+    if (fs->type == 32) clus |= fat_le16(e + DIR_CLUS_HI) << 16;
+
+    return clus;
+}
+
+/**
+ * Open a file: find it, and record its cluster chain as extents.
+ * @param fs the volume
+ * @param path path of the file, with components separated by '/'
+ * @param fp file structure to fill in
+ * @returns the open file, or NULL if it wasn't found or can't be opened
+ */
+struct fat_file *fat_open(struct fat_fs *fs, const char *path,
+    struct file *fp)
+{
+    struct fat_dir d;
+    struct fat_file *ff = NULL;
+    struct fat_extent *x;
+    char name[FAT_NAME_LEN + 1];
+    uint8_t *e = NULL;
+    const char *end;
+    uint32_t dir = 0, clus, size, i, clus_bytes;
+    int32_t r;
+
+    /* walk the path one directory at a time */
+    for (;;) {
+        while (*path == '/') path++;
+
+        if ((end = strchr(path, '/')) == NULL) {
+            end = path + strlen(path);
+        }
+
+        if (end == path) return NULL;
+
+        fat_dir_open(&d, fs, dir);
+
+        while ((r = fat_dir_next(&d, name, &e)) > 0) {
+            if (!fat_namecmp(name, path, end - path)) break;
+        }
+
+        if (r <= 0) return NULL;
+
+        if (*end == '\0') break;
+
+        if (!(e[DIR_ATTR] & ATTR_DIRECTORY)) return NULL;
+
+        dir = fat_ent_clus(fs, e);
+        path = end;
+    }
+
+    if (e[DIR_ATTR] & ATTR_DIRECTORY) {
+        return NULL;
+    }
+
+    for (i = 0; i < FAT_FILES; i++) {
+        if (!fat_files[i].in_use) {
+            ff = &fat_files[i];
+            break;
+        }
+    }
+
+    if (ff == NULL) {
+        return NULL;
+    }
+
+    clus = fat_ent_clus(fs, e);
+    size = fat_le32(e + DIR_SIZE);
+    clus_bytes = fs->sec_per_clus * BLOCK_SIZE;
+
+    ff->fs = fs;
+    ff->count = 0;
+    ff->cur = 0;
+    ff->cur_off = 0;
+
+    /* walk the chain once, merging clusters that follow each other */
+    for (i = 0; i < size && clus != 0; i += clus_bytes) {
+        if (clus < 2 || clus >= fs->clusters + 2) {
+            printf("FAT: bad cluster %d in chain\n", clus);
+            return NULL;
+        }
+
+        x = ff->count ? &ff->ext[ff->count - 1] : NULL;
+
+        if (x && x->lba + x->len / BLOCK_SIZE == fat_clus_lba(fs, clus)) {
+            x->len += clus_bytes;
+        } else if (ff->count == FAT_MAX_EXTENTS) {
+            printf("FAT: %s is too fragmented\n", name);
+            return NULL;
+        } else {
+            x = &ff->ext[ff->count++];
+            x->lba = fat_clus_lba(fs, clus);
+            x->len = clus_bytes;
+        }
+
+        if ((r = fat_next(fs, clus)) < 0) return NULL;
+        clus = r;
+    }
+
+    if (i < size) {
+        printf("FAT: %s is shorter than its directory entry says\n", name);
+        return NULL;
+    }
+
+    ff->in_use = 1;
+
+    fp->private = ff;
+    fp->file_len = size;
+    fp->file_pos = 0;
+    strncpy(fp->filename, name, sizeof(fp->filename) - 1);
+    fp->filename[sizeof(fp->filename) - 1] = '\0';
+
+    return ff;
+}
+
+/**
+ * Read from an open file. Each extent the range covers is read with one
+ * request to the block device.
+ * @param ff the file
+ * @param pos file offset to read from
+ * @param buf destination
+ * @param len number of bytes, within the file
+ * @returns 0 on success, < 0 on a device error
+ */
+int fat_read(struct fat_file *ff, uint32_t pos, void *buf, uint32_t len)
+{
+    struct fat_extent *x;
+    uint8_t *out = buf;
+    uint32_t off, n;
+
+    /* reads are mostly sequential, so search on from the last extent */
+    if (pos < ff->cur_off) {
+        ff->cur = 0;
+        ff->cur_off = 0;
+    }
+
+    while (len) {
+        x = &ff->ext[ff->cur];
+        off = pos - ff->cur_off;
+
+        if (off >= x->len) {
+            ff->cur_off += x->len;
+            ff->cur++;
+            continue;
+        }
+
+        n = x->len - off;
+        if (n > len) n = len;
+
+        if (block_read_bytes(ff->fs->bdev, x->lba, off, out, n) < 0) {
+            return -1;
+        }
+
+        out += n;
+        pos += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * Close a file
+ */
+void fat_close(struct fat_file *ff)
+{
+    ff->in_use = 0;
+}
+
+/**
+ * Print the files in the root directory of a volume
+ * @param fs the volume
+ */
+void fat_list(struct fat_fs *fs)
+{
+    struct fat_dir d;
+    char name[FAT_NAME_LEN + 1];
+    uint8_t *e;
+
+    fat_dir_open(&d, fs, 0);
+
+    while (fat_dir_next(&d, name, &e) > 0) {
+        if (name[0] == '.') continue;
+
+        printf("%s%s\n", name, (e[DIR_ATTR] & ATTR_DIRECTORY) ? "/" : "");
+    }
+}
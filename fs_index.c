@@ -0,0 +1,117 @@
+/* In-RAM index of a flash filesystem
+ * Licensed under the GNU General Public License v2
+ *
+ * Walking the fs_ent chain means touching a header on flash for every file
+ * on the device. The platform code walks it once, while checking the flash,
+ * and records every header here; listing, lookup and open are then answered
+ * from RAM.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <fs_index.h>
+
+/**
+ * Hash a file name
+ * @param s the file name
+ * @returns bucket number
+ */
+static uint32_t fs_index_hash(const char *s)
+{
+    uint32_t h = 5381;
+    int i;
+
+    for (i = 0; i < FS_INDEX_NAME_LEN && s[i] != '\0'; i++) {
+        h = (h << 5) + h + (uint8_t)s[i];
+    }
+
+    return h & (FS_INDEX_BUCKETS - 1);
+}
+
+/**
+ * Set up an empty index
+ * @param idx the index
+ * @param base address of the first file header of the filesystem
+ */
+void fs_index_init(struct fs_index *idx, uint32_t base)
+{
+    int i;
+
+    idx->base = base;
+    idx->count = 0;
+
+    for (i = 0; i < FS_INDEX_BUCKETS; i++) {
+        idx->hash[i] = NULL;
+    }
+}
+
+/**
+ * Record a file in the index
+ * @param idx the index
+ * @param filename name of the file, not necessarily NUL terminated
+ * @param name_len size of the name field in the file header
+ * @param offset offset of the file header from idx->base
+ * @param length length of the file data
+ * @param crc32 CRC recorded in the file header
+ * @param date date recorded in the file header
+ * @returns the new entry, or NULL if the index is full
+ */
+struct fs_index_ent *fs_index_add(struct fs_index *idx, const char *filename,
+    uint32_t name_len, uint32_t offset, uint32_t length, uint32_t crc32,
+    uint32_t date)
+{
+    struct fs_index_ent *e;
+    uint32_t h;
+
+    if (idx->count == FS_INDEX_MAX) {
+        printf("Warning: more than %d files on flash; ignoring the rest.\n",
+            FS_INDEX_MAX);
+        return NULL;
+    }
+
+    if (name_len > FS_INDEX_NAME_LEN) name_len = FS_INDEX_NAME_LEN;
+
+    e = &idx->ents[idx->count++];
+
+    strncpy(e->filename, filename, name_len);
+    e->filename[name_len] = '\0';
+    e->offset = offset;
+    e->length = length;
+    e->crc32 = crc32;
+    e->date = date;
+
+    /* add to the tail of the bucket so the first file of a name wins */
+    h = fs_index_hash(e->filename);
+    e->hash_next = NULL;
+
+    if (idx->hash[h] == NULL) {
+        idx->hash[h] = e;
+    } else {
+        struct fs_index_ent *t = idx->hash[h];
+        while (t->hash_next != NULL) t = t->hash_next;
+        t->hash_next = e;
+    }
+
+    return e;
+}
+
+/**
+ * Find a file by name
+ * @param idx the index
+ * @param filename the name to look for
+ * @returns the entry, or NULL if there is no such file
+ */
+struct fs_index_ent *fs_index_lookup(struct fs_index *idx,
+    const char *filename)
+{
+    struct fs_index_ent *e = idx->hash[fs_index_hash(filename)];
+
+    for (; e != NULL; e = e->hash_next) {
+        if (!strncmp(e->filename, filename, FS_INDEX_NAME_LEN)) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
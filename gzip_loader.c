@@ -0,0 +1,286 @@
+/*
+ * gzip Compressed Kernel Loader
+ *
+ * Licensed under the GNU General Public License v.2.
+ * See COPYING in the root directory of this source distribution for more
+ * details.
+ *
+ * Loads vmlinux.gz and other gzip images, one or more members each
+ * checked against its CRC32 and length, as well as zlib streams checked
+ * against their Adler-32.
+ */
+
+#include <printf.h>
+#include <promlib.h>
+#include <string.h>
+#include <crc32.h>
+#include <gzip_loader.h>
+
+#include <ciloio.h>
+#include <bootcache.h>
+#include <pipeline.h>
+#include <inflate.h>
+
+/* platform-specific defines */
+#include <platform.h>
+
+/* input block size when the file has to be read rather than mapped */
+#define GZIP_ASYNC_BLOCK 4096
+
+#define GZIP_ID1 0x1f
+#define GZIP_ID2 0x8b
+#define GZIP_DEFLATE 8
+
+/* gzip member header flags */
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+#define GZIP_FRESERVED 0xe0
+
+/* zlib header: CMF then FLG, together a multiple of 31 */
+#define ZLIB_FDICT 0x20
+#define is_zlib(p) \
+    (((p)[0] & 0x0f) == GZIP_DEFLATE && ((p)[0] >> 4) <= 7 && \
+     !((p)[1] & ZLIB_FDICT) && ((p)[0] << 8 | (p)[1]) % 31 == 0)
+
+#define ADLER_BASE 65521
+#define ADLER_NMAX 5552 /* most bytes before the sums can overflow */
+
+/* a dot for every this many bytes decoded */
+#define GZIP_TICK 0x80000
+
+#define gzip_le32(p) \
+    ((p)[0] | (p)[1] << 8 | (p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+#define gzip_be32(p) \
+    ((uint32_t)(p)[0] << 24 | (p)[1] << 16 | (p)[2] << 8 | (p)[3])
+
+/**
+ * Check if a file is a gzip or zlib image.
+ * @param fp the file
+ * @returns non-zero if it starts with a gzip or zlib header
+ */
+int is_gzip(struct file *fp)
+{
+    uint8_t *p = cilo_map(fp, 0, 2);
+
+    if (p == NULL) {
+        return 0;
+    }
+
+    return (p[0] == GZIP_ID1 && p[1] == GZIP_ID2) || is_zlib(p);
+}
+
+/**
+ * Read bytes from outside the compressed data.
+ * @returns 0 on success, -1 if the file ends first
+ */
+static int gzip_read(struct inflate *z, uint8_t *buf, uint32_t len)
+{
+    int c;
+
+    while (len--) {
+        if ((c = inflate_byte(z)) < 0) {
+            return -1;
+        }
+
+        *buf++ = c;
+    }
+
+    return 0;
+}
+
+/**
+ * Adler-32 of a buffer, as used by zlib.
+ */
+static uint32_t adler32(const uint8_t *buf, uint32_t len)
+{
+    uint32_t a = 1, b = 0, n;
+
+    while (len) {
+        n = len < ADLER_NMAX ? len : ADLER_NMAX;
+        len -= n;
+
+        while (n--) {
+            a += *buf++;
+            b += a;
+        }
+
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+
+    return b << 16 | a;
+}
+
+/**
+ * Decode a gzip member whose two magic bytes have been read.
+ * @returns 0 on success, -1 on error
+ */
+static int gzip_member(struct inflate *z)
+{
+    uint8_t hdr[8], trailer[8];
+    uint8_t *out;
+    uint32_t len;
+    int c;
+
+    /* method, flags, mtime, extra flags, OS */
+    if (gzip_read(z, hdr, sizeof(hdr)) < 0) {
+        printf("Truncated gzip header.\n");
+        return -1;
+    }
+
+    if (hdr[0] != GZIP_DEFLATE || (hdr[1] & GZIP_FRESERVED)) {
+        printf("Unsupported gzip method %d, flags %02x.\n", hdr[0], hdr[1]);
+        return -1;
+    }
+
+    if (hdr[1] & GZIP_FEXTRA) {
+        if (gzip_read(z, trailer, 2) < 0) {
+            return -1;
+        }
+
+        for (len = trailer[0] | trailer[1] << 8; len; len--) {
+            if (inflate_byte(z) < 0) return -1;
+        }
+    }
+
+    /* file name, comment: zero-terminated */
+    if (hdr[1] & GZIP_FNAME) {
+        while ((c = inflate_byte(z)) > 0);
+        if (c < 0) return -1;
+    }
+
+    if (hdr[1] & GZIP_FCOMMENT) {
+        while ((c = inflate_byte(z)) > 0);
+        if (c < 0) return -1;
+    }
+
+    /* header CRC16; gzip itself never writes one, so it isn't checked */
+    if ((hdr[1] & GZIP_FHCRC) && gzip_read(z, trailer, 2) < 0) {
+        return -1;
+    }
+
+    out = z->pos;
+
+    if (inflate_raw(z) < 0) {
+        printf("\nError in decoding gzip data.\n");
+        return -1;
+    }
+
+    len = z->pos - out;
+
+    if (gzip_read(z, trailer, sizeof(trailer)) < 0 ||
+        crc32_update(0, out, len) != gzip_le32(trailer) ||
+        len != gzip_le32(trailer + 4))
+    {
+        printf("\ngzip member failed its CRC32 or length check.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode a zlib stream whose two header bytes have been read.
+ * @returns 0 on success, -1 on error
+ */
+static int zlib_stream(struct inflate *z)
+{
+    uint8_t trailer[4];
+    uint8_t *out = z->pos;
+
+    if (inflate_raw(z) < 0) {
+        printf("\nError in decoding zlib data.\n");
+        return -1;
+    }
+
+    if (gzip_read(z, trailer, sizeof(trailer)) < 0 ||
+        adler32(out, z->pos - out) != gzip_be32(trailer))
+    {
+        printf("\nzlib stream failed its Adler-32 check.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Print a dot for each GZIP_TICK bytes decoded.
+ */
+static void gzip_tick(struct inflate *z)
+{
+    while (z->pos >= z->tick_at) {
+        c_putc('.');
+        z->tick_at += GZIP_TICK;
+    }
+}
+
+/**
+ * Decode a gzip image, one or more members that decode to one file, or a
+ * zlib stream.
+ * @param z decoder, set up on the image and on where the output goes
+ * @returns 0 on success, -1 if the image is corrupt or doesn't fit
+ */
+int gzip_decode(struct inflate *z)
+{
+    uint8_t magic[2];
+
+    if (gzip_read(z, magic, 2) < 0) {
+        printf("Truncated gzip header.\n");
+        return -1;
+    }
+
+    if (is_zlib(magic)) {
+        return zlib_stream(z);
+    }
+
+    do {
+        if (magic[0] != GZIP_ID1 || magic[1] != GZIP_ID2) {
+            printf("\nTrailing garbage after gzip data.\n");
+            return -1;
+        }
+
+        if (gzip_member(z) < 0) {
+            return -1;
+        }
+    } while (gzip_read(z, magic, 2) == 0);
+
+    return 0;
+}
+
+void load_gzip(struct file *fp, uint32_t load_address, char *cmd_line)
+{
+    struct pipe_file src;
+    struct inflate z;
+    uint8_t bufs[2][GZIP_ASYNC_BLOCK];
+
+    pipe_file_init(&src, fp, 0, fp->file_len, bufs[0], GZIP_ASYNC_BLOCK);
+
+    /* decode straight to the load address, in whatever RAM is left */
+    inflate_init(&z, &src.st, (uint8_t *)load_address,
+        LOAD_LIMIT - load_address);
+
+#ifndef NO_LOAD_PROGRESS
+    z.tick = gzip_tick;
+    z.tick_at = (uint8_t *)load_address + GZIP_TICK;
+#endif
+
+    if (gzip_decode(&z) < 0) {
+        printf("Aborting.\n");
+        return;
+    }
+
+    if (cilo_verify(fp) < 0) {
+        printf("Refusing to boot an unverified kernel.\n");
+        return;
+    }
+
+    boot_cache_save(fp, cmd_line);
+
+    printf("\nDecompressed %d bytes.\n", z.pos - (uint8_t *)load_address);
+    printf("Starting kernel at 0x%016x.\n\n", load_address);
+    ((void (*)(uint32_t mem_sz, char *cmd_line))(load_address))
+        (c_memsz(), cmd_line);
+}
@@ -24,7 +24,9 @@
 
 #include "LzmaTypes.h"
 
+#ifndef LZMA_NO_IN_CB
 #define _LZMA_IN_CB 1
+#endif
 /* Use callback for input data */
 
 /* #define _LZMA_OUT_READ */
@@ -110,4 +112,18 @@ int LzmaDecode(CLzmaDecoderState *vs,
     #endif
     unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed);
 
+/* CILO: the decoder built a second time without the input callback (see
+ * LzmaDecodeMem.c), for compressed data that can be addressed directly.
+ * Takes the same state; the callback build's extra fields come last.
+ */
+int LzmaDecodeMem(CLzmaDecoderState *vs,
+    const unsigned char *inStream, SizeT inSize, SizeT *inSizeProcessed,
+    unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed);
+
+/* CILO: progress ticker, called when the decoder refills its input once
+ * the output position has reached lzma_tick_at (see lzma_loader.c)
+ */
+extern UInt32 lzma_tick_at;
+void lzma_tick(UInt32 pos);
+
 #endif
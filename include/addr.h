@@ -13,6 +13,9 @@
 #define PHYS_TO_KSEG032(a) ((a) + 0x80000000ul)
 #define PHYS_TO_KSEG132(a) ((a) + 0xE0000000ul)
 
+/* the uncached alias of a KSEG0 address */
+#define KSEG0_TO_KSEG132(a) ((a) | 0x20000000ul)
+
 /* 64-bit addresses */
 
 #define KSEG0_TO_PHYS64(a) ((a) & 0xFFFFFFFF7FFFFFFFull)
@@ -0,0 +1,32 @@
+/*
+ * Cache operations for the cache instruction on R4000-class processors.
+ * Derived from the Linux kernel's include/asm-mips/cacheops.h.
+ *
+ * (C) Copyright 1996, 97, 99, 2002, 03 Ralf Baechle
+ * (C) Copyright 1999 Silicon Graphics, Inc.
+ */
+#ifndef _ASM_CACHEOPS_H
+#define _ASM_CACHEOPS_H
+
+/* Cache operations available on all MIPS processors with R4000-style caches */
+#define Index_Invalidate_I      0x00
+#define Index_Writeback_Inv_D   0x01
+#define Index_Load_Tag_I        0x04
+#define Index_Load_Tag_D        0x05
+#define Index_Store_Tag_I       0x08
+#define Index_Store_Tag_D       0x09
+#define Create_Dirty_Excl_D     0x0d
+#define Hit_Invalidate_I        0x10
+#define Hit_Invalidate_D        0x11
+#define Hit_Writeback_Inv_D     0x15
+#define Hit_Writeback_D         0x19
+
+/* Secondary and tertiary caches */
+#define Index_Writeback_Inv_SD  0x03
+#define Page_Invalidate_T       0x16
+#define Hit_Writeback_Inv_SD    0x17
+
+/* R5000 and RM5200 secondary cache, which is invalidated a page at a time */
+#define R5K_Page_Invalidate_S   0x17
+
+#endif /* _ASM_CACHEOPS_H */
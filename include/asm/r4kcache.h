@@ -0,0 +1,210 @@
+/*
+ * Cache helpers for the R4000-class processors found in the c3600 and
+ * c7200 (R4700, R5000, RM5200 and RM7000). The dcache_ helpers only touch
+ * the primary data cache; the cache_ ones go on to the secondary cache,
+ * which the R4700 doesn't have, the R5000 and RM5200 may have outside the
+ * chip, and the RM7000 has on it. An RM7000's tertiary cache is only
+ * handled by cache_wback_inv_range(), as nothing gives its size.
+ *
+ * Loosely based on the Linux kernel's include/asm-mips/r4kcache.h and
+ * arch/mips/mm/sc-r5k.c and sc-rm7k.c.
+ */
+#ifndef _ASM_R4KCACHE_H
+#define _ASM_R4KCACHE_H
+
+#include <types.h>
+#include <asm/cacheops.h>
+#include <asm/mipsregs.h>
+
+/* Processor implementation numbers (PRId bits 15:8) */
+#define PRID_IMP_MASK       0xff00
+#define PRID_IMP_R4700      0x2100
+#define PRID_IMP_R5000      0x2300
+#define PRID_IMP_RM7000     0x2700
+#define PRID_IMP_NEVADA     0x2800 /* RM5200 series */
+
+#define IS_KSEG0(a) (((uint32_t)(a) & 0xE0000000ul) == 0x80000000ul)
+
+/* secondary cache kinds */
+#define SCACHE_NONE 0
+#define SCACHE_R5K 1 /* write-through, invalidated by page */
+#define SCACHE_RM7K 2 /* write-back, handled by line */
+
+#define SC_PAGE 4096 /* bytes an R5000 or tertiary page op covers */
+#define RM7K_SC_LINE 32
+#define RM7K_SC_SIZE (256 << 10)
+
+#define cache_op(op, addr)                          \
+    __asm__ __volatile__(                           \
+        ".set push\n"                               \
+        ".set noreorder\n"                          \
+        ".set mips3\n"                              \
+        "cache %0, (%1)\n"                          \
+        ".set pop\n"                                \
+        :                                           \
+        : "i" (op), "r" (addr))
+
+/**
+ * Primary data cache line size, in bytes
+ */
+static inline uint32_t dcache_line_size(void)
+{
+    return (read_c0_config() & CONF_DB) ? 32 : 16;
+}
+
+/**
+ * Primary data cache size, in bytes
+ */
+static inline uint32_t dcache_size(void)
+{
+    return 4096 << ((read_c0_config() & CONF_DC) >> 6);
+}
+
+/**
+ * Write back and invalidate the whole primary data cache. Index ops are
+ * issued over a KSEG0 range the size of the cache, which also covers every
+ * way of the set-associative caches on these parts.
+ */
+static inline void dcache_wback_inv_all(void)
+{
+    uint32_t line = dcache_line_size();
+    uint32_t addr = 0x80000000ul;
+    uint32_t end = addr + dcache_size();
+
+    for (; addr < end; addr += line) {
+        cache_op(Index_Writeback_Inv_D, addr);
+    }
+}
+
+/**
+ * Write back and invalidate the primary data cache lines covering a KSEG0
+ * range, e.g. before a device writes to it by DMA.
+ * @param start first byte of the range
+ * @param len length of the range in bytes
+ */
+static inline void dcache_wback_inv_range(uint32_t start, uint32_t len)
+{
+    uint32_t line = dcache_line_size();
+    uint32_t addr = start & ~(line - 1);
+    uint32_t end = start + len;
+
+    for (; addr < end; addr += line) {
+        cache_op(Hit_Writeback_Inv_D, addr);
+    }
+}
+
+/**
+ * Find out which kind of secondary cache is enabled
+ * @returns SCACHE_NONE, SCACHE_R5K or SCACHE_RM7K
+ */
+static inline int scache_type(void)
+{
+    uint32_t prid = read_c0_prid();
+    uint32_t config = read_c0_config();
+
+    if (prid & 0xff0000) return SCACHE_NONE;
+
+    switch (prid & PRID_IMP_MASK) {
+    case PRID_IMP_R5000:
+    case PRID_IMP_NEVADA:
+        return (config & R5K_CONF_SE) ? SCACHE_R5K : SCACHE_NONE;
+    case PRID_IMP_RM7000:
+        return (config & RM7K_CONF_SE) ? SCACHE_RM7K : SCACHE_NONE;
+    }
+
+    return SCACHE_NONE;
+}
+
+/**
+ * R5000 or RM5200 secondary cache size, in bytes
+ */
+static inline uint32_t r5k_scache_size(void)
+{
+    return (512 << 10) << ((read_c0_config() & R5K_CONF_SS) >> 20);
+}
+
+/**
+ * Write back and invalidate the primary data cache and the secondary
+ * cache. Page and index ops are issued over a KSEG0 range the size of the
+ * secondary cache, as for the primary one.
+ */
+static inline void cache_wback_inv_all(void)
+{
+    uint32_t addr = 0x80000000ul;
+
+    dcache_wback_inv_all();
+
+    switch (scache_type()) {
+    case SCACHE_R5K:
+        for (; addr < 0x80000000ul + r5k_scache_size(); addr += SC_PAGE) {
+            cache_op(R5K_Page_Invalidate_S, addr);
+        }
+        break;
+    case SCACHE_RM7K:
+        for (; addr < 0x80000000ul + RM7K_SC_SIZE; addr += RM7K_SC_LINE) {
+            cache_op(Index_Writeback_Inv_SD, addr);
+        }
+        break;
+    }
+}
+
+/**
+ * Write back and invalidate every cache level's lines covering a KSEG0
+ * range, e.g. after a device has written to it by DMA, or after the flash
+ * behind it has been reprogrammed.
+ * @param start first byte of the range
+ * @param len length of the range in bytes
+ */
+static inline void cache_wback_inv_range(uint32_t start, uint32_t len)
+{
+    uint32_t end = start + len;
+    uint32_t addr;
+    int type = scache_type();
+
+    dcache_wback_inv_range(start, len);
+
+    if (type == SCACHE_R5K) {
+        for (addr = start & ~(SC_PAGE - 1); addr < end; addr += SC_PAGE) {
+            cache_op(R5K_Page_Invalidate_S, addr);
+        }
+    } else if (type == SCACHE_RM7K) {
+        for (addr = start & ~(RM7K_SC_LINE - 1); addr < end;
+            addr += RM7K_SC_LINE)
+        {
+            cache_op(Hit_Writeback_Inv_SD, addr);
+        }
+
+        /* the tertiary cache is write-through */
+        if (read_c0_config() & RM7K_CONF_TE) {
+            for (addr = start & ~(SC_PAGE - 1); addr < end;
+                addr += SC_PAGE)
+            {
+                cache_op(Page_Invalidate_T, addr);
+            }
+        }
+    }
+}
+
+/**
+ * Check whether Create_Dirty_Exclusive_D can be used safely. The R4600
+ * is left out on purpose: early revisions corrupt lines with this op.
+ */
+static inline int cpu_has_cdex(void)
+{
+    uint32_t prid = read_c0_prid();
+
+    /* legacy (pre-MIPS32) parts report a company ID of zero */
+    if (prid & 0xff0000) return 0;
+
+    switch (prid & PRID_IMP_MASK) {
+    case PRID_IMP_R4700:
+    case PRID_IMP_R5000:
+    case PRID_IMP_RM7000:
+    case PRID_IMP_NEVADA:
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif /* _ASM_R4KCACHE_H */
@@ -0,0 +1,81 @@
+/*
+ * Wired TLB entries for the R4000-class processors found in the c3600 and
+ * c7200, used to reach devices that lie outside KSEG0/KSEG1.
+ */
+#ifndef _ASM_R4KTLB_H
+#define _ASM_R4KTLB_H
+
+#include <types.h>
+#include <asm/mipsregs.h>
+
+/* EntryLo fields */
+#define ENTRYLO_G           0x01 /* global, ignore the ASID */
+#define ENTRYLO_V           0x02 /* valid */
+#define ENTRYLO_D           0x04 /* writable */
+#define ENTRYLO_C_SHIFT     3
+#define ENTRYLO_PFN(pa)     (((pa) >> 12) << 6)
+
+/* CILO runs in 32-bit mode, so EntryHi/EntryLo are written as 32-bit
+ * registers rather than through the write_c0_entry* helpers, whose 64-bit
+ * variants need interrupt masking support we don't have
+ */
+#define tlb_write_entryhi(val)  __write_32bit_c0_register($10, 0, val)
+#define tlb_write_entrylo0(val) __write_32bit_c0_register($2, 0, val)
+#define tlb_write_entrylo1(val) __write_32bit_c0_register($3, 0, val)
+
+/* the R4000 wants a few cycles between mtc0 and a TLB write */
+#define tlbw_hazard()                               \
+    __asm__ __volatile__(                           \
+        ".set push\n"                               \
+        ".set noreorder\n"                          \
+        "nop\nnop\nnop\nnop\n"                      \
+        ".set pop\n")
+
+/**
+ * Size of one page for a PageMask value
+ * @param pagemask one of PM_*
+ * @returns page size in bytes
+ */
+static inline uint32_t tlb_page_size(uint32_t pagemask)
+{
+    return ((pagemask >> 1) | 0xfff) + 1;
+}
+
+/**
+ * Map a pair of pages of physical address space at vaddr. An entry already
+ * covering vaddr is replaced, so that two entries never match the same
+ * address; otherwise the next wired slot is taken, out of reach of
+ * tlbwr.
+ * @param vaddr virtual address, aligned to twice the page size
+ * @param paddr physical address of the first page
+ * @param pagemask page size, one of PM_*
+ * @param cca cache coherency attribute, one of CONF_CM_*
+ */
+static inline void tlb_wire(uint32_t vaddr, uint32_t paddr, uint32_t pagemask,
+    uint32_t cca)
+{
+    uint32_t lo = ENTRYLO_G | ENTRYLO_V | ENTRYLO_D | (cca << ENTRYLO_C_SHIFT);
+    int32_t index;
+
+    write_c0_pagemask(pagemask);
+    tlb_write_entryhi(vaddr);
+    tlbw_hazard();
+    tlb_probe();
+    tlbw_hazard();
+
+    if ((index = read_c0_index()) < 0) {
+        index = read_c0_wired();
+        write_c0_wired(index + 1);
+        write_c0_index(index);
+    }
+
+    tlb_write_entrylo0(ENTRYLO_PFN(paddr) | lo);
+    tlb_write_entrylo1(ENTRYLO_PFN(paddr + tlb_page_size(pagemask)) | lo);
+    tlbw_hazard();
+    tlb_write_indexed();
+    tlbw_hazard();
+
+    write_c0_pagemask(PM_4K);
+}
+
+#endif /* _ASM_R4KTLB_H */
@@ -0,0 +1,29 @@
+#ifndef _INCLUDE_BOOTCACHE_H
+#define _INCLUDE_BOOTCACHE_H
+
+#include <types.h>
+#include <ciloio.h>
+
+#define BOOT_CACHE_MAGIC 0x43494C4F /* "CILO" */
+
+#define BOOT_CACHE_CMDLINE 256
+
+/* where the last kernel booted was found, kept in NVRAM so the next boot
+ * can go straight to it. The header at offset must still match the name,
+ * length and date for the record to be used.
+ */
+struct boot_record {
+    uint32_t magic;
+    uint32_t crc; /* CRC32 of everything after this field */
+    char device[16];
+    char filename[64];
+    uint32_t offset; /* offset of the file header on the device */
+    uint32_t length;
+    uint32_t date;
+    char cmd_line[BOOT_CACHE_CMDLINE];
+};
+
+int boot_cache_load(struct boot_record *rec);
+void boot_cache_save(struct file *fp, const char *cmd_line);
+
+#endif /* _INCLUDE_BOOTCACHE_H */
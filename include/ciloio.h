@@ -3,6 +3,10 @@
 
 #include <types.h>
 
+struct cilo_ra;
+struct storage_class;
+struct boot_record;
+
 struct file {
     uint8_t dev; /* device ID number */
     uint32_t file_len; /* length of the file */
@@ -10,20 +14,68 @@ struct file {
     char filename[128];
 
     int8_t code; /* error code */
+    uint8_t mapped; /* device can be addressed directly (see cilo_map) */
 
     void *private; /* private data for the platform specific flash handler */
+
+    struct storage_class *sto; /* device the file lives on */
+
+    struct cilo_ra *ra; /* read-ahead cache, for devices that can't be mapped */
+
+    /* CRC32 of the first crc_pos bytes, for devices that check files as
+     * they are read (see cilo_verify) */
+    uint32_t crc;
+    uint32_t crc_pos;
 };
 
+/* an asynchronous read, see cilo_read_async() */
+struct cilo_req {
+    struct file *fp;
+    void *buf; /* destination */
+    uint32_t offset; /* file offset of the first byte */
+    uint32_t len; /* number of bytes */
+    int8_t state; /* one of CILO_REQ_* */
+
+    void *private; /* transfer state for the device driver */
+};
+
+#define CILO_REQ_PENDING 0
+#define CILO_REQ_DONE 1
+#define CILO_REQ_ERROR -1
+
 #define SEEK_SET 9
 #define SEEK_CUR 1
 #define SEEK_END 2
 
 #define cilo_tell(fp) ((fp)->file_pos)
 
+/* largest range cilo_map() can serve from a device that isn't mapped */
+#define CILO_MAP_BOUNCE 2048
+
+/* read-ahead cache geometry for devices that can't be mapped: reads are
+ * issued to the device in blocks of CILO_RA_BLOCK bytes, and a sequential
+ * reader has CILO_RA_DEPTH blocks fetched at a time.
+ */
+#ifndef CILO_RA_BLOCK
+#define CILO_RA_BLOCK 4096 /* must be a power of two */
+#endif
+#ifndef CILO_RA_DEPTH
+#define CILO_RA_DEPTH 8
+#endif
+#define CILO_RA_FILES 2 /* files that can have a read-ahead cache at once */
+
+void *cilo_alloc(uint32_t len);
 struct file cilo_open(const char *filename);
+struct file cilo_locate(const struct boot_record *rec);
 int32_t cilo_read(void *pbuf, uint32_t size, uint32_t nmemb, 
     struct file *fp);
 int32_t cilo_seek(struct file *fp, uint32_t offset, uint8_t whence);
+void *cilo_map(struct file *fp, uint32_t offset, uint32_t len);
+void cilo_close(struct file *fp);
+int32_t cilo_read_async(struct cilo_req *req, void *pbuf, uint32_t len,
+    struct file *fp);
+int cilo_poll(struct cilo_req *req);
+int cilo_verify(struct file *fp);
 struct fs_ent *find_file(const char *filename, uint32_t base);
 
 #endif /* _INCLUDE_CILOIO_H */
@@ -0,0 +1,9 @@
+#ifndef _INCLUDE_CRC32_H
+#define _INCLUDE_CRC32_H
+
+#include <types.h>
+
+uint32_t crc32_update(uint32_t crc, const void *buf, uint32_t len);
+uint32_t crc32_copy(void *dst, const void *src, uint32_t len, uint32_t crc);
+
+#endif /* _INCLUDE_CRC32_H */
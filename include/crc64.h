@@ -0,0 +1,14 @@
+#ifndef _INCLUDE_CRC64_H
+#define _INCLUDE_CRC64_H
+
+#include <types.h>
+
+/* a CRC-64 kept as two 32-bit halves, since the targets are 32-bit */
+struct crc64 {
+    uint32_t lo;
+    uint32_t hi;
+};
+
+void crc64_update(struct crc64 *crc, const void *buf, uint32_t len);
+
+#endif /* _INCLUDE_CRC64_H */
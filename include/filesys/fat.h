@@ -0,0 +1,56 @@
+#ifndef _FILESYS_FAT_H
+#define _FILESYS_FAT_H
+
+#include <types.h>
+#include <ciloio.h>
+#include <storage/block.h>
+
+#define FAT_VOLUMES 2 /* FAT volumes that can be mounted at once */
+#define FAT_FILES 2 /* FAT files that can be open at once */
+#define FAT_MAX_EXTENTS 128 /* runs of contiguous clusters per file */
+#define FAT_NAME_LEN 127 /* longest long file name handled */
+
+/* a mounted FAT16 or FAT32 volume */
+struct fat_fs {
+    struct block_dev *bdev;
+    uint8_t in_use;
+    uint8_t type; /* 16 or 32 */
+
+    uint32_t sec_per_clus;
+    uint32_t fat_lba; /* first sector of the first FAT */
+    uint32_t root_lba; /* first sector of the FAT16 root directory */
+    uint32_t root_sectors; /* size of the FAT16 root directory */
+    uint32_t root_clus; /* first cluster of the FAT32 root directory */
+    uint32_t data_lba; /* first sector of cluster 2 */
+    uint32_t clusters; /* number of data clusters */
+
+    /* the FAT sector last read */
+    uint32_t fat_cache_lba;
+    uint32_t fat_cache[BLOCK_SIZE / sizeof(uint32_t)];
+};
+
+/* a run of contiguous clusters */
+struct fat_extent {
+    uint32_t lba; /* first sector */
+    uint32_t len; /* length in bytes */
+};
+
+/* an open file, described by the extents of its cluster chain */
+struct fat_file {
+    struct fat_fs *fs;
+    uint8_t in_use;
+
+    uint32_t count; /* number of extents */
+    uint32_t cur; /* extent the last read ended in */
+    uint32_t cur_off; /* file offset of extent cur */
+    struct fat_extent ext[FAT_MAX_EXTENTS];
+};
+
+struct fat_fs *fat_mount(struct block_dev *bdev);
+struct fat_file *fat_open(struct fat_fs *fs, const char *path,
+    struct file *fp);
+int fat_read(struct fat_file *ff, uint32_t pos, void *buf, uint32_t len);
+void fat_close(struct fat_file *ff);
+void fat_list(struct fat_fs *fs);
+
+#endif /* _FILESYS_FAT_H */
@@ -0,0 +1,36 @@
+#ifndef _INCLUDE_FS_INDEX_H
+#define _INCLUDE_FS_INDEX_H
+
+#include <types.h>
+
+#define FS_INDEX_MAX 128 /* files indexed per filesystem */
+#define FS_INDEX_BUCKETS 64 /* name hash buckets; must be a power of two */
+#define FS_INDEX_NAME_LEN 64 /* longest file name of any fs_ent format */
+
+/* metadata of one file, copied out of its on-flash header */
+struct fs_index_ent {
+    char filename[FS_INDEX_NAME_LEN + 1];
+    uint32_t offset; /* offset of the file header from the filesystem base */
+    uint32_t length; /* length of the file data in bytes */
+    uint32_t crc32;
+    uint32_t date;
+
+    struct fs_index_ent *hash_next;
+};
+
+/* in-RAM index of a flash filesystem, built by a single walk of it */
+struct fs_index {
+    uint32_t base; /* address of the first file header */
+    uint32_t count;
+    struct fs_index_ent ents[FS_INDEX_MAX];
+    struct fs_index_ent *hash[FS_INDEX_BUCKETS];
+};
+
+void fs_index_init(struct fs_index *idx, uint32_t base);
+struct fs_index_ent *fs_index_add(struct fs_index *idx, const char *filename,
+    uint32_t name_len, uint32_t offset, uint32_t length, uint32_t crc32,
+    uint32_t date);
+struct fs_index_ent *fs_index_lookup(struct fs_index *idx,
+    const char *filename);
+
+#endif /* _INCLUDE_FS_INDEX_H */
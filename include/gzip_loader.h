@@ -0,0 +1,12 @@
+#ifndef _INCLUDE_GZIP_LOADER_H
+#define _INCLUDE_GZIP_LOADER_H
+
+#include <types.h>
+#include <ciloio.h>
+#include <inflate.h>
+
+int is_gzip(struct file *fp);
+int gzip_decode(struct inflate *z);
+void load_gzip(struct file *fp, uint32_t load_address, char *cmd_line);
+
+#endif /* _INCLUDE_GZIP_LOADER_H */
@@ -0,0 +1,58 @@
+#ifndef _INCLUDE_INFLATE_H
+#define _INCLUDE_INFLATE_H
+
+#include <types.h>
+#include <pipeline.h>
+
+/* codes up to this long are decoded with a single table lookup */
+#define INFLATE_FAST_BITS 9
+#define INFLATE_MAX_BITS 15
+#define INFLATE_LIT_CODES 288
+#define INFLATE_DIST_CODES 30
+
+/* a Huffman code: a lookup table for the short codes, and the code in
+ * canonical form for the rest
+ */
+struct inflate_huff {
+    uint16_t fast[1 << INFLATE_FAST_BITS]; /* symbol << 4 | length, or 0 */
+    uint16_t count[INFLATE_MAX_BITS + 1]; /* codes of each length */
+    uint16_t symbol[INFLATE_LIT_CODES]; /* symbols in canonical order */
+};
+
+/* A deflate decoder writing to a flat output buffer: the window is
+ * everything written since the stream started, so matches are copied
+ * within the destination. Input is taken a buffer at a time from a
+ * pipeline stage.
+ */
+struct inflate {
+    /* input */
+    const uint8_t *in;
+    const uint8_t *in_end;
+    struct pipe_stage *src;
+    uint32_t in_total; /* bytes taken from src, up to in_end */
+    uint32_t bits; /* bit buffer, next bit lowest */
+    uint32_t nbits;
+
+    /* output */
+    uint8_t *window; /* start of the current stream */
+    uint8_t *pos; /* where the next byte goes */
+    uint8_t *out_end; /* end of the destination */
+
+    struct inflate_huff lit;
+    struct inflate_huff dist;
+
+    /* optional: called between blocks once the output passes tick_at */
+    void (*tick)(struct inflate *z);
+    uint8_t *tick_at;
+};
+
+/* bytes of input the decoder has consumed */
+#define inflate_consumed(z) \
+    ((z)->in_total - ((z)->in_end - (z)->in) - (z)->nbits / 8)
+
+void inflate_init(struct inflate *z, struct pipe_stage *src, uint8_t *out,
+    uint32_t out_max);
+int inflate_byte(struct inflate *z);
+int inflate_raw(struct inflate *z);
+
+#endif /* _INCLUDE_INFLATE_H */
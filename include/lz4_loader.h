@@ -0,0 +1,13 @@
+#ifndef _INCLUDE_LZ4_LOADER_H
+#define _INCLUDE_LZ4_LOADER_H
+
+#include <types.h>
+#include <ciloio.h>
+#include <pipeline.h>
+
+int is_lz4(struct file *fp);
+int32_t lz4_decode(struct pipe_stage *src, uint32_t len, uint8_t *dst,
+    uint8_t *end);
+void load_lz4(struct file *fp, uint32_t load_address, char *cmd_line);
+
+#endif /* _INCLUDE_LZ4_LOADER_H */
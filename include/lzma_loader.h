@@ -6,4 +6,7 @@
 
 void load_lzma(struct file *fp, uint32_t load_address, char *cmd_line);
 
+int is_zstd(struct file *fp);
+void load_zstd(struct file *fp, uint32_t load_address, char *cmd_line);
+
 #endif /* _INCLUDE_LZMA_LOADER_H */
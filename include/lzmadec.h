@@ -0,0 +1,85 @@
+#ifndef _INCLUDE_LZMADEC_H
+#define _INCLUDE_LZMADEC_H
+
+#include <types.h>
+#include <pipeline.h>
+
+#define LZMA_STATES 12
+#define LZMA_POS_STATES_MAX 16 /* pb <= 4 */
+#define LZMA_LITERAL_CODERS_MAX 16 /* lc + lp <= 4, as LZMA2 requires */
+#define LZMA_DIST_STATES 4
+#define LZMA_DIST_SLOTS 64
+#define LZMA_DIST_MODEL_END 14
+#define LZMA_FULL_DISTANCES 128
+#define LZMA_ALIGN_BITS 4
+
+struct lzma_len_probs {
+    uint16_t choice;
+    uint16_t choice2;
+    uint16_t low[LZMA_POS_STATES_MAX][8];
+    uint16_t mid[LZMA_POS_STATES_MAX][8];
+    uint16_t high[256];
+};
+
+/* adaptive probabilities, about 28 KB */
+struct lzma_probs {
+    uint16_t is_match[LZMA_STATES][LZMA_POS_STATES_MAX];
+    uint16_t is_rep[LZMA_STATES];
+    uint16_t is_rep0[LZMA_STATES];
+    uint16_t is_rep1[LZMA_STATES];
+    uint16_t is_rep2[LZMA_STATES];
+    uint16_t is_rep0_long[LZMA_STATES][LZMA_POS_STATES_MAX];
+    uint16_t dist_slot[LZMA_DIST_STATES][LZMA_DIST_SLOTS];
+    uint16_t dist_special[LZMA_FULL_DISTANCES - LZMA_DIST_MODEL_END];
+    uint16_t dist_align[1 << LZMA_ALIGN_BITS];
+    struct lzma_len_probs match_len;
+    struct lzma_len_probs rep_len;
+    uint16_t literal[LZMA_LITERAL_CODERS_MAX][0x300];
+};
+
+/* An LZMA/LZMA2 decoder writing to a flat output buffer: the dictionary is
+ * everything written since the last dictionary reset, so there is no
+ * circular buffer and no copy out of one. Input is taken a buffer at a
+ * time from a pipeline stage.
+ */
+struct lzma_dec {
+    /* input */
+    const uint8_t *in;
+    const uint8_t *in_end;
+    struct pipe_stage *src;
+    uint32_t in_total; /* bytes taken from src, up to in_end */
+
+    /* output */
+    uint8_t *dict; /* start of the dictionary */
+    uint32_t pos; /* bytes in the dictionary */
+    uint8_t *out_end; /* end of the destination */
+
+    /* range coder */
+    uint32_t range;
+    uint32_t code;
+
+    /* LZMA state */
+    uint32_t lc;
+    uint32_t lp_mask;
+    uint32_t pb_mask;
+    uint32_t state;
+    uint32_t rep0, rep1, rep2, rep3;
+    struct lzma_probs *probs;
+
+    /* optional: called between LZMA2 chunks once the output passes tick_at */
+    void (*tick)(struct lzma_dec *d);
+    uint8_t *tick_at;
+};
+
+/* bytes of input the decoder has consumed */
+#define lzma_dec_consumed(d) ((d)->in_total - ((d)->in_end - (d)->in))
+
+/* where the next byte of output goes */
+#define lzma_dec_out(d) ((d)->dict + (d)->pos)
+
+void lzma_dec_init(struct lzma_dec *d, struct lzma_probs *probs,
+    struct pipe_stage *src, uint8_t *out, uint32_t out_max);
+int lzma_dec_byte(struct lzma_dec *d);
+int lzma2_decode(struct lzma_dec *d);
+
+#endif /* _INCLUDE_LZMADEC_H */
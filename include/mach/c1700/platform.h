@@ -6,9 +6,21 @@
 #define FLASH_BASE 0x60000000
 #define MEMORY_BASE 0x80000000
 
+/* RAM kept clear at the top for the stack ROMMON started us on */
+#define STACK_RESERVE 0x20000
+
+/* RAM under the stack for CILO's own large buffers, see cilo_alloc() */
+#define HEAP_RESERVE 0x20000
+
+/* end of the RAM that images may be loaded or staged in */
+#define LOAD_LIMIT (MEMORY_BASE + c_memsz() - STACK_RESERVE - HEAP_RESERVE)
+
 void platform_init();
+void register_storage();
 uint32_t check_flash();
 void flash_directory();
+void platform_chain(void *stub, uint32_t dst, const void *src, uint32_t len,
+    uint32_t entry);
 uint32_t locate_stage_two();
 void stage_two(uint32_t kern_off, uint32_t kern_entry, uint32_t kern_size,
     uint32_t kern_loadpt);
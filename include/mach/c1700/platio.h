@@ -3,6 +3,8 @@
 
 #include <types.h>
 #include <ciloio.h>
+#include <fs_index.h>
+#include <storage/storage.h>
 
 /* a flash filesystem entry for the C1700 */
 struct fs_ent {
@@ -14,10 +16,21 @@ struct fs_ent {
     char filename[48];
 };
 
-void platio_file_open(struct file *fp, const char *filename);
+extern struct fs_index *flash_index;
+extern struct storage_class flash_storage;
+
+int platio_init(void);
+uint32_t platio_index_flash(void);
+uint32_t platio_probe(struct storage_class *sto);
+int platio_lookup(struct storage_class *sto, struct file *fp,
+    const char *filename);
+void platio_list(struct storage_class *sto);
 uint32_t platio_read(void *pbuf, uint32_t size, uint32_t nmemb,
     struct file *fp);
 uint8_t platio_find_file(const char *filename);
+void *platio_map(struct file *fp, uint32_t offset, uint32_t len);
+int platio_read_async(struct cilo_req *req);
+int platio_poll(struct cilo_req *req);
 
 #define FS_FILE_MAGIC 0xbad00b1e
 
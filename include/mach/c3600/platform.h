@@ -4,11 +4,54 @@
 #include <types.h>
 
 #define FLASH_BASE 0x30000000
+
+/* PCMCIA linear flash card windows. They lie outside KSEG0/KSEG1, so each
+ * is reached through a wired TLB entry of two 16MB pages at a KSEG2
+ * address; override the physical addresses with -D if need be.
+ */
+#define PCMCIA_SLOTS 2
+#ifndef PCMCIA_SLOT0_PHYS
+#define PCMCIA_SLOT0_PHYS 0x58000000
+#endif
+#ifndef PCMCIA_SLOT1_PHYS
+#define PCMCIA_SLOT1_PHYS 0x48000000
+#endif
+#define PCMCIA_SLOT0_BASE 0xC0000000
+#define PCMCIA_SLOT1_BASE 0xC2000000
+#define PCMCIA_WINDOW_SIZE 0x2000000
+
+/* PCMCIA support is only built with -DPCMCIA, as none of this has been
+ * checked on hardware. A slot's window is only touched once the socket's
+ * ExCA (i82365) interface status register shows both card detect pins;
+ * the controller's ExCA index and data registers have to be given, as
+ * KSEG1 addresses, with -DPCMCIA_EXCA_INDEX= and -DPCMCIA_EXCA_DATA=.
+ */
+#ifdef PCMCIA
+#if !defined(PCMCIA_EXCA_INDEX) || !defined(PCMCIA_EXCA_DATA)
+#error "-DPCMCIA needs -DPCMCIA_EXCA_INDEX and -DPCMCIA_EXCA_DATA"
+#endif
+#endif
+#define EXCA_SOCKET_REGS 0x40 /* register block of each socket */
+#define EXCA_STATUS 0x01 /* interface status register */
+#define EXCA_STATUS_CD 0x0C /* CD1 and CD2 */
+
 #define KERNEL_ENTRY_POINT 0x80008000
 #define MEMORY_BASE 0x80000000
 
+/* RAM kept clear for the stack, which sits at the top of RAM */
+#define STACK_RESERVE 0x20000
+
+/* RAM under the stack for CILO's own large buffers, see cilo_alloc() */
+#define HEAP_RESERVE 0x20000
+
+/* end of the RAM that images may be loaded or staged in */
+#define LOAD_LIMIT (MEMORY_BASE + c_memsz() - STACK_RESERVE - HEAP_RESERVE)
+
 void platform_init();
+void register_storage();
 uint32_t check_flash();
 void flash_directory();
+void platform_chain(void *stub, uint32_t dst, const void *src, uint32_t len,
+    uint32_t entry);
 
 #endif /* _INCLUDE_MACH_C3600_PLATFORM_H */
@@ -0,0 +1,82 @@
+#ifndef _INCLUDE_MACH_C7200_GT64K_H
+#define _INCLUDE_MACH_C7200_GT64K_H
+
+#include <types.h>
+
+/* GT-64010 system controller on the NPE (physical 0x14000000), via KSEG1 */
+#define GT64K_BASE 0xB4000000
+
+/* PCI configuration registers; bus 0 device 0 is the GT-64010 itself */
+#define GT_PCI_CONF_ADDR 0xCF8
+#define GT_PCI_CONF_DATA 0xCFC
+#define GT_PCI_CONF_EN   0x80000000
+#define GT_PCI_ID_64010  0x014611AB /* device 0x0146, vendor 0x11AB */
+
+/* IDMA channel registers; n is the channel number (0-3) */
+#define GT_DMA_COUNT(n) (0x800 + ((n) << 2))
+#define GT_DMA_SRC(n)   (0x810 + ((n) << 2))
+#define GT_DMA_DST(n)   (0x820 + ((n) << 2))
+#define GT_DMA_NEXT(n)  (0x830 + ((n) << 2))
+#define GT_DMA_CTRL(n)  (0x840 + ((n) << 2))
+
+/* channel control bits */
+#define GT_DMA_SRC_INC    (0 << 2)
+#define GT_DMA_DST_INC    (0 << 4)
+#define GT_DMA_LIMIT_32   (3 << 6) /* 32 bytes per bus transaction */
+#define GT_DMA_NON_CHAIN  (1 << 9)
+#define GT_DMA_BLOCK_MODE (1 << 11)
+#define GT_DMA_CHAN_EN    (1 << 12)
+#define GT_DMA_ACTIVE     (1 << 14)
+
+/* channels used by CILO: one for synchronous copies, one for async reads */
+#define GT_DMA_CHAN_SYNC  0
+#define GT_DMA_CHAN_ASYNC 1
+
+/* largest transfer programmed at once; the byte count register is 16 bits
+ * wide, and this keeps every chunk a whole number of cache lines
+ */
+#define GT_DMA_CHUNK 0x8000
+
+/* copies shorter than this are done by the CPU */
+#define GT_DMA_MIN_LEN 0x1000
+
+/* first-level chip select decoders, holding address bits [35:21] */
+#define GT_CS20_LOW     0x008
+#define GT_CS20_HIGH    0x010
+#define GT_CS3BOOT_LOW  0x018
+#define GT_CS3BOOT_HIGH 0x020
+
+/* second-level device decoders, holding address bits [27:20]; n is the
+ * bank: 0-3 for CS[3:0], GT_BOOT_BANK for BootCS
+ */
+#define GT_CS_LOW(n)  (0x400 + ((n) << 3))
+#define GT_CS_HIGH(n) (0x404 + ((n) << 3))
+#define GT_BOOT_BANK  4
+#define GT_DEV_BANKS  5
+
+/* device bank parameters, and the read timing fields in them */
+#define GT_DEV_PARAM(n) (0x45C + ((n) << 2))
+#define GT_DEV_ACC_FIRST_SHIFT 3 /* cycles to the first data of an access */
+#define GT_DEV_ACC_NEXT_SHIFT  7 /* cycles to each following burst beat */
+#define GT_DEV_ACC_MASK        0xF
+
+#define GT_DEV_ACC_FIRST(p) (((p) >> GT_DEV_ACC_FIRST_SHIFT) & GT_DEV_ACC_MASK)
+#define GT_DEV_ACC_NEXT(p)  (((p) >> GT_DEV_ACC_NEXT_SHIFT) & GT_DEV_ACC_MASK)
+#define GT_DEV_ACC(p, first, next) (((p) & \
+    ~((GT_DEV_ACC_MASK << GT_DEV_ACC_FIRST_SHIFT) | \
+    (GT_DEV_ACC_MASK << GT_DEV_ACC_NEXT_SHIFT))) | \
+    ((first) << GT_DEV_ACC_FIRST_SHIFT) | ((next) << GT_DEV_ACC_NEXT_SHIFT))
+
+/* the GT-64010 registers are little endian */
+#define gt_read(reg) SWAP_32(*(volatile uint32_t *)(GT64K_BASE + (reg)))
+#define gt_write(reg, v) \
+    (*(volatile uint32_t *)(GT64K_BASE + (reg)) = SWAP_32(v))
+
+int gt_present(void);
+void gt_dma_start(int chan, const void *src, void *dst, uint32_t len);
+int gt_dma_busy(int chan);
+int gt_dma_eligible(const void *src, void *dst, uint32_t len);
+void gt_dma_copy(void *dst, const void *src, uint32_t len);
+int gt_dev_bank(uint32_t paddr);
+
+#endif /* _INCLUDE_MACH_C7200_GT64K_H */
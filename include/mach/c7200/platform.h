@@ -5,11 +5,119 @@
 
 #define FLASH_BASE 0xBA000000
 #define FLASHFS_BASE 0xBA040000
+
+/* physical address of the bootflash, as seen by the GT-64010 */
+#define FLASH_PHYS 0x1A000000
+
+/* KSEG0 alias of the bootflash, so reads are cache line bursts */
+#define FLASH_BASE_CACHED 0x9A000000
+#define FLASHFS_BASE_CACHED 0x9A040000
+
+/* window used to read the filesystem; build with -DFLASH_UNCACHED to read
+ * through KSEG1 one bus cycle at a time instead
+ */
+#ifdef FLASH_UNCACHED
+#define FLASHFS_READ_BASE FLASHFS_BASE
+#else
+#define FLASHFS_READ_BASE FLASHFS_BASE_CACHED
+#endif
+
+/* files on flash are checked against the CRC32 IOS keeps in their header
+ * only with -DFLASH_CRC, which -DREQUIRE_CRC needs
+ */
+#if defined(REQUIRE_CRC) && !defined(FLASH_CRC)
+#define FLASH_CRC
+#endif
+
+/* PCMCIA linear flash card windows. They lie outside KSEG0/KSEG1, so each
+ * is reached through a wired TLB entry of two 16MB pages at a KSEG2
+ * address; override the physical addresses with -D if need be.
+ */
+#define PCMCIA_SLOTS 2
+#ifndef PCMCIA_SLOT0_PHYS
+#define PCMCIA_SLOT0_PHYS 0x40000000
+#endif
+#ifndef PCMCIA_SLOT1_PHYS
+#define PCMCIA_SLOT1_PHYS 0x44000000
+#endif
+#define PCMCIA_SLOT0_BASE 0xC0000000
+#define PCMCIA_SLOT1_BASE 0xC2000000
+#define PCMCIA_WINDOW_SIZE 0x2000000
+
+/* PCMCIA support is only built with -DPCMCIA, as none of this has been
+ * checked on hardware. A slot's window is only touched once the socket's
+ * ExCA (i82365) interface status register shows both card detect pins;
+ * the controller's ExCA index and data registers have to be given, as
+ * KSEG1 addresses, with -DPCMCIA_EXCA_INDEX= and -DPCMCIA_EXCA_DATA=.
+ */
+#ifdef PCMCIA
+#if !defined(PCMCIA_EXCA_INDEX) || !defined(PCMCIA_EXCA_DATA)
+#error "-DPCMCIA needs -DPCMCIA_EXCA_INDEX and -DPCMCIA_EXCA_DATA"
+#endif
+#endif
+#define EXCA_SOCKET_REGS 0x40 /* register block of each socket */
+#define EXCA_STATUS 0x01 /* interface status register */
+#define EXCA_STATUS_CD 0x0C /* CD1 and CD2 */
+
+/* uncached mappings of the card windows, for the registers of PC Card ATA
+ * disks. In memory mode the task file is at the start of common memory,
+ * the device control register at 0xE, and every address in 0x400-0x7FF
+ * reads the data register, so 32-bit reads that the bus splits into two
+ * 16-bit cycles still land on it. Build with -DNO_ATA_DATA32 to read the
+ * data 16 bits at a time.
+ */
+#define PCMCIA_SLOT0_IO 0xC4000000
+#define PCMCIA_SLOT1_IO 0xC6000000
+#define PCMCIA_ATA_CTL 0x00E
+#define PCMCIA_ATA_DATA 0x400
+
+/* CP0 Count rate, half the CPU clock; the default is for a 200MHz NPE,
+ * override it with -D to get true throughput figures on other NPEs
+ */
+#ifndef COUNT_HZ
+#define COUNT_HZ 100000000
+#endif
+
+/* channel A of the console DUART, a 2681 in the I/O FPGA at physical
+ * 0x1E840000: its status and receive holding registers. They are only read
+ * to notice a key during the boot cache window, as ROMMON's getc waits for
+ * ever; override them with -D if a board's console is elsewhere.
+ */
+#ifndef CONSOLE_DUART_SR
+#define CONSOLE_DUART_SR 0xBE84040C
+#endif
+
+#ifndef CONSOLE_DUART_RHR
+#define CONSOLE_DUART_RHR 0xBE84041C
+#endif
+
+#define DUART_SR_RXRDY 0x01
+
+/* boot cache record slot: the last 512 bytes of the 128kB NVRAM at
+ * physical 0x1E000000, past anything IOS keeps at the front of it
+ */
+#ifndef BOOT_CACHE_NVRAM
+#define BOOT_CACHE_NVRAM (0xBE000000 + 0x20000 - 512)
+#endif
+
 #define KERNEL_ENTRY_POINT 0x80008000
 #define MEMORY_BASE 0x80000000
 
+/* RAM kept clear for the stack, which sits at the top of RAM */
+#define STACK_RESERVE 0x20000
+
+/* RAM under the stack for CILO's own large buffers, see cilo_alloc() */
+#define HEAP_RESERVE 0x20000
+
+/* end of the RAM that images may be loaded or staged in */
+#define LOAD_LIMIT (MEMORY_BASE + c_memsz() - STACK_RESERVE - HEAP_RESERVE)
+
 void platform_init();
+int platform_key_wait(int secs);
+void register_storage();
 uint32_t check_flash();
 void flash_directory();
+void platform_chain(void *stub, uint32_t dst, const void *src, uint32_t len,
+    uint32_t entry);
 
 #endif /* _INCLUDE_MACH_C7200_PLATFORM_H */
@@ -3,6 +3,9 @@
 
 #include <types.h>
 #include <ciloio.h>
+#include <fs_index.h>
+#include <storage/storage.h>
+#include <storage/cfi.h>
 
 /* a flash filesystem entry for the C7200 */
 struct fs_ent {
@@ -26,12 +29,39 @@ struct fs_ent {
     uint32_t sg09;	/* 0xffffffffh */
 };
 
-void platio_file_open(struct file *fp, const char *filename);
+extern struct fs_index *flash_index;
+extern struct storage_class flash_storage;
+extern struct cfi_info flash_cfi;
+extern struct storage_class slot_storage[];
+extern struct storage_class disk_storage[];
+
+int platio_init(void);
+uint32_t platio_index_flash(void);
+uint32_t platio_probe(struct storage_class *sto);
+uint32_t platio_slot_probe(struct storage_class *sto);
+int platio_lookup(struct storage_class *sto, struct file *fp,
+    const char *filename);
+void platio_list(struct storage_class *sto);
 
 uint32_t platio_read(void *pbuf, uint32_t size, uint32_t nmemb, struct file *fp);
 
 uint8_t platio_find_file(const char *filename);
 
+void *platio_map(struct file *fp, uint32_t offset, uint32_t len);
+#ifdef FLASH_CRC
+int platio_verify(struct file *fp);
+#endif
+int platio_read_async(struct cilo_req *req);
+int platio_poll(struct cilo_req *req);
+int platio_write(struct storage_class *sto, const char *filename,
+    const void *buf, uint32_t len);
+int platio_locate(struct storage_class *sto, struct file *fp,
+    const struct boot_record *rec);
+void platio_record(struct file *fp, struct boot_record *rec);
+
 #define FS_FILE_MAGIC 0x07158805
 
+/* type given to files written by CILO when there is no header to copy */
+#define FS_FILE_TYPE_BINARY 1
+
 #endif /* _INCLUDE_MACH_C7200_PLATIO */
@@ -0,0 +1,33 @@
+#ifndef _INCLUDE_MZIP_LOADER_H
+#define _INCLUDE_MZIP_LOADER_H
+
+#include <types.h>
+#include <ciloio.h>
+
+/* header of an IOS MZIP image, as written by elf2mzip (see
+ * elf2mzip/mzip.h). Fields are in the byte order of the target.
+ */
+struct mzip_header {
+    char hdr_magic[4];
+    uint32_t hdr_version;
+    uint32_t hdr_entrypt;
+    uint32_t hdr_flags1;
+    uint32_t hdr_flags2;
+    uint32_t hdr_padding1[8];
+    uint16_t hdr_crc_code;
+    uint16_t hdr_crc_header;
+    uint32_t hdr_header_size;
+    uint32_t hdr_loader_addr;
+    uint32_t hdr_flags3;
+    uint32_t hdr_code_packed_size;
+    uint32_t hdr_code_unpacked_size;
+    uint32_t hdr_memory_image_size;
+    uint32_t hdr_padding2[8];
+};
+
+#define MZIP_HDR_SIZE (sizeof(struct mzip_header))
+
+int is_mzip(struct file *fp);
+void load_mzip(struct file *fp, char *cmd_line);
+
+#endif /* _INCLUDE_MZIP_LOADER_H */
@@ -0,0 +1,83 @@
+#ifndef _INCLUDE_PIPELINE_H
+#define _INCLUDE_PIPELINE_H
+
+#include <types.h>
+#include <ciloio.h>
+
+/* A stage produces a stream of bytes, handed out a buffer at a time. Sources
+ * produce it from a device, filters (decompressors, checksums) transform
+ * what they pull from the stage upstream of them, and sinks at the end of
+ * the chain pull the stream into memory. Buffers are passed by pointer, so
+ * a mapped file or a decompressor writing straight to its destination is
+ * never copied.
+ */
+struct pipe_stage {
+    /* hand out the next buffer of the stream. *len is 0 at the end of the
+     * stream; the buffer is only valid until the next call.
+     * returns 0 on success, -1 on error */
+    int (*pull)(struct pipe_stage *st, const uint8_t **buf, uint32_t *len);
+
+    /* optional: copy up to len bytes of the stream to dst, or skip them if
+     * dst is NULL. Lets a source deliver straight into the destination.
+     * returns the number of bytes, 0 at the end of the stream, -1 on error */
+    int32_t (*read)(struct pipe_stage *st, void *dst, uint32_t len);
+
+    /* optional: take the rest of the stream in place, for consumers that
+     * want it as one flat buffer. returns NULL if it can't be mapped */
+    const uint8_t *(*map)(struct pipe_stage *st, uint32_t *len);
+
+    struct pipe_stage *up; /* stage this one pulls from, NULL for a source */
+};
+
+/* source: a range of a file. Mapped files are handed out in place; other
+ * devices are read a chunk ahead into a pair of buffers.
+ */
+struct pipe_file {
+    struct pipe_stage st;
+    struct file *fp;
+    uint32_t end; /* file offset the stream stops at */
+    uint32_t chunk; /* bytes handed out per pull */
+
+    uint8_t *bufs[2]; /* chunk bytes each, only needed if not mapped */
+    struct cilo_req reqs[2];
+    int cur;
+    int busy; /* reqs[cur] is a read ahead in flight */
+};
+
+/* source: raw bytes sent down the console */
+struct pipe_serial {
+    struct pipe_stage st;
+    uint32_t left; /* bytes still to come */
+    uint8_t *buf;
+    uint32_t chunk;
+};
+
+/* filter: passes the stream through, keeping a checksum of it */
+struct pipe_sum {
+    struct pipe_stage st;
+    uint32_t (*update)(uint32_t sum, const void *buf, uint32_t len);
+    uint32_t sum;
+    uint32_t count; /* bytes seen */
+};
+
+/* sink-side cursor over a stream, for sinks that consume it piecemeal */
+struct pipe_reader {
+    struct pipe_stage *st;
+    const uint8_t *buf; /* rest of the last buffer pulled */
+    uint32_t len;
+    uint32_t pos; /* bytes consumed from the stream */
+};
+
+void pipe_file_init(struct pipe_file *pf, struct file *fp, uint32_t offset,
+    uint32_t len, uint8_t *bufs, uint32_t chunk);
+void pipe_serial_init(struct pipe_serial *ps, uint32_t len, uint8_t *buf,
+    uint32_t chunk);
+void pipe_sum_init(struct pipe_sum *ps, struct pipe_stage *up,
+    uint32_t (*update)(uint32_t sum, const void *buf, uint32_t len),
+    uint32_t sum);
+
+void pipe_reader_init(struct pipe_reader *rd, struct pipe_stage *st);
+int pipe_read(struct pipe_reader *rd, void *dst, uint32_t len);
+int32_t pipe_to_memory(struct pipe_stage *st, void *dst, uint32_t max);
+
+#endif /* _INCLUDE_PIPELINE_H */
@@ -14,6 +14,14 @@
 
 #define GETBAUD 62
 
+/* config register; a guess like the rest, so it can be overridden */
+#ifndef GETCONFREG
+#define GETCONFREG 7
+#endif
+
+/* config register bit to ignore NVRAM, as in the usual 0x2142 */
+#define CONFREG_IGNORE_NVRAM 0x0040
+
 /* Promlib Calls */
 void c_putc(const char c);
 void c_puts(const char *s);
@@ -24,5 +32,6 @@ long c_timer(void);
 int c_strnlen(const char *c, int maxlen);
 char *c_verstr(void);
 int c_baud(void);
+int c_confreg(void);
 
 #endif /* _PROMLIB_H */
@@ -0,0 +1,56 @@
+#ifndef _STORAGE_ATA_H
+#define _STORAGE_ATA_H
+
+#include <types.h>
+#include <storage/block.h>
+
+/* task file registers, as offsets from ata_dev.regs */
+#define ATA_REG_DATA        0
+#define ATA_REG_ERROR       1 /* read */
+#define ATA_REG_FEATURE     1 /* write */
+#define ATA_REG_COUNT       2
+#define ATA_REG_LBA0        3
+#define ATA_REG_LBA1        4
+#define ATA_REG_LBA2        5
+#define ATA_REG_DEVICE      6
+#define ATA_REG_STATUS      7 /* read */
+#define ATA_REG_COMMAND     7 /* write */
+
+/* status register */
+#define ATA_SR_BSY          0x80
+#define ATA_SR_DRDY         0x40
+#define ATA_SR_DF           0x20
+#define ATA_SR_DRQ          0x08
+#define ATA_SR_ERR          0x01
+
+/* device control register */
+#define ATA_CTL_NIEN        0x02
+#define ATA_CTL_SRST        0x04
+
+#define ATA_DEV_LBA         0xE0 /* device 0, LBA addressing */
+
+#define ATA_CMD_READ_SECTORS    0x20
+#define ATA_CMD_READ_MULTIPLE   0xC4
+#define ATA_CMD_SET_MULTIPLE    0xC6
+#define ATA_CMD_IDENTIFY        0xEC
+
+/* polls of the status register before giving up on the device */
+#define ATA_TIMEOUT 0x1000000
+
+/* ata_dev.flags */
+#define ATA_DATA32 0x01 /* data can be read 32 bits at a time */
+
+/* a memory-mapped ATA device, e.g. a CompactFlash or PC Card ATA disk */
+struct ata_dev {
+    uint32_t regs; /* address of the task file */
+    uint32_t ctl; /* address of the device control/alternate status register */
+    uint32_t data; /* address the data is read from */
+    uint8_t flags; /* ATA_* flags, set by the platform */
+
+    uint8_t multi; /* sectors per READ MULTIPLE block, 0 if not in use */
+};
+
+int ata_probe(struct block_dev *bdev);
+int ata_read(struct block_dev *bdev, uint32_t lba, uint32_t count, void *buf);
+
+#endif /* _STORAGE_ATA_H */
@@ -0,0 +1,32 @@
+#ifndef _STORAGE_BLOCK_H
+#define _STORAGE_BLOCK_H
+
+#include <types.h>
+#include <storage/storage.h>
+
+struct fat_fs;
+
+#define BLOCK_SIZE 512 /* bytes per sector */
+
+/* a sector-addressed device, such as an ATA disk */
+struct block_dev {
+    uint32_t sectors; /* capacity, filled in by probe */
+
+    /* check for the device and prepare it; returns non-zero if present */
+    int (*probe)(struct block_dev *bdev);
+    /* read count sectors starting at lba; returns < 0 on error */
+    int (*read)(struct block_dev *bdev, uint32_t lba, uint32_t count,
+        void *buf);
+
+    void *private; /* data for the device driver */
+
+    struct fat_fs *fs; /* filesystem on the device, if one was found */
+};
+
+/* storage ops for a storage class whose private data is a block_dev */
+extern struct storage_ops block_ops;
+
+int block_read_bytes(struct block_dev *bdev, uint32_t lba, uint32_t offset,
+    void *buf, uint32_t len);
+
+#endif /* _STORAGE_BLOCK_H */
@@ -0,0 +1,44 @@
+#ifndef _INCLUDE_STORAGE_CFI_H
+#define _INCLUDE_STORAGE_CFI_H
+
+#include <types.h>
+
+/* primary vendor command sets */
+#define CFI_CMDSET_INTEL_EXT 0x0001
+#define CFI_CMDSET_AMD_STD   0x0002
+#define CFI_CMDSET_INTEL_STD 0x0003
+
+/* erase block regions kept per array */
+#define CFI_MAX_REGIONS 4
+
+struct cfi_region {
+    uint32_t blocks; /* number of erase blocks */
+    uint32_t size; /* bytes per erase block, across the whole bus */
+};
+
+/* a flash array that answered the CFI query. Sizes cover every device on
+ * the bus, so an array of two interleaved 8 MB parts has a size of 16 MB.
+ */
+struct cfi_info {
+    uint32_t base; /* uncached base address of the array */
+    uint8_t width; /* bytes per bus access */
+    uint8_t interleave; /* devices side by side on the bus */
+    uint16_t cmdset; /* primary vendor command set */
+    uint16_t manuf; /* manufacturer ID */
+    uint16_t device; /* device ID */
+    uint32_t size; /* bytes in the array */
+    uint32_t write_buffer; /* bytes per buffered write, 0 if unsupported */
+    uint8_t page_words; /* page-mode read page in device words, 0 if none */
+    uint8_t nregions; /* erase block regions used */
+    struct cfi_region regions[CFI_MAX_REGIONS];
+};
+
+int cfi_probe(struct cfi_info *cfi, uint32_t base);
+void cfi_reset(struct cfi_info *cfi);
+const char *cfi_cmdset_name(uint16_t cmdset);
+uint32_t cfi_block(struct cfi_info *cfi, uint32_t offset, uint32_t *start);
+int cfi_erase(struct cfi_info *cfi, uint32_t offset, uint32_t len);
+int cfi_program(struct cfi_info *cfi, uint32_t offset, const void *buf,
+    uint32_t len);
+
+#endif /* _INCLUDE_STORAGE_CFI_H */
@@ -2,12 +2,58 @@
 #define _STORAGE_STORAGE_H
 
 #include <types.h>
+#include <ciloio.h>
+
+struct storage_class;
+struct boot_record;
+
+/* operations a storage class provides; map, close, verify, read_async,
+ * poll, write, locate and record may be NULL */
+struct storage_ops {
+    /* check for the medium and prepare it; returns non-zero if present */
+    uint32_t (*probe)(struct storage_class *sto);
+    /* find a file and fill in fp; returns non-zero if found */
+    int (*lookup)(struct storage_class *sto, struct file *fp,
+        const char *filename);
+    uint32_t (*read)(void *pbuf, uint32_t size, uint32_t nmemb,
+        struct file *fp);
+    /* direct pointer to file data, or NULL if the device isn't mapped */
+    void *(*map)(struct file *fp, uint32_t offset, uint32_t len);
+    /* print the files on the device */
+    void (*list)(struct storage_class *sto);
+    /* release anything lookup set up for the file; may be NULL */
+    void (*close)(struct file *fp);
+    /* check the file against its stored checksum; returns 1 if it matches,
+     * -1 if it doesn't, 0 if the file can't be checked. May be NULL */
+    int (*verify)(struct file *fp);
+    int (*read_async)(struct cilo_req *req);
+    int (*poll)(struct cilo_req *req);
+    /* create or replace a file from a buffer in RAM; the RAM after the
+     * buffer may be used as scratch. Returns 0 on success. May be NULL */
+    int (*write)(struct storage_class *sto, const char *filename,
+        const void *buf, uint32_t len);
+    /* open the file a boot record names, checking only the header at the
+     * recorded offset; returns non-zero if it still matches. May be NULL */
+    int (*locate)(struct storage_class *sto, struct file *fp,
+        const struct boot_record *rec);
+    /* fill in the offset, length and date of a boot record for an open
+     * file. May be NULL */
+    void (*record)(struct file *fp, struct boot_record *rec);
+};
+
+#define STORAGE_UNPROBED -1
+#define STORAGE_ABSENT 0
+#define STORAGE_PRESENT 1
 
 struct storage_class {
     uint32_t dev_id;
     char dev_name[16];
     uint32_t start_addr;
 
+    struct storage_ops *ops;
+    void *private; /* data for the storage class driver */
+    int8_t probed; /* cached probe result, one of STORAGE_* */
+
     /* storage device manager stuff */
     struct storage_class *next;
     struct storage_class *prev;
@@ -15,5 +61,11 @@ struct storage_class {
 
 void initialize_storage_manager();
 void register_storage_class(struct storage_class *sto);
+uint32_t storage_probe(struct storage_class *sto);
+uint32_t storage_probe_all(void);
+struct storage_class *storage_find_class(const char *name, uint32_t len);
+struct storage_class *storage_open(const char *path, struct file *fp);
+void storage_list(void);
+int storage_write(const char *path, const void *buf, uint32_t len);
 
 #endif /* _STORAGE_STORAGE_H */
@@ -15,6 +15,8 @@ uint32_t strlen(const char *s);
 
 int memcpy(void *dst, const void *src, int n);
 
+void memzero(void *dst, uint32_t n);
+
 const char *strchr(const char *s, int c);
 
 const char *strstr(const char *haystack, const char *needle);
@@ -0,0 +1,12 @@
+#ifndef _INCLUDE_XZ_LOADER_H
+#define _INCLUDE_XZ_LOADER_H
+
+#include <types.h>
+#include <ciloio.h>
+#include <lzmadec.h>
+
+int is_xz(struct file *fp);
+int32_t xz_decode(struct lzma_dec *d);
+void load_xz(struct file *fp, uint32_t load_address, char *cmd_line);
+
+#endif /* _INCLUDE_XZ_LOADER_H */
@@ -0,0 +1,86 @@
+#ifndef _INCLUDE_ZSTDDEC_H
+#define _INCLUDE_ZSTDDEC_H
+
+#include <types.h>
+#include <pipeline.h>
+
+#define ZSTD_MAGIC 0xfd2fb528
+#define ZSTD_SKIPPABLE_MAGIC 0x184d2a50 /* low four bits are free */
+
+/* largest block, compressed or not */
+#define ZSTD_BLOCK_MAX (128 << 10)
+
+/* largest window a frame may ask for; matches never reach further back
+ * than this. 128MB is what "zstd --ultra -22" uses. Override with -D.
+ */
+#ifndef ZSTD_WINDOW_MAX
+#define ZSTD_WINDOW_MAX (128 << 20)
+#endif
+
+#define ZSTD_LL_LOG_MAX 9
+#define ZSTD_ML_LOG_MAX 9
+#define ZSTD_OF_LOG_MAX 8
+#define ZSTD_HUF_LOG_MAX 11
+
+/* FSE decoding table entry: the next state is base plus the next bits */
+struct zstd_fse {
+    uint16_t base;
+    uint8_t symbol;
+    uint8_t bits;
+};
+
+/* Huffman decoding table entry, indexed by the next ZSTD_HUF_LOG_MAX bits
+ * at most
+ */
+struct zstd_huf {
+    uint8_t symbol;
+    uint8_t bits;
+};
+
+/* A Zstandard decoder writing to a flat output buffer: everything written
+ * since the frame started is the window, so there is no window buffer and
+ * no copy out of one. Input is taken a buffer at a time from a pipeline
+ * stage. About 137KB, mostly the literals of a block; keep it off the
+ * stack.
+ */
+struct zstd_dec {
+    /* input */
+    const uint8_t *in;
+    const uint8_t *in_end;
+    struct pipe_stage *src;
+    uint32_t in_total; /* bytes taken from src, up to in_end */
+    uint8_t *block; /* ZSTD_BLOCK_MAX bytes to gather a compressed block
+                     * in, needed only if the input isn't mapped */
+
+    /* output */
+    uint8_t *frame; /* start of the current frame */
+    uint8_t *pos; /* where the next byte goes */
+    uint8_t *out_end; /* end of the destination */
+    uint32_t window; /* window size of the current frame */
+
+    /* carried from block to block within a frame */
+    uint32_t rep[3];
+    uint32_t have; /* tables set by an earlier block, ZSTD_HAVE_* */
+    uint32_t ll_log, of_log, ml_log, huf_log;
+    struct zstd_fse ll[1 << ZSTD_LL_LOG_MAX];
+    struct zstd_fse of[1 << ZSTD_OF_LOG_MAX];
+    struct zstd_fse ml[1 << ZSTD_ML_LOG_MAX];
+    struct zstd_huf huf[1 << ZSTD_HUF_LOG_MAX];
+
+    uint8_t lit[ZSTD_BLOCK_MAX];
+
+    /* optional: called between blocks once the output passes tick_at */
+    void (*tick)(struct zstd_dec *d);
+    uint8_t *tick_at;
+};
+
+/* bytes of input the decoder has consumed */
+#define zstd_dec_consumed(d) ((d)->in_total - ((d)->in_end - (d)->in))
+
+void zstd_dec_init(struct zstd_dec *d, struct pipe_stage *src, uint8_t *out,
+    uint8_t *out_end);
+int zstd_dec_byte(struct zstd_dec *d);
+int zstd_frame(struct zstd_dec *d);
+int zstd_decode(struct zstd_dec *d);
+
+#endif /* _INCLUDE_ZSTDDEC_H */
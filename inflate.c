@@ -0,0 +1,556 @@
+/* Inflate
+ * Licensed under the GNU General Public License v2
+ *
+ * A decoder for deflate streams (RFC 1951), the compression used in gzip
+ * and zlib files and in ZIP archives such as the code segment of an MZIP
+ * image. Huffman codes of up to INFLATE_FAST_BITS bits, which are nearly
+ * all of them, are decoded by indexing a table with the next bits of
+ * input; longer ones are decoded a bit at a time from the canonical code.
+ *
+ * As in lzmadec.c, output goes straight to its final address and that
+ * memory is the window, so there is no copy out of a circular buffer.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <pipeline.h>
+#include <inflate.h>
+
+#define INFLATE_STORED 0
+#define INFLATE_FIXED 1
+#define INFLATE_DYNAMIC 2
+
+#define INFLATE_END_OF_BLOCK 256
+#define INFLATE_CODELEN_CODES 19
+
+/* base length and extra bits of length symbols 257 to 285 */
+static const uint16_t inflate_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t inflate_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+/* base distance and extra bits of distance symbols */
+static const uint16_t inflate_dist_base[INFLATE_DIST_CODES] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+
+static const uint8_t inflate_dist_extra[INFLATE_DIST_CODES] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* order the code length code lengths are sent in */
+static const uint8_t inflate_codelen_order[INFLATE_CODELEN_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/**
+ * Take the next buffer of input from the source.
+ * @returns 0 on success, -1 at the end of the input or on error
+ */
+static int inflate_refill(struct inflate *z)
+{
+    const uint8_t *buf;
+    uint32_t len;
+
+    if (z->src->pull(z->src, &buf, &len) < 0 || len == 0) {
+        return -1;
+    }
+
+    z->in = buf;
+    z->in_end = buf + len;
+    z->in_total += len;
+
+    return 0;
+}
+
+/**
+ * Set up a decoder.
+ * @param z decoder to set up
+ * @param src stage the compressed data is pulled from
+ * @param out destination of the decoded data
+ * @param out_max most bytes the destination can take
+ */
+void inflate_init(struct inflate *z, struct pipe_stage *src, uint8_t *out,
+    uint32_t out_max)
+{
+    const uint8_t *buf = NULL;
+    uint32_t len;
+
+    z->src = src;
+    z->in = NULL;
+    z->in_end = NULL;
+    z->in_total = 0;
+    z->bits = 0;
+    z->nbits = 0;
+
+    /* take all of the input in place if it can be mapped */
+    if (src->map != NULL && (buf = src->map(src, &len)) != NULL) {
+        z->in = buf;
+        z->in_end = buf + len;
+        z->in_total = len;
+    }
+
+    z->window = out;
+    z->pos = out;
+    z->out_end = out + out_max;
+
+    z->tick = NULL;
+    z->tick_at = NULL;
+}
+
+/**
+ * Take a byte of input outside of the compressed data, e.g. a header.
+ * Bytes read ahead into the bit buffer are handed back first.
+ * @returns the byte, or -1 at the end of the input
+ */
+int inflate_byte(struct inflate *z)
+{
+    int b;
+
+    if (z->nbits >= 8) {
+        b = z->bits & 0xff;
+        z->bits >>= 8;
+        z->nbits -= 8;
+        return b;
+    }
+
+    if (z->in == z->in_end && inflate_refill(z) < 0) {
+        return -1;
+    }
+
+    return *z->in++;
+}
+
+/**
+ * Make sure the bit buffer holds at least n bits, n <= 25.
+ * @returns 0 on success, -1 if the input ends first
+ */
+static int inflate_need(struct inflate *z, uint32_t n)
+{
+    while (z->nbits < n) {
+        if (z->in == z->in_end && inflate_refill(z) < 0) {
+            return -1;
+        }
+
+        z->bits |= (uint32_t)*z->in++ << z->nbits;
+        z->nbits += 8;
+    }
+
+    return 0;
+}
+
+/**
+ * Take n bits, n <= 16.
+ * @returns the bits, or -1 if the input ends first
+ */
+static int inflate_bits(struct inflate *z, uint32_t n)
+{
+    uint32_t v;
+
+    if (inflate_need(z, n) < 0) {
+        return -1;
+    }
+
+    v = z->bits & ((1 << n) - 1);
+    z->bits >>= n;
+    z->nbits -= n;
+
+    return v;
+}
+
+/**
+ * Build a Huffman code from a list of code lengths. Incomplete codes are
+ * allowed, as deflate uses them for a distance code with a single symbol;
+ * a code that is not assigned fails to decode.
+ * @param h code to build
+ * @param lens code length of each symbol, 0 if it is not used
+ * @param n number of symbols
+ * @returns 0 on success, -1 if the lengths are over-subscribed
+ */
+static int inflate_build(struct inflate_huff *h, const uint8_t *lens,
+    uint32_t n)
+{
+    uint16_t offs[INFLATE_MAX_BITS + 1];
+    uint32_t len, sym, code, rev, i, j, k;
+    int left = 1;
+
+    memzero(h->count, sizeof(h->count));
+
+    for (sym = 0; sym < n; sym++) {
+        h->count[lens[sym]]++;
+    }
+
+    for (len = 1; len <= INFLATE_MAX_BITS; len++) {
+        left = (left << 1) - h->count[len];
+
+        if (left < 0) {
+            return -1;
+        }
+    }
+
+    /* symbols sorted by code length, then by value */
+    offs[1] = 0;
+
+    for (len = 1; len < INFLATE_MAX_BITS; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+
+    for (sym = 0; sym < n; sym++) {
+        if (lens[sym]) h->symbol[offs[lens[sym]]++] = sym;
+    }
+
+    /* fill in the table entries of each short code. Codes are sent most
+     * significant bit first, so a code's entries are at its bit reversal
+     * and every 1 << len after that.
+     */
+    memzero(h->fast, sizeof(h->fast));
+    code = 0;
+    i = 0;
+
+    for (len = 1; len <= INFLATE_FAST_BITS; len++) {
+        for (k = 0; k < h->count[len]; k++, code++, i++) {
+            for (rev = 0, j = 0; j < len; j++) {
+                rev |= ((code >> j) & 1) << (len - 1 - j);
+            }
+
+            for (; rev < (1 << INFLATE_FAST_BITS); rev += 1 << len) {
+                h->fast[rev] = h->symbol[i] << 4 | len;
+            }
+        }
+
+        code <<= 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode a symbol.
+ * @returns the symbol, or -1 if the input ends or the code is not assigned
+ */
+static int inflate_decode(struct inflate *z, const struct inflate_huff *h)
+{
+    uint32_t entry, len;
+    int code = 0, first = 0, index = 0, count;
+
+    /* top up the bit buffer as far as the input allows */
+    while (z->nbits <= 24) {
+        if (z->in == z->in_end && inflate_refill(z) < 0) {
+            break;
+        }
+
+        z->bits |= (uint32_t)*z->in++ << z->nbits;
+        z->nbits += 8;
+    }
+
+    entry = h->fast[z->bits & ((1 << INFLATE_FAST_BITS) - 1)];
+    len = entry & 15;
+
+    if (len && len <= z->nbits) {
+        z->bits >>= len;
+        z->nbits -= len;
+        return entry >> 4;
+    }
+
+    /* a long code, or the end of the input: one bit at a time */
+    for (len = 1; len <= INFLATE_MAX_BITS; len++) {
+        if (z->nbits == 0) {
+            return -1;
+        }
+
+        code |= z->bits & 1;
+        z->bits >>= 1;
+        z->nbits--;
+
+        count = h->count[len];
+
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+/**
+ * Copy a stored block.
+ * @returns 0 on success, -1 if it is corrupt or doesn't fit
+ */
+static int inflate_stored(struct inflate *z)
+{
+    uint32_t len, n;
+    int b[4], i;
+
+    /* LEN and NLEN start on a byte boundary */
+    z->bits >>= z->nbits & 7;
+    z->nbits &= ~7;
+
+    for (i = 0; i < 4; i++) {
+        if ((b[i] = inflate_byte(z)) < 0) {
+            return -1;
+        }
+    }
+
+    len = b[0] | b[1] << 8;
+
+    if ((b[2] | b[3] << 8) != (~len & 0xffff) || len > z->out_end - z->pos) {
+        return -1;
+    }
+
+    /* bytes already in the bit buffer, then straight from the input */
+    while (len && z->nbits) {
+        *z->pos++ = inflate_byte(z);
+        len--;
+    }
+
+    while (len) {
+        if (z->in == z->in_end && inflate_refill(z) < 0) {
+            return -1;
+        }
+
+        n = z->in_end - z->in;
+        if (n > len) n = len;
+
+        memcpy(z->pos, z->in, n);
+        z->in += n;
+        z->pos += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode the literals and matches of a Huffman-coded block.
+ * @returns 0 on success, -1 if it is corrupt or doesn't fit
+ */
+static int inflate_codes(struct inflate *z)
+{
+    uint8_t *match;
+    int sym, extra;
+    uint32_t len, dist;
+
+    for (;;) {
+        if ((sym = inflate_decode(z, &z->lit)) < 0) {
+            return -1;
+        }
+
+        if (sym < INFLATE_END_OF_BLOCK) {
+            if (z->pos == z->out_end) {
+                return -1;
+            }
+
+            *z->pos++ = sym;
+            continue;
+        }
+
+        if (sym == INFLATE_END_OF_BLOCK) {
+            return 0;
+        }
+
+        sym -= INFLATE_END_OF_BLOCK + 1;
+
+        if (sym >= 29 ||
+            (extra = inflate_bits(z, inflate_len_extra[sym])) < 0)
+        {
+            return -1;
+        }
+
+        len = inflate_len_base[sym] + extra;
+
+        if ((sym = inflate_decode(z, &z->dist)) < 0 ||
+            sym >= INFLATE_DIST_CODES ||
+            (extra = inflate_bits(z, inflate_dist_extra[sym])) < 0)
+        {
+            return -1;
+        }
+
+        dist = inflate_dist_base[sym] + extra;
+
+        if (dist > z->pos - z->window || len > z->out_end - z->pos) {
+            return -1;
+        }
+
+        match = z->pos - dist;
+
+        if (dist >= len) {
+            memcpy(z->pos, match, len);
+            z->pos += len;
+        } else {
+            /* overlapping: repeats the last dist bytes */
+            while (len--) *z->pos++ = *match++;
+        }
+    }
+}
+
+/**
+ * Set up the fixed Huffman codes.
+ */
+static void inflate_fixed(struct inflate *z)
+{
+    uint8_t lens[INFLATE_LIT_CODES];
+    uint32_t i;
+
+    for (i = 0; i < INFLATE_LIT_CODES; i++) {
+        lens[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    }
+
+    inflate_build(&z->lit, lens, INFLATE_LIT_CODES);
+
+    for (i = 0; i < INFLATE_DIST_CODES; i++) {
+        lens[i] = 5;
+    }
+
+    inflate_build(&z->dist, lens, INFLATE_DIST_CODES);
+}
+
+/**
+ * Read the Huffman codes of a dynamic block.
+ * @returns 0 on success, -1 if they are corrupt
+ */
+static int inflate_dynamic(struct inflate *z)
+{
+    uint8_t lens[INFLATE_LIT_CODES + INFLATE_DIST_CODES];
+    int nlit, ndist, ncode, sym, len, rep;
+    int i;
+
+    if ((nlit = inflate_bits(z, 5)) < 0 || (ndist = inflate_bits(z, 5)) < 0 ||
+        (ncode = inflate_bits(z, 4)) < 0)
+    {
+        return -1;
+    }
+
+    nlit += 257;
+    ndist += 1;
+    ncode += 4;
+
+    if (nlit > 286 || ndist > INFLATE_DIST_CODES) {
+        return -1;
+    }
+
+    /* the code the code lengths are sent in, built in the literal code */
+    memzero(lens, INFLATE_CODELEN_CODES);
+
+    for (i = 0; i < ncode; i++) {
+        if ((len = inflate_bits(z, 3)) < 0) {
+            return -1;
+        }
+
+        lens[inflate_codelen_order[i]] = len;
+    }
+
+    if (inflate_build(&z->lit, lens, INFLATE_CODELEN_CODES) < 0) {
+        return -1;
+    }
+
+    /* literal/length and distance code lengths, run-length coded */
+    for (i = 0; i < nlit + ndist; ) {
+        if ((sym = inflate_decode(z, &z->lit)) < 0) {
+            return -1;
+        }
+
+        if (sym < 16) {
+            lens[i++] = sym;
+            continue;
+        }
+
+        /* 16 repeats the previous length, 17 and 18 repeat zero */
+        len = 0;
+
+        if (sym == 16) {
+            if (i == 0) return -1;
+            len = lens[i - 1];
+            rep = inflate_bits(z, 2);
+            rep += 3;
+        } else if (sym == 17) {
+            rep = inflate_bits(z, 3);
+            rep += 3;
+        } else {
+            rep = inflate_bits(z, 7);
+            rep += 11;
+        }
+
+        if (rep < 3 || i + rep > nlit + ndist) {
+            return -1;
+        }
+
+        while (rep--) lens[i++] = len;
+    }
+
+    /* a block can't end without an end of block code */
+    if (lens[INFLATE_END_OF_BLOCK] == 0) {
+        return -1;
+    }
+
+    if (inflate_build(&z->lit, lens, nlit) < 0 ||
+        inflate_build(&z->dist, lens + nlit, ndist) < 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode a raw deflate stream to the decoder's output. Matches can't reach
+ * back past the start of the stream. The input is left on the byte
+ * boundary after the stream, so a trailer can be read with inflate_byte().
+ * @param z decoder
+ * @returns 0 on success, -1 if the stream is corrupt or doesn't fit
+ */
+int inflate_raw(struct inflate *z)
+{
+    int last, type, r;
+
+    z->window = z->pos;
+
+    do {
+        if ((last = inflate_bits(z, 1)) < 0 ||
+            (type = inflate_bits(z, 2)) < 0)
+        {
+            return -1;
+        }
+
+        switch (type) {
+        case INFLATE_STORED:
+            r = inflate_stored(z);
+            break;
+        case INFLATE_FIXED:
+            inflate_fixed(z);
+            r = inflate_codes(z);
+            break;
+        case INFLATE_DYNAMIC:
+            r = inflate_dynamic(z) < 0 ? -1 : inflate_codes(z);
+            break;
+        default:
+            r = -1;
+        }
+
+        if (r < 0) {
+            return -1;
+        }
+
+        if (z->tick != NULL && z->pos >= z->tick_at) {
+            z->tick(z);
+        }
+    } while (!last);
+
+    /* drop the rest of the last byte */
+    z->bits >>= z->nbits & 7;
+    z->nbits &= ~7;
+
+    return 0;
+}
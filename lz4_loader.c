@@ -0,0 +1,561 @@
+/*
+ * LZ4 Compressed Kernel Loader
+ *
+ * Licensed under the GNU General Public License v.2.
+ * See COPYING in the root directory of this source distribution for more
+ * details.
+ *
+ * LZ4 trades compression ratio for decode speed: a block is a run of
+ * literal copies and back references with no entropy coding, so it
+ * unpacks at close to memcpy speed. Both the LZ4 frame format and the
+ * legacy format the kernel's "lz4 -l" build produces are understood.
+ * Blocks are decoded straight to the load address, from flash in place
+ * or, for devices that can't be mapped, from a staging area at the top of
+ * RAM.
+ */
+
+#include <printf.h>
+#include <promlib.h>
+#include <string.h>
+#include <lz4_loader.h>
+
+#include <ciloio.h>
+#include <bootcache.h>
+#include <pipeline.h>
+
+/* platform-specific defines */
+#include <platform.h>
+
+#define LZ4_MAGIC 0x184d2204
+#define LZ4_LEGACY_MAGIC 0x184c2102
+#define LZ4_SKIPPABLE_MAGIC 0x184d2a50 /* low four bits are free */
+
+/* frame descriptor flags */
+#define LZ4_FLG_VERSION 0xc0
+#define LZ4_FLG_VERSION_01 0x40
+#define LZ4_FLG_BLOCK_CHECKSUM 0x10
+#define LZ4_FLG_CONTENT_SIZE 0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_RESERVED 0x02
+#define LZ4_FLG_DICT_ID 0x01
+
+#define LZ4_BLOCK_UNCOMPRESSED 0x80000000
+
+/* legacy frames: 8 MB blocks, each at worst a little larger compressed */
+#define LZ4_LEGACY_BLOCK (8 << 20)
+#define LZ4_LEGACY_BOUND (LZ4_LEGACY_BLOCK + LZ4_LEGACY_BLOCK / 255 + 16)
+
+#define LZ4_MIN_MATCH 4
+
+/* xxHash32 primes */
+#define XXH_P1 2654435761U
+#define XXH_P2 2246822519U
+#define XXH_P3 3266489917U
+#define XXH_P4 668265263U
+#define XXH_P5 374761393U
+
+#define lz4_le32(p) \
+    ((p)[0] | (p)[1] << 8 | (p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+#define xxh_rotl(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+/* where compressed data comes from */
+struct lz4_in {
+    const uint8_t *map; /* rest of the file in place, if it can be mapped */
+    struct pipe_reader rd; /* otherwise read through here... */
+    uint8_t *stage; /* ...into here */
+    uint32_t stage_len;
+    uint8_t hdr[16]; /* or, for headers read before there is a stage, here */
+    uint32_t left; /* bytes of the file not yet taken */
+};
+
+/* where decompressed data goes */
+struct lz4_out {
+    uint8_t *start; /* load address */
+    uint8_t *frame; /* start of the current frame */
+    uint8_t *pos;
+    uint8_t *end;
+};
+
+/**
+ * xxHash32 of a buffer, as used for LZ4 frame checksums.
+ */
+static uint32_t xxh32(const uint8_t *p, uint32_t len, uint32_t seed)
+{
+    const uint8_t *end = p + len;
+    uint32_t h, v1, v2, v3, v4;
+
+    if (len >= 16) {
+        v1 = seed + XXH_P1 + XXH_P2;
+        v2 = seed + XXH_P2;
+        v3 = seed;
+        v4 = seed - XXH_P1;
+
+        do {
+            v1 = xxh_rotl(v1 + lz4_le32(p) * XXH_P2, 13) * XXH_P1;
+            v2 = xxh_rotl(v2 + lz4_le32(p + 4) * XXH_P2, 13) * XXH_P1;
+            v3 = xxh_rotl(v3 + lz4_le32(p + 8) * XXH_P2, 13) * XXH_P1;
+            v4 = xxh_rotl(v4 + lz4_le32(p + 12) * XXH_P2, 13) * XXH_P1;
+            p += 16;
+        } while (end - p >= 16);
+
+        h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) +
+            xxh_rotl(v4, 18);
+    } else {
+        h = seed + XXH_P5;
+    }
+
+    h += len;
+
+    for (; end - p >= 4; p += 4) {
+        h = xxh_rotl(h + lz4_le32(p) * XXH_P3, 17) * XXH_P4;
+    }
+
+    for (; p < end; p++) {
+        h = xxh_rotl(h + *p * XXH_P5, 11) * XXH_P1;
+    }
+
+    h ^= h >> 15;
+    h *= XXH_P2;
+    h ^= h >> 13;
+    h *= XXH_P3;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/**
+ * Check if a file is an LZ4 image.
+ * @param fp the file
+ * @returns non-zero if it starts with an LZ4 frame or legacy magic
+ */
+int is_lz4(struct file *fp)
+{
+    uint8_t *p = cilo_map(fp, 0, 4);
+
+    return p != NULL &&
+        (lz4_le32(p) == LZ4_MAGIC || lz4_le32(p) == LZ4_LEGACY_MAGIC);
+}
+
+/**
+ * Take the next len bytes of the file, contiguous.
+ * @returns pointer to them, valid until the next call, or NULL if the file
+ *          ends first or they don't fit in the staging area
+ */
+static const uint8_t *lz4_take(struct lz4_in *in, uint32_t len)
+{
+    const uint8_t *p;
+
+    if (len > in->left) {
+        return NULL;
+    }
+
+    in->left -= len;
+
+    if (in->map != NULL) {
+        p = in->map;
+        in->map += len;
+        return p;
+    }
+
+    p = len <= sizeof(in->hdr) ? in->hdr : in->stage;
+
+    if (len > in->stage_len && p == in->stage) {
+        return NULL;
+    }
+
+    if (pipe_read(&in->rd, (uint8_t *)p, len) < 0) {
+        return NULL;
+    }
+
+    return p;
+}
+
+/**
+ * Make room at the top of the destination for blocks of up to len bytes
+ * read from a device that can't be mapped.
+ * @returns 0 on success, -1 if there isn't room
+ */
+static int lz4_stage(struct lz4_in *in, struct lz4_out *out, uint32_t len)
+{
+    uint8_t *stage;
+
+    if (in->map != NULL || in->stage_len >= len) {
+        return 0;
+    }
+
+    stage = (uint8_t *)(((uint32_t)out->end - len) & ~31);
+
+    if (stage < out->pos || stage > out->end) {
+        printf("\nNo room to stage %d byte LZ4 blocks.\n", len);
+        return -1;
+    }
+
+    in->stage = stage;
+    in->stage_len = len;
+    out->end = stage;
+
+    return 0;
+}
+
+/**
+ * Decode one LZ4 block. Matches may reach back into earlier blocks of the
+ * same frame.
+ * @param in compressed block
+ * @param len length of the compressed block
+ * @param out destination, advanced past the decoded data
+ * @returns 0 on success, -1 if the block is corrupt or doesn't fit
+ */
+static int lz4_block(const uint8_t *in, uint32_t len, struct lz4_out *out)
+{
+    const uint8_t *ip = in, *iend = in + len;
+    uint8_t *op = out->pos, *oend = out->end, *match;
+    uint32_t token, n, offset;
+    uint8_t b;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        /* literals */
+        n = token >> 4;
+
+        if (n == 15) {
+            do {
+                if (ip == iend) return -1;
+                b = *ip++;
+                n += b;
+            } while (b == 255);
+        }
+
+        if (n > iend - ip || n > oend - op) {
+            return -1;
+        }
+
+        memcpy(op, ip, n);
+        op += n;
+        ip += n;
+
+        /* the last sequence has no match */
+        if (ip == iend) {
+            break;
+        }
+
+        /* match */
+        if (iend - ip < 2) {
+            return -1;
+        }
+
+        offset = ip[0] | ip[1] << 8;
+        ip += 2;
+
+        if (offset == 0 || offset > op - out->frame) {
+            return -1;
+        }
+
+        n = token & 15;
+
+        if (n == 15) {
+            do {
+                if (ip == iend) return -1;
+                b = *ip++;
+                n += b;
+            } while (b == 255);
+        }
+
+        n += LZ4_MIN_MATCH;
+
+        if (n > oend - op) {
+            return -1;
+        }
+
+        match = op - offset;
+
+        if (offset >= n) {
+            memcpy(op, match, n);
+            op += n;
+        } else {
+            /* overlapping: repeats the last offset bytes */
+            while (n--) *op++ = *match++;
+        }
+    }
+
+    out->pos = op;
+
+    return 0;
+}
+
+/**
+ * Decode an LZ4 frame whose magic has been read.
+ * @returns 0 on success, -1 on error
+ */
+static int lz4_frame(struct lz4_in *in, struct lz4_out *out)
+{
+    const uint8_t *p;
+    uint8_t flg, bd, desc[15];
+    uint32_t desc_len = 2, block_max, size, len;
+    uint32_t content_len = 0;
+
+    if ((p = lz4_take(in, 2)) == NULL) {
+        return -1;
+    }
+
+    flg = desc[0] = p[0];
+    bd = desc[1] = p[1];
+
+    if ((flg & LZ4_FLG_VERSION) != LZ4_FLG_VERSION_01 ||
+        (flg & LZ4_FLG_RESERVED) || (bd & 0x8f) || (bd >> 4) < 4)
+    {
+        printf("\nUnsupported LZ4 frame descriptor %02x %02x.\n", flg, bd);
+        return -1;
+    }
+
+    block_max = 1 << (8 + 2 * (bd >> 4));
+
+    /* optional content size and dictionary ID, then the descriptor's hash */
+    len = (flg & LZ4_FLG_CONTENT_SIZE ? 8 : 0) +
+        (flg & LZ4_FLG_DICT_ID ? 4 : 0) + 1;
+
+    if ((p = lz4_take(in, len)) == NULL) {
+        return -1;
+    }
+
+    memcpy(desc + desc_len, p, len - 1);
+    desc_len += len - 1;
+
+    if (((xxh32(desc, desc_len, 0) >> 8) & 0xff) != p[len - 1]) {
+        printf("\nCorrupt LZ4 frame descriptor.\n");
+        return -1;
+    }
+
+    if (flg & LZ4_FLG_DICT_ID) {
+        printf("\nLZ4 frames with a dictionary are not supported.\n");
+        return -1;
+    }
+
+    if (flg & LZ4_FLG_CONTENT_SIZE) {
+        if (desc[6] || desc[7] || desc[8] || desc[9]) {
+            return -1;
+        }
+
+        content_len = lz4_le32(desc + 2);
+    }
+
+    if (lz4_stage(in, out, block_max + 4) < 0) {
+        return -1;
+    }
+
+    if (content_len > out->end - out->pos) {
+        printf("\nDecompressed image does not fit in memory.\n");
+        return -1;
+    }
+
+    out->frame = out->pos;
+
+    for (;;) {
+        if ((p = lz4_take(in, 4)) == NULL) {
+            return -1;
+        }
+
+        if ((size = lz4_le32(p)) == 0) {
+            break;
+        }
+
+        len = size & ~LZ4_BLOCK_UNCOMPRESSED;
+
+        if (len > block_max) {
+            return -1;
+        }
+
+        if (flg & LZ4_FLG_BLOCK_CHECKSUM) {
+            len += 4;
+        }
+
+        if ((p = lz4_take(in, len)) == NULL) {
+            return -1;
+        }
+
+        if (flg & LZ4_FLG_BLOCK_CHECKSUM) {
+            len -= 4;
+
+            if (xxh32(p, len, 0) != lz4_le32(p + len)) {
+                printf("\nLZ4 block failed its checksum.\n");
+                return -1;
+            }
+        }
+
+        if (size & LZ4_BLOCK_UNCOMPRESSED) {
+            if (len > out->end - out->pos) {
+                return -1;
+            }
+
+            memcpy(out->pos, p, len);
+            out->pos += len;
+        } else if (lz4_block(p, len, out) < 0) {
+            return -1;
+        }
+
+#ifndef NO_LOAD_PROGRESS
+        c_putc('.');
+#endif
+    }
+
+    if ((flg & LZ4_FLG_CONTENT_SIZE) && out->pos - out->frame != content_len) {
+        printf("\nLZ4 frame is not the size its header gives.\n");
+        return -1;
+    }
+
+    if (flg & LZ4_FLG_CONTENT_CHECKSUM) {
+        if ((p = lz4_take(in, 4)) == NULL) {
+            return -1;
+        }
+
+        if (xxh32(out->frame, out->pos - out->frame, 0) != lz4_le32(p)) {
+            printf("\nLZ4 frame failed its checksum.\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Decode a legacy LZ4 frame whose magic has been read. It has no end
+ * marker: it runs to the end of the file or to the next frame's magic.
+ * @param magic set to the next frame's magic, or 0 at the end of the file
+ * @returns 0 on success, -1 on error
+ */
+static int lz4_legacy(struct lz4_in *in, struct lz4_out *out,
+    uint32_t *magic)
+{
+    const uint8_t *p;
+    uint32_t len;
+
+    *magic = 0;
+
+    if (lz4_stage(in, out, LZ4_LEGACY_BOUND) < 0) {
+        return -1;
+    }
+
+    while (in->left >= 4) {
+        p = lz4_take(in, 4);
+        len = lz4_le32(p);
+
+        if (len == LZ4_MAGIC || len == LZ4_LEGACY_MAGIC ||
+            (len & ~0xf) == LZ4_SKIPPABLE_MAGIC)
+        {
+            *magic = len;
+            return 0;
+        }
+
+        if (len > LZ4_LEGACY_BOUND || (p = lz4_take(in, len)) == NULL) {
+            return -1;
+        }
+
+        /* blocks are independent, so a match can't reach behind one */
+        out->frame = out->pos;
+
+        if (lz4_block(p, len, out) < 0) {
+            return -1;
+        }
+
+#ifndef NO_LOAD_PROGRESS
+        c_putc('.');
+#endif
+    }
+
+    return 0;
+}
+
+/**
+ * Decode an LZ4 image: one or more frames, to the end of the stream.
+ * @param src stage the image comes from, taken in place if it can be mapped
+ * @param len length of the image
+ * @param dst where the output goes
+ * @param end end of the room for it, blocks read from a device that can't
+ *        be mapped are staged just below
+ * @returns bytes decoded, or -1 if the image is corrupt or doesn't fit
+ */
+int32_t lz4_decode(struct pipe_stage *src, uint32_t len, uint8_t *dst,
+    uint8_t *end)
+{
+    struct lz4_in in;
+    struct lz4_out out;
+    const uint8_t *p;
+    uint32_t magic, map_len;
+
+    in.map = src->map != NULL ? src->map(src, &map_len) : NULL;
+    in.left = len;
+    in.stage = NULL;
+    in.stage_len = 0;
+    pipe_reader_init(&in.rd, src);
+
+    out.start = out.pos = out.frame = dst;
+    out.end = end;
+
+    p = lz4_take(&in, 4);
+    magic = p ? lz4_le32(p) : 0;
+
+    /* one or more frames, to the end of the file */
+    while (magic) {
+        if (magic == LZ4_MAGIC) {
+            if (lz4_frame(&in, &out) < 0) {
+                return -1;
+            }
+        } else if (magic == LZ4_LEGACY_MAGIC) {
+            if (lz4_legacy(&in, &out, &magic) < 0) {
+                return -1;
+            }
+
+            continue;
+        } else if ((magic & ~0xf) == LZ4_SKIPPABLE_MAGIC) {
+            if ((p = lz4_take(&in, 4)) == NULL ||
+                lz4_take(&in, lz4_le32(p)) == NULL)
+            {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+
+        magic = 0;
+
+        if (in.left >= 4) {
+            p = lz4_take(&in, 4);
+            magic = lz4_le32(p);
+        }
+    }
+
+    if (in.left) {
+        return -1;
+    }
+
+    return out.pos - out.start;
+}
+
+void load_lz4(struct file *fp, uint32_t load_address, char *cmd_line)
+{
+    struct pipe_file src;
+    int32_t len;
+
+    pipe_file_init(&src, fp, 0, fp->file_len, NULL, 0);
+
+    len = lz4_decode(&src.st, fp->file_len, (uint8_t *)load_address,
+        (uint8_t *)LOAD_LIMIT);
+
+    if (len < 0) {
+        printf("\nError in decoding LZ4-compressed kernel image. Aborting.\n");
+        return;
+    }
+
+    if (cilo_verify(fp) < 0) {
+        printf("Refusing to boot an unverified kernel.\n");
+        return;
+    }
+
+    boot_cache_save(fp, cmd_line);
+
+    printf("\nDecompressed %d bytes.\n", len);
+    printf("Starting kernel at 0x%016x.\n\n", load_address);
+    ((void (*)(uint32_t mem_sz, char *cmd_line))(load_address))
+        (c_memsz(), cmd_line);
+}
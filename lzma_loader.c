@@ -5,6 +5,9 @@
  * Licensed under the GNU General Public License v.2.
  * See COPYING in the root directory of this source distribution for more
  * details.
+ *
+ * Zstandard images are loaded here as well: they decode several times
+ * faster than LZMA for a ratio not far off it.
  */
 
 #include <printf.h>
@@ -12,64 +15,166 @@
 #include <lzma_loader.h>
 
 #include <ciloio.h>
+#include <bootcache.h>
 
 /* LZMA SDK */
 #include <LzmaDecode.h>
 
+#include <pipeline.h>
+#include <zstddec.h>
+
+/* platform-specific defines */
+#include <platform.h>
+
+/* input block size when the file has to be read rather than mapped */
+#define LZMA_ASYNC_BLOCK 4096
+
+/* a dot for every this many bytes of a zstd image decoded */
+#define ZSTD_TICK 0x80000
+
+/* progress ticks over the output, a dot every 2% and the percentage every
+ * 10%. Building with -DNO_LOAD_PROGRESS keeps the decode quiet.
+ */
+#define LZMA_TICKS 50
+
+/* output position of the next tick, checked by the decoder per refill */
+UInt32 lzma_tick_at = 0xffffffff;
+static uint32_t lzma_tick_step;
+static uint32_t lzma_ticks;
+
 struct private_data {
     ILzmaInCallback callback;
-    uint8_t *buffer;
-    struct file *fp;
-    uint32_t total_read;
-    uint32_t last;
+    struct pipe_stage *in; /* stage the compressed stream is pulled from */
+};
+
+/* filter: decodes the whole stream straight into its destination on the
+ * first pull, and hands that out as a single buffer. Input that can be
+ * mapped is decoded where it sits; anything else is fed to the decoder
+ * through read_data().
+ */
+struct lzma_stage {
+    struct pipe_stage st;
+    struct private_data pvt;
+    CLzmaDecoderState *state;
+    uint8_t *out;
+    uint32_t out_size;
+    int done;
 };
 
+/**
+ * Print the ticks the decoder has passed, and set the next threshold.
+ * @param pos output position reached
+ */
+void lzma_tick(UInt32 pos)
+{
+    while (pos >= lzma_tick_at) {
+        if (++lzma_ticks == LZMA_TICKS) {
+            /* load_lzma prints the 100 once the kernel is checked */
+            lzma_tick_at = 0xffffffff;
+            return;
+        }
+
+        if (lzma_ticks % 5 == 0) {
+            printf("%d", lzma_ticks * (100 / LZMA_TICKS));
+        } else {
+            c_putc('.');
+        }
+
+        lzma_tick_at += lzma_tick_step;
+    }
+}
+
+/**
+ * Start the progress ticker for a decode.
+ * @param out_size bytes the decoder will produce
+ */
+static void lzma_tick_start(uint32_t out_size)
+{
+    lzma_tick_at = 0xffffffff;
+
+#ifndef NO_LOAD_PROGRESS
+    lzma_tick_step = out_size / LZMA_TICKS;
+    lzma_ticks = 0;
+
+    if (lzma_tick_step) {
+        lzma_tick_at = lzma_tick_step;
+    }
+
+    printf("0");
+#endif
+}
+
 int read_data(void *object, const uint8_t **buffer, uint32_t *size)
 {
     struct private_data *pvt = (struct private_data *)object;
 
-    if (cilo_tell(pvt->fp) > pvt->fp->file_len) {
-        printf("FATAL: Attempt to read past end of file. Aborting.\n");
+    if (pvt->in->pull(pvt->in, buffer, size) < 0) {
+        printf("FATAL: Error while reading compressed image. Aborting.\n");
         return LZMA_RESULT_DATA_ERROR;
     }
-    
-    *size = pvt->fp->file_len - cilo_tell(pvt->fp);
-    *size = *size > 512 ? 512 : *size;
 
-    pvt->total_read += *size;
+    return LZMA_RESULT_OK;
+}
+
+static int lzma_pull(struct pipe_stage *st, const uint8_t **buf,
+    uint32_t *len)
+{
+    struct lzma_stage *lz = (struct lzma_stage *)st;
+    const uint8_t *in = NULL;
+    uint32_t in_len, in_processed;
+    uint32_t out_processed = 0;
+    int r;
+
+    *len = 0;
 
-    uint32_t done = (pvt->total_read * 100)/pvt->fp->file_len;
-    if (done % 10 == 0 && done != pvt->last) {
-        printf("%d", done);
-        pvt->last = done;
-    } else if (done != pvt->last && done % 2 == 0) {
-        printf(".");
-        pvt->last = done;
+    if (lz->done) {
+        return 0;
     }
 
-    cilo_read(pvt->buffer, *size, 1, pvt->fp);
+    lz->done = 1;
 
-    *buffer = pvt->buffer;
+    if (st->up->map != NULL) {
+        in = st->up->map(st->up, &in_len);
+    }
 
-    return LZMA_RESULT_OK;
+    if (in != NULL) {
+        r = LzmaDecodeMem(lz->state, in, in_len, &in_processed, lz->out,
+            lz->out_size, &out_processed);
+    } else {
+        r = LzmaDecode(lz->state, (ILzmaInCallback *)&lz->pvt, lz->out,
+            lz->out_size, &out_processed);
+    }
+
+    if (r != LZMA_RESULT_OK) {
+        return -1;
+    }
+
+    *buf = lz->out;
+    *len = out_processed;
+
+    return 0;
 }
 
 void load_lzma(struct file *fp, uint32_t load_address, char *cmd_line)
 {
     CLzmaDecoderState state;
-    uint8_t buffer[512];
-    struct private_data pvt;
-    uint8_t props[LZMA_PROPERTIES_SIZE];
+    struct pipe_file src;
+    struct lzma_stage lz;
+    uint8_t bufs[2][LZMA_ASYNC_BLOCK];
+    uint8_t *props;
     
     uint32_t out_size = 0;
-    uint8_t out_size_read[4];
+    uint8_t *out_size_read;
 
-    /* seek to beginning of file */
-    cilo_seek(fp, 0, SEEK_SET);
+    /* LZMA header: properties, then a 64-bit little endian output size */
+    props = cilo_map(fp, 0, LZMA_PROPERTIES_SIZE + 8);
 
-    /* Setup LZMA decoding properties */
-    cilo_read(props, LZMA_PROPERTIES_SIZE, 1, fp);
+    if (props == NULL) {
+        printf("File too short to contain an LZMA header. Aborting.\n");
+        return;
+    }
 
+    /* Setup LZMA decoding properties */
     if (LzmaDecodeProperties(&state.Properties, props, LZMA_PROPERTIES_SIZE)
         != LZMA_RESULT_OK)
     {
@@ -78,36 +183,128 @@ void load_lzma(struct file *fp, uint32_t load_address, char *cmd_line)
     }
 
     /* read in out size */
-    cilo_read(out_size_read, 1, 4, fp);
+    out_size_read = props + LZMA_PROPERTIES_SIZE;
 
     out_size = out_size_read[0] | out_size_read[1] << 8 |
         out_size_read[2] << 16 | out_size_read[3] << 24;
 
-    cilo_seek(fp, 4, SEEK_CUR);
+    if (out_size > LOAD_LIMIT - load_address) {
+        printf("Kernel of %d bytes does not fit in memory. Aborting.\n",
+            out_size);
+        return;
+    }
 
     uint16_t probs[LzmaGetNumProbs(&state.Properties)];
-
-    /* setup structs */
-    pvt.callback.Read = read_data;
-    pvt.buffer = buffer;
-    pvt.fp = fp;
-    pvt.total_read = 0;
     state.Probs = probs;
-    pvt.last = 100;
-    
-    /* do the decoding */
-    uint32_t out_processed = 0;
 
-    int result = LzmaDecode(&state, (ILzmaInCallback *)&pvt, 
-        (uint8_t *)load_address, out_size, &out_processed);
+    /* file -> LZMA decoder -> memory */
+    pipe_file_init(&src, fp, LZMA_PROPERTIES_SIZE + 8,
+        fp->file_len - (LZMA_PROPERTIES_SIZE + 8), bufs[0],
+        LZMA_ASYNC_BLOCK);
 
-    if (result != LZMA_RESULT_OK) {
+    lz.st.pull = lzma_pull;
+    lz.st.read = NULL;
+    lz.st.map = NULL;
+    lz.st.up = &src.st;
+    lz.state = &state;
+    lz.out = (uint8_t *)load_address;
+    lz.out_size = out_size;
+    lz.done = 0;
+
+    lz.pvt.callback.Read = read_data;
+    lz.pvt.in = &src.st;
+
+    lzma_tick_start(out_size);
+
+    if (pipe_to_memory(&lz.st, (void *)load_address, out_size) < 0) {
         printf("\nError in decoding LZMA-compressed kernel image. Aborting.\n");
         return;
     }
 
+    if (cilo_verify(fp) < 0) {
+        printf("Refusing to boot an unverified kernel.\n");
+        return;
+    }
+
+    boot_cache_save(fp, cmd_line);
+
     /* kick into kernel: */
-    printf("100\nStarting kernel at 0x%016x.\n\n", load_address);
+#ifndef NO_LOAD_PROGRESS
+    printf("100\n");
+#endif
+    printf("Starting kernel at 0x%016x.\n\n", load_address);
+    ((void (*)(uint32_t mem_sz, char *cmd_line))(load_address))
+        (c_memsz(), cmd_line);
+}
+
+/**
+ * Check if a file is a Zstandard image.
+ * @param fp the file
+ * @returns non-zero if it starts with a zstd frame
+ */
+int is_zstd(struct file *fp)
+{
+    uint8_t *p = cilo_map(fp, 0, 4);
+
+    return p != NULL && (p[0] | p[1] << 8 | p[2] << 16 |
+        (uint32_t)p[3] << 24) == ZSTD_MAGIC;
+}
+
+/**
+ * Print a dot for each ZSTD_TICK bytes decoded.
+ */
+static void zstd_tick(struct zstd_dec *d)
+{
+    while (d->pos >= d->tick_at) {
+        c_putc('.');
+        d->tick_at += ZSTD_TICK;
+    }
+}
+
+void load_zstd(struct file *fp, uint32_t load_address, char *cmd_line)
+{
+    struct pipe_file src;
+    struct zstd_dec *d;
+    uint8_t bufs[2][LZMA_ASYNC_BLOCK];
+
+    pipe_file_init(&src, fp, 0, fp->file_len, bufs[0], LZMA_ASYNC_BLOCK);
+
+    /* the decoder goes at the top of RAM, with room below it to gather
+     * blocks in if the file can't be mapped. The kernel is decoded straight
+     * to its load address and gets whatever is left.
+     */
+    d = (struct zstd_dec *)((LOAD_LIMIT - sizeof(*d)) & ~31);
+    zstd_dec_init(d, &src.st, (uint8_t *)load_address, (uint8_t *)d);
+
+    if (d->in == NULL) {
+        d->block = (uint8_t *)d - ZSTD_BLOCK_MAX;
+        d->out_end = d->block;
+    }
+
+    if (d->out_end <= (uint8_t *)load_address) {
+        printf("Not enough memory to decode a zstd image. Aborting.\n");
+        return;
+    }
+
+#ifndef NO_LOAD_PROGRESS
+    d->tick = zstd_tick;
+    d->tick_at = (uint8_t *)load_address + ZSTD_TICK;
+#endif
+
+    if (zstd_decode(d) < 0) {
+        printf("Aborting.\n");
+        return;
+    }
+
+    if (cilo_verify(fp) < 0) {
+        printf("Refusing to boot an unverified kernel.\n");
+        return;
+    }
+
+    boot_cache_save(fp, cmd_line);
+
+    printf("\nDecompressed %d bytes.\n", d->pos - (uint8_t *)load_address);
+    printf("Starting kernel at 0x%016x.\n\n", load_address);
     ((void (*)(uint32_t mem_sz, char *cmd_line))(load_address))
         (c_memsz(), cmd_line);
 }
@@ -0,0 +1,523 @@
+/* LZMA and LZMA2 decoder
+ * Licensed under the GNU General Public License v2
+ *
+ * A decoder for the LZMA2 streams inside .xz files, which LzmaDecode.c
+ * (LZMA SDK 4.40) can't read. LZMA2 splits the data into chunks that each
+ * start a new range coder and may reset the dictionary, the LZMA state or
+ * the properties; this code follows the format as implemented by the LZMA
+ * SDK's LzmaDec/Lzma2Dec and by XZ Embedded.
+ *
+ * Output goes straight to its final address and that memory is the
+ * dictionary, so matches are copied within the destination. Input comes a
+ * buffer at a time from a pipeline stage, or in one piece if the stage can
+ * map it.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <pipeline.h>
+#include <lzmadec.h>
+
+#define LZMA_RC_TOP (1 << 24)
+#define LZMA_PROB_BITS 11
+#define LZMA_PROB_INIT (1 << (LZMA_PROB_BITS - 1))
+#define LZMA_MOVE_BITS 5
+
+/* largest properties byte: pb = 4, lp = 4, lc = 8 */
+#define LZMA_PROPS_MAX ((4 * 5 + 4) * 9 + 8)
+
+/**
+ * Take the next buffer of input from the source.
+ * @returns 0 on success, -1 at the end of the input or on error
+ */
+static int lzma_dec_refill(struct lzma_dec *d)
+{
+    const uint8_t *buf;
+    uint32_t len;
+
+    if (d->src->pull(d->src, &buf, &len) < 0 || len == 0) {
+        return -1;
+    }
+
+    d->in = buf;
+    d->in_end = buf + len;
+    d->in_total += len;
+
+    return 0;
+}
+
+/**
+ * Set up a decoder.
+ * @param d decoder to set up
+ * @param probs probability tables, which are large enough that the caller
+ *        chooses where they live
+ * @param src stage the compressed data is pulled from
+ * @param out destination of the decoded data
+ * @param out_max most bytes the destination can take
+ */
+void lzma_dec_init(struct lzma_dec *d, struct lzma_probs *probs,
+    struct pipe_stage *src, uint8_t *out, uint32_t out_max)
+{
+    const uint8_t *buf = NULL;
+    uint32_t len;
+
+    d->src = src;
+    d->in = NULL;
+    d->in_end = NULL;
+    d->in_total = 0;
+
+    /* take all of the input in place if it can be mapped */
+    if (src->map != NULL && (buf = src->map(src, &len)) != NULL) {
+        d->in = buf;
+        d->in_end = buf + len;
+        d->in_total = len;
+    }
+
+    d->dict = out;
+    d->pos = 0;
+    d->out_end = out + out_max;
+    d->probs = probs;
+
+    d->tick = NULL;
+    d->tick_at = NULL;
+}
+
+/**
+ * Take a byte of input outside of the compressed data, e.g. a header.
+ * @returns the byte, or -1 at the end of the input
+ */
+int lzma_dec_byte(struct lzma_dec *d)
+{
+    if (d->in == d->in_end && lzma_dec_refill(d) < 0) {
+        return -1;
+    }
+
+    return *d->in++;
+}
+
+/**
+ * Reset the LZMA state and probabilities.
+ */
+static void lzma_reset(struct lzma_dec *d)
+{
+    uint16_t *p = (uint16_t *)d->probs;
+    uint32_t i;
+
+    d->state = 0;
+    d->rep0 = d->rep1 = d->rep2 = d->rep3 = 0;
+
+    for (i = 0; i < sizeof(struct lzma_probs) / sizeof(uint16_t); i++) {
+        p[i] = LZMA_PROB_INIT;
+    }
+}
+
+/**
+ * Take new lc/lp/pb properties from a properties byte.
+ * @returns 0 on success, -1 if they are out of range for LZMA2
+ */
+static int lzma_props(struct lzma_dec *d, uint32_t props)
+{
+    uint32_t lc, lp, pb;
+
+    if (props > LZMA_PROPS_MAX) {
+        return -1;
+    }
+
+    pb = props / 45;
+    props %= 45;
+    lp = props / 9;
+    lc = props % 9;
+
+    if (lc + lp > 4 || pb > 4) {
+        return -1;
+    }
+
+    d->lc = lc;
+    d->lp_mask = (1 << lp) - 1;
+    d->pb_mask = (1 << pb) - 1;
+
+    return 0;
+}
+
+/* range coder, working on the locals of lzma_chunk() */
+#define RC_NORMALIZE \
+    if (range < LZMA_RC_TOP) { \
+        if (in == in_end) { \
+            d->in = in; \
+            if (lzma_dec_refill(d) < 0) return -1; \
+            in = d->in; \
+            in_end = d->in_end; \
+        } \
+        range <<= 8; \
+        code = (code << 8) | *in++; \
+    }
+
+#define RC_BIT(p, b) { \
+        uint32_t bound; \
+        RC_NORMALIZE; \
+        bound = (range >> LZMA_PROB_BITS) * *(p); \
+        if (code < bound) { \
+            range = bound; \
+            *(p) += ((1 << LZMA_PROB_BITS) - *(p)) >> LZMA_MOVE_BITS; \
+            b = 0; \
+        } else { \
+            range -= bound; \
+            code -= bound; \
+            *(p) -= *(p) >> LZMA_MOVE_BITS; \
+            b = 1; \
+        } \
+    }
+
+#define RC_BITTREE(probs, limit, s) { \
+        s = 1; \
+        do { \
+            RC_BIT(&(probs)[s], bit); \
+            s = (s << 1) + bit; \
+        } while (s < (limit)); \
+    }
+
+#define RC_BITTREE_REVERSE(probs, bits, dest) { \
+        uint32_t rs = 1, ri = 0; \
+        do { \
+            RC_BIT(&(probs)[rs], bit); \
+            rs = (rs << 1) + bit; \
+            dest += bit << ri; \
+        } while (++ri < (bits)); \
+    }
+
+#define RC_DIRECT(bits, dest) { \
+        uint32_t rn = (bits), mask; \
+        do { \
+            RC_NORMALIZE; \
+            range >>= 1; \
+            code -= range; \
+            mask = 0 - (code >> 31); \
+            code += range & mask; \
+            dest = (dest << 1) + (mask + 1); \
+        } while (--rn); \
+    }
+
+/* match length, 2 to 273 */
+#define RC_LEN(l, pos_state, len) { \
+        RC_BIT(&(l)->choice, bit); \
+        if (!bit) { \
+            RC_BITTREE((l)->low[pos_state], 8, sym); \
+            len = 2 + sym - 8; \
+        } else { \
+            RC_BIT(&(l)->choice2, bit); \
+            if (!bit) { \
+                RC_BITTREE((l)->mid[pos_state], 8, sym); \
+                len = 2 + 8 + sym - 8; \
+            } else { \
+                RC_BITTREE((l)->high, 256, sym); \
+                len = 2 + 16 + sym - 256; \
+            } \
+        } \
+    }
+
+/**
+ * Decode LZMA data until the dictionary holds limit bytes. Matches may
+ * not reach before the start of the dictionary or past the limit.
+ * @returns 0 on success, -1 if the data is corrupt or ends early
+ */
+static int lzma_chunk(struct lzma_dec *d, uint32_t limit)
+{
+    struct lzma_probs *p = d->probs;
+    const uint8_t *in = d->in, *in_end = d->in_end;
+    uint32_t range = d->range, code = d->code;
+    uint32_t state = d->state;
+    uint32_t rep0 = d->rep0, rep1 = d->rep1, rep2 = d->rep2, rep3 = d->rep3;
+    uint8_t *dict = d->dict;
+    uint32_t pos = d->pos;
+    uint32_t pos_state, sym, bit, len, tmp;
+    uint16_t *probs;
+    uint8_t *src, *dst;
+
+    while (pos < limit) {
+        pos_state = pos & d->pb_mask;
+
+        RC_BIT(&p->is_match[state][pos_state], bit);
+
+        if (!bit) {
+            probs = p->literal[((pos & d->lp_mask) << d->lc) +
+                (pos ? dict[pos - 1] >> (8 - d->lc) : 0)];
+
+            if (state < 7) {
+                RC_BITTREE(probs, 0x100, sym);
+            } else {
+                /* after a match, guided by the byte at rep0 */
+                uint32_t match_byte, match_bit, offset = 0x100;
+
+                if (rep0 >= pos) return -1;
+                match_byte = dict[pos - rep0 - 1];
+
+                sym = 1;
+                do {
+                    match_byte <<= 1;
+                    match_bit = match_byte & offset;
+                    RC_BIT(&probs[offset + match_bit + sym], bit);
+                    sym = (sym << 1) + bit;
+                    offset &= bit ? match_bit : ~match_bit;
+                } while (sym < 0x100);
+            }
+
+            dict[pos++] = sym;
+            state = state < 4 ? 0 : (state < 10 ? state - 3 : state - 6);
+            continue;
+        }
+
+        RC_BIT(&p->is_rep[state], bit);
+
+        if (!bit) {
+            /* a match at a new distance */
+            state = state < 7 ? 7 : 10;
+            rep3 = rep2;
+            rep2 = rep1;
+            rep1 = rep0;
+
+            RC_LEN(&p->match_len, pos_state, len);
+
+            tmp = len < LZMA_DIST_STATES + 2 ? len - 2 : LZMA_DIST_STATES - 1;
+            RC_BITTREE(p->dist_slot[tmp], LZMA_DIST_SLOTS, sym);
+            sym -= LZMA_DIST_SLOTS;
+
+            if (sym < 4) {
+                rep0 = sym;
+            } else {
+                tmp = (sym >> 1) - 1;
+                rep0 = 2 + (sym & 1);
+
+                if (sym < LZMA_DIST_MODEL_END) {
+                    rep0 <<= tmp;
+                    probs = p->dist_special + rep0 - sym - 1;
+                    RC_BITTREE_REVERSE(probs, tmp, rep0);
+                } else {
+                    RC_DIRECT(tmp - LZMA_ALIGN_BITS, rep0);
+                    rep0 <<= LZMA_ALIGN_BITS;
+                    RC_BITTREE_REVERSE(p->dist_align, LZMA_ALIGN_BITS, rep0);
+                }
+            }
+        } else {
+            /* a match at one of the last four distances */
+            RC_BIT(&p->is_rep0[state], bit);
+
+            if (!bit) {
+                RC_BIT(&p->is_rep0_long[state][pos_state], bit);
+
+                if (!bit) {
+                    /* a single byte from rep0 */
+                    state = state < 7 ? 9 : 11;
+
+                    if (rep0 >= pos) return -1;
+                    dict[pos] = dict[pos - rep0 - 1];
+                    pos++;
+                    continue;
+                }
+            } else {
+                RC_BIT(&p->is_rep1[state], bit);
+
+                if (!bit) {
+                    tmp = rep1;
+                } else {
+                    RC_BIT(&p->is_rep2[state], bit);
+
+                    if (!bit) {
+                        tmp = rep2;
+                    } else {
+                        tmp = rep3;
+                        rep3 = rep2;
+                    }
+
+                    rep2 = rep1;
+                }
+
+                rep1 = rep0;
+                rep0 = tmp;
+            }
+
+            state = state < 7 ? 8 : 11;
+            RC_LEN(&p->rep_len, pos_state, len);
+        }
+
+        /* this also catches the end marker, which LZMA2 doesn't allow */
+        if (rep0 >= pos || len > limit - pos) {
+            return -1;
+        }
+
+        src = dict + pos - rep0 - 1;
+        dst = dict + pos;
+        pos += len;
+
+        do {
+            *dst++ = *src++;
+        } while (--len);
+    }
+
+    RC_NORMALIZE;
+
+    d->in = in;
+    d->range = range;
+    d->code = code;
+    d->state = state;
+    d->rep0 = rep0;
+    d->rep1 = rep1;
+    d->rep2 = rep2;
+    d->rep3 = rep3;
+    d->pos = pos;
+
+    return 0;
+}
+
+/**
+ * Copy an uncompressed LZMA2 chunk into the dictionary.
+ * @returns 0 on success, -1 if the input ends early
+ */
+static int lzma2_copy(struct lzma_dec *d, uint32_t len)
+{
+    uint32_t n;
+
+    while (len) {
+        if (d->in == d->in_end && lzma_dec_refill(d) < 0) {
+            return -1;
+        }
+
+        n = d->in_end - d->in;
+        if (n > len) n = len;
+
+        memcpy(d->dict + d->pos, d->in, n);
+        d->in += n;
+        d->pos += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode an LZMA2 chunk of LZMA data.
+ * @param d decoder
+ * @param control the chunk's control byte
+ * @param unpacked bytes the chunk decodes to
+ * @param hdr the size bytes that followed the control byte
+ * @param need_props set until a chunk has given properties; cleared here
+ * @returns 0 on success, -1 if the chunk is corrupt
+ */
+static int lzma2_chunk(struct lzma_dec *d, int control, uint32_t unpacked,
+    const int *hdr, int *need_props)
+{
+    uint32_t packed = (hdr[2] << 8) + hdr[3] + 1;
+    uint32_t start;
+    int c, i;
+
+    if (control >= 0xc0) {
+        /* new properties, which also reset the state */
+        if ((c = lzma_dec_byte(d)) < 0 || lzma_props(d, c) < 0) {
+            return -1;
+        }
+
+        *need_props = 0;
+        lzma_reset(d);
+    } else if (*need_props) {
+        return -1;
+    } else if (control >= 0xa0) {
+        lzma_reset(d);
+    }
+
+    /* each chunk starts a new range coder */
+    start = lzma_dec_consumed(d);
+
+    if (lzma_dec_byte(d) != 0x00) {
+        return -1;
+    }
+
+    d->code = 0;
+    d->range = 0xffffffff;
+
+    for (i = 0; i < 4; i++) {
+        if ((c = lzma_dec_byte(d)) < 0) {
+            return -1;
+        }
+
+        d->code = (d->code << 8) | c;
+    }
+
+    if (lzma_chunk(d, d->pos + unpacked) < 0) {
+        return -1;
+    }
+
+    /* the chunk must use exactly its input and leave the coder flushed */
+    if (lzma_dec_consumed(d) - start != packed || d->code != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode an LZMA2 stream to the decoder's output, up to and including its
+ * end marker. The output follows on from anything decoded before.
+ * @param d decoder
+ * @returns 0 on success, -1 if the stream is corrupt or doesn't fit
+ */
+int lzma2_decode(struct lzma_dec *d)
+{
+    int c, i, need_dict_reset = 1, need_props = 1;
+    uint32_t unpacked;
+    int hdr[4];
+
+    for (;;) {
+        if ((c = lzma_dec_byte(d)) < 0) {
+            return -1;
+        }
+
+        if (c == 0x00) {
+            return 0;
+        }
+
+        if (c >= 0xe0 || c == 0x01) {
+            /* dictionary reset: nothing before here can be referenced */
+            need_props = 1;
+            need_dict_reset = 0;
+            d->dict += d->pos;
+            d->pos = 0;
+        } else if (need_dict_reset) {
+            return -1;
+        }
+
+        if (c < 0x80 && c > 0x02) {
+            return -1;
+        }
+
+        /* sizes: 21 bits unpacked and 16 bits packed for LZMA chunks, just
+         * 16 bits unpacked for uncompressed ones; all are stored minus one */
+        for (i = 0; i < (c >= 0x80 ? 4 : 2); i++) {
+            if ((hdr[i] = lzma_dec_byte(d)) < 0) {
+                return -1;
+            }
+        }
+
+        if (c < 0x80) {
+            unpacked = (hdr[0] << 8) + hdr[1] + 1;
+        } else {
+            unpacked = ((c & 0x1f) << 16) + (hdr[0] << 8) + hdr[1] + 1;
+        }
+
+        if (unpacked > d->out_end - lzma_dec_out(d)) {
+            printf("\nDecompressed image does not fit in memory.\n");
+            return -1;
+        }
+
+        if (c < 0x80) {
+            if (lzma2_copy(d, unpacked) < 0) {
+                return -1;
+            }
+        } else if (lzma2_chunk(d, c, unpacked, hdr, &need_props) < 0) {
+            return -1;
+        }
+
+        if (d->tick != NULL && lzma_dec_out(d) >= d->tick_at) {
+            d->tick(d);
+        }
+    }
+}
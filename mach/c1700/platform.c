@@ -7,7 +7,13 @@
 #include <types.h>
 #include <mach/c1700/platform.h>
 #include <mach/c1700/platio.h>
+#include <storage/storage.h>
 #include <printf.h>
+#include <string.h>
+
+/* copy routine and cache sync in chain.S */
+extern char chain_stub[], chain_stub_end[];
+void chain_sync(const void *addr, uint32_t len);
 
 /**
  * perform hardware-specifc initialization for this platform
@@ -17,36 +23,35 @@ void platform_init()
 }
 
 /**
- * Perform a sanity check on flash
- * @returns 0 if no flash found, number of flash devices found otherwise
+ * Register the storage devices of this platform. Nothing is probed until
+ * check_flash(), or until a file is opened on a device.
  */
-uint32_t check_flash()
+void register_storage()
 {
-    uint32_t *ptr = (uint32_t *)FLASH_BASE;
-
-    if (*ptr != FS_FILE_MAGIC) {
-        return 0;
+    if (platio_init() < 0) {
+        return;
     }
 
-    return 1;
+    register_storage_class(&flash_storage);
     /* TODO: add support for PCMCIA flash */
 }
 
 /**
- * print a directory listing of the 'main' flash device in the system
+ * Perform a sanity check on flash
+ * @returns 0 if no flash found, number of flash devices found otherwise
+ */
+uint32_t check_flash()
+{
+    return storage_probe_all();
+}
+
+/**
+ * print a directory listing of the flash devices in the system
  */
 
 void flash_directory()
 {
-    struct fs_ent *f = (struct fs_ent *)FLASH_BASE;
-    uint32_t offset = 0;
-
-    /* Iterate over the files; f->magic is 0 if an invalid file is found. */
-    while (f->magic == FS_FILE_MAGIC) {
-        printf("%s\n", f->filename);
-        offset += sizeof(struct fs_ent) + f->length;
-        f = (struct fs_ent *)(FLASH_BASE + offset);
-    }
+    storage_list();
 }
 
 /**
@@ -73,3 +78,25 @@ void stage_two(uint32_t kern_off, uint32_t kern_entry, uint32_t kern_size,
         (kern_off, kern_size, kern_entry, kern_loadpt);
     
 }
+
+/**
+ * Start an image that runs where CILO does. chain_stub, which moves the
+ * image into place and makes it visible to instruction fetch, is copied
+ * clear of both copies of the image first.
+ * @param stub room for the copy routine, clear of both copies of the image
+ * @param dst where the image runs
+ * @param src where the image is, dst if it is in place already
+ * @param len size of the image, a multiple of four
+ * @param entry entry point of the image
+ */
+void platform_chain(void *stub, uint32_t dst, const void *src, uint32_t len,
+    uint32_t entry)
+{
+    uint32_t n = chain_stub_end - chain_stub;
+
+    memcpy(stub, chain_stub, n);
+    chain_sync(stub, n);
+
+    ((void (*)(uint32_t, const void *, uint32_t, uint32_t))stub)
+        (dst, src, len, entry);
+}
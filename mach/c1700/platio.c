@@ -7,72 +7,117 @@
 #include <mach/c1700/platio.h>
 #include <ciloio.h>
 #include <string.h>
+#include <printf.h>
 
 #include <mach/c1700/platform.h>
 
-/* find file in filesystem starting at base */
-struct fs_ent *find_file(const char *filename, uint32_t base)
+/* index of the files on flash, built by check_flash(); see platio_init() */
+struct fs_index *flash_index;
+
+/**
+ * Walk the flash filesystem once and record every file in flash_index
+ * @returns number of files found
+ */
+uint32_t platio_index_flash(void)
 {
-    /* Actual file offset */
     uint32_t offset = 0;
+    struct fs_ent *f = (struct fs_ent *)FLASH_BASE;
 
-    struct fs_ent *f = (struct fs_ent *)(base + offset);
+    fs_index_init(flash_index, FLASH_BASE);
 
     /* iterate over files in flash */
     while (f->magic == FS_FILE_MAGIC) {
-        if (!strncmp(f->filename, filename, 48)) {
-            return f;
+        if (!fs_index_add(flash_index, f->filename, sizeof(f->filename),
+            offset, f->length, f->crc32, f->date))
+        {
+            break;
         }
 
         offset += sizeof(struct fs_ent) + f->length;
-        f = (struct fs_ent *)(base + offset);
+        f = (struct fs_ent *)(FLASH_BASE + offset);
+    }
+
+    return flash_index->count;
+}
+
+/* find file in the indexed filesystem starting at base */
+struct fs_ent *find_file(const char *filename, uint32_t base)
+{
+    struct fs_index_ent *e;
+
+    if (base != flash_index->base) {
+        return NULL;
+    }
+
+    if ((e = fs_index_lookup(flash_index, filename)) == NULL) {
+        return NULL;
     }
 
-    return NULL;
+    return (struct fs_ent *)(base + e->offset);
 }
 
 /**
- * Find a file within the platform-supported I/O devices
+ * Find a file on flash
  * @param filename the file
- * @returns 0 on failure, device ID number on success
+ * @returns 0 on failure, 1 on success
  */
 uint8_t platio_find_file(const char *filename)
 {
-    if (find_file(filename, FLASH_BASE)) {
+    if (fs_index_lookup(flash_index, filename)) {
         return 1;
     }
-    /* todo: add support for PCMCIA devices */
 
     return 0;
 }
 
 /**
- * Open a file.
+ * Probe the flash device by indexing its filesystem
+ * @param sto the flash storage class
+ * @returns non-zero if any files were found
+ */
+uint32_t platio_probe(struct storage_class *sto)
+{
+    return platio_index_flash();
+}
+
+/**
+ * Look up a file on flash and fill in the file structure.
+ * @param sto the flash storage class
  * @param fp File structure to hold file information
  * @param filename name of the file
+ * @returns non-zero if the file was found
  */
-void platio_file_open(struct file *fp, const char *filename)
+int platio_lookup(struct storage_class *sto, struct file *fp,
+    const char *filename)
 {
-    struct fs_ent *ent = find_file(filename, FLASH_BASE);
+    struct fs_index_ent *e = fs_index_lookup(flash_index, filename);
 
-    if (ent == NULL) {
-        fp->code = 0;
-        fp->private = NULL;
-        return;
+    if (e == NULL) {
+        return 0;
     }
 
-    fp->dev = 1; /* TODO: add support for PCMCIA flash */
-
-    fp->private = (void *)ent;
+    fp->private = (void *)(flash_index->base + e->offset);
 
-    fp->file_len = ent->length;
+    fp->file_len = e->length;
     fp->file_pos = 0;
 
     /* copy the filename */
-    strncpy(fp->filename, ent->filename, 48);
+    strncpy(fp->filename, e->filename, 48);
 
-    fp->code = 1;
-    
+    return 1;
+}
+
+/**
+ * Print a directory listing of flash
+ * @param sto the flash storage class
+ */
+void platio_list(struct storage_class *sto)
+{
+    uint32_t i;
+
+    for (i = 0; i < flash_index->count; i++) {
+        printf("%s\n", flash_index->ents[i].filename);
+    }
 }
 
 /**
@@ -96,3 +141,69 @@ uint32_t platio_read(void *pbuf, uint32_t size, uint32_t nmemb, struct file *fp)
     return nmemb * size;
 
 }
+
+/**
+ * Map a range of a file into the address space. Flash is directly
+ * addressable, so this is just the address of the data.
+ * @param fp file to map
+ * @param offset offset of the first byte within the file
+ * @param len number of bytes that will be accessed
+ * @returns pointer to the data, or NULL if it can't be mapped
+ */
+void *platio_map(struct file *fp, uint32_t offset, uint32_t len)
+{
+    return (void *)((uint32_t)(fp->private) + sizeof(struct fs_ent) + offset);
+}
+
+/**
+ * Start an asynchronous read. Flash is read by the CPU, so the request
+ * completes before this returns.
+ * @param req the request; req->fp, req->buf, req->offset and req->len are set
+ * @returns 1 if the request completed, 0 if it is in progress, < 0 on error
+ */
+int platio_read_async(struct cilo_req *req)
+{
+    memcpy(req->buf, platio_map(req->fp, req->offset, req->len), req->len);
+
+    return 1;
+}
+
+/**
+ * Check on a request started by platio_read_async()
+ * @param req the request
+ * @returns 1 if the request completed, 0 if it is in progress, < 0 on error
+ */
+int platio_poll(struct cilo_req *req)
+{
+    return 1;
+}
+
+static struct storage_ops flash_ops = {
+    .probe = platio_probe,
+    .lookup = platio_lookup,
+    .read = platio_read,
+    .map = platio_map,
+    .list = platio_list,
+    .read_async = platio_read_async,
+    .poll = platio_poll,
+};
+
+/* the on-board flash, registered by register_storage() */
+struct storage_class flash_storage = {
+    .dev_name = "flash",
+    .start_addr = FLASH_BASE,
+    .ops = &flash_ops,
+};
+
+/**
+ * Allocate the file index, which is too big for CILO's BSS
+ * @returns 0 on success, -1 if there isn't the memory
+ */
+int platio_init(void)
+{
+    if ((flash_index = cilo_alloc(sizeof(struct fs_index))) == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
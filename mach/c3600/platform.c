@@ -1,7 +1,14 @@
 #include <types.h>
 #include <mach/c3600/platform.h>
 #include <mach/c3600/platio.h>
+#include <storage/storage.h>
 #include <printf.h>
+#include <string.h>
+#include <addr.h>
+#include <asm/r4kcache.h>
+
+/* copy routine in chain.S */
+extern char chain_stub[], chain_stub_end[];
 
 /**
  * perform hardware-specifc initialization for this platform
@@ -10,35 +17,62 @@ void platform_init()
 {
 }
 
+/**
+ * Register the storage devices of this platform. Nothing is probed until
+ * check_flash(), or until a file is opened on a device.
+ */
+void register_storage()
+{
+    if (platio_init() < 0) {
+        return;
+    }
+
+    register_storage_class(&flash_storage);
+#ifdef PCMCIA
+    register_storage_class(&slot_storage[0]);
+    register_storage_class(&slot_storage[1]);
+#endif
+}
+
 /**
  * Perform a sanity check on flash
  * @returns 0 if no flash found, number of flash devices found otherwise
  */
 uint32_t check_flash()
 {
-    uint32_t *ptr = (uint32_t *)FLASH_BASE;
-
-    if (*ptr != FS_FILE_MAGIC) {
-        return 0;
-    }
-
-    return 1;
-    /* TODO: add support for PCMCIA flash */
+    return storage_probe_all();
 }
 
 /**
- * print a directory listing of the 'main' flash device in the system
+ * print a directory listing of the flash devices in the system
  */
 
 void flash_directory()
 {
-    struct fs_ent *f = (struct fs_ent *)FLASH_BASE;
-    uint32_t offset = 0;
-
-    /* Iterate over the files; f->magic is 0 if an invalid file is found. */
-    while (f->magic == FS_FILE_MAGIC) {
-        printf("%s\n", f->filename);
-        offset += sizeof(struct fs_ent) + f->length;
-        f = (struct fs_ent *)(FLASH_BASE + offset);
-    }
+    storage_list();
+}
+
+/**
+ * Start an image that runs where CILO does. A copy of chain_stub, which
+ * moves the image into place and cleans up the caches, is run uncached
+ * from KSEG1 so that nothing it does to memory or the caches can pull the
+ * ground from under it.
+ * @param stub room for the copy routine, clear of both copies of the image
+ * @param dst where the image runs
+ * @param src where the image is, dst if it is in place already
+ * @param len size of the image, a multiple of four
+ * @param entry entry point of the image
+ */
+void platform_chain(void *stub, uint32_t dst, const void *src, uint32_t len,
+    uint32_t entry)
+{
+    void (*copy)(uint32_t, const void *, uint32_t, uint32_t);
+
+    /* no dirty line may be written back over the routine or the image */
+    dcache_wback_inv_all();
+
+    copy = (void *)KSEG0_TO_KSEG132((uint32_t)stub);
+    memcpy(copy, chain_stub, chain_stub_end - chain_stub);
+
+    copy(dst, src, len, entry);
 }
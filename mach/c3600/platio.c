@@ -7,72 +7,205 @@
 #include <mach/c3600/platio.h>
 #include <ciloio.h>
 #include <string.h>
+#include <printf.h>
 
 #include <mach/c3600/platform.h>
+#include <asm/r4ktlb.h>
 
-/* find file in filesystem starting at base */
-struct fs_ent *find_file(const char *filename, uint32_t base)
+/* index of the files on flash, built by check_flash(); see platio_init() */
+struct fs_index *flash_index;
+
+static const uint32_t slot_phys[PCMCIA_SLOTS] = {
+    PCMCIA_SLOT0_PHYS, PCMCIA_SLOT1_PHYS
+};
+
+/* offsets at which a card's filesystem may start */
+static const uint32_t slot_fs_offsets[] = { 0 };
+
+/* cards are read through the cache unless built with -DFLASH_UNCACHED */
+#ifdef FLASH_UNCACHED
+#define PCMCIA_CCA CONF_CM_UNCACHED
+#else
+#define PCMCIA_CCA CONF_CM_CACHABLE_NONCOHERENT
+#endif
+
+/**
+ * Walk a flash filesystem once and record every file in an index
+ * @param idx index to fill in
+ * @param base address of the first fs_ent
+ * @param size number of bytes that can be read from base
+ * @returns number of files found
+ */
+static uint32_t platio_index(struct fs_index *idx, uint32_t base,
+    uint32_t size)
 {
-    /* Actual file offset */
     uint32_t offset = 0;
+    struct fs_ent *f = (struct fs_ent *)base;
 
-    struct fs_ent *f = (struct fs_ent *)(base + offset);
+    fs_index_init(idx, base);
 
     /* iterate over files in flash */
-    while (f->magic == FS_FILE_MAGIC) {
-        if (!strncmp(f->filename, filename, 48)) {
-            return f;
+    while (size - offset >= sizeof(struct fs_ent) &&
+        f->magic == FS_FILE_MAGIC)
+    {
+        if (f->length > size - offset - sizeof(struct fs_ent)) {
+            break;
+        }
+
+        if (!fs_index_add(idx, f->filename, sizeof(f->filename),
+            offset, f->length, f->crc32, f->date))
+        {
+            break;
         }
 
         offset += sizeof(struct fs_ent) + f->length;
         f = (struct fs_ent *)(base + offset);
     }
 
-    return NULL;
+    return idx->count;
+}
+
+/**
+ * Walk the flash filesystem once and record every file in flash_index.
+ * The size of the on-board flash isn't known, so the walk only stops at
+ * the first empty entry.
+ * @returns number of files found
+ */
+uint32_t platio_index_flash(void)
+{
+    return platio_index(flash_index, FLASH_BASE, 0xFFFFFFFF - FLASH_BASE);
+}
+
+/* find file in the indexed filesystem starting at base */
+struct fs_ent *find_file(const char *filename, uint32_t base)
+{
+    struct fs_index_ent *e;
+
+    if (base != flash_index->base) {
+        return NULL;
+    }
+
+    if ((e = fs_index_lookup(flash_index, filename)) == NULL) {
+        return NULL;
+    }
+
+    return (struct fs_ent *)(base + e->offset);
 }
 
 /**
- * Find a file within the platform-supported I/O devices
+ * Find a file on flash
  * @param filename the file
- * @returns 0 on failure, device ID number on success
+ * @returns 0 on failure, 1 on success
  */
 uint8_t platio_find_file(const char *filename)
 {
-    if (find_file(filename, FLASH_BASE)) {
+    if (fs_index_lookup(flash_index, filename)) {
         return 1;
     }
-    /* todo: add support for PCMCIA devices */
 
     return 0;
 }
 
 /**
- * Open a file.
+ * Probe the flash device by indexing its filesystem
+ * @param sto the flash storage class
+ * @returns non-zero if any files were found
+ */
+uint32_t platio_probe(struct storage_class *sto)
+{
+    return platio_index_flash();
+}
+
+/**
+ * Ask the PCMCIA controller whether there is a card in a slot
+ * @param slot the slot
+ * @returns non-zero if a card is fully inserted
+ */
+static int platio_card_present(uint32_t slot)
+{
+#ifdef PCMCIA
+    *(volatile uint8_t *)PCMCIA_EXCA_INDEX =
+        slot * EXCA_SOCKET_REGS + EXCA_STATUS;
+
+    return (*(volatile uint8_t *)PCMCIA_EXCA_DATA & EXCA_STATUS_CD) ==
+        EXCA_STATUS_CD;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Probe a PCMCIA slot for a linear flash card: if the controller reports
+ * a card, map the card window and index the filesystem on the card, if
+ * there is one.
+ * @param sto the slot's storage class
+ * @returns non-zero if any files were found
+ */
+uint32_t platio_slot_probe(struct storage_class *sto)
+{
+    uint32_t i, off;
+
+    if (!platio_card_present(sto - slot_storage)) {
+        return 0;
+    }
+
+    tlb_wire(sto->start_addr, slot_phys[sto - slot_storage], PM_16M,
+        PCMCIA_CCA);
+
+    for (i = 0; i < sizeof(slot_fs_offsets) / sizeof(slot_fs_offsets[0]); i++)
+    {
+        off = slot_fs_offsets[i];
+
+        if (platio_index(sto->private, sto->start_addr + off,
+            PCMCIA_WINDOW_SIZE - off))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Look up a file on a flash device and fill in the file structure.
+ * @param sto the device's storage class
  * @param fp File structure to hold file information
  * @param filename name of the file
+ * @returns non-zero if the file was found
  */
-void platio_file_open(struct file *fp, const char *filename)
+int platio_lookup(struct storage_class *sto, struct file *fp,
+    const char *filename)
 {
-    struct fs_ent *ent = find_file(filename, FLASH_BASE);
+    struct fs_index *idx = sto->private;
+    struct fs_index_ent *e = fs_index_lookup(idx, filename);
 
-    if (ent == NULL) {
-        fp->code = 0;
-        fp->private = NULL;
-        return;
+    if (e == NULL) {
+        return 0;
     }
 
-    fp->dev = 1; /* TODO: add support for PCMCIA flash */
-
-    fp->private = (void *)ent;
+    fp->private = (void *)(idx->base + e->offset);
 
-    fp->file_len = ent->length;
+    fp->file_len = e->length;
     fp->file_pos = 0;
 
     /* copy the filename */
-    strncpy(fp->filename, ent->filename, 48);
+    strncpy(fp->filename, e->filename, 48);
+
+    return 1;
+}
+
+/**
+ * Print a directory listing of a flash device
+ * @param sto the device's storage class
+ */
+void platio_list(struct storage_class *sto)
+{
+    struct fs_index *idx = sto->private;
+    uint32_t i;
 
-    fp->code = 1;
-    
+    for (i = 0; i < idx->count; i++) {
+        printf("%s\n", idx->ents[i].filename);
+    }
 }
 
 /**
@@ -96,3 +229,105 @@ uint32_t platio_read(void *pbuf, uint32_t size, uint32_t nmemb, struct file *fp)
     return nmemb * size;
 
 }
+
+/**
+ * Map a range of a file into the address space. Flash is directly
+ * addressable, so this is just the address of the data.
+ * @param fp file to map
+ * @param offset offset of the first byte within the file
+ * @param len number of bytes that will be accessed
+ * @returns pointer to the data, or NULL if it can't be mapped
+ */
+void *platio_map(struct file *fp, uint32_t offset, uint32_t len)
+{
+    return (void *)((uint32_t)(fp->private) + sizeof(struct fs_ent) + offset);
+}
+
+/**
+ * Start an asynchronous read. Flash is read by the CPU, so the request
+ * completes before this returns.
+ * @param req the request; req->fp, req->buf, req->offset and req->len are set
+ * @returns 1 if the request completed, 0 if it is in progress, < 0 on error
+ */
+int platio_read_async(struct cilo_req *req)
+{
+    memcpy(req->buf, platio_map(req->fp, req->offset, req->len), req->len);
+
+    return 1;
+}
+
+/**
+ * Check on a request started by platio_read_async()
+ * @param req the request
+ * @returns 1 if the request completed, 0 if it is in progress, < 0 on error
+ */
+int platio_poll(struct cilo_req *req)
+{
+    return 1;
+}
+
+static struct storage_ops flash_ops = {
+    .probe = platio_probe,
+    .lookup = platio_lookup,
+    .read = platio_read,
+    .map = platio_map,
+    .list = platio_list,
+    .read_async = platio_read_async,
+    .poll = platio_poll,
+};
+
+/* the on-board flash, registered by register_storage() */
+struct storage_class flash_storage = {
+    .dev_name = "flash",
+    .start_addr = FLASH_BASE,
+    .ops = &flash_ops,
+};
+
+/* PCMCIA linear flash cards are read the same way as the on-board flash */
+static struct storage_ops slot_ops = {
+    .probe = platio_slot_probe,
+    .lookup = platio_lookup,
+    .read = platio_read,
+    .map = platio_map,
+    .list = platio_list,
+    .read_async = platio_read_async,
+    .poll = platio_poll,
+};
+
+struct storage_class slot_storage[PCMCIA_SLOTS] = {
+    {
+        .dev_name = "slot0",
+        .start_addr = PCMCIA_SLOT0_BASE,
+        .ops = &slot_ops,
+    },
+    {
+        .dev_name = "slot1",
+        .start_addr = PCMCIA_SLOT1_BASE,
+        .ops = &slot_ops,
+    },
+};
+
+/**
+ * Allocate the file indexes, which are too big for CILO's BSS
+ * @returns 0 on success, -1 if there isn't the memory
+ */
+int platio_init(void)
+{
+    uint32_t i;
+
+    if ((flash_index = cilo_alloc(sizeof(struct fs_index))) == NULL) {
+        return -1;
+    }
+
+    flash_storage.private = flash_index;
+
+    for (i = 0; i < PCMCIA_SLOTS; i++) {
+        if ((slot_storage[i].private =
+            cilo_alloc(sizeof(struct fs_index))) == NULL)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -202,3 +202,24 @@ int c_baud(void)
         : "a0", "v0"
     );
 }
+
+/* confreg - get the configuration register
+ * @return the 16-bit configuration register ROMMON booted with
+ */
+int c_confreg(void)
+{
+    int r = 0;
+
+    asm volatile (".set noreorder\n"
+                  "li $a0, %[syscall]\n"
+                  "syscall\n"
+                  "nop\n"
+                  "move %[result], $v0\n"
+                  ".set reorder\n"
+        : [result]"=r"(r)
+        : [syscall]"g"(GETCONFREG)
+        : "a0", "v0"
+    );
+
+    return r & 0xffff;
+}
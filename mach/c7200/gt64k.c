@@ -0,0 +1,174 @@
+/* GT-64010 IDMA support for the Cisco 7200 Series
+ *
+ * Licensed under the GNU General Public License v2.
+ *
+ * Used to move large blocks from flash into RAM without the CPU, in
+ * builds with -DGT_DMA; it hasn't been tried on hardware or Dynamips. Only
+ * the unmapped segments are handled: KSEG0 and KSEG1 addresses are turned
+ * into physical addresses by masking off the segment bits. Destinations in
+ * KSEG0 are written back and invalidated from every cache level before the
+ * transfer, which is why only whole cache lines are ever given to the DMA
+ * engine.
+ */
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <asm/r4kcache.h>
+
+#include <mach/c7200/gt64k.h>
+
+#define IS_UNMAPPED(a) (((uint32_t)(a) & 0xC0000000ul) == 0x80000000ul)
+#define TO_PHYS(a) ((uint32_t)(a) & 0x1FFFFFFFul)
+
+/* -1 until gt_present() has looked, then whether there is a GT-64010 */
+static int gt_found = -1;
+
+/**
+ * Check that the system controller is a GT-64010 before any of its other
+ * registers are used: other NPEs have other controllers, or other
+ * registers, at the same address. The ID is read through the controller's
+ * own PCI configuration space, once.
+ * @returns non-zero if the controller is a GT-64010
+ */
+int gt_present(void)
+{
+    uint32_t id;
+
+    if (gt_found < 0) {
+        gt_write(GT_PCI_CONF_ADDR, GT_PCI_CONF_EN);
+        id = gt_read(GT_PCI_CONF_DATA);
+        gt_found = id == GT_PCI_ID_64010;
+
+        if (!gt_found) {
+            printf("System controller ID %08x is not a GT-64010\n", id);
+        }
+    }
+
+    return gt_found;
+}
+
+/**
+ * Program a DMA channel and start it
+ * @param chan channel number
+ * @param src source, KSEG0 or KSEG1 address
+ * @param dst destination, KSEG0 or KSEG1 address
+ * @param len number of bytes, at most GT_DMA_CHUNK
+ */
+void gt_dma_start(int chan, const void *src, void *dst, uint32_t len)
+{
+    if (IS_KSEG0(dst)) {
+        cache_wback_inv_range((uint32_t)dst, len);
+    }
+
+    gt_write(GT_DMA_COUNT(chan), len);
+    gt_write(GT_DMA_SRC(chan), TO_PHYS(src));
+    gt_write(GT_DMA_DST(chan), TO_PHYS(dst));
+    gt_write(GT_DMA_NEXT(chan), 0);
+    gt_write(GT_DMA_CTRL(chan), GT_DMA_SRC_INC | GT_DMA_DST_INC |
+        GT_DMA_LIMIT_32 | GT_DMA_NON_CHAIN | GT_DMA_BLOCK_MODE |
+        GT_DMA_CHAN_EN);
+}
+
+/**
+ * Check whether a channel is still transferring
+ * @param chan channel number
+ * @returns non-zero while the transfer is in progress
+ */
+int gt_dma_busy(int chan)
+{
+    return gt_read(GT_DMA_CTRL(chan)) & GT_DMA_ACTIVE;
+}
+
+/**
+ * Check whether a transfer can be handed to the DMA engine as a whole:
+ * there is a GT-64010, both ends are unmapped, the destination made of
+ * whole cache lines, the source doubleword aligned, and the length within
+ * one chunk.
+ * @returns non-zero if gt_dma_start() may be used
+ */
+int gt_dma_eligible(const void *src, void *dst, uint32_t len)
+{
+    uint32_t line = dcache_line_size();
+
+    return gt_present() && IS_UNMAPPED(src) && IS_UNMAPPED(dst) &&
+        len >= line && len <= GT_DMA_CHUNK &&
+        ((uint32_t)dst & (line - 1)) == 0 && (len & (line - 1)) == 0 &&
+        ((uint32_t)src & 7) == 0;
+}
+
+/**
+ * Copy a block, using the DMA engine for the cache-line aligned middle
+ * of it and the CPU for the rest. Short copies, copies from or to mapped
+ * addresses, copies whose source can't be aligned along with the
+ * destination and all copies without a GT-64010 are left to the CPU.
+ * @param dst destination
+ * @param src source
+ * @param len number of bytes
+ */
+void gt_dma_copy(void *dst, const void *src, uint32_t len)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    uint32_t line = dcache_line_size();
+    uint32_t head = (line - ((uint32_t)d & (line - 1))) & (line - 1);
+    uint32_t n, chunk;
+
+    if (len < GT_DMA_MIN_LEN + head || !IS_UNMAPPED(d) || !IS_UNMAPPED(s) ||
+        (((uint32_t)s + head) & 7) || !gt_present())
+    {
+        memcpy(dst, src, len);
+        return;
+    }
+
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (n = len & ~(line - 1); n > 0; n -= chunk) {
+        chunk = n > GT_DMA_CHUNK ? GT_DMA_CHUNK : n;
+
+        gt_dma_start(GT_DMA_CHAN_SYNC, s, d, chunk);
+        while (gt_dma_busy(GT_DMA_CHAN_SYNC));
+
+        d += chunk;
+        s += chunk;
+        len -= chunk;
+    }
+
+    memcpy(d, s, len);
+}
+
+/**
+ * Find the device bank that decodes a physical address
+ * @param paddr physical address
+ * @returns the bank number (0-3, or GT_BOOT_BANK), or -1 if the address
+ *          isn't on the device bus
+ */
+int gt_dev_bank(uint32_t paddr)
+{
+    uint32_t hi = paddr >> 21, lo = (paddr >> 20) & 0xFF;
+    int bank;
+
+    for (bank = 0; bank < GT_DEV_BANKS; bank++) {
+        if (bank < 3) {
+            if (hi < (gt_read(GT_CS20_LOW) & 0x7FFF) ||
+                hi > (gt_read(GT_CS20_HIGH) & 0x7FFF))
+            {
+                continue;
+            }
+        } else if (hi < (gt_read(GT_CS3BOOT_LOW) & 0x7FFF) ||
+            hi > (gt_read(GT_CS3BOOT_HIGH) & 0x7FFF))
+        {
+            continue;
+        }
+
+        if (lo >= (gt_read(GT_CS_LOW(bank)) & 0xFF) &&
+            lo <= (gt_read(GT_CS_HIGH(bank)) & 0xFF))
+        {
+            return bank;
+        }
+    }
+
+    return -1;
+}
@@ -1,44 +1,304 @@
 #include <types.h>
 #include <mach/c7200/platform.h>
 #include <mach/c7200/platio.h>
+#include <storage/storage.h>
 #include <printf.h>
+#include <string.h>
+#include <crc32.h>
+#include <asm/r4kcache.h>
+#include <addr.h>
+#include <mach/c7200/gt64k.h>
+
+/* copy routine in chain.S */
+extern char chain_stub[], chain_stub_end[];
+
+#ifdef FLASH_TUNING
+/* amount of bootflash read when timing the two windows */
+#define FLASH_TIMING_LEN 0x10000
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 /**
- * perform hardware-specifc initialization for this platform
+ * Time a copy out of bootflash into the kernel load area, which is free at
+ * this point.
+ * @param base flash window to read from
+ * @returns elapsed CP0 Count ticks
  */
-void platform_init()
+static uint32_t time_flash_read(uint32_t base)
 {
+    uint32_t start = read_c0_count();
+
+    memcpy((void *)LOADADDR, (void *)base, FLASH_TIMING_LEN);
+
+    return read_c0_count() - start;
 }
 
 /**
- * Perform a sanity check on flash
- * @returns 0 if no flash found, number of flash devices found otherwise
+ * Turn a FLASH_TIMING_LEN read time into a throughput
+ * @param ticks elapsed CP0 Count ticks
+ * @returns kilobytes per second
  */
-uint32_t check_flash()
+static uint32_t flash_kbps(uint32_t ticks)
+{
+    uint32_t us = ticks / (COUNT_HZ / 1000000);
+
+    if (!us) us = 1;
+
+    return (FLASH_TIMING_LEN / 1024) * 1000000 / us;
+}
+
+/**
+ * Time both bootflash windows and print the throughput of each
+ * @param when label for the figures
+ */
+static void report_flash_read(const char *when)
 {
-    uint32_t *ptr = (uint32_t *)FLASHFS_BASE;
+    uint32_t cached, uncached;
+
+    /* start from a cold cache so the cached figure includes line fills */
+    dcache_wback_inv_all();
+
+    cached = time_flash_read(FLASHFS_BASE_CACHED);
+    uncached = time_flash_read(FLASHFS_BASE);
+
+    printf("Bootflash read %s: %d kB/s cached (%d ticks), "
+        "%d kB/s uncached (%d ticks)\n", when, flash_kbps(cached), cached,
+        flash_kbps(uncached), uncached);
+}
+
+/**
+ * Try a set of device bank parameters for the bootflash, reading it back
+ * through the uncached window, which does one access per word, and the
+ * cached one, which does line fill bursts
+ * @param bank GT-64010 device bank of the bootflash
+ * @param param device bank parameters to try
+ * @param ref CRC32 of the timing area read with the original parameters
+ * @returns 1 if both windows read back correctly
+ */
+static int flash_timing_ok(int bank, uint32_t param, uint32_t ref)
+{
+    /* read it back so the write has landed before the flash is read */
+    gt_write(GT_DEV_PARAM(bank), param);
+    (void)gt_read(GT_DEV_PARAM(bank));
+
+    dcache_wback_inv_all();
 
-    if (*ptr != FS_FILE_MAGIC) {
+    return crc32_update(0, (void *)FLASHFS_BASE, FLASH_TIMING_LEN) == ref &&
+        crc32_update(0, (void *)FLASHFS_BASE_CACHED, FLASH_TIMING_LEN) == ref;
+}
+
+/**
+ * Tighten the bootflash read wait states. The access times ROMMON leaves
+ * are shortened one cycle at a time for as long as the flash still reads
+ * back correctly, and then given a cycle of margin. The burst beat time
+ * is only taken below the first access time when the parts do page-mode
+ * reads, which is what lets a line fill run at page speed.
+ * @returns 1 if the timing was tuned, 0 if it was left alone
+ */
+static int tune_flash_timing(void)
+{
+    int bank, page = flash_cfi.page_words != 0;
+    uint32_t orig, ref, first, next, orig_first, orig_next;
+
+    /* the device bank registers are only known on a GT-64010 */
+    if (!gt_present()) {
+        printf("Bootflash read timing left alone\n");
         return 0;
     }
 
+    bank = gt_dev_bank(FLASH_PHYS);
+
+    if (bank < 0 || bank == GT_BOOT_BANK) {
+        printf("Bootflash %s, read timing left alone\n",
+            bank < 0 ? "not on a device bank" : "shares the boot ROM bank");
+        return 0;
+    }
+
+    orig = gt_read(GT_DEV_PARAM(bank));
+    orig_first = first = GT_DEV_ACC_FIRST(orig);
+    orig_next = next = GT_DEV_ACC_NEXT(orig);
+    ref = crc32_update(0, (void *)FLASHFS_BASE, FLASH_TIMING_LEN);
+
+    while (first > 1 && flash_timing_ok(bank, GT_DEV_ACC(orig, first - 1,
+        page ? next : MIN(next, first - 1)), ref))
+    {
+        first--;
+    }
+
+    if (page) {
+        while (next > 1 &&
+            flash_timing_ok(bank, GT_DEV_ACC(orig, first, next - 1), ref))
+        {
+            next--;
+        }
+    }
+
+    if (first < orig_first) first++;
+    if (next < orig_next) next++;
+    if (!page) next = MIN(orig_next, first);
+
+    if (!flash_timing_ok(bank, GT_DEV_ACC(orig, first, next), ref)) {
+        first = orig_first;
+        next = orig_next;
+        flash_timing_ok(bank, orig, ref);
+    }
+
+    /* nothing read with a failed setting may stay in the cache */
+    dcache_wback_inv_all();
+
+    printf("Bootflash bank %d read timing: first access %d -> %d, "
+        "burst beat %d -> %d cycles\n", bank, orig_first, first,
+        orig_next, next);
+
     return 1;
-    /* TODO: add support for PCMCIA flash */
 }
+#endif
 
 /**
- * print a directory listing of the 'main' flash device in the system
+ * Print what the bootflash is made of
  */
+static void report_flash_cfi(void)
+{
+    if (!flash_cfi.cmdset) {
+        printf("Bootflash did not answer the CFI query\n");
+        return;
+    }
 
-void flash_directory()
+    printf("Bootflash: %s command set, ID %x:%x, %d MB, %d x %d-bit, ",
+        cfi_cmdset_name(flash_cfi.cmdset), flash_cfi.manuf, flash_cfi.device,
+        flash_cfi.size >> 20, flash_cfi.interleave,
+        flash_cfi.width * 8 / flash_cfi.interleave);
+
+    if (flash_cfi.page_words) {
+        printf("%d-word page mode\n", flash_cfi.page_words);
+    } else {
+        printf("no page mode\n");
+    }
+}
+
+/**
+ * Give the user a few seconds to press a key on the console. Anything
+ * already waiting, like the rest of the line that booted CILO, is dropped
+ * first.
+ * @param secs how long to wait
+ * @returns non-zero if a key was pressed
+ */
+int platform_key_wait(int secs)
+{
+    volatile uint8_t *sr = (volatile uint8_t *)CONSOLE_DUART_SR;
+    volatile uint8_t *rhr = (volatile uint8_t *)CONSOLE_DUART_RHR;
+    uint32_t start;
+
+    while (*sr & DUART_SR_RXRDY) {
+        (void)*rhr;
+    }
+
+    for (; secs > 0; secs--) {
+        start = read_c0_count();
+
+        while (read_c0_count() - start < COUNT_HZ) {
+            if (*sr & DUART_SR_RXRDY) {
+                (void)*rhr;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * perform hardware-specifc initialization for this platform
+ */
+void platform_init()
 {
-    struct fs_ent *f = (struct fs_ent *)FLASHFS_BASE;
-    uint32_t offset = 0;
+    printf("\n");
+    report_flash_cfi();
 
-    /* Iterate over the files; f->magic is 0 if an invalid file is found. */
-    while (f->magic == FS_FILE_MAGIC) {
-        printf("%s\n", f->filename);
-        offset += sizeof(struct fs_ent) + f->length;
-        f = (struct fs_ent *)(FLASHFS_BASE + offset);
+#ifdef FLASH_TUNING
+    report_flash_read("as found");
+
+    if (tune_flash_timing()) {
+        report_flash_read("tuned");
     }
+#endif
+
+    printf("Reading bootflash %s\n",
+#ifdef FLASH_UNCACHED
+        "uncached"
+#else
+        "cached"
+#endif
+        );
+}
+
+/**
+ * Register the storage devices of this platform. Nothing is probed until
+ * check_flash(), or until a file is opened on a device.
+ */
+void register_storage()
+{
+#ifndef FLASH_UNCACHED
+    /* drop anything ROMMON left in the caches for the flash window */
+    cache_wback_inv_all();
+#endif
+
+    /* identify the parts while nothing is reading the bootflash; a probe
+     * that fails leaves flash_cfi.cmdset at 0 */
+    cfi_probe(&flash_cfi, FLASH_BASE);
+
+    if (platio_init() < 0) {
+        return;
+    }
+
+    register_storage_class(&flash_storage);
+#ifdef PCMCIA
+    register_storage_class(&slot_storage[0]);
+    register_storage_class(&slot_storage[1]);
+    register_storage_class(&disk_storage[0]);
+    register_storage_class(&disk_storage[1]);
+#endif
+}
+
+/**
+ * Perform a sanity check on flash
+ * @returns 0 if no flash found, number of flash devices found otherwise
+ */
+uint32_t check_flash()
+{
+    return storage_probe_all();
+}
+
+/**
+ * print a directory listing of the flash devices in the system
+ */
+
+void flash_directory()
+{
+    storage_list();
+}
+
+/**
+ * Start an image that runs where CILO does. A copy of chain_stub, which
+ * moves the image into place and cleans up the caches, is run uncached
+ * from KSEG1 so that nothing it does to memory or the caches can pull the
+ * ground from under it.
+ * @param stub room for the copy routine, clear of both copies of the image
+ * @param dst where the image runs
+ * @param src where the image is, dst if it is in place already
+ * @param len size of the image, a multiple of four
+ * @param entry entry point of the image
+ */
+void platform_chain(void *stub, uint32_t dst, const void *src, uint32_t len,
+    uint32_t entry)
+{
+    void (*copy)(uint32_t, const void *, uint32_t, uint32_t);
+
+    /* no dirty line may be written back over the routine or the image */
+    dcache_wback_inv_all();
+
+    copy = (void *)KSEG0_TO_KSEG132((uint32_t)stub);
+    memcpy(copy, chain_stub, chain_stub_end - chain_stub);
+
+    copy(dst, src, len, entry);
 }
@@ -7,72 +7,266 @@
 #include <mach/c7200/platio.h>
 #include <ciloio.h>
 #include <string.h>
+#include <printf.h>
 
 #include <mach/c7200/platform.h>
+#include <asm/r4ktlb.h>
+#include <storage/block.h>
+#include <storage/ata.h>
+#include <mach/c7200/gt64k.h>
+#include <crc32.h>
+#include <promlib.h>
+#include <asm/r4kcache.h>
+#include <bootcache.h>
 
-/* find file in filesystem starting at base */
-struct fs_ent *find_file(const char *filename, uint32_t base)
+/* index of the files on flash, built by check_flash(); see platio_init() */
+struct fs_index *flash_index;
+
+/* bootflash parts, as identified by register_storage() */
+struct cfi_info flash_cfi;
+
+static const uint32_t slot_phys[PCMCIA_SLOTS] = {
+    PCMCIA_SLOT0_PHYS, PCMCIA_SLOT1_PHYS
+};
+
+/* offsets at which a card's filesystem may start: straight away, or after
+ * the same reserved area as on bootflash
+ */
+static const uint32_t slot_fs_offsets[] = { 0, FLASHFS_BASE - FLASH_BASE };
+
+/* cards are read through the cache unless built with -DFLASH_UNCACHED */
+#ifdef FLASH_UNCACHED
+#define PCMCIA_CCA CONF_CM_UNCACHED
+#else
+#define PCMCIA_CCA CONF_CM_CACHABLE_NONCOHERENT
+#endif
+
+/**
+ * Walk a flash filesystem once and record every file in an index
+ * @param idx index to fill in
+ * @param base address of the first fs_ent
+ * @param size number of bytes that can be read from base
+ * @returns number of files found
+ */
+static uint32_t platio_index(struct fs_index *idx, uint32_t base,
+    uint32_t size)
 {
-    /* Actual file offset */
     uint32_t offset = 0;
+    struct fs_ent *f = (struct fs_ent *)base;
 
-    struct fs_ent *f = (struct fs_ent *)(base + offset);
+    fs_index_init(idx, base);
 
     /* iterate over files in flash */
-    while (f->magic == FS_FILE_MAGIC) {
-        if (!strncmp(f->filename, filename, 64)) {
-            return f;
+    while (size - offset >= sizeof(struct fs_ent) &&
+        f->magic == FS_FILE_MAGIC)
+    {
+        if (f->length > size - offset - sizeof(struct fs_ent)) {
+            break;
+        }
+
+        if (!fs_index_add(idx, f->filename, sizeof(f->filename),
+            offset, f->length, f->crc32, f->date))
+        {
+            break;
         }
 
         offset += sizeof(struct fs_ent) + f->length;
         f = (struct fs_ent *)(base + offset);
     }
 
-    return NULL;
+    return idx->count;
+}
+
+/**
+ * Walk the flash filesystem once and record every file in flash_index.
+ * The size of the on-board flash isn't known, so the walk only stops at
+ * the first empty entry.
+ * @returns number of files found
+ */
+uint32_t platio_index_flash(void)
+{
+    return platio_index(flash_index, FLASHFS_READ_BASE,
+        0xFFFFFFFF - FLASHFS_READ_BASE);
+}
+
+/* find file in the indexed filesystem starting at base */
+struct fs_ent *find_file(const char *filename, uint32_t base)
+{
+    struct fs_index_ent *e;
+
+    if (base != flash_index->base) {
+        return NULL;
+    }
+
+    if ((e = fs_index_lookup(flash_index, filename)) == NULL) {
+        return NULL;
+    }
+
+    return (struct fs_ent *)(base + e->offset);
 }
 
 /**
- * Find a file within the platform-supported I/O devices
+ * Find a file on flash
  * @param filename the file
- * @returns 0 on failure, device ID number on success
+ * @returns 0 on failure, 1 on success
  */
 uint8_t platio_find_file(const char *filename)
 {
-    if (find_file(filename, FLASHFS_BASE)) {
+    if (fs_index_lookup(flash_index, filename)) {
         return 1;
     }
-    /* todo: add support for PCMCIA devices */
 
     return 0;
 }
 
 /**
- * Open a file.
+ * Probe the flash device by indexing its filesystem
+ * @param sto the flash storage class
+ * @returns non-zero if any files were found
+ */
+uint32_t platio_probe(struct storage_class *sto)
+{
+    return platio_index_flash();
+}
+
+/**
+ * Ask the PCMCIA controller whether there is a card in a slot
+ * @param slot the slot
+ * @returns non-zero if a card is fully inserted
+ */
+static int platio_card_present(uint32_t slot)
+{
+#ifdef PCMCIA
+    *(volatile uint8_t *)PCMCIA_EXCA_INDEX =
+        slot * EXCA_SOCKET_REGS + EXCA_STATUS;
+
+    return (*(volatile uint8_t *)PCMCIA_EXCA_DATA & EXCA_STATUS_CD) ==
+        EXCA_STATUS_CD;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Probe a PCMCIA slot for a linear flash card: if the controller reports
+ * a card, map the card window and index the filesystem on the card, if
+ * there is one.
+ * @param sto the slot's storage class
+ * @returns non-zero if any files were found
+ */
+uint32_t platio_slot_probe(struct storage_class *sto)
+{
+    uint32_t i, off;
+
+    if (!platio_card_present(sto - slot_storage)) {
+        return 0;
+    }
+
+    tlb_wire(sto->start_addr, slot_phys[sto - slot_storage], PM_16M,
+        PCMCIA_CCA);
+
+    for (i = 0; i < sizeof(slot_fs_offsets) / sizeof(slot_fs_offsets[0]); i++)
+    {
+        off = slot_fs_offsets[i];
+
+        if (platio_index(sto->private, sto->start_addr + off,
+            PCMCIA_WINDOW_SIZE - off))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Look up a file on a flash device and fill in the file structure.
+ * @param sto the device's storage class
  * @param fp File structure to hold file information
  * @param filename name of the file
+ * @returns non-zero if the file was found
  */
-void platio_file_open(struct file *fp, const char *filename)
+int platio_lookup(struct storage_class *sto, struct file *fp,
+    const char *filename)
 {
-    struct fs_ent *ent = find_file(filename, FLASHFS_BASE);
+    struct fs_index *idx = sto->private;
+    struct fs_index_ent *e = fs_index_lookup(idx, filename);
 
-    if (ent == NULL) {
-        fp->code = 0;
-        fp->private = NULL;
-        return;
+    if (e == NULL) {
+        return 0;
     }
 
-    fp->dev = 1; /* TODO: add support for PCMCIA flash */
-
-    fp->private = (void *)ent;
+    fp->private = (void *)(idx->base + e->offset);
 
-    fp->file_len = ent->length;
+    fp->file_len = e->length;
     fp->file_pos = 0;
 
     /* copy the filename */
-    strncpy(fp->filename, ent->filename, 64);
+    strncpy(fp->filename, e->filename, 64);
+
+    return 1;
+}
+
+/**
+ * Open a bootflash file from a boot record by checking the one header the
+ * record points at, without indexing the filesystem
+ * @param sto the bootflash storage class
+ * @param fp file structure to fill in
+ * @param rec the boot record
+ * @returns non-zero if the header still matches the record
+ */
+int platio_locate(struct storage_class *sto, struct file *fp,
+    const struct boot_record *rec)
+{
+    struct fs_ent *f = (struct fs_ent *)(FLASHFS_READ_BASE + rec->offset);
+
+    if ((rec->offset & 3) || (flash_cfi.size && rec->offset +
+        sizeof(struct fs_ent) > flash_cfi.size - (FLASHFS_BASE - FLASH_BASE)))
+    {
+        return 0;
+    }
+
+    if (f->magic != FS_FILE_MAGIC || f->length != rec->length ||
+        f->date != rec->date ||
+        strncmp(f->filename, rec->filename, sizeof(f->filename)))
+    {
+        return 0;
+    }
+
+    fp->private = f;
+    fp->file_len = f->length;
+    fp->file_pos = 0;
+    strncpy(fp->filename, rec->filename, 64);
+
+    return 1;
+}
 
-    fp->code = 1;
-    
+/**
+ * Fill in where a bootflash file is, for the boot cache
+ * @param fp the file
+ * @param rec the boot record
+ */
+void platio_record(struct file *fp, struct boot_record *rec)
+{
+    struct fs_ent *f = fp->private;
+
+    rec->offset = (uint32_t)f - FLASHFS_READ_BASE;
+    rec->length = f->length;
+    rec->date = f->date;
+}
+
+/**
+ * Print a directory listing of a flash device
+ * @param sto the device's storage class
+ */
+void platio_list(struct storage_class *sto)
+{
+    struct fs_index *idx = sto->private;
+    uint32_t i;
+
+    for (i = 0; i < idx->count; i++) {
+        printf("%s\n", idx->ents[i].filename);
+    }
 }
 
 /**
@@ -86,12 +280,412 @@ void platio_file_open(struct file *fp, const char *filename)
 uint32_t platio_read(void *pbuf, uint32_t size, uint32_t nmemb, struct file *fp)
 {
     /* calculate the effective offset of the data we want to read: */
-    char *from = (char *)((uint32_t)(fp->private) + sizeof(struct fs_ent) + fp->file_pos);
+    char *data = (char *)((uint32_t)(fp->private) + sizeof(struct fs_ent));
+    char *from = data + fp->file_pos;
+    uint32_t len = size * nmemb;
 
-    memcpy(pbuf, from, size * nmemb);
+#ifdef FLASH_CRC
+    if (fp->file_pos >= fp->crc_pos && fp->file_pos <= fp->file_len &&
+        len <= fp->file_len - fp->file_pos)
+    {
+        /* bring the CRC up to where this read starts, then check the read
+         * as it is copied, so flash is only read once
+         */
+        fp->crc = crc32_update(fp->crc, data + fp->crc_pos,
+            fp->file_pos - fp->crc_pos);
+        fp->crc = crc32_copy(pbuf, from, len, fp->crc);
+        fp->crc_pos = fp->file_pos + len;
+    } else
+#endif
+    {
+#ifdef GT_DMA
+        /* large blocks are moved by the GT-64010 */
+        gt_dma_copy(pbuf, from, len);
+#else
+        memcpy(pbuf, from, len);
+#endif
+    }
 
-    fp->file_pos += size * nmemb;
+    fp->file_pos += len;
 
     return nmemb * size;
 
 }
+
+#ifdef FLASH_CRC
+/**
+ * Check a file against the CRC32 in its header. Only the part of the file
+ * platio_read() hasn't already checked is read here.
+ * @param fp the file
+ * @returns 1 if the CRC matches, -1 if not
+ */
+int platio_verify(struct file *fp)
+{
+    struct fs_ent *f = fp->private;
+    char *data = (char *)f + sizeof(struct fs_ent);
+
+    fp->crc = crc32_update(fp->crc, data + fp->crc_pos,
+        fp->file_len - fp->crc_pos);
+    fp->crc_pos = fp->file_len;
+
+    if (fp->crc != f->crc32) {
+        printf("%s: CRC32 is %08x, header says %08x\n", fp->filename,
+            fp->crc, f->crc32);
+        return -1;
+    }
+
+    return 1;
+}
+#endif
+
+/**
+ * Map a range of a file into the address space. Flash is directly
+ * addressable, so this is just the address of the data.
+ * @param fp file to map
+ * @param offset offset of the first byte within the file
+ * @param len number of bytes that will be accessed
+ * @returns pointer to the data, or NULL if it can't be mapped
+ */
+void *platio_map(struct file *fp, uint32_t offset, uint32_t len)
+{
+    return (void *)((uint32_t)(fp->private) + sizeof(struct fs_ent) + offset);
+}
+
+/**
+ * Start an asynchronous read. In -DGT_DMA builds, requests the DMA engine
+ * can take whole are started on the async channel; anything else is
+ * copied by the CPU before this returns.
+ * @param req the request; req->fp, req->buf, req->offset and req->len are set
+ * @returns 1 if the request completed, 0 if it is in progress, < 0 on error
+ */
+int platio_read_async(struct cilo_req *req)
+{
+    void *from = platio_map(req->fp, req->offset, req->len);
+
+#ifdef GT_DMA
+    if (gt_dma_eligible(from, req->buf, req->len)) {
+        while (gt_dma_busy(GT_DMA_CHAN_ASYNC));
+        gt_dma_start(GT_DMA_CHAN_ASYNC, from, req->buf, req->len);
+        return 0;
+    }
+#endif
+
+    memcpy(req->buf, from, req->len);
+
+    return 1;
+}
+
+/**
+ * Check on a request started by platio_read_async()
+ * @param req the request
+ * @returns 1 if the request completed, 0 if it is in progress, < 0 on error
+ */
+int platio_poll(struct cilo_req *req)
+{
+#ifdef GT_DMA
+    return !gt_dma_busy(GT_DMA_CHAN_ASYNC);
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Write a file to the bootflash. A file of the same name is replaced: the
+ * files after it are moved down over it and the new file goes on the end
+ * of the chain, with the headers' seek fields rewritten to match. All of
+ * the filesystem from the erase block holding the first header to change
+ * is staged in RAM, then erased and programmed in one pass. The new file's
+ * magic number is programmed last, so an interrupted write never leaves a
+ * header that points at missing data.
+ * @param sto the bootflash storage class
+ * @param filename name to give the file
+ * @param buf file data, in RAM; the RAM after it is used for staging
+ * @param len length of the file
+ * @returns 0 on success, -1 on failure
+ */
+int platio_write(struct storage_class *sto, const char *filename,
+    const void *buf, uint32_t len)
+{
+    struct fs_index *idx = sto->private;
+    struct fs_index_ent *e = fs_index_lookup(idx, filename);
+    struct fs_ent *f, *hdr = NULL, h;
+    uint32_t fs_off = FLASHFS_BASE - FLASH_BASE;
+    uint32_t first, start, blk, keep, total, fileno = 0, magic, i, n;
+    uint8_t *stage, *p;
+    int erased;
+
+    if (!flash_cfi.cmdset) {
+        printf("%s: not a CFI flash part, can't write to it\n",
+            sto->dev_name);
+        return -1;
+    }
+
+    /* a full index may have stopped short of the end of the chain; the
+     * files past it would be overwritten */
+    if (idx->count == FS_INDEX_MAX) {
+        printf("%s: %d files or more, too many to rewrite safely\n",
+            sto->dev_name, FS_INDEX_MAX);
+        return -1;
+    }
+
+    /* the first file to be rewritten, and where its header is */
+    first = e ? e - idx->ents : idx->count;
+    if (e) {
+        start = e->offset;
+    } else if (idx->count) {
+        e = &idx->ents[idx->count - 1];
+        start = e->offset + sizeof(struct fs_ent) + e->length;
+    } else {
+        start = 0;
+    }
+
+    if (!cfi_block(&flash_cfi, fs_off + start, &blk)) {
+        printf("%s: no room for %s\n", sto->dev_name, filename);
+        return -1;
+    }
+
+    keep = fs_off + start - blk;
+    total = keep + sizeof(struct fs_ent) + len;
+    for (i = first + 1; i < idx->count; i++) {
+        total += sizeof(struct fs_ent) + idx->ents[i].length;
+    }
+
+    stage = (uint8_t *)(((uint32_t)buf + len + 31) & ~31);
+
+    if ((uint32_t)stage + total > LOAD_LIMIT) {
+        printf("%s: not enough RAM to stage the write\n", sto->dev_name);
+        return -1;
+    }
+
+    /* room for the data and a blank header to end the chain */
+    if (blk + total + sizeof(struct fs_ent) > flash_cfi.size) {
+        printf("%s: not enough room for %s\n", sto->dev_name, filename);
+        return -1;
+    }
+
+    /* what's left of the erase block before the first header */
+    memcpy(stage, (void *)(idx->base + start - keep), keep);
+    p = stage + keep;
+
+    for (i = 0; i < idx->count; i++) {
+        f = (struct fs_ent *)(idx->base + idx->ents[i].offset);
+        if (f->fileno >= fileno) fileno = f->fileno + 1;
+        if (i == first || (hdr == NULL && i == idx->count - 1)) hdr = f;
+    }
+
+    /* move the files after the replaced one down; headers are patched in
+     * a copy, as the staged ones needn't be word aligned */
+    for (i = first + 1; i < idx->count; i++) {
+        n = sizeof(struct fs_ent) + idx->ents[i].length;
+        memcpy(&h, (void *)(idx->base + idx->ents[i].offset),
+            sizeof(struct fs_ent));
+        memcpy(p + sizeof(struct fs_ent), (void *)(idx->base +
+            idx->ents[i].offset + sizeof(struct fs_ent)), h.length);
+        h.seek = blk + (p - stage) + n;
+        memcpy(p, &h, sizeof(struct fs_ent));
+        p += n;
+    }
+
+    /* the new header, modelled on the file it replaces or the last file,
+     * with its magic number left erased for now */
+    if (hdr) {
+        memcpy(&h, hdr, sizeof(struct fs_ent));
+    } else {
+        for (n = 0; n < sizeof(struct fs_ent) / sizeof(uint32_t); n++) {
+            ((uint32_t *)&h)[n] = 0xFFFFFFFF;
+        }
+        h.type = FS_FILE_TYPE_BINARY;
+        h.date = 0;
+        h.sg02 = 0xFFFFFFF8;
+    }
+
+    h.magic = 0xFFFFFFFF;
+    h.fileno = fileno;
+    memzero(h.filename, sizeof(h.filename));
+    strncpy(h.filename, filename, sizeof(h.filename) - 1);
+    h.length = len;
+    h.crc32 = crc32_copy(p + sizeof(struct fs_ent), buf, len, 0);
+    h.seek = blk + total;
+    memcpy(p, &h, sizeof(struct fs_ent));
+
+    printf("Writing %s (%d bytes) to %s...\n", h.filename, len,
+        sto->dev_name);
+
+    if ((erased = cfi_erase(&flash_cfi, blk,
+        total + sizeof(struct fs_ent))) < 0 ||
+        cfi_program(&flash_cfi, blk, stage, total))
+    {
+        printf("%s: write failed; files from %s on may be lost\n",
+            sto->dev_name, first < idx->count ? idx->ents[first].filename :
+            filename);
+        return -1;
+    }
+
+    magic = FS_FILE_MAGIC;
+    if (cfi_program(&flash_cfi, blk + (p - stage), &magic, sizeof(magic))) {
+        return -1;
+    }
+
+    /* drop the old contents of everything erased from the caches, at
+     * every level, and index the new chain */
+    cache_wback_inv_range(FLASH_BASE_CACHED + blk, flash_cfi.size - blk);
+    platio_index_flash();
+
+    if ((e = fs_index_lookup(idx, h.filename)) == NULL ||
+        crc32_update(0, (void *)(idx->base + e->offset +
+        sizeof(struct fs_ent)), e->length) != h.crc32)
+    {
+        printf("%s: %s did not read back correctly\n", sto->dev_name,
+            h.filename);
+        return -1;
+    }
+
+    printf("Done: %d erase blocks erased, %d bytes programmed.\n", erased,
+        total);
+
+    return 0;
+}
+
+static struct storage_ops flash_ops = {
+    .probe = platio_probe,
+    .lookup = platio_lookup,
+    .read = platio_read,
+    .map = platio_map,
+    .list = platio_list,
+#ifdef FLASH_CRC
+    .verify = platio_verify,
+#endif
+    .read_async = platio_read_async,
+    .poll = platio_poll,
+    .write = platio_write,
+    .locate = platio_locate,
+    .record = platio_record,
+};
+
+/* the on-board flash, registered by register_storage() */
+struct storage_class flash_storage = {
+    .dev_name = "bootflash",
+    .start_addr = FLASH_BASE,
+    .ops = &flash_ops,
+};
+
+/* PCMCIA linear flash cards are read the same way as the on-board flash */
+static struct storage_ops slot_ops = {
+    .probe = platio_slot_probe,
+    .lookup = platio_lookup,
+    .read = platio_read,
+    .map = platio_map,
+    .list = platio_list,
+#ifdef FLASH_CRC
+    .verify = platio_verify,
+#endif
+    .read_async = platio_read_async,
+    .poll = platio_poll,
+};
+
+struct storage_class slot_storage[PCMCIA_SLOTS] = {
+    {
+        .dev_name = "slot0",
+        .start_addr = PCMCIA_SLOT0_BASE,
+        .ops = &slot_ops,
+    },
+    {
+        .dev_name = "slot1",
+        .start_addr = PCMCIA_SLOT1_BASE,
+        .ops = &slot_ops,
+    },
+};
+
+/**
+ * Allocate the file indexes, which are too big for CILO's BSS
+ * @returns 0 on success, -1 if there isn't the memory
+ */
+int platio_init(void)
+{
+    uint32_t i;
+
+    if ((flash_index = cilo_alloc(sizeof(struct fs_index))) == NULL) {
+        return -1;
+    }
+
+    flash_storage.private = flash_index;
+
+    for (i = 0; i < PCMCIA_SLOTS; i++) {
+        if ((slot_storage[i].private =
+            cilo_alloc(sizeof(struct fs_index))) == NULL)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* PC Card ATA disks in the PCMCIA slots */
+#ifdef NO_ATA_DATA32
+#define PCMCIA_ATA_FLAGS 0
+#else
+#define PCMCIA_ATA_FLAGS ATA_DATA32
+#endif
+
+static struct ata_dev disk_ata[PCMCIA_SLOTS] = {
+    {
+        .regs = PCMCIA_SLOT0_IO,
+        .ctl = PCMCIA_SLOT0_IO + PCMCIA_ATA_CTL,
+        .data = PCMCIA_SLOT0_IO + PCMCIA_ATA_DATA,
+        .flags = PCMCIA_ATA_FLAGS,
+    },
+    {
+        .regs = PCMCIA_SLOT1_IO,
+        .ctl = PCMCIA_SLOT1_IO + PCMCIA_ATA_CTL,
+        .data = PCMCIA_SLOT1_IO + PCMCIA_ATA_DATA,
+        .flags = PCMCIA_ATA_FLAGS,
+    },
+};
+
+/**
+ * Probe a PCMCIA slot for an ATA disk. A slot holding a linear flash card
+ * is left alone, so the probe never writes to a flash card.
+ * @param bdev the disk
+ * @returns non-zero if a disk is present
+ */
+static int platio_disk_probe(struct block_dev *bdev)
+{
+    uint32_t slot = (struct ata_dev *)bdev->private - disk_ata;
+
+    if (!platio_card_present(slot) || storage_probe(&slot_storage[slot])) {
+        return 0;
+    }
+
+    tlb_wire(disk_ata[slot].regs, slot_phys[slot], PM_4K, CONF_CM_UNCACHED);
+
+    return ata_probe(bdev);
+}
+
+static struct block_dev disk_blk[PCMCIA_SLOTS] = {
+    {
+        .probe = platio_disk_probe,
+        .read = ata_read,
+        .private = &disk_ata[0],
+    },
+    {
+        .probe = platio_disk_probe,
+        .read = ata_read,
+        .private = &disk_ata[1],
+    },
+};
+
+struct storage_class disk_storage[PCMCIA_SLOTS] = {
+    {
+        .dev_name = "disk0",
+        .start_addr = PCMCIA_SLOT0_IO,
+        .ops = &block_ops,
+        .private = &disk_blk[0],
+    },
+    {
+        .dev_name = "disk1",
+        .start_addr = PCMCIA_SLOT1_IO,
+        .ops = &block_ops,
+        .private = &disk_blk[1],
+    },
+};
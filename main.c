@@ -7,14 +7,145 @@
 #include <elf.h>
 #include <elf_loader.h>
 #include <lzma_loader.h>
+#include <xz_loader.h>
+#include <lz4_loader.h>
+#include <gzip_loader.h>
+#include <mzip_loader.h>
 #include <ciloio.h>
 #include <promlib.h>
+#include <storage/storage.h>
+#include <bootcache.h>
 
 /* platform-specific defines */
 #include <platform.h>
 
 #include <string.h>
 
+/**
+ * Load a kernel and jump to it. Only returns if the kernel couldn't be
+ * loaded.
+ * @param fp the open kernel file
+ * @param kernel name the kernel was given by
+ * @param cmd_line kernel command line
+ */
+static void boot_file(struct file *fp, const char *kernel, char *cmd_line)
+{
+    /* check if this is an LZMA-compressed kernel image. */
+    if (strstr(kernel, "lzma")) {
+        printf("Loading LZMA-compressed kernel image.\n");
+        load_lzma(fp, LOADADDR, cmd_line);
+    } else if (is_xz(fp)) {
+        printf("Loading xz-compressed kernel image.\n");
+        load_xz(fp, LOADADDR, cmd_line);
+    } else if (is_lz4(fp)) {
+        printf("Loading LZ4-compressed kernel image.\n");
+        load_lz4(fp, LOADADDR, cmd_line);
+    } else if (is_zstd(fp)) {
+        printf("Loading zstd-compressed kernel image.\n");
+        load_zstd(fp, LOADADDR, cmd_line);
+    } else if (is_gzip(fp)) {
+        printf("Loading gzip-compressed kernel image.\n");
+        load_gzip(fp, LOADADDR, cmd_line);
+    } else if (is_mzip(fp)) {
+        printf("Loading IOS MZIP image.\n");
+        load_mzip(fp, cmd_line);
+    } else {
+        printf("Booting %s.\n", kernel);
+        uint8_t *ident = cilo_map(fp, 0, ELF_IDENT_COUNT);
+
+        if (ident == NULL) {
+            printf("\"%s\" is not an ELF file.\n", kernel);
+            return;
+        }
+
+        /* check if this is a 32-bit or 64-bit kernel image. */
+        if (ident[ELF_INDEX_CLASS] == ELF_CLASS_32) { 
+            load_elf32_file(fp, cmd_line);
+        } else {
+            load_elf64_file(fp, cmd_line);
+        }
+    }
+}
+
+/**
+ * Boot the kernel recorded in the boot cache, if the header it points at
+ * still matches. Returns if there is no record, if it is stale, or if the
+ * kernel couldn't be loaded.
+ * @param cmd_line where the kernel command line goes
+ */
+static void boot_cached(char *cmd_line)
+{
+    struct boot_record rec;
+    struct file fp;
+
+    if (boot_cache_load(&rec)) {
+        return;
+    }
+
+    fp = cilo_locate(&rec);
+
+    if (fp.code == -1) {
+        printf("%s:%s has moved; scanning for files.\n", rec.device,
+            rec.filename);
+        return;
+    }
+
+    printf("Booting %s:%s from the boot cache.\n", rec.device,
+        rec.filename);
+    strcpy(cmd_line, rec.cmd_line);
+    boot_file(&fp, rec.filename, cmd_line);
+
+    printf("Boot from the boot cache failed; scanning for files.\n");
+    cilo_close(&fp);
+}
+
+/**
+ * Copy a file onto a device that can be written to. The file is read into
+ * RAM at the kernel load address, and checked if its device can check it,
+ * before the destination is touched.
+ * @param args "source destination", e.g. "slot0:vmlinux bootflash:vmlinux"
+ */
+static void copy_file(char *args)
+{
+    char *dst = (char *)strchr(args, ' ');
+    struct file src;
+    uint32_t len;
+
+    if (dst == NULL) {
+        printf("Usage: copy <device:file> <device:file>\n");
+        return;
+    }
+
+    *dst++ = '\0';
+
+    src = cilo_open(args);
+
+    if (src.code == -1) {
+        printf("Unable to find \"%s\".\n", args);
+        return;
+    }
+
+    len = src.file_len;
+
+    if (LOADADDR + len > LOAD_LIMIT) {
+        printf("\"%s\" does not fit in RAM.\n", args);
+        cilo_close(&src);
+        return;
+    }
+
+    cilo_read((void *)LOADADDR, len, 1, &src);
+
+    if (cilo_verify(&src) < 0) {
+        printf("Not copying a file that failed its check.\n");
+        cilo_close(&src);
+        return;
+    }
+
+    cilo_close(&src);
+
+    storage_write(dst, (void *)LOADADDR, len);
+}
+
 /**
  * Entry Point for CiscoLoad
  */
@@ -24,11 +155,11 @@ void start_bootloader()
     int f;
     char buf[129];
     char *cmd_line = (char *)MEMORY_BASE;
-    char kernel[49];
+    char kernel[81]; /* device:filename */
     const char *cmd_line_append;
 
     buf[128] = '\0';
-    kernel[48] = '\0';
+    kernel[80] = '\0';
 
     /* determine amount of RAM present */
     c_putc('I');
@@ -38,12 +169,8 @@ void start_bootloader()
     /* check flash filesystem sanity */
     c_putc('L');
 
-    f = check_flash();
-    
-    if (!f) {
-        printf("\nError: Unable to find any valid flash! Aborting load.\n");
-        return;
-    }
+    initialize_storage_manager();
+    register_storage();
 
     c_putc('O');
     platform_init();
@@ -51,6 +178,16 @@ void start_bootloader()
     printf("\nCiscoLoader (CILO) - Linux bootloader for Cisco Routers\n");
     printf("Available RAM: %d kB\n", r/1024);
 
+    /* go straight to last time's kernel if it hasn't moved */
+    boot_cached(cmd_line);
+
+    f = check_flash();
+    
+    if (!f) {
+        printf("\nError: Unable to find any valid flash! Aborting load.\n");
+        return;
+    }
+
     printf("Available files:\n");
     flash_directory();
 
@@ -58,6 +195,11 @@ enter_filename:
     printf("\nEnter filename to boot:\n> ");
     c_gets(buf, 128);
 
+    if (!strncmp(buf, "copy ", 5)) {
+        copy_file(buf + 5);
+        goto enter_filename;
+    }
+
     int baud = c_baud(); /* get console baud rate */
     
     /* determine if a command line string has been appended to kernel name */
@@ -65,8 +207,9 @@ enter_filename:
         strcpy(cmd_line, (char *)(cmd_line_append + 1));
         /* extract the kernel file name now */
         uint32_t kernel_name_len = cmd_line_append - buf;
+        if (kernel_name_len > 80) kernel_name_len = 80;
         strncpy(kernel, buf, kernel_name_len);
-        kernel[kernel_name_len + 1] = '\0';
+        kernel[kernel_name_len] = '\0';
         /* determine if console is set in the command line; if not,
          * append it.
          */
@@ -75,7 +218,7 @@ enter_filename:
         }
 
     } else {
-        strncpy(kernel, buf, 48);
+        strncpy(kernel, buf, 80);
         sprintf(cmd_line, "console=ttyS0,%d", baud);
     }
 
@@ -87,26 +230,10 @@ enter_filename:
         goto enter_filename;
     }
 
-    /* check if this is an LZMA-compressed kernel image. */
-    if (strstr(kernel, "lzma")) {
-        printf("Loading LZMA-compressed kernel image.\n");
-        load_lzma(&kernel_file, LOADADDR, cmd_line);
-    } else {
-        printf("Booting %s.\n", kernel);
-        struct elf32_header hdr;
-
-        cilo_read(&hdr, sizeof(struct elf32_header), 1, &kernel_file);
-        cilo_seek(&kernel_file, 0, SEEK_SET);
-
-        /* check if this is a 32-bit or 64-bit kernel image. */
-        if (hdr.ident[ELF_INDEX_CLASS] == ELF_CLASS_32) { 
-            load_elf32_file(&kernel_file, cmd_line);
-        } else {
-            load_elf64_file(&kernel_file, cmd_line);
-        }
-    }
+    boot_file(&kernel_file, kernel, cmd_line);
 
     printf("Fatal error while loading kernel. Aborting.\n");
+    cilo_close(&kernel_file);
 
     goto enter_filename;
 }
@@ -0,0 +1,71 @@
+/* mkcrc32 - generate the slicing-by-8 CRC32 tables used by crc32.c
+ * Licensed under the GNU General Public License v2
+ *
+ * Writes a C header to stdout holding the eight 256-entry tables for the
+ * reflected CRC-32 (polynomial 0xEDB88320). Two sets are written: one for
+ * little endian targets, and one with every entry byte swapped for big
+ * endian targets, which keep the CRC byte swapped while they work so that
+ * words can be used as loaded. crc32.c picks one with CRC32_BIG_ENDIAN.
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+#define POLY 0xEDB88320u
+
+static uint32_t swab32(uint32_t x)
+{
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+static void print_tables(uint32_t t[8][256], int swap)
+{
+    int k, i;
+
+    printf("static const uint32_t crc32_table[8][256] = {\n");
+
+    for (k = 0; k < 8; k++) {
+        printf("    {");
+        for (i = 0; i < 256; i++) {
+            if (i % 6 == 0) printf("\n        ");
+            printf("0x%08xu,%s", swap ? swab32(t[k][i]) : t[k][i],
+                (i % 6 == 5 || i == 255) ? "" : " ");
+        }
+        printf("\n    },\n");
+    }
+
+    printf("};\n");
+}
+
+int main(void)
+{
+    static uint32_t t[8][256];
+    uint32_t c;
+    int i, j, k;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++) {
+            c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+        }
+        t[0][i] = c;
+    }
+
+    /* t[k][i] is the CRC of byte i followed by k zero bytes */
+    for (k = 1; k < 8; k++) {
+        for (i = 0; i < 256; i++) {
+            t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+        }
+    }
+
+    printf("/* generated by mkcrc32, do not edit */\n");
+    printf("#ifndef _INCLUDE_CRC32_TABLE_H\n");
+    printf("#define _INCLUDE_CRC32_TABLE_H\n\n");
+    printf("#ifdef CRC32_BIG_ENDIAN\n");
+    print_tables(t, 1);
+    printf("#else\n");
+    print_tables(t, 0);
+    printf("#endif\n\n");
+    printf("#endif /* _INCLUDE_CRC32_TABLE_H */\n");
+
+    return 0;
+}
@@ -0,0 +1,332 @@
+/*
+ * IOS MZIP Image Loader
+ *
+ * Licensed under the GNU General Public License v.2.
+ * See COPYING in the root directory of this source distribution for more
+ * details.
+ *
+ * Chain-boots IOS from CILO. An MZIP image is a header giving the load
+ * address, entry point and CRCs, then a ZIP archive holding the image.
+ * The header and code segment CRCs are checked the way elf2mzip computes
+ * them, along with the CRC32 of the unpacked image. IOS is usually linked
+ * to run where CILO itself is, so it is unpacked to the top of RAM and a
+ * copy routine placed clear of both moves it down once nothing of CILO is
+ * needed any more.
+ */
+
+#include <printf.h>
+#include <promlib.h>
+#include <string.h>
+#include <crc32.h>
+#include <mzip_loader.h>
+
+#include <ciloio.h>
+#include <bootcache.h>
+#include <pipeline.h>
+#include <inflate.h>
+
+/* platform-specific defines */
+#include <platform.h>
+
+/* input block size when the file has to be read rather than mapped */
+#define MZIP_ASYNC_BLOCK 4096
+
+/* CRC-16/CCITT, kept inverted as elf2mzip does */
+#define MZIP_CRC_POLY 0x1021
+
+/* the header CRC covers everything before it; the code segment CRC starts
+ * with the rest of the header
+ */
+#define MZIP_HDR_CRC_LEN 0x36
+#define MZIP_CODE_CRC_START 0x38
+
+/* ZIP local file header */
+#define ZIP_LOCAL_MAGIC 0x04034b50
+#define ZIP_DESC_MAGIC 0x08074b50
+#define ZIP_LOCAL_LEN 30
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+#define ZIP_FLAG_ENCRYPTED 0x0001
+#define ZIP_FLAG_DESCRIPTOR 0x0008
+
+/* room at the top of the load window for the copy routine */
+#define MZIP_STUB_ROOM 256
+
+/* a dot for every this many bytes decoded */
+#define MZIP_TICK 0x80000
+
+#define mzip_le16(p) ((p)[0] | (p)[1] << 8)
+#define mzip_le32(p) \
+    ((p)[0] | (p)[1] << 8 | (p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+static uint16_t mzip_crc_table[256];
+
+/**
+ * Build the CRC table, the first time it is needed.
+ */
+static void mzip_crc_init(void)
+{
+    uint16_t ent;
+    int i, j;
+
+    if (mzip_crc_table[1] != 0) {
+        return;
+    }
+
+    for (i = 0; i < 256; i++) {
+        ent = i << 8;
+
+        for (j = 0; j < 8; j++) {
+            ent = ent & 0x8000 ? (ent << 1) ^ MZIP_CRC_POLY : ent << 1;
+        }
+
+        mzip_crc_table[i] = ent;
+    }
+}
+
+/**
+ * Add a buffer to an MZIP CRC. Shaped like crc32_update so it can drive a
+ * pipe_sum filter.
+ * @param crc CRC so far, 0 to start a new one
+ * @param buf data
+ * @param len length of the data
+ * @returns the updated CRC, in the low 16 bits
+ */
+static uint32_t mzip_crc(uint32_t crc, const void *buf, uint32_t len)
+{
+    const uint8_t *p = buf;
+    uint16_t c = ~crc;
+
+    while (len--) {
+        c = mzip_crc_table[((c >> 8) ^ *p++) & 0xff] ^ (c << 8);
+    }
+
+    return (uint16_t)~c;
+}
+
+/**
+ * Check if a file is an MZIP image.
+ * @param fp the file
+ * @returns non-zero if it starts with the MZIP magic
+ */
+int is_mzip(struct file *fp)
+{
+    uint8_t *p = cilo_map(fp, 0, 4);
+
+    return p != NULL && !strncmp((char *)p, "MZIP", 4);
+}
+
+/**
+ * Read bytes from outside the compressed data.
+ * @returns 0 on success, -1 if the code segment ends first
+ */
+static int mzip_read(struct inflate *z, uint8_t *buf, uint32_t len)
+{
+    int c;
+
+    while (len--) {
+        if ((c = inflate_byte(z)) < 0) {
+            return -1;
+        }
+
+        if (buf) *buf++ = c;
+    }
+
+    return 0;
+}
+
+/**
+ * Unpack the file in the ZIP archive that makes up the code segment.
+ * @param z decoder, at the start of the archive
+ * @param size set to the size of the file
+ * @returns 0 on success, -1 on error
+ */
+static int mzip_unzip(struct inflate *z, uint32_t *size)
+{
+    uint8_t zip[ZIP_LOCAL_LEN];
+    uint8_t *out = z->pos;
+    uint32_t flags, method, crc, len, packed;
+    int c;
+
+    if (mzip_read(z, zip, ZIP_LOCAL_LEN) < 0 ||
+        mzip_le32(zip) != ZIP_LOCAL_MAGIC)
+    {
+        printf("MZIP code segment is not a ZIP archive.\n");
+        return -1;
+    }
+
+    flags = mzip_le16(zip + 6);
+    method = mzip_le16(zip + 8);
+    crc = mzip_le32(zip + 14);
+    packed = mzip_le32(zip + 18);
+    len = mzip_le32(zip + 22);
+
+    if ((flags & ZIP_FLAG_ENCRYPTED) ||
+        (method != ZIP_DEFLATED && method != ZIP_STORED) ||
+        (method == ZIP_STORED && (flags & ZIP_FLAG_DESCRIPTOR)))
+    {
+        printf("Unsupported ZIP method %d, flags %04x.\n", method, flags);
+        return -1;
+    }
+
+    /* file name and extra field */
+    if (mzip_read(z, NULL, mzip_le16(zip + 26) + mzip_le16(zip + 28)) < 0) {
+        return -1;
+    }
+
+    if (method == ZIP_DEFLATED) {
+        if (inflate_raw(z) < 0) {
+            printf("\nError in decoding MZIP code segment.\n");
+            return -1;
+        }
+    } else {
+        if (packed > z->out_end - z->pos) {
+            return -1;
+        }
+
+        while (packed--) {
+            if ((c = inflate_byte(z)) < 0) return -1;
+            *z->pos++ = c;
+        }
+    }
+
+    /* CRC and sizes that weren't known when the header was written */
+    if (flags & ZIP_FLAG_DESCRIPTOR) {
+        if (mzip_read(z, zip, 4) < 0 ||
+            (mzip_le32(zip) == ZIP_DESC_MAGIC && mzip_read(z, zip, 4) < 0) ||
+            mzip_read(z, zip + 4, 8) < 0)
+        {
+            return -1;
+        }
+
+        crc = mzip_le32(zip);
+        len = mzip_le32(zip + 8);
+    }
+
+    *size = z->pos - out;
+
+    if (*size != len || crc32_update(0, out, *size) != crc) {
+        printf("\nMZIP image failed its CRC32 or length check.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Print a dot for each MZIP_TICK bytes decoded.
+ */
+static void mzip_tick(struct inflate *z)
+{
+    while (z->pos >= z->tick_at) {
+        c_putc('.');
+        z->tick_at += MZIP_TICK;
+    }
+}
+
+void load_mzip(struct file *fp, char *cmd_line)
+{
+    struct mzip_header hdr;
+    struct pipe_file src;
+    struct pipe_sum crc;
+    struct inflate z;
+    uint8_t bufs[2][MZIP_ASYNC_BLOCK];
+    const uint8_t *buf;
+    uint8_t *p;
+    uint32_t dst, out, stub, image, size, len;
+
+    mzip_crc_init();
+
+    if ((p = cilo_map(fp, 0, MZIP_HDR_SIZE)) == NULL) {
+        printf("Truncated MZIP header.\n");
+        return;
+    }
+
+    memcpy(&hdr, p, MZIP_HDR_SIZE);
+    p = (uint8_t *)&hdr;
+
+    if (mzip_crc(0, p, MZIP_HDR_CRC_LEN) != hdr.hdr_crc_header) {
+        printf("Corrupt MZIP header.\n");
+        return;
+    }
+
+    if (hdr.hdr_header_size < MZIP_HDR_SIZE ||
+        hdr.hdr_header_size > fp->file_len ||
+        hdr.hdr_code_packed_size > fp->file_len - hdr.hdr_header_size)
+    {
+        printf("MZIP code segment lies outside the file.\n");
+        return;
+    }
+
+    /* memory the image takes once running, its BSS included */
+    dst = hdr.hdr_loader_addr;
+    image = hdr.hdr_memory_image_size > hdr.hdr_code_unpacked_size ?
+        hdr.hdr_memory_image_size : hdr.hdr_code_unpacked_size;
+    image = (image + 3) & ~3;
+    stub = (LOAD_LIMIT - MZIP_STUB_ROOM) & ~31;
+
+    if (dst < MEMORY_BASE || dst > stub || image > stub - dst ||
+        hdr.hdr_entrypt < dst || hdr.hdr_entrypt >= dst + image)
+    {
+        printf("MZIP image at 0x%08x, %d bytes, does not fit in RAM.\n",
+            dst, image);
+        return;
+    }
+
+    /* unpack in place if that is clear of CILO, else to the top of RAM */
+    if (dst >= LOADADDR) {
+        out = dst;
+    } else {
+        out = (stub - image) & ~31;
+
+        if (out < dst + image || out < LOADADDR) {
+            printf("No room to unpack a %d byte MZIP image.\n", image);
+            return;
+        }
+    }
+
+    pipe_file_init(&src, fp, hdr.hdr_header_size, hdr.hdr_code_packed_size,
+        bufs[0], MZIP_ASYNC_BLOCK);
+
+    pipe_sum_init(&crc, &src.st, mzip_crc, mzip_crc(0,
+        p + MZIP_CODE_CRC_START, MZIP_HDR_SIZE - MZIP_CODE_CRC_START));
+
+    inflate_init(&z, &crc.st, (uint8_t *)out, image);
+
+#ifndef NO_LOAD_PROGRESS
+    z.tick = mzip_tick;
+    z.tick_at = (uint8_t *)out + MZIP_TICK;
+#endif
+
+    if (mzip_unzip(&z, &size) < 0) {
+        printf("Aborting.\n");
+        return;
+    }
+
+    /* the rest of the code segment, for its CRC */
+    do {
+        if (crc.st.pull(&crc.st, &buf, &len) < 0) {
+            return;
+        }
+    } while (len);
+
+    if (crc.sum != hdr.hdr_crc_code || size != hdr.hdr_code_unpacked_size) {
+        printf("\nMZIP code segment failed its CRC. Aborting.\n");
+        return;
+    }
+
+    memzero((uint8_t *)out + size, image - size);
+
+    if (cilo_verify(fp) < 0) {
+        printf("Refusing to boot an unverified image.\n");
+        return;
+    }
+
+    boot_cache_save(fp, cmd_line);
+
+    printf("\nDecompressed %d bytes.\n", size);
+    printf("Starting IOS at 0x%08x.\n\n", hdr.hdr_entrypt);
+
+    /* nothing of CILO is used from here on */
+    platform_chain((void *)stub, dst, (void *)out, image, hdr.hdr_entrypt);
+}
@@ -0,0 +1,380 @@
+/* Streaming pipeline stages
+ * Licensed under the GNU General Public License v2
+ *
+ * Loaders build a chain of stages - a source, any filters, and a sink
+ * pulling from the end of the chain - instead of each reading the file
+ * its own way. Sources here are files (flash, ATA, anything cilo_open()
+ * can open) and the console; a checksum is a filter any loader can put in
+ * the chain, and decompressors are filters kept next to the loader for
+ * their format.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <promlib.h>
+#include <ciloio.h>
+#include <pipeline.h>
+
+/**
+ * Bytes of a file source left to hand out, up to one chunk.
+ */
+static uint32_t pipe_file_next(struct pipe_file *pf, uint32_t max)
+{
+    uint32_t pos = cilo_tell(pf->fp);
+
+    if (pos >= pf->end) {
+        return 0;
+    }
+
+    return pf->end - pos < max ? pf->end - pos : max;
+}
+
+/**
+ * Start reading the next chunk of a file into the free buffer.
+ */
+static void pipe_file_start(struct pipe_file *pf)
+{
+    uint32_t n = pipe_file_next(pf, pf->chunk);
+
+    if (n) {
+        cilo_read_async(&pf->reqs[pf->cur], pf->bufs[pf->cur], n, pf->fp);
+        pf->busy = 1;
+    }
+}
+
+static int pipe_file_pull(struct pipe_stage *st, const uint8_t **buf,
+    uint32_t *len)
+{
+    struct pipe_file *pf = (struct pipe_file *)st;
+    struct cilo_req *req;
+
+    /* hand out mapped files in place */
+    if (pf->fp->mapped) {
+        *len = pipe_file_next(pf, pf->chunk);
+
+        if (*len == 0) {
+            return 0;
+        }
+
+        if ((*buf = cilo_map(pf->fp, cilo_tell(pf->fp), *len)) == NULL) {
+            printf("Unable to map %s.\n", pf->fp->filename);
+            return -1;
+        }
+
+        cilo_seek(pf->fp, *len, SEEK_CUR);
+        return 0;
+    }
+
+    if (pf->bufs[0] == NULL) {
+        printf("No buffers to read %s into.\n", pf->fp->filename);
+        return -1;
+    }
+
+    if (!pf->busy) {
+        pipe_file_start(pf);
+    }
+
+    if (!pf->busy) {
+        *len = 0;
+        return 0;
+    }
+
+    req = &pf->reqs[pf->cur];
+    while (cilo_poll(req) == CILO_REQ_PENDING);
+    pf->busy = 0;
+
+    if (req->state != CILO_REQ_DONE) {
+        printf("Error while reading %s.\n", pf->fp->filename);
+        return -1;
+    }
+
+    *buf = req->buf;
+    *len = req->len;
+
+    /* read the next chunk while the caller works on this one */
+    pf->cur ^= 1;
+    pipe_file_start(pf);
+
+    return 0;
+}
+
+static int32_t pipe_file_read(struct pipe_stage *st, void *dst, uint32_t len)
+{
+    struct pipe_file *pf = (struct pipe_file *)st;
+    struct cilo_req *req = &pf->reqs[pf->cur];
+
+    /* drop a read ahead; the caller wants the data somewhere else */
+    if (pf->busy) {
+        while (cilo_poll(req) == CILO_REQ_PENDING);
+        cilo_seek(pf->fp, req->offset, SEEK_SET);
+        pf->busy = 0;
+    }
+
+    if ((len = pipe_file_next(pf, len)) == 0) {
+        return 0;
+    }
+
+    if (dst == NULL) {
+        cilo_seek(pf->fp, len, SEEK_CUR);
+        return len;
+    }
+
+    return cilo_read(dst, len, 1, pf->fp);
+}
+
+static const uint8_t *pipe_file_map(struct pipe_stage *st, uint32_t *len)
+{
+    struct pipe_file *pf = (struct pipe_file *)st;
+    const uint8_t *p;
+
+    if (!pf->fp->mapped || pf->busy) {
+        return NULL;
+    }
+
+    *len = pipe_file_next(pf, 0xffffffff);
+
+    if ((p = cilo_map(pf->fp, cilo_tell(pf->fp), *len)) != NULL) {
+        cilo_seek(pf->fp, *len, SEEK_CUR);
+    }
+
+    return p;
+}
+
+/**
+ * Set up a stage reading part of a file.
+ * @param pf stage to set up
+ * @param fp file to read
+ * @param offset offset of the first byte of the stream in the file
+ * @param len length of the stream
+ * @param bufs two buffers of chunk bytes, for files that can't be mapped.
+ *        May be NULL if the stream is only consumed with read().
+ * @param chunk bytes handed out by each pull
+ */
+void pipe_file_init(struct pipe_file *pf, struct file *fp, uint32_t offset,
+    uint32_t len, uint8_t *bufs, uint32_t chunk)
+{
+    pf->st.pull = pipe_file_pull;
+    pf->st.read = pipe_file_read;
+    pf->st.map = pipe_file_map;
+    pf->st.up = NULL;
+
+    pf->fp = fp;
+    pf->chunk = chunk;
+    pf->end = offset + len;
+
+    if (pf->end > fp->file_len || pf->end < offset) {
+        pf->end = fp->file_len;
+    }
+
+    pf->bufs[0] = bufs;
+    pf->bufs[1] = bufs ? bufs + chunk : NULL;
+    pf->cur = 0;
+    pf->busy = 0;
+
+    cilo_seek(fp, offset, SEEK_SET);
+}
+
+static int pipe_serial_pull(struct pipe_stage *st, const uint8_t **buf,
+    uint32_t *len)
+{
+    struct pipe_serial *ps = (struct pipe_serial *)st;
+    uint32_t i;
+
+    *len = ps->left < ps->chunk ? ps->left : ps->chunk;
+    *buf = ps->buf;
+
+    for (i = 0; i < *len; i++) {
+        ps->buf[i] = c_getc();
+    }
+
+    ps->left -= *len;
+
+    return 0;
+}
+
+static int32_t pipe_serial_read(struct pipe_stage *st, void *dst,
+    uint32_t len)
+{
+    struct pipe_serial *ps = (struct pipe_serial *)st;
+    uint8_t *out = dst;
+    uint32_t i;
+    char c;
+
+    if (len > ps->left) {
+        len = ps->left;
+    }
+
+    for (i = 0; i < len; i++) {
+        c = c_getc();
+        if (out) out[i] = c;
+    }
+
+    ps->left -= len;
+
+    return len;
+}
+
+/**
+ * Set up a stage reading raw bytes from the console.
+ * @param ps stage to set up
+ * @param len number of bytes to expect
+ * @param buf buffer of chunk bytes
+ * @param chunk bytes handed out by each pull
+ */
+void pipe_serial_init(struct pipe_serial *ps, uint32_t len, uint8_t *buf,
+    uint32_t chunk)
+{
+    ps->st.pull = pipe_serial_pull;
+    ps->st.read = pipe_serial_read;
+    ps->st.map = NULL;
+    ps->st.up = NULL;
+
+    ps->left = len;
+    ps->buf = buf;
+    ps->chunk = chunk;
+}
+
+static int pipe_sum_pull(struct pipe_stage *st, const uint8_t **buf,
+    uint32_t *len)
+{
+    struct pipe_sum *ps = (struct pipe_sum *)st;
+
+    if (st->up->pull(st->up, buf, len) < 0) {
+        return -1;
+    }
+
+    ps->sum = ps->update(ps->sum, *buf, *len);
+    ps->count += *len;
+
+    return 0;
+}
+
+/**
+ * Set up a filter keeping a checksum of everything pulled through it.
+ * @param ps stage to set up
+ * @param up stage to pull from
+ * @param update adds a buffer to the checksum, e.g. crc32_update
+ * @param sum checksum to start from
+ */
+void pipe_sum_init(struct pipe_sum *ps, struct pipe_stage *up,
+    uint32_t (*update)(uint32_t sum, const void *buf, uint32_t len),
+    uint32_t sum)
+{
+    ps->st.pull = pipe_sum_pull;
+    ps->st.read = NULL;
+    ps->st.map = NULL;
+    ps->st.up = up;
+
+    ps->update = update;
+    ps->sum = sum;
+    ps->count = 0;
+}
+
+/**
+ * Set up a cursor for consuming the output of a stage piecemeal.
+ * @param rd cursor to set up
+ * @param st last stage of the chain
+ */
+void pipe_reader_init(struct pipe_reader *rd, struct pipe_stage *st)
+{
+    rd->st = st;
+    rd->buf = NULL;
+    rd->len = 0;
+    rd->pos = 0;
+}
+
+/**
+ * Take the next len bytes of a stream. Stages that can read straight into
+ * the destination are asked to, once the last buffer pulled is used up.
+ * @param rd cursor on the stream
+ * @param dst where to copy the bytes, or NULL to skip over them
+ * @param len number of bytes
+ * @returns 0 on success, -1 on error or if the stream ends first
+ */
+int pipe_read(struct pipe_reader *rd, void *dst, uint32_t len)
+{
+    uint8_t *out = dst;
+    uint32_t n;
+    int32_t r;
+
+    while (len) {
+        if (rd->len == 0 && rd->st->read != NULL) {
+            if ((r = rd->st->read(rd->st, out, len)) <= 0) {
+                return -1;
+            }
+
+            n = r;
+        } else {
+            if (rd->len == 0 &&
+                (rd->st->pull(rd->st, &rd->buf, &rd->len) < 0 ||
+                 rd->len == 0))
+            {
+                return -1;
+            }
+
+            n = rd->len < len ? rd->len : len;
+
+            if (out) memcpy(out, rd->buf, n);
+            rd->buf += n;
+            rd->len -= n;
+        }
+
+        if (out) out += n;
+        rd->pos += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * Sink: pull a whole stream into memory. Buffers that a stage has already
+ * placed at their destination are not copied.
+ * @param st last stage of the chain
+ * @param dst where the stream goes
+ * @param max most bytes the destination can take
+ * @returns number of bytes in the stream, or -1 on error
+ */
+int32_t pipe_to_memory(struct pipe_stage *st, void *dst, uint32_t max)
+{
+    uint8_t *out = dst;
+    const uint8_t *buf;
+    uint32_t len, total = 0;
+    int32_t r;
+
+    if (st->read != NULL) {
+        while (total < max && (r = st->read(st, out + total, max - total))) {
+            if (r < 0) return -1;
+            total += r;
+        }
+
+        if (total == max && st->read(st, NULL, 1) > 0) {
+            printf("Stream overflows its %d byte destination.\n", max);
+            return -1;
+        }
+
+        return total;
+    }
+
+    for (;;) {
+        if (st->pull(st, &buf, &len) < 0) {
+            return -1;
+        }
+
+        if (len == 0) {
+            return total;
+        }
+
+        if (len > max - total) {
+            printf("Stream overflows its %d byte destination.\n", max);
+            return -1;
+        }
+
+        if (buf != out + total) {
+            memcpy(out + total, buf, len);
+        }
+
+        total += len;
+    }
+}
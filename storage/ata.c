@@ -0,0 +1,261 @@
+/* PIO driver for memory-mapped ATA devices
+ * Licensed under the GNU General Public License v2
+ *
+ * Reads use READ MULTIPLE where the device supports it, so a whole run of
+ * up to 256 sectors costs one command and the device only stops for a DRQ
+ * handshake every ata_dev.multi sectors. Data is read 32 bits at a time
+ * where the platform says the bus allows it. Sector data is copied as a
+ * byte stream; the bus is expected to present the device's bytes in
+ * order, as it must for the data to be usable at all.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <storage/block.h>
+#include <storage/ata.h>
+
+#define ata_inb(dev, reg) (*(volatile uint8_t *)((dev)->regs + (reg)))
+#define ata_outb(dev, reg, val) \
+    (*(volatile uint8_t *)((dev)->regs + (reg)) = (val))
+
+/* IDENTIFY DEVICE data is little endian 16-bit words */
+#define ID_WORD(id, n) ((id)[2 * (n)] | ((id)[2 * (n) + 1] << 8))
+
+/**
+ * Wait for the device to clear BSY and set the given status bits
+ * @param dev the device
+ * @param bits status bits that must be set
+ * @returns the status register, or -1 on a timeout or an error
+ */
+static int ata_wait(struct ata_dev *dev, uint8_t bits)
+{
+    uint32_t i;
+    uint8_t sr;
+
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        sr = ata_inb(dev, ATA_REG_STATUS);
+
+        if (sr & ATA_SR_BSY) continue;
+
+        if (sr & (ATA_SR_ERR | ATA_SR_DF)) return -1;
+
+        if ((sr & bits) == bits) return sr;
+    }
+
+    return -1;
+}
+
+/**
+ * Read a DRQ block from the data register
+ * @param dev the device
+ * @param buf destination
+ * @param len number of bytes, a multiple of 16
+ */
+static void ata_read_data(struct ata_dev *dev, void *buf, uint32_t len)
+{
+    uint32_t i;
+
+    if ((dev->flags & ATA_DATA32) && ((uint32_t)buf & 3) == 0) {
+        volatile uint32_t *data = (volatile uint32_t *)dev->data;
+        uint32_t *dst = buf;
+
+        for (i = 0; i < len / 4; i += 4) {
+            dst[i] = *data;
+            dst[i + 1] = *data;
+            dst[i + 2] = *data;
+            dst[i + 3] = *data;
+        }
+    } else if (((uint32_t)buf & 1) == 0) {
+        volatile uint16_t *data = (volatile uint16_t *)dev->data;
+        uint16_t *dst = buf;
+
+        for (i = 0; i < len / 2; i++) {
+            dst[i] = *data;
+        }
+    } else {
+        volatile uint16_t *data = (volatile uint16_t *)dev->data;
+        uint8_t *dst = buf;
+        uint16_t w;
+
+        for (i = 0; i < len; i += 2) {
+            w = *data;
+            memcpy(dst + i, &w, 2);
+        }
+    }
+}
+
+/**
+ * Issue a command that takes an LBA and a sector count
+ * @param dev the device
+ * @param cmd the command
+ * @param lba first sector
+ * @param count number of sectors, 1 to 256
+ * @returns 0 on success, -1 if the device didn't become ready
+ */
+static int ata_command(struct ata_dev *dev, uint8_t cmd, uint32_t lba,
+    uint32_t count)
+{
+    if (ata_wait(dev, ATA_SR_DRDY) < 0) {
+        return -1;
+    }
+
+    ata_outb(dev, ATA_REG_COUNT, count & 0xff); /* 0 means 256 */
+    ata_outb(dev, ATA_REG_LBA0, lba & 0xff);
+    ata_outb(dev, ATA_REG_LBA1, (lba >> 8) & 0xff);
+    ata_outb(dev, ATA_REG_LBA2, (lba >> 16) & 0xff);
+    ata_outb(dev, ATA_REG_DEVICE, ATA_DEV_LBA | ((lba >> 24) & 0x0f));
+    ata_outb(dev, ATA_REG_COMMAND, cmd);
+
+    return 0;
+}
+
+/**
+ * Look for an ATA device without writing to anything: the slot may hold a
+ * flash card with no filesystem on it, and writes would reach it as flash
+ * commands. The status register and the alternate status register are
+ * the same register, where a flash card has two unrelated bytes, and a
+ * device out of reset is ready. Blank flash, and an empty bus, read 0xFF.
+ * @param dev the device
+ * @returns non-zero if there seems to be an ATA device
+ */
+static int ata_present(struct ata_dev *dev)
+{
+    uint32_t i;
+    uint8_t sr;
+
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        sr = ata_inb(dev, ATA_REG_STATUS);
+
+        if (sr == 0xff || sr != *(volatile uint8_t *)dev->ctl) {
+            return 0;
+        }
+
+        if (!(sr & ATA_SR_BSY)) {
+            return (sr & (ATA_SR_DRDY | ATA_SR_DF)) == ATA_SR_DRDY;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Check for an ATA device, identify it and enable READ MULTIPLE.
+ * @param bdev block device whose private data is the ata_dev
+ * @returns non-zero if a usable device is present
+ */
+int ata_probe(struct block_dev *bdev)
+{
+    struct ata_dev *dev = bdev->private;
+    uint32_t idbuf[BLOCK_SIZE / sizeof(uint32_t)];
+    uint8_t *id = (uint8_t *)idbuf;
+    uint32_t max, multi;
+
+    dev->multi = 0;
+    bdev->sectors = 0;
+
+    /* nothing is written until the registers look like ATA */
+    if (!ata_present(dev)) {
+        return 0;
+    }
+
+    /* no interrupts; we poll */
+    *(volatile uint8_t *)dev->ctl = ATA_CTL_NIEN;
+
+    /* and a device will hold on to what is written to its task file */
+    ata_outb(dev, ATA_REG_DEVICE, ATA_DEV_LBA);
+    ata_outb(dev, ATA_REG_COUNT, 0x55);
+    ata_outb(dev, ATA_REG_LBA0, 0xaa);
+
+    if (ata_inb(dev, ATA_REG_COUNT) != 0x55 ||
+        ata_inb(dev, ATA_REG_LBA0) != 0xaa)
+    {
+        return 0;
+    }
+
+    if (ata_wait(dev, ATA_SR_DRDY) < 0) {
+        return 0;
+    }
+
+    ata_outb(dev, ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+
+    if (ata_wait(dev, ATA_SR_DRQ) < 0) {
+        return 0;
+    }
+
+    ata_read_data(dev, id, BLOCK_SIZE);
+
+    /* CHS-only devices aren't supported */
+    if (!(ID_WORD(id, 49) & 0x0200)) {
+        printf("ATA: device doesn't support LBA addressing\n");
+        return 0;
+    }
+
+    bdev->sectors = ID_WORD(id, 60) | (ID_WORD(id, 61) << 16);
+
+    /* largest power of two no greater than the device's maximum */
+    max = ID_WORD(id, 47) & 0xff;
+    for (multi = 1; multi * 2 <= max; multi *= 2);
+
+    if (max) {
+        if (ata_command(dev, ATA_CMD_SET_MULTIPLE, 0, multi) == 0 &&
+            ata_wait(dev, ATA_SR_DRDY) >= 0)
+        {
+            dev->multi = multi;
+        }
+    }
+
+#ifdef DEBUG
+    printf("ATA: %d sectors, %d sectors per DRQ block, %d-bit data\n",
+        bdev->sectors, dev->multi ? dev->multi : 1,
+        (dev->flags & ATA_DATA32) ? 32 : 16);
+#endif
+
+    return 1;
+}
+
+/**
+ * Read sectors from an ATA device
+ * @param bdev block device whose private data is the ata_dev
+ * @param lba first sector
+ * @param count number of sectors
+ * @param buf destination
+ * @returns 0 on success, < 0 on an error
+ */
+int ata_read(struct block_dev *bdev, uint32_t lba, uint32_t count, void *buf)
+{
+    struct ata_dev *dev = bdev->private;
+    uint8_t *out = buf;
+    uint8_t cmd = dev->multi ? ATA_CMD_READ_MULTIPLE : ATA_CMD_READ_SECTORS;
+    uint32_t step = dev->multi ? dev->multi : 1;
+    uint32_t n, blk;
+
+    while (count) {
+        n = count > 256 ? 256 : count;
+
+        if (ata_command(dev, cmd, lba, n) < 0) {
+            return -1;
+        }
+
+        count -= n;
+
+        /* one DRQ handshake per block of step sectors */
+        while (n) {
+            blk = n > step ? step : n;
+
+            if (ata_wait(dev, ATA_SR_DRQ) < 0) {
+                printf("ATA: error %02x reading sector %d\n",
+                    ata_inb(dev, ATA_REG_ERROR), lba);
+                return -1;
+            }
+
+            ata_read_data(dev, out, blk * BLOCK_SIZE);
+
+            out += blk * BLOCK_SIZE;
+            lba += blk;
+            n -= blk;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+/* Block devices for the storage manager
+ * Licensed under the GNU General Public License v2
+ *
+ * A block device is registered as a storage class whose private data is a
+ * struct block_dev. Files are opened from the FAT filesystem on the device,
+ * if there is one; the device as a whole can be opened by giving the device
+ * name with an empty file name, e.g. "disk0:".
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <ciloio.h>
+#include <storage/storage.h>
+#include <storage/block.h>
+#include <filesys/fat.h>
+
+/* holds partial sectors at either end of a read */
+static uint32_t block_bounce[BLOCK_SIZE / sizeof(uint32_t)];
+
+/**
+ * Read a byte range from a block device. Whole sectors are read straight
+ * into buf, with as many sectors per request as possible; partial sectors
+ * go through a bounce buffer.
+ * @param bdev the device
+ * @param lba sector the range is relative to
+ * @param offset byte offset of the range from the start of that sector
+ * @param buf destination
+ * @param len number of bytes
+ * @returns 0 on success, < 0 on a device error
+ */
+int block_read_bytes(struct block_dev *bdev, uint32_t lba, uint32_t offset,
+    void *buf, uint32_t len)
+{
+    uint8_t *out = buf;
+    uint32_t n;
+
+    lba += offset / BLOCK_SIZE;
+    offset %= BLOCK_SIZE;
+
+    while (len) {
+        if (offset == 0 && len >= BLOCK_SIZE) {
+            n = len / BLOCK_SIZE;
+
+            if (bdev->read(bdev, lba, n, out) < 0) return -1;
+
+            lba += n;
+            n *= BLOCK_SIZE;
+        } else {
+            if (bdev->read(bdev, lba, 1, block_bounce) < 0) return -1;
+
+            n = BLOCK_SIZE - offset;
+            if (n > len) n = len;
+
+            memcpy(out, (uint8_t *)block_bounce + offset, n);
+
+            lba++;
+            offset = 0;
+        }
+
+        out += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * Probe the block device behind a storage class
+ * @param sto the storage class
+ * @returns non-zero if the device is present
+ */
+static uint32_t block_probe(struct storage_class *sto)
+{
+    struct block_dev *bdev = sto->private;
+
+    if (!bdev->probe(bdev)) {
+        return 0;
+    }
+
+    bdev->fs = fat_mount(bdev);
+
+    return 1;
+}
+
+/**
+ * Open a file on the device's filesystem, or the whole device if filename
+ * is empty.
+ * @param sto the storage class
+ * @param fp file structure to fill in
+ * @param filename name of the file
+ * @returns non-zero if the file was found
+ */
+static int block_lookup(struct storage_class *sto, struct file *fp,
+    const char *filename)
+{
+    struct block_dev *bdev = sto->private;
+
+    if (filename[0] != '\0') {
+        return bdev->fs != NULL && fat_open(bdev->fs, filename, fp) != NULL;
+    }
+
+    fp->private = NULL;
+    fp->file_pos = 0;
+
+    /* only the first 4GB of a larger device can be read this way */
+    if (bdev->sectors >= 0xFFFFFFFF / BLOCK_SIZE) {
+        fp->file_len = 0xFFFFFFFF;
+    } else {
+        fp->file_len = bdev->sectors * BLOCK_SIZE;
+    }
+
+    strncpy(fp->filename, sto->dev_name, sizeof(sto->dev_name));
+
+    return 1;
+}
+
+/**
+ * Read data from a file on a block device
+ * @param pbuf Buffer to read data into
+ * @param size size of entity to be read
+ * @param nmemb number of members to read
+ * @param fp file information structure to read from.
+ * @returns number of bytes read
+ */
+static uint32_t block_read(void *pbuf, uint32_t size, uint32_t nmemb,
+    struct file *fp)
+{
+    struct block_dev *bdev = fp->sto->private;
+    uint32_t len = size * nmemb;
+    int r;
+
+    if (fp->file_pos >= fp->file_len) {
+        return 0;
+    }
+
+    if (len > fp->file_len - fp->file_pos) {
+        len = fp->file_len - fp->file_pos;
+    }
+
+    if (fp->private != NULL) {
+        r = fat_read(fp->private, fp->file_pos, pbuf, len);
+    } else {
+        r = block_read_bytes(bdev, 0, fp->file_pos, pbuf, len);
+    }
+
+    if (r < 0) {
+        printf("%s: read error at offset %d\n", fp->filename, fp->file_pos);
+        return 0;
+    }
+
+    fp->file_pos += len;
+
+    return len;
+}
+
+/**
+ * Print a directory listing of a block device
+ * @param sto the storage class
+ */
+static void block_list(struct storage_class *sto)
+{
+    struct block_dev *bdev = sto->private;
+
+    if (bdev->fs != NULL) {
+        fat_list(bdev->fs);
+    } else {
+        printf("(no filesystem, %d sectors)\n", bdev->sectors);
+    }
+}
+
+/**
+ * Close a file on a block device
+ * @param fp the file
+ */
+static void block_close(struct file *fp)
+{
+    if (fp->private != NULL) {
+        fat_close(fp->private);
+        fp->private = NULL;
+    }
+}
+
+struct storage_ops block_ops = {
+    .probe = block_probe,
+    .lookup = block_lookup,
+    .read = block_read,
+    .map = NULL,
+    .list = block_list,
+    .close = block_close,
+    .read_async = NULL,
+    .poll = NULL,
+};
@@ -0,0 +1,755 @@
+/* Common Flash Interface query and programming support
+ * Licensed under the GNU General Public License v2
+ *
+ * Identifies a NOR flash array from its CFI query table: the command set,
+ * the bus width and how many devices share it, the size and erase layout,
+ * the write buffer and whether the parts can do page-mode reads. The base
+ * address given must be an uncached window onto the array, since the array
+ * stops returning its contents while it is in query mode; it is always put
+ * back into read-array mode before returning.
+ *
+ * Programming uses the parts' write buffers where they have them, so each
+ * program operation covers a whole buffer rather than a single word. Erase
+ * skips blocks that are already blank, and on AMD parts queues a batch of
+ * blocks in one erase command so the device erases them back to back.
+ * Intel (0x0001/0x0003) and AMD (0x0002) command sets are supported.
+ */
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <storage/cfi.h>
+
+/* bus accessors; a host build can define these to drive a flash model */
+#ifndef CFI_BUS_READ
+#define CFI_BUS_READ(width, addr) ((width) == 4 ? \
+    *(volatile uint32_t *)(addr) : (width) == 2 ? \
+    *(volatile uint16_t *)(addr) : *(volatile uint8_t *)(addr))
+#define CFI_BUS_WRITE(width, addr, val) do { \
+    if ((width) == 4) *(volatile uint32_t *)(addr) = (val); \
+    else if ((width) == 2) *(volatile uint16_t *)(addr) = (val); \
+    else *(volatile uint8_t *)(addr) = (val); \
+} while (0)
+#endif
+
+/* query table offsets, in device words */
+#define CFI_QUERY_ADDR  0x55
+#define CFI_QRY         0x10
+#define CFI_CMDSET      0x13
+#define CFI_EXT_TABLE   0x15
+#define CFI_DEV_SIZE    0x27
+#define CFI_WBUF_SIZE   0x2A
+#define CFI_NREGIONS    0x2C
+#define CFI_REGION(n)   (0x2D + 4 * (n))
+
+/* commands */
+#define CFI_CMD_QUERY       0x98
+#define CFI_CMD_READ_ID     0x90
+#define CFI_CMD_INTEL_RESET 0xFF
+#define CFI_CMD_AMD_RESET   0xF0
+#define CFI_CMD_AMD_UNLOCK1 0xAA
+#define CFI_CMD_AMD_UNLOCK2 0x55
+
+#define CFI_CMD_INTEL_ERASE        0x20
+#define CFI_CMD_INTEL_PROGRAM      0x40
+#define CFI_CMD_INTEL_CLEAR_STATUS 0x50
+#define CFI_CMD_INTEL_LOCK_SETUP   0x60
+#define CFI_CMD_INTEL_CONFIRM      0xD0
+#define CFI_CMD_INTEL_BUFFER       0xE8
+
+#define CFI_CMD_AMD_SETUP        0x80
+#define CFI_CMD_AMD_ERASE_SECTOR 0x30
+#define CFI_CMD_AMD_PROGRAM      0xA0
+#define CFI_CMD_AMD_BUFFER       0x25
+#define CFI_CMD_AMD_BUFFER_DONE  0x29
+
+/* Intel status register */
+#define CFI_SR_READY  0x80
+#define CFI_SR_ERRORS 0x3A /* erase, program, VPP and lock errors */
+#define CFI_SR_LOCKED 0x02
+
+/* AMD status bits */
+#define CFI_DQ6_TOGGLE  0x40
+#define CFI_DQ5_TIMEOUT 0x20
+#define CFI_DQ3_ERASING 0x08
+
+/* status polls before an operation is given up on; well over the longest
+ * block erase time of the parts seen on these boxes
+ */
+#define CFI_TIMEOUT 0x8000000
+
+/* blocks queued in one AMD erase command */
+#define CFI_ERASE_BATCH 32
+
+/* result of a failed operation on a locked Intel block */
+#define CFI_LOCKED -2
+
+/* AMD unlock cycle addresses, in device words */
+#define CFI_AMD_ADDR1 0x555
+#define CFI_AMD_ADDR2 0x2AA
+
+/* Intel extended table: optional feature bits, page-mode read in bit 7 */
+#define CFI_INTEL_FEATURES 5
+#define CFI_INTEL_PAGE_MODE 0x80
+/* Intel parts don't give a page size in the table; theirs are 4 words */
+#define CFI_INTEL_PAGE_WORDS 4
+
+/* AMD extended table: page mode type, 1 = 4 words, 2 = 8, 3 = 16 */
+#define CFI_AMD_PAGE_MODE 0x0C
+
+/**
+ * Read one bus word at a byte offset into the array
+ */
+static uint32_t cfi_rd(struct cfi_info *cfi, uint32_t off)
+{
+    return CFI_BUS_READ(cfi->width, cfi->base + off);
+}
+
+/**
+ * Write one bus word at a byte offset into the array
+ */
+static void cfi_wr(struct cfi_info *cfi, uint32_t off, uint32_t val)
+{
+    CFI_BUS_WRITE(cfi->width, cfi->base + off, val);
+}
+
+/**
+ * Read one bus word at the given device word offset
+ */
+static uint32_t cfi_read(struct cfi_info *cfi, uint32_t off)
+{
+    return cfi_rd(cfi, off * cfi->width);
+}
+
+/**
+ * Repeat a byte-wide command or value for every device on the bus
+ */
+static uint32_t cfi_lanes(struct cfi_info *cfi, uint8_t val)
+{
+    uint32_t chip = cfi->width / cfi->interleave;
+    uint32_t r = 0;
+    int i;
+
+    for (i = 0; i < cfi->interleave; i++) {
+        r |= (uint32_t)val << (i * chip * 8);
+    }
+
+    return r;
+}
+
+/**
+ * Write a command to every device on the bus at a device word offset
+ */
+static void cfi_write(struct cfi_info *cfi, uint32_t off, uint8_t cmd)
+{
+    cfi_wr(cfi, off * cfi->width, cfi_lanes(cfi, cmd));
+}
+
+/**
+ * Write a command to every device on the bus at a byte offset, for the
+ * commands that take a block or buffer address
+ */
+static void cfi_cmd(struct cfi_info *cfi, uint32_t off, uint8_t cmd)
+{
+    cfi_wr(cfi, off, cfi_lanes(cfi, cmd));
+}
+
+/**
+ * Read a byte of the query table. Every device returns the same table, so
+ * the lowest byte lane stands for all of them.
+ */
+static uint8_t cfi_q(struct cfi_info *cfi, uint32_t off)
+{
+    return cfi_read(cfi, off) & 0xff;
+}
+
+/**
+ * Read a little-endian 16-bit value from the query table
+ */
+static uint16_t cfi_q16(struct cfi_info *cfi, uint32_t off)
+{
+    return cfi_q(cfi, off) | (cfi_q(cfi, off + 1) << 8);
+}
+
+/**
+ * Check for "QRY" from every device, under the current width/interleave
+ * @returns 1 if the array is in query mode
+ */
+static int cfi_qry(struct cfi_info *cfi)
+{
+    return cfi_read(cfi, CFI_QRY) == cfi_lanes(cfi, 'Q') &&
+        cfi_read(cfi, CFI_QRY + 1) == cfi_lanes(cfi, 'R') &&
+        cfi_read(cfi, CFI_QRY + 2) == cfi_lanes(cfi, 'Y');
+}
+
+/**
+ * Put the array back into read-array mode
+ * @param cfi the array
+ */
+void cfi_reset(struct cfi_info *cfi)
+{
+    switch (cfi->cmdset) {
+    case CFI_CMDSET_AMD_STD:
+        cfi_write(cfi, 0, CFI_CMD_AMD_RESET);
+        break;
+    case CFI_CMDSET_INTEL_EXT:
+    case CFI_CMDSET_INTEL_STD:
+        cfi_write(cfi, 0, CFI_CMD_INTEL_RESET);
+        break;
+    default:
+        /* unknown: AMD parts ignore 0xFF, Intel parts take 0xF0 as an
+         * invalid command that 0xFF then clears */
+        cfi_write(cfi, 0, CFI_CMD_AMD_RESET);
+        cfi_write(cfi, 0, CFI_CMD_INTEL_RESET);
+    }
+}
+
+/**
+ * Read the manufacturer and device IDs with the command set's autoselect
+ */
+static void cfi_read_id(struct cfi_info *cfi)
+{
+    uint32_t mask = cfi->width == cfi->interleave ? 0xff : 0xffff;
+
+    if (cfi->cmdset == CFI_CMDSET_AMD_STD) {
+        cfi_write(cfi, CFI_AMD_ADDR1, CFI_CMD_AMD_UNLOCK1);
+        cfi_write(cfi, CFI_AMD_ADDR2, CFI_CMD_AMD_UNLOCK2);
+        cfi_write(cfi, CFI_AMD_ADDR1, CFI_CMD_READ_ID);
+    } else {
+        cfi_write(cfi, 0, CFI_CMD_READ_ID);
+    }
+
+    cfi->manuf = cfi_read(cfi, 0) & mask;
+    cfi->device = cfi_read(cfi, 1) & mask;
+
+    cfi_reset(cfi);
+}
+
+/**
+ * Work out the page-mode read capability from the extended query table
+ */
+static void cfi_page_mode(struct cfi_info *cfi)
+{
+    uint16_t ext = cfi_q16(cfi, CFI_EXT_TABLE);
+    uint8_t type;
+
+    cfi->page_words = 0;
+
+    if (!ext || cfi_q(cfi, ext) != 'P' || cfi_q(cfi, ext + 1) != 'R' ||
+        cfi_q(cfi, ext + 2) != 'I')
+    {
+        return;
+    }
+
+    switch (cfi->cmdset) {
+    case CFI_CMDSET_INTEL_EXT:
+    case CFI_CMDSET_INTEL_STD:
+        if (cfi_q(cfi, ext + CFI_INTEL_FEATURES) & CFI_INTEL_PAGE_MODE) {
+            cfi->page_words = CFI_INTEL_PAGE_WORDS;
+        }
+        break;
+    case CFI_CMDSET_AMD_STD:
+        type = cfi_q(cfi, ext + CFI_AMD_PAGE_MODE);
+        if (type >= 1 && type <= 3) {
+            cfi->page_words = 2 << type;
+        }
+        break;
+    }
+}
+
+/**
+ * Probe for a CFI flash array, trying 32, 16 and 8-bit buses with every
+ * device width that fits them
+ * @param cfi structure to fill in
+ * @param base uncached address of the start of the array
+ * @returns 0 on success, -1 if nothing answered the query
+ */
+int cfi_probe(struct cfi_info *cfi, uint32_t base)
+{
+    uint32_t chip, sz;
+    int i;
+
+    cfi->base = base;
+    cfi->cmdset = 0;
+
+    for (cfi->width = 4; cfi->width; cfi->width >>= 1) {
+        for (chip = cfi->width; chip; chip >>= 1) {
+            cfi->interleave = cfi->width / chip;
+
+            cfi_reset(cfi);
+            cfi_write(cfi, CFI_QUERY_ADDR, CFI_CMD_QUERY);
+
+            if (cfi_qry(cfi)) goto found;
+        }
+    }
+
+    cfi->width = 1;
+    cfi->interleave = 1;
+    cfi_reset(cfi);
+
+    return -1;
+
+found:
+    cfi->cmdset = cfi_q16(cfi, CFI_CMDSET);
+    cfi->size = (1ul << cfi_q(cfi, CFI_DEV_SIZE)) * cfi->interleave;
+
+    sz = cfi_q16(cfi, CFI_WBUF_SIZE);
+    cfi->write_buffer = sz ? (1ul << sz) * cfi->interleave : 0;
+
+    cfi->nregions = cfi_q(cfi, CFI_NREGIONS);
+    if (cfi->nregions > CFI_MAX_REGIONS) {
+        cfi->nregions = CFI_MAX_REGIONS;
+    }
+
+    for (i = 0; i < cfi->nregions; i++) {
+        cfi->regions[i].blocks = cfi_q16(cfi, CFI_REGION(i)) + 1;
+        sz = cfi_q16(cfi, CFI_REGION(i) + 2);
+        cfi->regions[i].size = (sz ? sz * 256 : 128) * cfi->interleave;
+    }
+
+    cfi_page_mode(cfi);
+    cfi_reset(cfi);
+    cfi_read_id(cfi);
+
+    return 0;
+}
+
+/**
+ * Name a primary vendor command set
+ * @param cmdset command set ID from the query table
+ * @returns a printable name
+ */
+const char *cfi_cmdset_name(uint16_t cmdset)
+{
+    switch (cmdset) {
+    case CFI_CMDSET_INTEL_EXT:
+        return "Intel/Sharp extended";
+    case CFI_CMDSET_AMD_STD:
+        return "AMD/Fujitsu standard";
+    case CFI_CMDSET_INTEL_STD:
+        return "Intel standard";
+    default:
+        return "unknown";
+    }
+}
+
+/**
+ * Find the erase block holding an offset
+ * @param cfi the array
+ * @param offset byte offset into the array
+ * @param start filled in with the offset of the start of the block
+ * @returns the size of the block, or 0 if the offset is past the array
+ */
+uint32_t cfi_block(struct cfi_info *cfi, uint32_t offset, uint32_t *start)
+{
+    uint32_t base = 0, end;
+    int i;
+
+    for (i = 0; i < cfi->nregions; i++) {
+        end = base + cfi->regions[i].blocks * cfi->regions[i].size;
+
+        if (offset < end) {
+            *start = offset - (offset - base) % cfi->regions[i].size;
+            return cfi->regions[i].size;
+        }
+
+        base = end;
+    }
+
+    return 0;
+}
+
+/**
+ * Check whether every word of a block reads as erased
+ */
+static int cfi_blank(struct cfi_info *cfi, uint32_t start, uint32_t size)
+{
+    uint32_t ones = cfi->width == 4 ? 0xFFFFFFFF :
+        cfi->width == 2 ? 0xFFFF : 0xFF;
+    uint32_t off;
+
+    for (off = 0; off < size; off += cfi->width) {
+        if (cfi_rd(cfi, start + off) != ones) return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Send the AMD unlock cycles
+ */
+static void cfi_amd_unlock(struct cfi_info *cfi)
+{
+    cfi_write(cfi, CFI_AMD_ADDR1, CFI_CMD_AMD_UNLOCK1);
+    cfi_write(cfi, CFI_AMD_ADDR2, CFI_CMD_AMD_UNLOCK2);
+}
+
+/**
+ * Wait for an Intel program or erase operation to finish, on every device
+ * @param cfi the array
+ * @param off byte offset the operation was issued at
+ * @returns 0 on success, CFI_LOCKED if the block is locked, -1 otherwise
+ */
+static int cfi_intel_wait(struct cfi_info *cfi, uint32_t off)
+{
+    uint32_t ready = cfi_lanes(cfi, CFI_SR_READY);
+    uint32_t i, sr;
+    int r = -1;
+
+    for (i = 0; i < CFI_TIMEOUT; i++) {
+        sr = cfi_rd(cfi, off);
+
+        if ((sr & ready) != ready) continue;
+
+        if (!(sr & cfi_lanes(cfi, CFI_SR_ERRORS))) {
+            r = 0;
+        } else if (sr & cfi_lanes(cfi, CFI_SR_LOCKED)) {
+            r = CFI_LOCKED;
+        }
+
+        break;
+    }
+
+    if (r) cfi_cmd(cfi, off, CFI_CMD_INTEL_CLEAR_STATUS);
+
+    cfi_cmd(cfi, off, CFI_CMD_INTEL_RESET);
+
+    return r;
+}
+
+/**
+ * Wait for an AMD program or erase operation to finish, on every device,
+ * by watching the DQ6 toggle bit
+ * @param cfi the array
+ * @param off byte offset within the sector being worked on
+ * @returns 0 on success, -1 on a timeout or a failed operation
+ */
+static int cfi_amd_wait(struct cfi_info *cfi, uint32_t off)
+{
+    uint32_t toggle = cfi_lanes(cfi, CFI_DQ6_TOGGLE);
+    uint32_t i, a, b;
+
+    for (i = 0; i < CFI_TIMEOUT; i++) {
+        a = cfi_rd(cfi, off);
+        b = cfi_rd(cfi, off);
+
+        if (!((a ^ b) & toggle)) return 0;
+
+        /* DQ5 is set once a device has given up; it is only a failure if
+         * that device still toggles after it */
+        if (b & cfi_lanes(cfi, CFI_DQ5_TIMEOUT)) {
+            a = cfi_rd(cfi, off);
+            b = cfi_rd(cfi, off);
+
+            if (!((a ^ b) & toggle)) return 0;
+
+            break;
+        }
+    }
+
+    /* the unlock cycles also take a device out of a failed buffer write */
+    cfi_amd_unlock(cfi);
+    cfi_write(cfi, 0, CFI_CMD_AMD_RESET);
+
+    return -1;
+}
+
+/**
+ * Unlock an Intel block so it can be erased and programmed
+ */
+static int cfi_intel_unlock(struct cfi_info *cfi, uint32_t off)
+{
+    cfi_cmd(cfi, off, CFI_CMD_INTEL_LOCK_SETUP);
+    cfi_cmd(cfi, off, CFI_CMD_INTEL_CONFIRM);
+
+    return cfi_intel_wait(cfi, off);
+}
+
+/**
+ * Erase one block with the Intel command set, unlocking it first if it
+ * turns out to be locked
+ */
+static int cfi_intel_erase(struct cfi_info *cfi, uint32_t off)
+{
+    int r, tries;
+
+    for (tries = 0; tries < 2; tries++) {
+        cfi_cmd(cfi, off, CFI_CMD_INTEL_ERASE);
+        cfi_cmd(cfi, off, CFI_CMD_INTEL_CONFIRM);
+
+        if ((r = cfi_intel_wait(cfi, off)) != CFI_LOCKED ||
+            cfi_intel_unlock(cfi, off))
+        {
+            break;
+        }
+    }
+
+    return r;
+}
+
+/**
+ * Erase one block with the AMD command set
+ */
+static int cfi_amd_erase(struct cfi_info *cfi, uint32_t off)
+{
+    cfi_amd_unlock(cfi);
+    cfi_write(cfi, CFI_AMD_ADDR1, CFI_CMD_AMD_SETUP);
+    cfi_amd_unlock(cfi);
+    cfi_cmd(cfi, off, CFI_CMD_AMD_ERASE_SECTOR);
+
+    return cfi_amd_wait(cfi, off);
+}
+
+/**
+ * Erase a batch of blocks. AMD parts take the whole batch in one erase
+ * command, as long as each block is added within the window the device
+ * leaves for it; a block added just as the window closed may have been
+ * ignored, so each one is checked afterwards. Intel parts erase one block
+ * per command.
+ * @param cfi the array
+ * @param blocks offsets of the blocks
+ * @param n number of blocks
+ * @returns 0 on success, -1 on failure
+ */
+static int cfi_erase_batch(struct cfi_info *cfi, uint32_t *blocks, int n)
+{
+    uint32_t start, size;
+    int i, r = 0;
+
+    if (cfi->cmdset != CFI_CMDSET_AMD_STD) {
+        for (i = 0; i < n && !r; i++) {
+            r = cfi_intel_erase(cfi, blocks[i]);
+        }
+    } else {
+        cfi_amd_unlock(cfi);
+        cfi_write(cfi, CFI_AMD_ADDR1, CFI_CMD_AMD_SETUP);
+        cfi_amd_unlock(cfi);
+        cfi_cmd(cfi, blocks[0], CFI_CMD_AMD_ERASE_SECTOR);
+
+        /* queue more blocks until DQ3 says the erase has begun */
+        for (i = 1; i < n && !(cfi_rd(cfi, blocks[0]) &
+            cfi_lanes(cfi, CFI_DQ3_ERASING)); i++)
+        {
+            cfi_cmd(cfi, blocks[i], CFI_CMD_AMD_ERASE_SECTOR);
+        }
+
+        r = cfi_amd_wait(cfi, blocks[0]);
+
+        for (i = 0; i < n && !r; i++) {
+            size = cfi_block(cfi, blocks[i], &start);
+
+            if (!cfi_blank(cfi, start, size)) {
+                r = cfi_amd_erase(cfi, blocks[i]);
+            }
+        }
+    }
+
+    if (r) {
+        printf("flash: erase failed in block at %08x\n", blocks[i - 1]);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Erase every block that holds any of a range and isn't blank already
+ * @param cfi the array
+ * @param offset byte offset of the start of the range
+ * @param len length of the range
+ * @returns number of blocks erased, or -1 on failure
+ */
+int cfi_erase(struct cfi_info *cfi, uint32_t offset, uint32_t len)
+{
+    uint32_t blocks[CFI_ERASE_BATCH];
+    uint32_t start, size, end = offset + len;
+    int n = 0, erased = 0;
+
+    while (offset < end) {
+        if (!(size = cfi_block(cfi, offset, &start))) {
+            printf("flash: offset %08x is past the end of the array\n",
+                offset);
+            return -1;
+        }
+
+        if (!cfi_blank(cfi, start, size)) {
+            blocks[n++] = start;
+        }
+
+        offset = start + size;
+
+        if (n == CFI_ERASE_BATCH || (n && offset >= end)) {
+            if (cfi_erase_batch(cfi, blocks, n)) return -1;
+
+            erased += n;
+            n = 0;
+        }
+    }
+
+    return erased;
+}
+
+/**
+ * Assemble a bus word from a buffer, leaving the bytes it doesn't cover
+ * erased so programming them changes nothing
+ * @param cfi the array
+ * @param src data for bytes skip to skip + n - 1 of the word
+ */
+static uint32_t cfi_word(struct cfi_info *cfi, const uint8_t *src,
+    uint32_t skip, uint32_t n)
+{
+    union {
+        uint32_t w32;
+        uint16_t w16;
+        uint8_t b[4];
+    } w;
+
+    w.w32 = 0xFFFFFFFF;
+    memcpy(w.b + skip, src, n);
+
+    return cfi->width == 4 ? w.w32 : cfi->width == 2 ? w.w16 : w.b[0];
+}
+
+/**
+ * Program a single bus word
+ */
+static int cfi_program_word(struct cfi_info *cfi, uint32_t off, uint32_t val)
+{
+    int r, tries;
+
+    if (cfi->cmdset == CFI_CMDSET_AMD_STD) {
+        cfi_amd_unlock(cfi);
+        cfi_write(cfi, CFI_AMD_ADDR1, CFI_CMD_AMD_PROGRAM);
+        cfi_wr(cfi, off, val);
+
+        return cfi_amd_wait(cfi, off);
+    }
+
+    for (tries = 0; tries < 2; tries++) {
+        cfi_cmd(cfi, off, CFI_CMD_INTEL_PROGRAM);
+        cfi_wr(cfi, off, val);
+
+        if ((r = cfi_intel_wait(cfi, off)) != CFI_LOCKED ||
+            cfi_intel_unlock(cfi, off))
+        {
+            break;
+        }
+    }
+
+    return r;
+}
+
+/**
+ * Fill the write buffer and commit it
+ */
+static int cfi_buffer_write(struct cfi_info *cfi, uint32_t off,
+    const uint8_t *src, uint32_t len)
+{
+    uint32_t words = len / cfi->width, i;
+
+    if (cfi->cmdset == CFI_CMDSET_AMD_STD) {
+        cfi_amd_unlock(cfi);
+        cfi_cmd(cfi, off, CFI_CMD_AMD_BUFFER);
+    } else {
+        /* the buffer may still be busy with the last write */
+        for (i = 0; ; i++) {
+            cfi_cmd(cfi, off, CFI_CMD_INTEL_BUFFER);
+
+            if ((cfi_rd(cfi, off) & cfi_lanes(cfi, CFI_SR_READY)) ==
+                cfi_lanes(cfi, CFI_SR_READY))
+            {
+                break;
+            }
+
+            if (i == CFI_TIMEOUT) {
+                cfi_cmd(cfi, off, CFI_CMD_INTEL_RESET);
+                return -1;
+            }
+        }
+    }
+
+    cfi_wr(cfi, off, cfi_lanes(cfi, words - 1));
+
+    for (i = 0; i < words; i++) {
+        cfi_wr(cfi, off + i * cfi->width,
+            cfi_word(cfi, src + i * cfi->width, 0, cfi->width));
+    }
+
+    if (cfi->cmdset == CFI_CMDSET_AMD_STD) {
+        cfi_cmd(cfi, off, CFI_CMD_AMD_BUFFER_DONE);
+        return cfi_amd_wait(cfi, off);
+    }
+
+    cfi_cmd(cfi, off, CFI_CMD_INTEL_CONFIRM);
+
+    return cfi_intel_wait(cfi, off);
+}
+
+/**
+ * Program one write buffer's worth of whole bus words. The range must not
+ * cross a write buffer boundary.
+ */
+static int cfi_program_buffer(struct cfi_info *cfi, uint32_t off,
+    const uint8_t *src, uint32_t len)
+{
+    int r, tries;
+
+    for (tries = 0; tries < 2; tries++) {
+        if ((r = cfi_buffer_write(cfi, off, src, len)) != CFI_LOCKED ||
+            cfi_intel_unlock(cfi, off))
+        {
+            break;
+        }
+    }
+
+    return r;
+}
+
+/**
+ * Program a range of the array, which must have been erased. Partial bus
+ * words at either end are padded with erased bytes, so the range need not
+ * be aligned.
+ * @param cfi the array
+ * @param offset byte offset of the start of the range
+ * @param buf data to program
+ * @param len number of bytes
+ * @returns 0 on success, -1 on failure
+ */
+int cfi_program(struct cfi_info *cfi, uint32_t offset, const void *buf,
+    uint32_t len)
+{
+    const uint8_t *src = buf;
+    uint32_t skip, n;
+    int r;
+
+    while (len) {
+        skip = offset & (cfi->width - 1);
+
+        if (skip || len < cfi->width) {
+            /* a partial word at either end of the range */
+            n = cfi->width - skip;
+            if (n > len) n = len;
+
+            r = cfi_program_word(cfi, offset - skip,
+                cfi_word(cfi, src, skip, n));
+        } else if (cfi->write_buffer) {
+            n = cfi->write_buffer - (offset & (cfi->write_buffer - 1));
+            if (n > len) n = len & ~(cfi->width - 1);
+
+            r = cfi_program_buffer(cfi, offset, src, n);
+        } else {
+            n = cfi->width;
+            r = cfi_program_word(cfi, offset, cfi_word(cfi, src, 0, n));
+        }
+
+        if (r) {
+            printf("flash: program failed at %08x\n", offset);
+            return -1;
+        }
+
+        offset += n;
+        src += n;
+        len -= n;
+    }
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+/* Storage manager: registry of the storage devices in the system
+ * Licensed under the GNU General Public License v2
+ *
+ * Platforms register one storage class per device in register_storage().
+ * Each device is probed once and the result is kept, so opening a file is
+ * a single pass over the devices that are actually present.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <ciloio.h>
+#include <storage/storage.h>
+
+/* registered devices, in registration (and so search) order */
+static struct storage_class *storage_head;
+static struct storage_class *storage_tail;
+static uint32_t storage_next_id;
+
+void initialize_storage_manager()
+{
+    storage_head = NULL;
+    storage_tail = NULL;
+    storage_next_id = 1;
+}
+
+/**
+ * Add a device to the registry. Its ops, dev_name and any private data must
+ * already be filled in; dev_id is assigned here.
+ * @param sto the device
+ */
+void register_storage_class(struct storage_class *sto)
+{
+    sto->dev_id = storage_next_id++;
+    sto->probed = STORAGE_UNPROBED;
+    sto->next = NULL;
+    sto->prev = storage_tail;
+
+    if (storage_tail) storage_tail->next = sto;
+    else storage_head = sto;
+
+    storage_tail = sto;
+}
+
+/**
+ * Probe a device, or return the result of the earlier probe.
+ * @param sto the device
+ * @returns non-zero if the device is present
+ */
+uint32_t storage_probe(struct storage_class *sto)
+{
+    if (sto->probed == STORAGE_UNPROBED) {
+        sto->probed = sto->ops->probe(sto) ? STORAGE_PRESENT : STORAGE_ABSENT;
+    }
+
+    return sto->probed == STORAGE_PRESENT;
+}
+
+/**
+ * Probe every registered device
+ * @returns number of devices present
+ */
+uint32_t storage_probe_all(void)
+{
+    struct storage_class *sto;
+    uint32_t n = 0;
+
+    for (sto = storage_head; sto != NULL; sto = sto->next) {
+        if (storage_probe(sto)) n++;
+    }
+
+    return n;
+}
+
+/**
+ * Find a device by name
+ * @param name device name, not necessarily NUL terminated
+ * @param len length of the name
+ * @returns the device, or NULL if there is none by that name
+ */
+struct storage_class *storage_find_class(const char *name, uint32_t len)
+{
+    struct storage_class *sto;
+
+    if (len >= sizeof(sto->dev_name)) return NULL;
+
+    for (sto = storage_head; sto != NULL; sto = sto->next) {
+        if (!strncmp(sto->dev_name, name, len) && sto->dev_name[len] == '\0') {
+            return sto;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Open a file. A "device:filename" path names the device explicitly;
+ * otherwise every device that is present is searched in registration
+ * order.
+ * @param path file to open
+ * @param fp file structure to fill in
+ * @returns the device holding the file, or NULL if it wasn't found
+ */
+struct storage_class *storage_open(const char *path, struct file *fp)
+{
+    struct storage_class *sto;
+    const char *sep = strchr(path, ':');
+
+    if (sep != NULL) {
+        sto = storage_find_class(path, sep - path);
+
+        if (sto == NULL || !storage_probe(sto)) return NULL;
+
+        return sto->ops->lookup(sto, fp, sep + 1) ? sto : NULL;
+    }
+
+    for (sto = storage_head; sto != NULL; sto = sto->next) {
+        if (storage_probe(sto) && sto->ops->lookup(sto, fp, path)) {
+            return sto;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Print the files on every device that is present
+ */
+void storage_list(void)
+{
+    struct storage_class *sto;
+
+    for (sto = storage_head; sto != NULL; sto = sto->next) {
+        if (!storage_probe(sto)) continue;
+
+        printf("%s:\n", sto->dev_name);
+        sto->ops->list(sto);
+    }
+}
+
+/**
+ * Write a file to a device that supports writing. A device that looked
+ * empty when it was probed can still be written to.
+ * @param path "device:filename" to write
+ * @param buf file data, in RAM; the RAM after it may be used as scratch
+ * @param len length of the file
+ * @returns 0 on success, -1 on failure
+ */
+int storage_write(const char *path, const void *buf, uint32_t len)
+{
+    struct storage_class *sto;
+    const char *sep = strchr(path, ':');
+
+    if (sep == NULL || (sto = storage_find_class(path, sep - path)) == NULL) {
+        printf("%s: no such device\n", path);
+        return -1;
+    }
+
+    if (sto->ops->write == NULL) {
+        printf("%s: device can't be written to\n", sto->dev_name);
+        return -1;
+    }
+
+    storage_probe(sto);
+
+    if (sto->ops->write(sto, sep + 1, buf, len)) {
+        return -1;
+    }
+
+    sto->probed = STORAGE_PRESENT;
+
+    return 0;
+}
@@ -1,6 +1,10 @@
 #include <string.h>
 #include <types.h>
 
+#ifdef __mips__
+#include <asm/r4kcache.h>
+#endif
+
 int strcmp(const char *s1, const char *s2)
 {
     while (*s1 == *s2 && *s1 != '\0' && *s2 != '\0') {
@@ -67,8 +71,146 @@ uint32_t strlen(const char *s)
     return i;
 }
 
+#ifndef ARCH_HAS_MEMOPS
+
+/* copies shorter than this aren't worth the alignment fixups */
+#define MEMCPY_SMALL 32
+
+#ifdef __mips__
+/**
+ * Copy blocks of 32 bytes using 64-bit loads and stores. Both pointers must
+ * be doubleword aligned. Interrupts are masked for the duration of the copy
+ * since ROMMON's exception handlers only preserve the low 32 bits of the
+ * temporaries.
+ * @param d destination buffer
+ * @param s source buffer
+ * @param n number of bytes to copy; a non-zero multiple of 32
+ */
+static void memcpy_dwords(uint8_t *d, const uint8_t *s, uint32_t n)
+{
+    const uint8_t *end = s + n;
+
+    asm volatile (".set push\n"
+                  ".set noreorder\n"
+                  ".set mips3\n"
+                  "mfc0 $12, $12\n"
+                  "li $13, ~1\n"
+                  "and $13, $12, $13\n"
+                  "mtc0 $13, $12\n"
+                  "nop\n"
+                  "nop\n"
+                  "nop\n"
+                  "1: ld $8, 0(%[s])\n"
+                  "ld $9, 8(%[s])\n"
+                  "ld $10, 16(%[s])\n"
+                  "ld $11, 24(%[s])\n"
+                  "addiu %[s], %[s], 32\n"
+                  "sd $8, 0(%[d])\n"
+                  "sd $9, 8(%[d])\n"
+                  "sd $10, 16(%[d])\n"
+                  "sd $11, 24(%[d])\n"
+                  "bne %[s], %[end], 1b\n"
+                  "addiu %[d], %[d], 32\n"
+                  "mtc0 $12, $12\n"
+                  "nop\n"
+                  "nop\n"
+                  "nop\n"
+                  ".set pop\n"
+        : [d] "+r"(d), [s] "+r"(s)
+        : [end] "r"(end)
+        : "$8", "$9", "$10", "$11", "$12", "$13", "memory"
+    );
+}
+
+/**
+ * Copy blocks of 16 bytes using 32-bit loads and stores. Both pointers must
+ * be word aligned.
+ * @param d destination buffer
+ * @param s source buffer
+ * @param n number of bytes to copy; a non-zero multiple of 16
+ */
+static void memcpy_words(uint8_t *d, const uint8_t *s, uint32_t n)
+{
+    const uint8_t *end = s + n;
+
+    asm volatile (".set push\n"
+                  ".set noreorder\n"
+                  "1: lw $8, 0(%[s])\n"
+                  "lw $9, 4(%[s])\n"
+                  "lw $10, 8(%[s])\n"
+                  "lw $11, 12(%[s])\n"
+                  "addiu %[s], %[s], 16\n"
+                  "sw $8, 0(%[d])\n"
+                  "sw $9, 4(%[d])\n"
+                  "sw $10, 8(%[d])\n"
+                  "sw $11, 12(%[d])\n"
+                  "bne %[s], %[end], 1b\n"
+                  "addiu %[d], %[d], 16\n"
+                  ".set pop\n"
+        : [d] "+r"(d), [s] "+r"(s)
+        : [end] "r"(end)
+        : "$8", "$9", "$10", "$11", "memory"
+    );
+}
+
 /**
- * Copy n bytes from src to dst
+ * Copy blocks of 16 bytes from an unaligned source to a word aligned
+ * destination, assembling each source word with lwl/lwr (big endian).
+ * @param d destination buffer, word aligned
+ * @param s source buffer
+ * @param n number of bytes to copy; a non-zero multiple of 16
+ */
+static void memcpy_unaligned(uint8_t *d, const uint8_t *s, uint32_t n)
+{
+    const uint8_t *end = s + n;
+
+    asm volatile (".set push\n"
+                  ".set noreorder\n"
+                  "1: lwl $8, 0(%[s])\n"
+                  "lwr $8, 3(%[s])\n"
+                  "lwl $9, 4(%[s])\n"
+                  "lwr $9, 7(%[s])\n"
+                  "lwl $10, 8(%[s])\n"
+                  "lwr $10, 11(%[s])\n"
+                  "lwl $11, 12(%[s])\n"
+                  "lwr $11, 15(%[s])\n"
+                  "addiu %[s], %[s], 16\n"
+                  "sw $8, 0(%[d])\n"
+                  "sw $9, 4(%[d])\n"
+                  "sw $10, 8(%[d])\n"
+                  "sw $11, 12(%[d])\n"
+                  "bne %[s], %[end], 1b\n"
+                  "addiu %[d], %[d], 16\n"
+                  ".set pop\n"
+        : [d] "+r"(d), [s] "+r"(s)
+        : [end] "r"(end)
+        : "$8", "$9", "$10", "$11", "memory"
+    );
+}
+
+#else /* !__mips__ */
+
+static void memcpy_words(uint8_t *d, const uint8_t *s, uint32_t n)
+{
+    uint32_t *dw = (uint32_t *)d;
+    const uint32_t *sw = (const uint32_t *)s;
+
+    for (n >>= 4; n > 0; n--) {
+        dw[0] = sw[0];
+        dw[1] = sw[1];
+        dw[2] = sw[2];
+        dw[3] = sw[3];
+        dw += 4;
+        sw += 4;
+    }
+}
+
+#endif /* __mips__ */
+
+/**
+ * Copy n bytes from src to dst. Large copies are split into a byte-wise
+ * head that word-aligns the destination, an unrolled block copy using the
+ * widest accesses both pointers allow, and a byte-wise tail.
  * @param dst destination buffer
  * @param src source buffer
  * @param n number of bytes to copy
@@ -76,16 +218,184 @@ uint32_t strlen(const char *s)
  */
 int memcpy(void *dst, const void *src, int n)
 {
-    int i = 0;
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    uint32_t len, blk;
+
     if (!dst || !src) return -1;
+    if (n <= 0) return 0;
 
-    for (i = 0; i < n; i++) {
-        ((char *)dst)[i] = ((char *)src)[i];
+    len = n;
+
+    if (len >= MEMCPY_SMALL) {
+        /* align the destination to a word boundary */
+        while ((uint32_t)d & 3) {
+            *d++ = *s++;
+            len--;
+        }
+
+        if (((uint32_t)s & 3) == 0) {
+#ifdef __mips__
+            /* both doubleword aligned: use ld/sd */
+            if (((uint32_t)d & 7) == 0 && ((uint32_t)s & 7) == 0) {
+                blk = len & ~31;
+                if (blk) {
+                    memcpy_dwords(d, s, blk);
+                    d += blk; s += blk; len -= blk;
+                }
+            }
+#endif
+            blk = len & ~15;
+            if (blk) {
+                memcpy_words(d, s, blk);
+                d += blk; s += blk; len -= blk;
+            }
+        }
+#ifdef __mips__
+        else {
+            blk = len & ~15;
+            if (blk) {
+                memcpy_unaligned(d, s, blk);
+                d += blk; s += blk; len -= blk;
+            }
+        }
+#endif
     }
 
-    return i;
+    /* tail, or the whole copy if it was short or could not be aligned */
+    while (len--) {
+        *d++ = *s++;
+    }
+
+    return n;
 }
 
+#ifdef __mips__
+/**
+ * Zero whole primary data cache lines, allocating each line with
+ * Create_Dirty_Exclusive_D so that RAM is never read.
+ * @param d start of the region, KSEG0 and line aligned
+ * @param n number of bytes; a non-zero multiple of the line size
+ * @param line data cache line size (16 or 32 bytes)
+ */
+static void memzero_lines(uint8_t *d, uint32_t n, uint32_t line)
+{
+    uint8_t *end = d + n;
+
+    for (; d != end; d += line) {
+        cache_op(Create_Dirty_Excl_D, d);
+        asm volatile (".set push\n"
+                      ".set mips3\n"
+                      "sd $0, 0(%0)\n"
+                      "sd $0, 8(%0)\n"
+                      ".set pop\n"
+            : : "r"(d) : "memory");
+        if (line == 32) {
+            asm volatile (".set push\n"
+                          ".set mips3\n"
+                          "sd $0, 16(%0)\n"
+                          "sd $0, 24(%0)\n"
+                          ".set pop\n"
+                : : "r"(d) : "memory");
+        }
+    }
+}
+
+/**
+ * Zero blocks of 32 bytes with 64-bit stores.
+ * @param d start of the region, doubleword aligned
+ * @param n number of bytes; a non-zero multiple of 32
+ */
+static void memzero_dwords(uint8_t *d, uint32_t n)
+{
+    uint8_t *end = d + n;
+
+    asm volatile (".set push\n"
+                  ".set noreorder\n"
+                  ".set mips3\n"
+                  "1: sd $0, 0(%[d])\n"
+                  "sd $0, 8(%[d])\n"
+                  "sd $0, 16(%[d])\n"
+                  "addiu %[d], %[d], 32\n"
+                  "bne %[d], %[end], 1b\n"
+                  "sd $0, -8(%[d])\n"
+                  ".set pop\n"
+        : [d] "+r"(d)
+        : [end] "r"(end)
+        : "memory"
+    );
+}
+
+#else /* !__mips__ */
+
+static void memzero_dwords(uint8_t *d, uint32_t n)
+{
+    uint32_t *dw = (uint32_t *)d;
+
+    for (n >>= 5; n > 0; n--) {
+        dw[0] = 0; dw[1] = 0; dw[2] = 0; dw[3] = 0;
+        dw[4] = 0; dw[5] = 0; dw[6] = 0; dw[7] = 0;
+        dw += 8;
+    }
+}
+
+#endif /* __mips__ */
+
+/**
+ * Zero n bytes starting at dst. Used for .bss and any other region that
+ * has to be cleared before a kernel is started. On R4000-class CPUs, whole
+ * cache lines in KSEG0 are allocated in the data cache without being read
+ * from RAM first.
+ * @param dst start of the region
+ * @param n number of bytes to zero
+ */
+void memzero(void *dst, uint32_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    uint32_t blk;
+
+    if (!dst) return;
+
+    if (n >= MEMCPY_SMALL) {
+        while ((uint32_t)d & 7) {
+            *d++ = 0;
+            n--;
+        }
+
+#ifdef __mips__
+        if (IS_KSEG0(d) && cpu_has_cdex()) {
+            uint32_t line = dcache_line_size();
+
+            /* clear up to the first line boundary */
+            while (((uint32_t)d & (line - 1)) && n >= 8) {
+                *(uint32_t *)d = 0;
+                *(uint32_t *)(d + 4) = 0;
+                d += 8;
+                n -= 8;
+            }
+
+            blk = n & ~(line - 1);
+            if (blk) {
+                memzero_lines(d, blk, line);
+                d += blk; n -= blk;
+            }
+        }
+#endif
+
+        blk = n & ~31;
+        if (blk) {
+            memzero_dwords(d, blk);
+            d += blk; n -= blk;
+        }
+    }
+
+    while (n--) {
+        *d++ = 0;
+    }
+}
+
+#endif /* ARCH_HAS_MEMOPS */
+
 /**
  * strchr
  */
@@ -0,0 +1,13 @@
+/*
+ * The host has no caches to manage: stands in for CILO's asm/r4kcache.h,
+ * which is MIPS assembly.
+ */
+#ifndef _TEST_ASM_R4KCACHE_H
+#define _TEST_ASM_R4KCACHE_H
+
+#define dcache_wback_inv_all()
+#define dcache_wback_inv_range(start, len)
+#define cache_wback_inv_all()
+#define cache_wback_inv_range(start, len)
+
+#endif /* _TEST_ASM_R4KCACHE_H */
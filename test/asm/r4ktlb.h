@@ -0,0 +1,16 @@
+/*
+ * The host has no TLB to wire: stands in for CILO's asm/r4ktlb.h, which
+ * is MIPS assembly.
+ */
+#ifndef _TEST_ASM_R4KTLB_H
+#define _TEST_ASM_R4KTLB_H
+
+#include <types.h>
+#include <asm/mipsregs.h>
+
+static inline void tlb_wire(uint32_t vaddr, uint32_t paddr, uint32_t pagemask,
+    uint32_t cca)
+{
+}
+
+#endif /* _TEST_ASM_R4KTLB_H */
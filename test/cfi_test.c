@@ -0,0 +1,134 @@
+/*
+ * storage/cfi.c against the flash model, for every bus width and
+ * interleave the probe knows and both command sets: the probe has to find
+ * the layout the model was given, and random erases and programs have to
+ * leave the array holding what a reference copy says, without the model
+ * seeing a command a real array would reject.
+ */
+
+/* CILO's headers go first: the host's stddef.h replaces its NULL */
+#include <storage/cfi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flash_model.h"
+
+#define ARRAY_BASE 0x10000000
+#define ROUNDS 20
+#define MAX_WRITE 0x40000
+
+static unsigned char array[FLASH_MODEL_SIZE];
+static unsigned char ref[FLASH_MODEL_SIZE];
+static unsigned char data[MAX_WRITE];
+
+static const struct {
+    int width;
+    int interleave;
+} buses[] = {
+    { 4, 1 }, { 4, 2 }, { 4, 4 }, { 2, 1 }, { 2, 2 }, { 1, 1 },
+};
+
+/**
+ * Probe, erase and program one array layout
+ * @returns 0 if it all went as it should
+ */
+static int test_bus(int width, int interleave, int amd)
+{
+    struct cfi_info cfi;
+    uint32_t i, off, len, start, end, size;
+    int round;
+
+    srand(width * 10 + interleave + amd * 100);
+    flash_model_init(ARRAY_BASE, array, width, interleave, amd);
+
+    /* a third of the blocks blank, as cfi_erase() skips those */
+    for (i = 0; i < FLASH_MODEL_SIZE; i++) {
+        array[i] = (i / FLASH_MODEL_BLOCK) % 3 == 0 ? 0xff : rand();
+    }
+
+    /* Intel parts come up with blocks locked */
+    if (!amd) {
+        flash_locked[5] = flash_locked[6] = 1;
+    }
+
+    printf("%d-bit bus, %d part%s, %s: ", width * 8, interleave,
+        interleave > 1 ? "s" : "", amd ? "AMD" : "Intel");
+
+    if (cfi_probe(&cfi, ARRAY_BASE) < 0) {
+        printf("probe failed\n");
+        return 1;
+    }
+
+    if (cfi.width != width || cfi.interleave != interleave ||
+        cfi.cmdset != (amd ? 2 : 1) || cfi.size != FLASH_MODEL_SIZE ||
+        cfi.nregions != 1 || cfi.regions[0].size != FLASH_MODEL_BLOCK)
+    {
+        printf("probe found a %d-bit bus of %d parts, command set %d, "
+            "%x bytes\n", cfi.width * 8, cfi.interleave, cfi.cmdset,
+            cfi.size);
+        return 1;
+    }
+
+    flash_strict = 1;
+    memcpy(ref, array, FLASH_MODEL_SIZE);
+
+    for (round = 0; round < ROUNDS; round++) {
+        off = rand() % (FLASH_MODEL_SIZE - MAX_WRITE);
+        len = rand() % MAX_WRITE + 1;
+
+        for (i = 0; i < len; i++) {
+            data[i] = rand();
+        }
+
+        if (cfi_erase(&cfi, off, len) < 0 ||
+            cfi_program(&cfi, off, data, len) < 0)
+        {
+            printf("write of %x bytes at %x failed\n", len, off);
+            return 1;
+        }
+
+        /* every block the range touches is erased, then programmed */
+        cfi_block(&cfi, off, &start);
+        size = cfi_block(&cfi, off + len - 1, &end);
+        memset(ref + start, 0xff, end + size - start);
+        memcpy(ref + off, data, len);
+
+        for (i = 0; i < FLASH_MODEL_SIZE && ref[i] == array[i]; i++);
+
+        if (i < FLASH_MODEL_SIZE) {
+            printf("wrong data at %x after writing %x bytes at %x\n", i,
+                len, off);
+            return 1;
+        }
+    }
+
+    printf("%d erases, %d buffer writes, %d word writes",
+        flash_stats.erases, flash_stats.buffer_writes,
+        flash_stats.word_writes);
+
+    if (flash_stats.errors) {
+        printf(", %d errors\n", flash_stats.errors);
+        return 1;
+    }
+
+    printf("\n");
+
+    return 0;
+}
+
+int main(void)
+{
+    int i, amd, failed = 0;
+
+    for (amd = 0; amd < 2; amd++) {
+        for (i = 0; i < sizeof(buses) / sizeof(buses[0]); i++) {
+            failed |= test_bus(buses[i].width, buses[i].interleave, amd);
+        }
+    }
+
+    printf(failed ? "cfi: FAILED\n" : "cfi: ok\n");
+
+    return failed;
+}
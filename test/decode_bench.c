@@ -0,0 +1,554 @@
+/*
+ * Kernel decompressor throughput on the host: each decoder unpacks the
+ * same image, made from BENCH_INPUT by the Makefile (CILO's own sources
+ * unless another file is given), and has to reproduce it exactly. Rates
+ * are of decompressed output, the best of DECODE_ROUNDS runs.
+ *
+ * Input the loaders would read from a device rather than map is handed to
+ * the decoder from memory here, LZMA_ASYNC_BLOCK bytes at a time, so what
+ * is timed is the decoder and its refills and not the device.
+ *
+ * Each decoder is then fed the image cut short, the image with bytes
+ * flipped, and room for only part of the output. None may write past the
+ * room it is given, and decoders of formats that carry a check must
+ * refuse all three.
+ */
+
+/* CILO's headers go first: the host's stddef.h replaces its NULL */
+#include <LzmaDecode.h>
+#include <lzmadec.h>
+#include <lz4_loader.h>
+#include <gzip_loader.h>
+#include <zstddec.h>
+#include <xz_loader.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DECODE_MAX (32 << 20)
+#define DECODE_ROUNDS 10
+
+/* bytes past the room a decoder is given that it must leave alone */
+#define DECODE_GUARD 4096
+
+/* as in lzma_loader.c */
+#define LZMA_ASYNC_BLOCK 4096
+#define LZMA_TICKS 50
+
+static unsigned char ref[DECODE_MAX];
+static unsigned char in[DECODE_MAX];
+static unsigned char out[DECODE_MAX];
+static unsigned int ref_len, in_len;
+static unsigned int out_max = DECODE_MAX - DECODE_GUARD;
+
+/* set while decoders are fed bad input, to drop what they print */
+extern int console_quiet;
+
+/* the progress ticker, counting ticks instead of printing them */
+UInt32 lzma_tick_at;
+static UInt32 lzma_tick_step;
+static int ticks;
+
+void lzma_tick(UInt32 pos)
+{
+    while (pos >= lzma_tick_at) {
+        ticks++;
+        lzma_tick_at += lzma_tick_step;
+    }
+}
+
+struct lzma_input {
+    ILzmaInCallback callback;
+    unsigned int pos;
+};
+
+static int lzma_read(void *object, const unsigned char **buffer,
+    SizeT *size)
+{
+    struct lzma_input *li = (struct lzma_input *)object;
+
+    *buffer = in + li->pos;
+    *size = in_len - li->pos < LZMA_ASYNC_BLOCK ? in_len - li->pos :
+        LZMA_ASYNC_BLOCK;
+    li->pos += *size;
+
+    return LZMA_RESULT_OK;
+}
+
+/**
+ * Decode bench.lzma with the callback build of LzmaDecode.c
+ * @returns bytes decoded, or -1 on an error
+ */
+static int lzma_callback(void)
+{
+    static CProb probs[LZMA_BASE_SIZE + (LZMA_LIT_SIZE << 12)];
+    CLzmaDecoderState state;
+    struct lzma_input li;
+    SizeT done;
+
+    if (LzmaDecodeProperties(&state.Properties, in, LZMA_PROPERTIES_SIZE) !=
+        LZMA_RESULT_OK)
+    {
+        return -1;
+    }
+
+    state.Probs = probs;
+    li.callback.Read = lzma_read;
+    li.pos = LZMA_PROPERTIES_SIZE + 8;
+
+    if (LzmaDecode(&state, &li.callback, out, out_max, &done) !=
+        LZMA_RESULT_OK)
+    {
+        return -1;
+    }
+
+    return done;
+}
+
+/**
+ * Decode bench.lzma in place with LzmaDecodeMem, as from mapped flash
+ * @returns bytes decoded, or -1 on an error
+ */
+static int lzma_mapped(void)
+{
+    static CProb probs[LZMA_BASE_SIZE + (LZMA_LIT_SIZE << 12)];
+    CLzmaDecoderState state;
+    SizeT used, done;
+
+    if (LzmaDecodeProperties(&state.Properties, in, LZMA_PROPERTIES_SIZE) !=
+        LZMA_RESULT_OK)
+    {
+        return -1;
+    }
+
+    state.Probs = probs;
+
+    if (LzmaDecodeMem(&state, in + LZMA_PROPERTIES_SIZE + 8,
+        in_len - (LZMA_PROPERTIES_SIZE + 8), &used, out, out_max, &done) !=
+        LZMA_RESULT_OK)
+    {
+        return -1;
+    }
+
+    return done;
+}
+
+/* a compressed image in memory, as a pipeline source */
+struct mem_source {
+    struct pipe_stage st;
+    uint32_t pos;
+};
+
+static int mem_pull(struct pipe_stage *st, const uint8_t **buf,
+    uint32_t *len)
+{
+    struct mem_source *ms = (struct mem_source *)st;
+
+    *buf = in + ms->pos;
+    *len = in_len - ms->pos < LZMA_ASYNC_BLOCK ? in_len - ms->pos :
+        LZMA_ASYNC_BLOCK;
+    ms->pos += *len;
+
+    return 0;
+}
+
+static const uint8_t *mem_map(struct pipe_stage *st, uint32_t *len)
+{
+    struct mem_source *ms = (struct mem_source *)st;
+
+    *len = in_len - ms->pos;
+    ms->pos = in_len;
+
+    return in + in_len - *len;
+}
+
+/**
+ * Decode bench.lzma2 with lzmadec, from a source that can be mapped or not
+ * @returns bytes decoded, or -1 on an error
+ */
+static int lzma2(int mapped)
+{
+    static struct lzma_probs probs;
+    struct lzma_dec d;
+    struct mem_source ms;
+
+    ms.st.pull = mem_pull;
+    ms.st.read = NULL;
+    ms.st.map = mapped ? mem_map : NULL;
+    ms.st.up = NULL;
+    ms.pos = 0;
+
+    lzma_dec_init(&d, &probs, &ms.st, out, out_max);
+
+    if (lzma2_decode(&d) < 0) {
+        return -1;
+    }
+
+    return lzma_dec_out(&d) - out;
+}
+
+static int lzma2_callback(void)
+{
+    return lzma2(0);
+}
+
+static int lzma2_mapped(void)
+{
+    return lzma2(1);
+}
+
+/**
+ * Decode bench.xz or bench.ppc.xz with xz_loader.c, which checks the
+ * headers, the CRC64 of each block and the index as it goes
+ * @returns bytes decoded, or -1 on an error
+ */
+static int xz(int mapped)
+{
+    static struct lzma_probs probs;
+    struct lzma_dec d;
+    struct mem_source ms;
+
+    ms.st.pull = mem_pull;
+    ms.st.read = NULL;
+    ms.st.map = mapped ? mem_map : NULL;
+    ms.st.up = NULL;
+    ms.pos = 0;
+
+    lzma_dec_init(&d, &probs, &ms.st, out, out_max);
+
+    return xz_decode(&d);
+}
+
+static int xz_pulled(void)
+{
+    return xz(0);
+}
+
+static int xz_mapped(void)
+{
+    return xz(1);
+}
+
+/**
+ * Decode bench.lz4 with lz4_loader.c, from a source that can be mapped or
+ * not
+ * @returns bytes decoded, or -1 on an error
+ */
+static int lz4(int mapped)
+{
+    struct mem_source ms;
+
+    ms.st.pull = mem_pull;
+    ms.st.read = NULL;
+    ms.st.map = mapped ? mem_map : NULL;
+    ms.st.up = NULL;
+    ms.pos = 0;
+
+    return lz4_decode(&ms.st, in_len, out, out + out_max);
+}
+
+static int lz4_pulled(void)
+{
+    return lz4(0);
+}
+
+static int lz4_mapped(void)
+{
+    return lz4(1);
+}
+
+/**
+ * Decode bench.gz or bench.zlib with inflate.c, from a source that can be
+ * mapped or not
+ * @returns bytes decoded, or -1 on an error
+ */
+static int gzip(int mapped)
+{
+    struct mem_source ms;
+    struct inflate z;
+
+    ms.st.pull = mem_pull;
+    ms.st.read = NULL;
+    ms.st.map = mapped ? mem_map : NULL;
+    ms.st.up = NULL;
+    ms.pos = 0;
+
+    inflate_init(&z, &ms.st, out, out_max);
+
+    if (gzip_decode(&z) < 0) {
+        return -1;
+    }
+
+    return z.pos - out;
+}
+
+static int gzip_pulled(void)
+{
+    return gzip(0);
+}
+
+static int gzip_mapped(void)
+{
+    return gzip(1);
+}
+
+/**
+ * Decode bench.zst with zstddec.c, from a source that can be mapped or not
+ * @returns bytes decoded, or -1 on an error
+ */
+static int zstd(int mapped)
+{
+    static struct zstd_dec d;
+    static uint8_t block[ZSTD_BLOCK_MAX];
+    struct mem_source ms;
+
+    ms.st.pull = mem_pull;
+    ms.st.read = NULL;
+    ms.st.map = mapped ? mem_map : NULL;
+    ms.st.up = NULL;
+    ms.pos = 0;
+
+    zstd_dec_init(&d, &ms.st, out, out + out_max);
+
+    if (d.in == NULL) {
+        d.block = block;
+    }
+
+    if (zstd_decode(&d) < 0) {
+        return -1;
+    }
+
+    return d.pos - out;
+}
+
+static int zstd_pulled(void)
+{
+    return zstd(0);
+}
+
+static int zstd_mapped(void)
+{
+    return zstd(1);
+}
+
+static void tick_off(void)
+{
+    lzma_tick_at = 0xffffffff;
+}
+
+static void tick_on(void)
+{
+    lzma_tick_step = ref_len / LZMA_TICKS;
+    lzma_tick_at = lzma_tick_step;
+    ticks = 0;
+}
+
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**
+ * Read a whole file into a buffer
+ * @returns its length, or -1 if it can't be read or doesn't fit
+ */
+static int load(const char *name, unsigned char *buf)
+{
+    FILE *f = fopen(name, "rb");
+    size_t n;
+
+    if (f == NULL) {
+        printf("can't open %s\n", name);
+        return -1;
+    }
+
+    n = fread(buf, 1, DECODE_MAX, f);
+
+    if (!feof(f)) {
+        printf("%s is too large\n", name);
+        n = -1;
+    }
+
+    fclose(f);
+
+    return n;
+}
+
+/**
+ * Time a decoder and check what it produces
+ * @param prepare called before each run, may be NULL
+ * @returns 0 if every run reproduced the input
+ */
+static int bench(const char *name, const char *file, int (*decode)(void),
+    void (*prepare)(void))
+{
+    double t, best = 0;
+    int n, i;
+
+    if ((n = load(file, in)) < 0) {
+        return 1;
+    }
+
+    in_len = n;
+
+    for (i = 0; i < DECODE_ROUNDS; i++) {
+        if (prepare != NULL) {
+            prepare();
+        }
+
+        memset(out, 0, ref_len);
+        t = now();
+        n = decode();
+        t = now() - t;
+
+        if (n != ref_len || memcmp(out, ref, ref_len)) {
+            printf("%s: wrong output\n", name);
+            return 1;
+        }
+
+        if (i == 0 || t < best) {
+            best = t;
+        }
+    }
+
+    printf("%-28s %7d -> %8d %8.1f MB/s\n", name, in_len, ref_len,
+        ref_len / best / 1e6);
+
+    return 0;
+}
+
+/**
+ * Run a decoder on bad input, with DECODE_GUARD bytes after its room
+ * @returns 0 if it stayed in its room and, if checked, failed
+ */
+static int reject_one(const char *name, const char *what,
+    int (*decode)(void), int checked)
+{
+    int n, i;
+
+    memset(out + out_max, 0xa5, DECODE_GUARD);
+
+    console_quiet = 1;
+    tick_off();
+    n = decode();
+    console_quiet = 0;
+
+    for (i = 0; i < DECODE_GUARD; i++) {
+        if (out[out_max + i] != 0xa5) {
+            printf("%s: wrote past its room given %s\n", name, what);
+            return 1;
+        }
+    }
+
+    if (checked && n >= 0) {
+        printf("%s: accepted %s\n", name, what);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Check a decoder turns away a truncated image, a corrupted one, and one
+ * that doesn't fit.
+ * @param checked the format carries a check, so all three must fail
+ * @returns 0 if it did
+ */
+static int reject(const char *name, const char *file, int (*decode)(void),
+    int checked)
+{
+    int failed = 0, n, i;
+
+    if ((n = load(file, in)) < 0) {
+        return 1;
+    }
+
+    out_max = ref_len;
+    in_len = n / 2;
+    failed |= reject_one(name, "a truncated image", decode, checked);
+
+    in_len = n;
+    out_max = ref_len / 2;
+    failed |= reject_one(name, "too little room", decode, checked);
+
+    /* past any header, so it is the data that is wrong */
+    for (i = n / 8; i < n; i += n / 8) {
+        in[i] ^= 0x55;
+    }
+
+    out_max = ref_len;
+    failed |= reject_one(name, "a corrupted image", decode, checked);
+
+    out_max = DECODE_MAX - DECODE_GUARD;
+
+    return failed;
+}
+
+int main(void)
+{
+    int failed = 0, n;
+
+    if ((n = load("bench.bin", ref)) < 0) {
+        return 1;
+    }
+
+    ref_len = n;
+
+    failed |= bench("LzmaDecode callback", "bench.lzma", lzma_callback,
+        tick_off);
+    failed |= bench("LzmaDecode callback, ticker", "bench.lzma",
+        lzma_callback, tick_on);
+    failed |= bench("LzmaDecodeMem mapped", "bench.lzma", lzma_mapped,
+        tick_off);
+    failed |= bench("LzmaDecodeMem mapped, ticker", "bench.lzma",
+        lzma_mapped, tick_on);
+    failed |= bench("lzmadec LZMA2 pulled", "bench.lzma2", lzma2_callback,
+        NULL);
+    failed |= bench("lzmadec LZMA2 mapped", "bench.lzma2", lzma2_mapped,
+        NULL);
+    failed |= bench("xz pulled", "bench.xz", xz_pulled, NULL);
+    failed |= bench("xz mapped", "bench.xz", xz_mapped, NULL);
+    failed |= bench("xz PowerPC filter mapped", "bench.ppc.xz", xz_mapped,
+        NULL);
+    failed |= bench("LZ4 pulled", "bench.lz4", lz4_pulled, NULL);
+    failed |= bench("LZ4 mapped", "bench.lz4", lz4_mapped, NULL);
+    failed |= bench("inflate gzip pulled", "bench.gz", gzip_pulled, NULL);
+    failed |= bench("inflate gzip mapped", "bench.gz", gzip_mapped, NULL);
+    failed |= bench("inflate zlib pulled", "bench.zlib", gzip_pulled, NULL);
+    failed |= bench("inflate zlib mapped", "bench.zlib", gzip_mapped, NULL);
+    failed |= bench("zstd pulled", "bench.zst", zstd_pulled, NULL);
+    failed |= bench("zstd mapped", "bench.zst", zstd_mapped, NULL);
+
+    if (!failed && ticks == 0) {
+        printf("the progress ticker never ran\n");
+        failed = 1;
+    }
+
+    /* .lzma and raw LZMA2 carry no check of their own */
+    failed |= reject("LzmaDecode callback", "bench.lzma", lzma_callback, 0);
+    failed |= reject("LzmaDecodeMem mapped", "bench.lzma", lzma_mapped, 0);
+    failed |= reject("lzmadec LZMA2 pulled", "bench.lzma2", lzma2_callback,
+        0);
+    failed |= reject("lzmadec LZMA2 mapped", "bench.lzma2", lzma2_mapped, 0);
+    failed |= reject("xz pulled", "bench.xz", xz_pulled, 1);
+    failed |= reject("xz mapped", "bench.xz", xz_mapped, 1);
+    failed |= reject("xz PowerPC filter mapped", "bench.ppc.xz", xz_mapped,
+        1);
+    failed |= reject("LZ4 pulled", "bench.lz4", lz4_pulled, 1);
+    failed |= reject("LZ4 mapped", "bench.lz4", lz4_mapped, 1);
+    failed |= reject("inflate gzip pulled", "bench.gz", gzip_pulled, 1);
+    failed |= reject("inflate gzip mapped", "bench.gz", gzip_mapped, 1);
+    failed |= reject("inflate zlib pulled", "bench.zlib", gzip_pulled, 1);
+    failed |= reject("inflate zlib mapped", "bench.zlib", gzip_mapped, 1);
+    failed |= reject("zstd pulled", "bench.zst", zstd_pulled, 1);
+    failed |= reject("zstd mapped", "bench.zst", zstd_mapped, 1);
+
+    printf(failed ? "decode: FAILED\n" : "decode: ok\n");
+
+    return failed;
+}
@@ -0,0 +1,415 @@
+/*
+ * NOR flash array model for the host tests; see flash_model.h.
+ *
+ * Intel parts report busy through their status register for a few reads
+ * after each operation. AMD parts toggle DQ6 instead, and leave a window
+ * after a sector erase command in which up to ERASE_QUEUE more sectors are
+ * taken into the same erase; any sector added later is silently ignored,
+ * as on a real part whose window closed just before it arrived.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "flash_model.h"
+
+/* sectors an AMD erase takes after the first, before the window closes */
+#define ERASE_QUEUE 1
+
+/* reads a part stays busy for */
+#define BUSY_PROGRAM 3
+#define BUSY_ERASE 5
+
+/* largest write buffer, in bus words */
+#define BUFFER_WORDS 512
+
+enum state {
+    ARRAY, QUERY, ID, STATUS, PROGRAM,
+    BUFFER_COUNT, BUFFER_DATA, BUFFER_CONFIRM,
+    ERASE, LOCK, /* Intel */
+    UNLOCK1, UNLOCK2, SETUP, SETUP1, SETUP2,
+    BUSY, ERASE_WINDOW, /* AMD */
+};
+
+struct flash_model_stats flash_stats;
+int flash_strict;
+unsigned char flash_locked[FLASH_MODEL_BLOCKS];
+
+static unsigned int array_base;
+static unsigned char *array;
+static int bus_width, parts, amd_cmds;
+
+static enum state state;
+static int busy, status, toggle, window_reads, queued;
+static int count, left;
+static unsigned int buffer_off[BUFFER_WORDS], buffer_val[BUFFER_WORDS];
+static unsigned char query[0x60];
+
+/**
+ * Repeat a byte for every part on the bus
+ */
+static unsigned int lanes(unsigned char v)
+{
+    unsigned int r = 0;
+    int i;
+
+    for (i = 0; i < parts; i++) {
+        r |= (unsigned int)v << (i * (bus_width / parts) * 8);
+    }
+
+    return r;
+}
+
+static unsigned int get(unsigned int off)
+{
+    unsigned int v = 0;
+
+    memcpy(&v, array + off, bus_width);
+
+    return v;
+}
+
+/**
+ * Program a bus word: bits can only go from 1 to 0, so bytes given as 0xFF
+ * are left alone and the rest have to land on erased bytes
+ */
+static void program(unsigned int off, unsigned int v)
+{
+    unsigned int old = get(off);
+    int i;
+
+    if (flash_locked[off / FLASH_MODEL_BLOCK]) {
+        printf("flash model: program of locked block at %x\n", off);
+        flash_stats.errors++;
+        return;
+    }
+
+    for (i = 0; i < bus_width; i++) {
+        if ((v >> (8 * i) & 0xff) != 0xff && (old >> (8 * i) & 0xff) != 0xff) {
+            printf("flash model: program of %x over %x at %x\n", v, old, off);
+            flash_stats.errors++;
+            break;
+        }
+    }
+
+    old &= v;
+    memcpy(array + off, &old, bus_width);
+}
+
+static void erase(unsigned int off)
+{
+    if (flash_locked[off / FLASH_MODEL_BLOCK]) {
+        status = 0xA2;
+        return;
+    }
+
+    memset(array + off / FLASH_MODEL_BLOCK * FLASH_MODEL_BLOCK, 0xff,
+        FLASH_MODEL_BLOCK);
+    flash_stats.erases++;
+}
+
+/**
+ * Set up the array: mem holds its contents, FLASH_MODEL_SIZE bytes, and
+ * the array answers at base
+ * @param width bytes per bus access
+ * @param interleave parts side by side on the bus
+ * @param amd non-zero for the AMD command set, else Intel
+ */
+void flash_model_init(unsigned int base, unsigned char *mem, int width,
+    int interleave, int amd)
+{
+    unsigned int chip_size = FLASH_MODEL_SIZE / interleave;
+    unsigned int block = FLASH_MODEL_BLOCK / interleave;
+    int n;
+
+    array_base = base;
+    array = mem;
+    bus_width = width;
+    parts = interleave;
+    amd_cmds = amd;
+    state = ARRAY;
+    busy = 0;
+    flash_strict = 0;
+    memset(&flash_stats, 0, sizeof(flash_stats));
+    memset(flash_locked, 0, sizeof(flash_locked));
+
+    for (n = 0; (1u << n) < chip_size; n++);
+
+    memset(query, 0, sizeof(query));
+    query[0x10] = 'Q';
+    query[0x11] = 'R';
+    query[0x12] = 'Y';
+    query[0x13] = amd ? 2 : 1;
+    query[0x15] = 0x40; /* extended table */
+    query[0x27] = n;
+    query[0x2A] = width / interleave == 1 ? 5 : 6; /* 32 or 64 byte buffer */
+    query[0x2C] = 1;
+    query[0x2D] = FLASH_MODEL_BLOCKS - 1;
+    query[0x2F] = (block / 256) & 0xff;
+    query[0x30] = (block / 256) >> 8;
+    query[0x40] = 'P';
+    query[0x41] = 'R';
+    query[0x42] = 'I';
+    query[0x45] = 0x80;
+    query[0x4C] = amd ? 2 : 0; /* AMD page mode, 8 words */
+}
+
+unsigned int flash_model_read(int w, unsigned int addr)
+{
+    unsigned int off = addr - array_base;
+
+    if (w != bus_width) {
+        return 0;
+    }
+
+    switch (state) {
+    case QUERY:
+        return lanes(query[off / bus_width]);
+    case ID:
+        return lanes(off / bus_width == 0 ? 0x89 : 0x18);
+    case STATUS:
+    case BUFFER_COUNT:
+        if (busy) {
+            busy--;
+            return lanes(status & 0x7f);
+        }
+
+        return lanes(status);
+    case ERASE_WINDOW:
+        /* already busy, with DQ3 clear while more sectors may be added */
+        toggle ^= 0x40;
+
+        if (window_reads++ < 2) {
+            return lanes(toggle);
+        }
+
+        state = BUSY;
+        busy = BUSY_ERASE;
+        return lanes(toggle | 0x08);
+    case BUSY:
+        if (busy) {
+            busy--;
+            toggle ^= 0x40;
+            return lanes(toggle | 0x08);
+        }
+
+        state = ARRAY;
+        return get(off);
+    default:
+        return get(off);
+    }
+}
+
+/**
+ * A write under the AMD command set
+ */
+static void write_amd(unsigned int off, unsigned char cmd, unsigned int val)
+{
+    unsigned int word = off / bus_width;
+    int i;
+
+    switch (state) {
+    case PROGRAM:
+        program(off, val);
+        flash_stats.word_writes++;
+        state = BUSY;
+        busy = BUSY_PROGRAM;
+        return;
+    case BUFFER_COUNT:
+        count = left = (val & 0xff) + 1;
+        state = BUFFER_DATA;
+        return;
+    case BUFFER_DATA:
+        buffer_off[count - left] = off;
+        buffer_val[count - left] = val;
+        if (--left == 0) state = BUFFER_CONFIRM;
+        return;
+    case BUFFER_CONFIRM:
+        if (cmd != 0x29) {
+            printf("flash model: bad buffer confirm %x\n", val);
+            flash_stats.errors++;
+        }
+
+        for (i = 0; i < count; i++) {
+            program(buffer_off[i], buffer_val[i]);
+        }
+
+        flash_stats.buffer_writes++;
+        state = BUSY;
+        busy = BUSY_PROGRAM;
+        return;
+    case ERASE_WINDOW:
+        if (cmd == 0x30) {
+            if (queued++ < ERASE_QUEUE) erase(off);
+            return;
+        }
+        break;
+    case UNLOCK2:
+        switch (cmd) {
+        case 0xA0:
+            state = PROGRAM;
+            return;
+        case 0x80:
+            state = SETUP;
+            return;
+        case 0x90:
+            state = ID;
+            return;
+        case 0x25:
+            state = BUFFER_COUNT;
+            return;
+        }
+        break;
+    case SETUP2:
+        if (cmd == 0x30) {
+            erase(off);
+            window_reads = 0;
+            queued = 0;
+            state = ERASE_WINDOW;
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (cmd == 0xAA && word == 0x555) {
+        state = state == SETUP ? SETUP1 : UNLOCK1;
+    } else if (cmd == 0x55 && word == 0x2AA &&
+        (state == UNLOCK1 || state == SETUP1))
+    {
+        state = state == SETUP1 ? SETUP2 : UNLOCK2;
+    } else if (cmd == 0x98 && word == 0x55) {
+        state = QUERY;
+    } else {
+        if (state == BUSY && cmd != 0xF0) {
+            printf("flash model: write of %x while busy\n", val);
+            flash_stats.errors++;
+        }
+
+        state = ARRAY;
+    }
+}
+
+/**
+ * A write under the Intel command set
+ */
+static void write_intel(unsigned int off, unsigned char cmd, unsigned int val)
+{
+    int i;
+
+    switch (state) {
+    case PROGRAM:
+        program(off, val);
+        flash_stats.word_writes++;
+        status = flash_locked[off / FLASH_MODEL_BLOCK] ? 0x92 : 0x80;
+        busy = BUSY_PROGRAM;
+        state = STATUS;
+        return;
+    case BUFFER_COUNT:
+        count = left = (val & 0xff) + 1;
+        state = BUFFER_DATA;
+        return;
+    case BUFFER_DATA:
+        buffer_off[count - left] = off;
+        buffer_val[count - left] = val;
+        if (--left == 0) state = BUFFER_CONFIRM;
+        return;
+    case BUFFER_CONFIRM:
+        if (cmd != 0xD0) {
+            printf("flash model: bad buffer confirm %x\n", val);
+            flash_stats.errors++;
+        }
+
+        if (flash_locked[buffer_off[0] / FLASH_MODEL_BLOCK]) {
+            status = 0x92;
+        } else {
+            for (i = 0; i < count; i++) {
+                program(buffer_off[i], buffer_val[i]);
+            }
+
+            status = 0x80;
+            flash_stats.buffer_writes++;
+        }
+
+        busy = BUSY_PROGRAM;
+        state = STATUS;
+        return;
+    case ERASE:
+        if (cmd == 0xD0) {
+            status = 0x80;
+            erase(off);
+            busy = BUSY_ERASE;
+            state = STATUS;
+            return;
+        }
+        break;
+    case LOCK:
+        if (cmd == 0xD0) {
+            flash_locked[off / FLASH_MODEL_BLOCK] = 0;
+            status = 0x80;
+            busy = BUSY_PROGRAM;
+            state = STATUS;
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    switch (cmd) {
+    case 0x98:
+        state = QUERY;
+        break;
+    case 0x90:
+        state = ID;
+        break;
+    case 0x70:
+        state = STATUS;
+        break;
+    case 0x50:
+        status = 0x80;
+        state = STATUS;
+        break;
+    case 0x40:
+        state = PROGRAM;
+        break;
+    case 0xE8:
+        status = 0x80;
+        state = BUFFER_COUNT;
+        break;
+    case 0x20:
+        state = ERASE;
+        break;
+    case 0x60:
+        state = LOCK;
+        break;
+    default:
+        /* 0xFF, and anything unknown, goes back to reading the array */
+        state = ARRAY;
+    }
+}
+
+void flash_model_write(int w, unsigned int addr, unsigned int val)
+{
+    unsigned int off = addr - array_base;
+    unsigned char cmd = val & 0xff;
+
+    if (w != bus_width) {
+        return;
+    }
+
+    /* commands, unlike data, have to reach every part */
+    if (flash_strict && val != lanes(cmd) && state != PROGRAM &&
+        state != BUFFER_DATA)
+    {
+        printf("flash model: command %x not sent to every part\n", val);
+        flash_stats.errors++;
+    }
+
+    if (amd_cmds) {
+        write_amd(off, cmd, val);
+    } else {
+        write_intel(off, cmd, val);
+    }
+}
@@ -0,0 +1,36 @@
+/*
+ * A NOR flash array for the host tests, driven by storage/cfi.c in place
+ * of the bus: one or more CFI parts side by side, with the Intel or the
+ * AMD command set. It answers the query, ID and status reads cfi.c makes
+ * and counts anything a real array would get wrong: commands not written
+ * to every part on the bus, programming data over bytes that aren't
+ * erased, or writing to a locked block.
+ */
+#ifndef _TEST_FLASH_MODEL_H
+#define _TEST_FLASH_MODEL_H
+
+#define FLASH_MODEL_BLOCK 0x10000 /* erase block, across the whole bus */
+#define FLASH_MODEL_BLOCKS 32
+#define FLASH_MODEL_SIZE (FLASH_MODEL_BLOCK * FLASH_MODEL_BLOCKS)
+
+struct flash_model_stats {
+    int errors; /* commands a real array would have rejected or mangled */
+    int erases; /* blocks erased */
+    int buffer_writes; /* write buffer operations */
+    int word_writes; /* single word programs */
+};
+
+extern struct flash_model_stats flash_stats;
+
+/* check that commands reach every part; off after flash_model_init(), as
+ * a probe tries bus layouts that don't match on the way */
+extern int flash_strict;
+
+extern unsigned char flash_locked[FLASH_MODEL_BLOCKS];
+
+void flash_model_init(unsigned int base, unsigned char *mem, int width,
+    int interleave, int amd);
+unsigned int flash_model_read(int width, unsigned int addr);
+void flash_model_write(int width, unsigned int addr, unsigned int val);
+
+#endif /* _TEST_FLASH_MODEL_H */
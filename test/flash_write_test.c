@@ -0,0 +1,249 @@
+/*
+ * platio_write() on the c7200, against the flash model: RAM and bootflash
+ * are mapped at the addresses CILO uses for them, and files are created,
+ * replaced and grown on an array with each command set. After every write
+ * each file has to read back whole, with a header whose CRC32 matches and
+ * whose seek field points at the next header. A write to a filesystem
+ * holding more files than the index has room for has to be refused
+ * without touching the array.
+ */
+
+/* CILO's headers go first: the host's stddef.h replaces its NULL */
+#include <mach/c7200/platform.h>
+#include <mach/c7200/platio.h>
+#include <crc32.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "flash_model.h"
+
+/* RAM the tests give CILO; see c_memsz() in stubs.c */
+#define RAM_SIZE (8 << 20)
+
+/* where the data to be written is put, clear of CILO's heap */
+#define WRITE_BUF (MEMORY_BASE + 0x10000)
+
+#define MAX_FILES 8
+
+static struct {
+    char name[16];
+    uint32_t len;
+    uint8_t *data;
+} files[MAX_FILES];
+static int nfiles;
+
+static uint8_t saved[FLASH_MODEL_SIZE];
+
+/**
+ * Map n bytes at a fixed address
+ */
+static int map_at(uint32_t addr, uint32_t n)
+{
+    void *p = mmap((void *)(unsigned long)addr, n, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (p != (void *)(unsigned long)addr) {
+        printf("can't map %x bytes at %x\n", n, addr);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Check every file written so far against flash, and the chain of headers
+ * against what the index says
+ * @returns 0 if flash holds what it should
+ */
+static int check_files(void)
+{
+    struct fs_index_ent *e;
+    struct fs_ent *f;
+    uint32_t next;
+    int i;
+
+    platio_index_flash();
+
+    if (flash_index->count != nfiles) {
+        printf("%d files on flash, expected %d\n", flash_index->count,
+            nfiles);
+        return -1;
+    }
+
+    for (i = 0; i < nfiles; i++) {
+        if ((e = fs_index_lookup(flash_index, files[i].name)) == NULL) {
+            printf("%s is missing\n", files[i].name);
+            return -1;
+        }
+
+        f = (struct fs_ent *)(unsigned long)(flash_index->base + e->offset);
+        next = FLASHFS_BASE - FLASH_BASE + e->offset +
+            sizeof(struct fs_ent) + f->length;
+
+        if (f->length != files[i].len ||
+            memcmp(f + 1, files[i].data, files[i].len))
+        {
+            printf("%s reads back wrong\n", files[i].name);
+            return -1;
+        }
+
+        if (f->crc32 != crc32_update(0, files[i].data, files[i].len) ||
+            f->seek != next)
+        {
+            printf("%s has a bad header\n", files[i].name);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Write a file of random data, or replace it, and check the result
+ * @returns 0 on success
+ */
+static int write_file(const char *name, uint32_t len)
+{
+    uint8_t *buf = (uint8_t *)WRITE_BUF;
+    uint32_t i;
+    int n;
+
+    for (n = 0; n < nfiles && strcmp(files[n].name, name); n++);
+
+    if (n == nfiles) {
+        strcpy(files[nfiles++].name, name);
+    }
+
+    for (i = 0; i < len; i++) {
+        buf[i] = rand();
+    }
+
+    free(files[n].data);
+    files[n].data = malloc(len);
+    files[n].len = len;
+    memcpy(files[n].data, buf, len);
+
+    if (platio_write(&flash_storage, name, buf, len) < 0) {
+        printf("writing %s failed\n", name);
+        return -1;
+    }
+
+    return check_files();
+}
+
+/**
+ * Lay out a chain of n empty files straight onto the array
+ */
+static void make_files(int n)
+{
+    struct fs_ent *f = (struct fs_ent *)FLASHFS_BASE;
+    int i;
+
+    for (i = 0; i < n; i++, f++) {
+        memset(f, 0xff, sizeof(*f));
+        f->magic = FS_FILE_MAGIC;
+        f->fileno = i;
+        sprintf(f->filename, "f%d", i);
+        f->length = 0;
+        f->seek = (uint32_t)(unsigned long)(f + 1) - FLASH_BASE;
+        f->crc32 = 0;
+    }
+}
+
+/**
+ * Writes to an array with one of the command sets
+ * @returns 0 if they all went as they should
+ */
+static int test_flash(int amd)
+{
+    uint8_t *buf = (uint8_t *)WRITE_BUF;
+    int i;
+
+    printf("%s: ", amd ? "AMD" : "Intel");
+
+    memset((void *)FLASH_BASE, 0xff, FLASH_MODEL_SIZE);
+    flash_model_init(FLASH_BASE, (uint8_t *)FLASH_BASE, 4, 2, amd);
+
+    if (cfi_probe(&flash_cfi, FLASH_BASE) < 0) {
+        printf("probe failed\n");
+        return -1;
+    }
+
+    flash_strict = 1;
+    platio_index_flash();
+
+    for (i = 0; i < nfiles; i++) {
+        free(files[i].data);
+        files[i].data = NULL;
+    }
+
+    nfiles = 0;
+
+    /* new files, then files replaced at the start, middle and end of the
+     * chain, growing and shrinking */
+    if (write_file("vmlinux", 300000) || write_file("a", 5) ||
+        write_file("config", 70001) || write_file("a", 90000) ||
+        write_file("vmlinux", 1000) || write_file("config", 12) ||
+        write_file("b", 0))
+    {
+        return -1;
+    }
+
+    /* an index with no room left can't say where the chain ends */
+    memset((void *)FLASHFS_BASE, 0xff, FLASH_MODEL_SIZE -
+        (FLASHFS_BASE - FLASH_BASE));
+    make_files(FS_INDEX_MAX - 1);
+
+    platio_index_flash();
+    memset(buf, 0x5a, 100);
+
+    if (platio_write(&flash_storage, "last", buf, 100) < 0 ||
+        flash_index->count != FS_INDEX_MAX)
+    {
+        printf("writing the last file the index has room for failed\n");
+        return -1;
+    }
+
+    memcpy(saved, (void *)FLASH_BASE, FLASH_MODEL_SIZE);
+
+    if (platio_write(&flash_storage, "more", buf, 100) == 0 ||
+        memcmp(saved, (void *)FLASH_BASE, FLASH_MODEL_SIZE))
+    {
+        printf("a write past a full index went ahead\n");
+        return -1;
+    }
+
+    printf("%d erases, %d buffer writes, %d word writes",
+        flash_stats.erases, flash_stats.buffer_writes,
+        flash_stats.word_writes);
+
+    if (flash_stats.errors) {
+        printf(", %d errors\n", flash_stats.errors);
+        return -1;
+    }
+
+    printf("\n");
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    if (map_at(MEMORY_BASE, RAM_SIZE) < 0 ||
+        map_at(FLASH_BASE, FLASH_MODEL_SIZE) < 0 || platio_init() < 0)
+    {
+        return 1;
+    }
+
+    failed |= test_flash(0) < 0;
+    failed |= test_flash(1) < 0;
+
+    printf(failed ? "flash write: FAILED\n" : "flash write: ok\n");
+
+    return failed;
+}
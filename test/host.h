@@ -0,0 +1,21 @@
+/*
+ * Included ahead of every CILO source built for the host: renames the
+ * functions CILO shares with the host C library, so a test can link both
+ * and call either.
+ */
+#ifndef _TEST_HOST_H
+#define _TEST_HOST_H
+
+#define memcpy cilo_memcpy
+#define memzero cilo_memzero
+#define printf cilo_printf
+#define sprintf cilo_sprintf
+#define strcmp cilo_strcmp
+#define strncmp cilo_strncmp
+#define strcpy cilo_strcpy
+#define strncpy cilo_strncpy
+#define strlen cilo_strlen
+#define strchr cilo_strchr
+#define strstr cilo_strstr
+
+#endif /* _TEST_HOST_H */
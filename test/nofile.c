@@ -0,0 +1,45 @@
+/*
+ * The file layer, for tests that link a loader but only ever hand it
+ * pipeline stages over memory: nothing here is reached, and every call
+ * fails.
+ */
+
+/* CILO's headers go first: the host's stddef.h replaces its NULL */
+#include <ciloio.h>
+#include <bootcache.h>
+
+int32_t cilo_read(void *pbuf, uint32_t size, uint32_t nmemb,
+    struct file *fp)
+{
+    return -1;
+}
+
+int32_t cilo_seek(struct file *fp, uint32_t offset, uint8_t whence)
+{
+    return -1;
+}
+
+void *cilo_map(struct file *fp, uint32_t offset, uint32_t len)
+{
+    return NULL;
+}
+
+int32_t cilo_read_async(struct cilo_req *req, void *pbuf, uint32_t len,
+    struct file *fp)
+{
+    return -1;
+}
+
+int cilo_poll(struct cilo_req *req)
+{
+    return -1;
+}
+
+int cilo_verify(struct file *fp)
+{
+    return -1;
+}
+
+void boot_cache_save(struct file *fp, const char *cmd_line)
+{
+}
@@ -0,0 +1,40 @@
+/*
+ * What the tests' share of CILO needs from ROMMON, done with the host C
+ * library.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* set by a test to drop what CILO prints, e.g. while feeding it bad input */
+int console_quiet;
+
+void c_putc(const char c)
+{
+    if (!console_quiet) {
+        putchar(c);
+    }
+}
+
+void c_puts(const char *s)
+{
+    if (!console_quiet) {
+        fputs(s, stdout);
+    }
+}
+
+/* nothing is ever typed at a test */
+char c_getc(void)
+{
+    return 0;
+}
+
+int c_strnlen(const char *s, int maxlen)
+{
+    return strnlen(s, maxlen);
+}
+
+int c_memsz(void)
+{
+    return 8 << 20;
+}
@@ -0,0 +1,497 @@
+/*
+ * xz Compressed Kernel Loader
+ *
+ * Licensed under the GNU General Public License v.2.
+ * See COPYING in the root directory of this source distribution for more
+ * details.
+ *
+ * Loads the .xz images that current kernel builds produce: one xz stream
+ * of LZMA2 blocks, optionally through the PowerPC branch filter, with
+ * every header, the index and each block's CRC32 or CRC64 checked.
+ */
+
+#include <printf.h>
+#include <promlib.h>
+#include <string.h>
+#include <crc32.h>
+#include <crc64.h>
+#include <xz_loader.h>
+
+#include <ciloio.h>
+#include <bootcache.h>
+#include <pipeline.h>
+#include <lzmadec.h>
+
+/* platform-specific defines */
+#include <platform.h>
+
+/* input block size when the file has to be read rather than mapped */
+#define XZ_ASYNC_BLOCK 4096
+
+#define XZ_MAGIC_LEN 6
+#define XZ_HEADER_LEN 12
+#define XZ_FOOTER_LEN 12
+#define XZ_BLOCK_HEADER_MAX 1024
+
+#define XZ_CHECK_NONE 0x00
+#define XZ_CHECK_CRC32 0x01
+#define XZ_CHECK_CRC64 0x04
+#define XZ_CHECK_MAX 0x0f
+
+#define XZ_FILTER_POWERPC 0x05
+#define XZ_FILTER_LZMA2 0x21
+
+/* a dot for every this many bytes decoded */
+#define XZ_TICK 0x80000
+
+static const uint8_t xz_magic[XZ_MAGIC_LEN] = {
+    0xfd, '7', 'z', 'X', 'Z', 0x00
+};
+
+/* bytes in each type of check */
+static const uint8_t xz_check_size[XZ_CHECK_MAX + 1] = {
+    0, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64
+};
+
+/* what the blocks added up to, to hold the index against */
+struct xz_sums {
+    uint32_t blocks;
+    uint32_t unpadded;
+    uint32_t uncompressed;
+};
+
+#define xz_le32(p) \
+    ((p)[0] | (p)[1] << 8 | (p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+/**
+ * Check if a file is an xz image.
+ * @param fp the file
+ * @returns non-zero if it starts with the xz magic
+ */
+int is_xz(struct file *fp)
+{
+    uint8_t *p = cilo_map(fp, 0, XZ_MAGIC_LEN);
+    int i;
+
+    if (p == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < XZ_MAGIC_LEN; i++) {
+        if (p[i] != xz_magic[i]) return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Read bytes from outside the compressed data.
+ * @returns 0 on success, -1 if the file ends first
+ */
+static int xz_read(struct lzma_dec *d, uint8_t *buf, uint32_t len)
+{
+    int c;
+
+    while (len--) {
+        if ((c = lzma_dec_byte(d)) < 0) {
+            return -1;
+        }
+
+        *buf++ = c;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode a variable-length integer from a header. Values too large for 32
+ * bits are refused; nothing CILO can load needs them.
+ * @param buf header
+ * @param pos position in the header, advanced past the integer
+ * @param end end of the header
+ * @param val the value
+ * @returns 0 on success, -1 if it is malformed or too large
+ */
+static int xz_vli(const uint8_t *buf, uint32_t *pos, uint32_t end,
+    uint32_t *val)
+{
+    uint32_t shift = 0;
+    uint8_t b;
+
+    *val = 0;
+
+    do {
+        if (*pos >= end || shift > 28) {
+            return -1;
+        }
+
+        b = buf[(*pos)++];
+
+        if (shift == 28 && (b & 0x70)) {
+            return -1;
+        }
+
+        *val |= (b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    return 0;
+}
+
+/**
+ * Decode a variable-length integer from the index, adding it to the
+ * index's CRC.
+ * @returns 0 on success, -1 if it is malformed or too large
+ */
+static int xz_index_vli(struct lzma_dec *d, uint32_t *crc, uint32_t *val)
+{
+    uint8_t buf[5];
+    uint32_t pos = 0, n = 0;
+    int c;
+
+    do {
+        if (n == sizeof(buf) || (c = lzma_dec_byte(d)) < 0) {
+            return -1;
+        }
+
+        buf[n++] = c;
+    } while (c & 0x80);
+
+    *crc = crc32_update(*crc, buf, n);
+
+    return xz_vli(buf, &pos, n, val);
+}
+
+/**
+ * Undo the PowerPC branch filter: relative branch targets were made
+ * absolute to compress better.
+ * @param buf decoded block
+ * @param len length of the block
+ * @param start position the filter started counting from
+ */
+static void xz_bcj_powerpc(uint8_t *buf, uint32_t len, uint32_t start)
+{
+    uint32_t i, src, dst;
+
+    for (i = 0; i + 4 <= len; i += 4) {
+        if ((buf[i] >> 2) != 0x12 || (buf[i + 3] & 3) != 1) {
+            continue;
+        }
+
+        src = (buf[i] & 3) << 24 | buf[i + 1] << 16 | buf[i + 2] << 8 |
+            (buf[i + 3] & ~3);
+        dst = src - (start + i);
+
+        buf[i] = 0x48 | ((dst >> 24) & 3);
+        buf[i + 1] = dst >> 16;
+        buf[i + 2] = dst >> 8;
+        buf[i + 3] = (buf[i + 3] & 3) | (dst & ~3);
+    }
+}
+
+/**
+ * Check a block's decoded data against the check that follows it.
+ * @returns 0 if it matches or can't be checked, -1 if it doesn't match
+ */
+static int xz_check(struct lzma_dec *d, uint8_t check, const uint8_t *out,
+    uint32_t len)
+{
+    uint8_t stored[64];
+    struct crc64 crc64 = { 0, 0 };
+
+    if (xz_read(d, stored, xz_check_size[check]) < 0) {
+        return -1;
+    }
+
+    switch (check) {
+    case XZ_CHECK_NONE:
+        return 0;
+    case XZ_CHECK_CRC32:
+        return crc32_update(0, out, len) == xz_le32(stored) ? 0 : -1;
+    case XZ_CHECK_CRC64:
+        crc64_update(&crc64, out, len);
+        return crc64.lo == xz_le32(stored) &&
+            crc64.hi == xz_le32(stored + 4) ? 0 : -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode one block of the stream to the decoder's output.
+ * @param d decoder
+ * @param size_byte first byte of the block header
+ * @param check type of check the stream uses
+ * @param sums block totals, updated for this block
+ * @returns 0 on success, -1 on error
+ */
+static int xz_block(struct lzma_dec *d, int size_byte, uint8_t check,
+    struct xz_sums *sums)
+{
+    uint8_t hdr[XZ_BLOCK_HEADER_MAX];
+    uint32_t hdr_len = (size_byte + 1) * 4, end = hdr_len - 4, pos = 2;
+    uint32_t compressed = 0xffffffff, uncompressed = 0xffffffff;
+    uint32_t id, props_len, bcj = 0, bcj_start = 0, in_start, len;
+    uint8_t *out;
+    int i, filters;
+
+    hdr[0] = size_byte;
+
+    if (xz_read(d, hdr + 1, hdr_len - 1) < 0) {
+        printf("Truncated xz block header.\n");
+        return -1;
+    }
+
+    if (crc32_update(0, hdr, end) != xz_le32(hdr + end)) {
+        printf("Corrupt xz block header.\n");
+        return -1;
+    }
+
+    if (hdr[1] & 0x3c) {
+        printf("Unsupported xz block flags %02x.\n", hdr[1]);
+        return -1;
+    }
+
+    filters = (hdr[1] & 3) + 1;
+
+    if (((hdr[1] & 0x40) && xz_vli(hdr, &pos, end, &compressed) < 0) ||
+        ((hdr[1] & 0x80) && xz_vli(hdr, &pos, end, &uncompressed) < 0))
+    {
+        printf("Bad sizes in xz block header.\n");
+        return -1;
+    }
+
+    /* the PowerPC branch filter, if any, then LZMA2 */
+    for (i = 0; i < filters; i++) {
+        if (xz_vli(hdr, &pos, end, &id) < 0 ||
+            xz_vli(hdr, &pos, end, &props_len) < 0 ||
+            props_len > end - pos)
+        {
+            printf("Bad filter in xz block header.\n");
+            return -1;
+        }
+
+        if (id == XZ_FILTER_LZMA2 && i == filters - 1 && props_len == 1 &&
+            hdr[pos] <= 40)
+        {
+            /* the dictionary size doesn't matter when decoding to memory */
+        } else if (id == XZ_FILTER_POWERPC && i < filters - 1 && !bcj &&
+            (props_len == 0 || props_len == 4))
+        {
+            bcj = 1;
+            if (props_len) bcj_start = xz_le32(hdr + pos);
+        } else {
+            printf("Unsupported xz filter %x.\n", id);
+            return -1;
+        }
+
+        pos += props_len;
+    }
+
+    while (pos < end) {
+        if (hdr[pos++]) {
+            printf("Corrupt xz block header.\n");
+            return -1;
+        }
+    }
+
+    in_start = lzma_dec_consumed(d);
+    out = lzma_dec_out(d);
+
+    if (lzma2_decode(d) < 0) {
+        printf("\nError in decoding xz block %d.\n", sums->blocks);
+        return -1;
+    }
+
+    len = lzma_dec_out(d) - out;
+    compressed = compressed == 0xffffffff ?
+        lzma_dec_consumed(d) - in_start : compressed;
+
+    if (lzma_dec_consumed(d) - in_start != compressed ||
+        (uncompressed != 0xffffffff && len != uncompressed))
+    {
+        printf("\nxz block %d doesn't match its header.\n", sums->blocks);
+        return -1;
+    }
+
+    /* block padding to a multiple of four bytes */
+    for (pos = hdr_len + compressed; pos & 3; pos++) {
+        if (lzma_dec_byte(d) != 0x00) {
+            printf("\nCorrupt xz block padding.\n");
+            return -1;
+        }
+    }
+
+    if (bcj) {
+        xz_bcj_powerpc(out, len, bcj_start);
+    }
+
+    if (xz_check(d, check, out, len) < 0) {
+        printf("\nxz block %d failed its check.\n", sums->blocks);
+        return -1;
+    }
+
+    sums->blocks++;
+    sums->unpadded += hdr_len + compressed + xz_check_size[check];
+    sums->uncompressed += len;
+
+    return 0;
+}
+
+/**
+ * Check the index, whose indicator byte has been read, and the footer
+ * against the blocks decoded.
+ * @returns 0 on success, -1 if they don't match
+ */
+static int xz_index(struct lzma_dec *d, const uint8_t *flags,
+    struct xz_sums *sums)
+{
+    uint8_t zero = 0, buf[XZ_FOOTER_LEN];
+    uint32_t crc = crc32_update(0, &zero, 1);
+    uint32_t start = lzma_dec_consumed(d) - 1;
+    uint32_t count, unpadded, uncompressed, i;
+    struct xz_sums index = { 0, 0, 0 };
+    int c;
+
+    if (xz_index_vli(d, &crc, &count) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (xz_index_vli(d, &crc, &unpadded) < 0 ||
+            xz_index_vli(d, &crc, &uncompressed) < 0)
+        {
+            return -1;
+        }
+
+        index.unpadded += unpadded;
+        index.uncompressed += uncompressed;
+    }
+
+    while ((lzma_dec_consumed(d) - start) & 3) {
+        if ((c = lzma_dec_byte(d)) != 0x00) {
+            return -1;
+        }
+
+        crc = crc32_update(crc, &zero, 1);
+    }
+
+    if (count != sums->blocks || index.unpadded != sums->unpadded ||
+        index.uncompressed != sums->uncompressed)
+    {
+        return -1;
+    }
+
+    /* the index's CRC, then the footer: CRC, backward size, flags, magic */
+    if (xz_read(d, buf, 4) < 0 || xz_le32(buf) != crc) {
+        return -1;
+    }
+
+    i = lzma_dec_consumed(d) - start;
+
+    if (xz_read(d, buf, XZ_FOOTER_LEN) < 0 ||
+        crc32_update(0, buf + 4, 6) != xz_le32(buf) ||
+        xz_le32(buf + 4) != i / 4 - 1 ||
+        buf[8] != flags[0] || buf[9] != flags[1] ||
+        buf[10] != 'Y' || buf[11] != 'Z')
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Print a dot for each XZ_TICK bytes decoded.
+ */
+static void xz_tick(struct lzma_dec *d)
+{
+    while (lzma_dec_out(d) >= d->tick_at) {
+        c_putc('.');
+        d->tick_at += XZ_TICK;
+    }
+}
+
+/**
+ * Decode an xz stream to the decoder's output, checking its headers, its
+ * index and the check of each block.
+ * @param d decoder, set up on the stream and on where the output goes
+ * @returns bytes decoded, or -1 if the stream is corrupt, unsupported or
+ * doesn't fit
+ */
+int32_t xz_decode(struct lzma_dec *d)
+{
+    struct xz_sums sums = { 0, 0, 0 };
+    uint8_t hdr[XZ_HEADER_LEN];
+    int c;
+
+    /* stream header: magic, flags, CRC32 of the flags */
+    if (xz_read(d, hdr, XZ_HEADER_LEN) < 0 ||
+        crc32_update(0, hdr + XZ_MAGIC_LEN, 2) != xz_le32(hdr + 8))
+    {
+        printf("Corrupt xz stream header.\n");
+        return -1;
+    }
+
+    if (hdr[6] != 0 || hdr[7] > XZ_CHECK_MAX) {
+        printf("Unsupported xz stream flags %02x %02x.\n", hdr[6], hdr[7]);
+        return -1;
+    }
+
+    if (hdr[7] != XZ_CHECK_NONE && hdr[7] != XZ_CHECK_CRC32 &&
+        hdr[7] != XZ_CHECK_CRC64)
+    {
+        printf("Warning: can't verify xz check type %d.\n", hdr[7]);
+    }
+
+    /* blocks, up to the index indicator */
+    while ((c = lzma_dec_byte(d)) > 0) {
+        if (xz_block(d, c, hdr[7], &sums) < 0) {
+            return -1;
+        }
+    }
+
+    if (c < 0 || xz_index(d, hdr + XZ_MAGIC_LEN, &sums) < 0) {
+        printf("\nCorrupt xz index or footer.\n");
+        return -1;
+    }
+
+    return sums.uncompressed;
+}
+
+void load_xz(struct file *fp, uint32_t load_address, char *cmd_line)
+{
+    struct pipe_file src;
+    struct lzma_dec dec;
+    struct lzma_probs probs;
+    uint8_t bufs[2][XZ_ASYNC_BLOCK];
+    int32_t len;
+
+    pipe_file_init(&src, fp, 0, fp->file_len, bufs[0], XZ_ASYNC_BLOCK);
+
+    /* decode straight to the load address, in whatever RAM is left */
+    lzma_dec_init(&dec, &probs, &src.st, (uint8_t *)load_address,
+        LOAD_LIMIT - load_address);
+
+#ifndef NO_LOAD_PROGRESS
+    dec.tick = xz_tick;
+    dec.tick_at = (uint8_t *)load_address + XZ_TICK;
+#endif
+
+    if ((len = xz_decode(&dec)) < 0) {
+        printf("Aborting.\n");
+        return;
+    }
+
+    if (cilo_verify(fp) < 0) {
+        printf("Refusing to boot an unverified kernel.\n");
+        return;
+    }
+
+    boot_cache_save(fp, cmd_line);
+
+    printf("\nDecompressed %d bytes.\n", len);
+    printf("Starting kernel at 0x%016x.\n\n", load_address);
+    ((void (*)(uint32_t mem_sz, char *cmd_line))(load_address))
+        (c_memsz(), cmd_line);
+}
@@ -0,0 +1,1377 @@
+/* Zstandard decoder
+ * Licensed under the GNU General Public License v2
+ *
+ * A decoder for Zstandard frames (RFC 8878) without dictionaries. Each
+ * compressed block is a literals section, Huffman coded or not, and a
+ * sequences section of literal lengths, match lengths and offsets that are
+ * FSE coded and read backwards from the end of the block.
+ *
+ * As in lzmadec.c and inflate.c, output goes straight to its final address
+ * and that memory is the window, so a frame's window size only limits how
+ * far back a match may reach. The memory needed on top of the output is
+ * the struct zstd_dec itself, plus a block of staging when the input can't
+ * be mapped.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <printf.h>
+#include <pipeline.h>
+#include <zstddec.h>
+
+#define ZSTD_BLOCK_RAW 0
+#define ZSTD_BLOCK_RLE 1
+#define ZSTD_BLOCK_COMPRESSED 2
+
+#define ZSTD_LIT_RAW 0
+#define ZSTD_LIT_RLE 1
+#define ZSTD_LIT_COMPRESSED 2
+#define ZSTD_LIT_TREELESS 3
+
+#define ZSTD_SEQ_PREDEFINED 0
+#define ZSTD_SEQ_RLE 1
+#define ZSTD_SEQ_COMPRESSED 2
+#define ZSTD_SEQ_REPEAT 3
+
+/* frame header descriptor */
+#define ZSTD_FHD_SINGLE 0x20
+#define ZSTD_FHD_RESERVED 0x08
+#define ZSTD_FHD_CHECKSUM 0x04
+
+/* tables a block may take over from the one before, in zstd_dec.have */
+#define ZSTD_HAVE_LL 1
+#define ZSTD_HAVE_OF 2
+#define ZSTD_HAVE_ML 4
+#define ZSTD_HAVE_HUF 8
+
+#define ZSTD_LL_CODES 36
+#define ZSTD_ML_CODES 53
+#define ZSTD_OF_CODES 32
+
+/* Huffman weights are FSE coded with at most this accuracy */
+#define ZSTD_WEIGHT_LOG_MAX 6
+#define ZSTD_WEIGHT_MAX 12
+#define ZSTD_WEIGHTS 256
+
+#define zstd_le16(p) ((p)[0] | (p)[1] << 8)
+#define zstd_le32(p) \
+    ((p)[0] | (p)[1] << 8 | (p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+/* baseline and extra bits of each literal length and match length code */
+static const uint32_t zstd_ll_base[ZSTD_LL_CODES] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048,
+    4096, 8192, 16384, 32768, 65536
+};
+
+static const uint8_t zstd_ll_extra[ZSTD_LL_CODES] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16
+};
+
+static const uint32_t zstd_ml_base[ZSTD_ML_CODES] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027,
+    2051, 4099, 8195, 16387, 32771, 65539
+};
+
+static const uint8_t zstd_ml_extra[ZSTD_ML_CODES] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10,
+    11, 12, 13, 14, 15, 16
+};
+
+/* the predefined distributions, used when a block doesn't send its own */
+#define ZSTD_LL_DEFAULT_LOG 6
+#define ZSTD_ML_DEFAULT_LOG 6
+#define ZSTD_OF_DEFAULT_LOG 5
+#define ZSTD_OF_DEFAULT_CODES 29
+
+static const int16_t zstd_ll_default[ZSTD_LL_CODES] = {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1
+};
+
+static const int16_t zstd_ml_default[ZSTD_ML_CODES] = {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1
+};
+
+static const int16_t zstd_of_default[ZSTD_OF_DEFAULT_CODES] = {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+/* an entropy-coded bitstream, read backwards from its last byte, in which
+ * the highest set bit marks where the bits start
+ */
+struct zstd_bits {
+    const uint8_t *start;
+    const uint8_t *ptr; /* bytes below this are still to be loaded */
+    uint32_t acc; /* the low n bits are next, most significant first */
+    uint32_t n;
+    uint32_t over; /* bits read past the start, which read as zeros */
+};
+
+/* a 64-bit value as two 32-bit halves, for the content checksum */
+struct zstd_xxh {
+    uint32_t lo;
+    uint32_t hi;
+};
+
+/* XXH64 primes */
+static const struct zstd_xxh xxh_p1 = { 0x85ebca87, 0x9e3779b1 };
+static const struct zstd_xxh xxh_p2 = { 0x27d4eb4f, 0xc2b2ae3d };
+static const struct zstd_xxh xxh_p3 = { 0x9e3779f9, 0x165667b1 };
+static const struct zstd_xxh xxh_p4 = { 0xc2b2ae63, 0x85ebca77 };
+static const struct zstd_xxh xxh_p5 = { 0x165667c5, 0x27d4eb2f };
+
+/**
+ * Position of the highest set bit of a non-zero value.
+ */
+static uint32_t zstd_highbit(uint32_t v)
+{
+    uint32_t n = 0;
+
+    while (v >>= 1) n++;
+
+    return n;
+}
+
+/**
+ * Take the next buffer of input from the source.
+ * @returns 0 on success, -1 at the end of the input or on error
+ */
+static int zstd_refill(struct zstd_dec *d)
+{
+    const uint8_t *buf;
+    uint32_t len;
+
+    if (d->src->pull(d->src, &buf, &len) < 0 || len == 0) {
+        return -1;
+    }
+
+    d->in = buf;
+    d->in_end = buf + len;
+    d->in_total += len;
+
+    return 0;
+}
+
+/**
+ * Set up a decoder.
+ * @param d decoder to set up
+ * @param src stage the compressed data is pulled from
+ * @param out destination of the decoded data
+ * @param out_end end of the destination
+ */
+void zstd_dec_init(struct zstd_dec *d, struct pipe_stage *src, uint8_t *out,
+    uint8_t *out_end)
+{
+    const uint8_t *buf = NULL;
+    uint32_t len;
+
+    d->src = src;
+    d->in = NULL;
+    d->in_end = NULL;
+    d->in_total = 0;
+    d->block = NULL;
+
+    /* take all of the input in place if it can be mapped */
+    if (src->map != NULL && (buf = src->map(src, &len)) != NULL) {
+        d->in = buf;
+        d->in_end = buf + len;
+        d->in_total = len;
+    }
+
+    d->frame = out;
+    d->pos = out;
+    d->out_end = out_end;
+    d->window = 0;
+    d->have = 0;
+
+    d->tick = NULL;
+    d->tick_at = NULL;
+}
+
+/**
+ * Take a byte of input outside of a block, e.g. a header.
+ * @returns the byte, or -1 at the end of the input
+ */
+int zstd_dec_byte(struct zstd_dec *d)
+{
+    if (d->in == d->in_end && zstd_refill(d) < 0) {
+        return -1;
+    }
+
+    return *d->in++;
+}
+
+/**
+ * Take the next len bytes of input in one piece: where they are if the
+ * current input buffer holds them all, else gathered into d->block.
+ * @param len bytes wanted, at most ZSTD_BLOCK_MAX
+ * @returns the bytes, or NULL if the input ends first
+ */
+static const uint8_t *zstd_take(struct zstd_dec *d, uint32_t len)
+{
+    const uint8_t *p = d->in;
+    uint32_t n, got = 0;
+
+    if (d->in_end - d->in >= len) {
+        d->in += len;
+        return p;
+    }
+
+    if (d->block == NULL) {
+        return NULL;
+    }
+
+    while (got < len) {
+        if (d->in == d->in_end && zstd_refill(d) < 0) {
+            return NULL;
+        }
+
+        n = d->in_end - d->in;
+        if (n > len - got) n = len - got;
+
+        memcpy(d->block + got, d->in, n);
+        d->in += n;
+        got += n;
+    }
+
+    return d->block;
+}
+
+/**
+ * Start reading a bitstream backwards.
+ * @returns 0 on success, -1 if it is empty or has no start marker
+ */
+static int zstd_bits_init(struct zstd_bits *b, const uint8_t *p,
+    uint32_t len)
+{
+    if (len == 0 || p[len - 1] == 0) {
+        return -1;
+    }
+
+    b->start = p;
+    b->ptr = p + len - 1;
+    b->n = zstd_highbit(*b->ptr);
+    b->acc = *b->ptr & ((1 << b->n) - 1);
+    b->over = 0;
+
+    return 0;
+}
+
+/**
+ * Load bytes until at least 25 bits are buffered, or the start is reached.
+ */
+static void zstd_bits_fill(struct zstd_bits *b)
+{
+    while (b->n <= 24 && b->ptr > b->start) {
+        b->acc = b->acc << 8 | *--b->ptr;
+        b->n += 8;
+    }
+}
+
+/**
+ * Look at the next k bits, 0 < k <= 25, without taking them.
+ */
+static uint32_t zstd_bits_peek(struct zstd_bits *b, uint32_t k)
+{
+    if (b->n < k) {
+        zstd_bits_fill(b);
+    }
+
+    if (b->n >= k) {
+        return (b->acc >> (b->n - k)) & ((1 << k) - 1);
+    }
+
+    return (b->acc << (k - b->n)) & ((1 << k) - 1);
+}
+
+/**
+ * Drop k bits that have been looked at.
+ */
+static void zstd_bits_skip(struct zstd_bits *b, uint32_t k)
+{
+    if (k <= b->n) {
+        b->n -= k;
+    } else {
+        b->over += k - b->n;
+        b->n = 0;
+    }
+}
+
+/**
+ * Take the next k bits, k <= 32. Past the start the bits read as zeros.
+ */
+static uint32_t zstd_bits_read(struct zstd_bits *b, uint32_t k)
+{
+    uint32_t v;
+
+    if (k == 0) {
+        return 0;
+    }
+
+    if (k > 24) {
+        v = zstd_bits_read(b, k - 16) << 16;
+        return v | zstd_bits_read(b, 16);
+    }
+
+    v = zstd_bits_peek(b, k);
+    zstd_bits_skip(b, k);
+
+    return v;
+}
+
+/**
+ * Check that a bitstream was read exactly to its start.
+ */
+static int zstd_bits_done(const struct zstd_bits *b)
+{
+    return b->n == 0 && b->ptr == b->start && b->over == 0;
+}
+
+/**
+ * Take n bits, n <= 16, from a bitstream read forwards, as a table
+ * description is. Bytes past the end read as zeros.
+ * @param p stream
+ * @param len length of the stream
+ * @param pos bit position to read at
+ */
+static uint32_t zstd_fwd_bits(const uint8_t *p, uint32_t len, uint32_t pos,
+    uint32_t n)
+{
+    uint32_t v = 0, i = pos >> 3, s;
+
+    for (s = 0; s < 24 && i < len; s += 8) {
+        v |= (uint32_t)p[i++] << s;
+    }
+
+    return (v >> (pos & 7)) & ((1 << n) - 1);
+}
+
+/**
+ * Read an FSE table description: the accuracy log, and the normalised
+ * count of each symbol.
+ * @param p description
+ * @param len bytes available
+ * @param norm set to the count of each symbol, -1 for "less than one"
+ * @param max_sym largest symbol allowed; set to the largest one present
+ * @param log set to the accuracy log
+ * @param max_log largest accuracy log allowed
+ * @returns bytes the description takes, or -1 if it is corrupt
+ */
+static int zstd_fse_count(const uint8_t *p, uint32_t len, int16_t *norm,
+    uint32_t *max_sym, uint32_t *log, uint32_t max_log)
+{
+    uint32_t pos, sym = 0, nbits, threshold, v, rep;
+    int remaining, max, count, zero = 0;
+
+    memzero(norm, (*max_sym + 1) * sizeof(*norm));
+
+    *log = zstd_fwd_bits(p, len, 0, 4) + 5;
+    pos = 4;
+
+    if (*log > max_log) {
+        return -1;
+    }
+
+    remaining = (1 << *log) + 1;
+    threshold = 1 << *log;
+    nbits = *log + 1;
+
+    while (remaining > 1 && sym <= *max_sym) {
+        /* a zero count is followed by 2-bit counts of more zeros, 3 meaning
+         * that another count follows
+         */
+        if (zero) {
+            do {
+                rep = zstd_fwd_bits(p, len, pos, 2);
+                pos += 2;
+                sym += rep;
+            } while (rep == 3);
+
+            if (sym > *max_sym) {
+                return -1;
+            }
+        }
+
+        /* small values take one bit less */
+        max = 2 * threshold - 1 - remaining;
+        v = zstd_fwd_bits(p, len, pos, nbits);
+
+        if ((v & (threshold - 1)) < max) {
+            count = v & (threshold - 1);
+            pos += nbits - 1;
+        } else {
+            count = v & (2 * threshold - 1);
+            if (count >= threshold) count -= max;
+            pos += nbits;
+        }
+
+        count--;
+        remaining -= count < 0 ? -count : count;
+        norm[sym++] = count;
+        zero = count == 0;
+
+        while (remaining < threshold) {
+            nbits--;
+            threshold >>= 1;
+        }
+    }
+
+    if (remaining != 1 || pos > len * 8) {
+        return -1;
+    }
+
+    *max_sym = sym - 1;
+
+    return (pos + 7) / 8;
+}
+
+/**
+ * Build an FSE decoding table from normalised counts.
+ * @param t table, 1 << log entries
+ * @param norm count of each symbol
+ * @param nsym number of symbols
+ * @param log accuracy log
+ * @returns 0 on success, -1 if the counts are corrupt
+ */
+static int zstd_fse_build(struct zstd_fse *t, const int16_t *norm,
+    uint32_t nsym, uint32_t log)
+{
+    uint16_t next[ZSTD_ML_CODES];
+    uint32_t size = 1 << log, high = size - 1, pos = 0, step, s, i, state;
+    int k;
+
+    /* "less than one" symbols get a single state each, from the top */
+    for (s = 0; s < nsym; s++) {
+        if (norm[s] == -1) {
+            t[high--].symbol = s;
+            next[s] = 1;
+        } else {
+            next[s] = norm[s];
+        }
+    }
+
+    /* spread the others over the rest */
+    step = (size >> 1) + (size >> 3) + 3;
+
+    for (s = 0; s < nsym; s++) {
+        for (k = 0; k < norm[s]; k++) {
+            t[pos].symbol = s;
+
+            do {
+                pos = (pos + step) & (size - 1);
+            } while (pos > high);
+        }
+    }
+
+    if (pos != 0) {
+        return -1;
+    }
+
+    for (i = 0; i < size; i++) {
+        state = next[t[i].symbol]++;
+        t[i].bits = log - zstd_highbit(state);
+        t[i].base = (state << t[i].bits) - size;
+    }
+
+    return 0;
+}
+
+/**
+ * Read the FSE weights of a Huffman tree description.
+ * @param w set to the weights
+ * @returns the number of weights, or -1 if they are corrupt
+ */
+static int zstd_huf_weights(const uint8_t *p, uint32_t len, uint8_t *w)
+{
+    struct zstd_fse t[1 << ZSTD_WEIGHT_LOG_MAX];
+    int16_t norm[ZSTD_WEIGHT_MAX + 1];
+    struct zstd_bits b;
+    uint32_t max_sym = ZSTD_WEIGHT_MAX, log, s1, s2, n = 0;
+    int r;
+
+    if ((r = zstd_fse_count(p, len, norm, &max_sym, &log,
+            ZSTD_WEIGHT_LOG_MAX)) < 0 ||
+        zstd_fse_build(t, norm, max_sym + 1, log) < 0 ||
+        zstd_bits_init(&b, p + r, len - r) < 0)
+    {
+        return -1;
+    }
+
+    /* two interleaved states; the one not updated last has the final
+     * weight once the stream runs out
+     */
+    s1 = zstd_bits_read(&b, log);
+    s2 = zstd_bits_read(&b, log);
+
+    for (;;) {
+        if (n > ZSTD_WEIGHTS - 3) {
+            return -1;
+        }
+
+        w[n++] = t[s1].symbol;
+        s1 = t[s1].base + zstd_bits_read(&b, t[s1].bits);
+
+        if (b.over) {
+            w[n++] = t[s2].symbol;
+            break;
+        }
+
+        w[n++] = t[s2].symbol;
+        s2 = t[s2].base + zstd_bits_read(&b, t[s2].bits);
+
+        if (b.over) {
+            w[n++] = t[s1].symbol;
+            break;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Read a Huffman tree description and build its decoding table. Symbols
+ * of weight w have codes of huf_log + 1 - w bits; the table is indexed by
+ * the next huf_log bits, so each symbol fills 1 << (w - 1) entries.
+ * @returns bytes the description takes, or -1 if it is corrupt
+ */
+static int zstd_huf_table(struct zstd_dec *d, const uint8_t *p, uint32_t len)
+{
+    uint8_t w[ZSTD_WEIGHTS];
+    uint32_t start[ZSTD_HUF_LOG_MAX + 1];
+    uint32_t n, i, j, size, total = 0, log, left, next;
+    int r;
+
+    if (len == 0) {
+        return -1;
+    }
+
+    if (p[0] >= 128) {
+        /* 4 bits per weight */
+        n = p[0] - 127;
+        size = (n + 1) / 2;
+
+        if (size >= len) {
+            return -1;
+        }
+
+        for (i = 0; i < n; i++) {
+            w[i] = i & 1 ? p[1 + i / 2] & 15 : p[1 + i / 2] >> 4;
+        }
+    } else {
+        size = p[0];
+
+        if (size >= len || (r = zstd_huf_weights(p + 1, size, w)) < 0) {
+            return -1;
+        }
+
+        n = r;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (w[i] > ZSTD_HUF_LOG_MAX) return -1;
+        if (w[i]) total += 1 << (w[i] - 1);
+    }
+
+    if (total == 0 || (log = zstd_highbit(total) + 1) > ZSTD_HUF_LOG_MAX) {
+        return -1;
+    }
+
+    /* the last weight is implied: it makes the total a power of two */
+    left = (1 << log) - total;
+
+    if (left & (left - 1)) {
+        return -1;
+    }
+
+    w[n++] = zstd_highbit(left) + 1;
+
+    /* lower weights, i.e. longer codes, first */
+    memzero(start, sizeof(start));
+
+    for (i = 0; i < n; i++) {
+        if (w[i]) start[w[i]] += 1 << (w[i] - 1);
+    }
+
+    for (next = 0, i = 1; i <= log; i++) {
+        j = start[i];
+        start[i] = next;
+        next += j;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (w[i] == 0) continue;
+
+        for (j = 0; j < 1 << (w[i] - 1); j++) {
+            d->huf[start[w[i]] + j].symbol = i;
+            d->huf[start[w[i]] + j].bits = log + 1 - w[i];
+        }
+
+        start[w[i]] += 1 << (w[i] - 1);
+    }
+
+    d->huf_log = log;
+    d->have |= ZSTD_HAVE_HUF;
+
+    return size + 1;
+}
+
+/**
+ * Decode a Huffman-coded stream of literals.
+ * @param out where the literals go
+ * @param n number of literals in the stream
+ * @returns 0 on success, -1 if the stream is corrupt
+ */
+static int zstd_huf_stream(struct zstd_dec *d, const uint8_t *p,
+    uint32_t len, uint8_t *out, uint32_t n)
+{
+    const struct zstd_huf *e;
+    struct zstd_bits b;
+
+    if (zstd_bits_init(&b, p, len) < 0) {
+        return -1;
+    }
+
+    while (n--) {
+        e = &d->huf[zstd_bits_peek(&b, d->huf_log)];
+        zstd_bits_skip(&b, e->bits);
+        *out++ = e->symbol;
+    }
+
+    return zstd_bits_done(&b) ? 0 : -1;
+}
+
+/**
+ * Decode the literals section of a compressed block into d->lit.
+ * @param p the section, followed by the rest of the block
+ * @param len bytes left in the block
+ * @param nlit set to the number of literals
+ * @returns bytes the section takes, or -1 if it is corrupt
+ */
+static int zstd_literals(struct zstd_dec *d, const uint8_t *p, uint32_t len,
+    uint32_t *nlit)
+{
+    uint32_t type, fmt, hlen, regen, size, total, v, seg, s1, s2, s3;
+    int r;
+
+    if (len == 0) {
+        return -1;
+    }
+
+    type = p[0] & 3;
+    fmt = (p[0] >> 2) & 3;
+
+    if (type == ZSTD_LIT_RAW || type == ZSTD_LIT_RLE) {
+        /* sizes of 5, 12 or 20 bits */
+        hlen = fmt == 1 ? 2 : fmt == 3 ? 3 : 1;
+
+        if (len < hlen) {
+            return -1;
+        }
+
+        if (fmt == 1) {
+            regen = p[0] >> 4 | p[1] << 4;
+        } else if (fmt == 3) {
+            regen = p[0] >> 4 | p[1] << 4 | p[2] << 12;
+        } else {
+            regen = p[0] >> 3;
+        }
+
+        size = type == ZSTD_LIT_RAW ? regen : 1;
+
+        if (regen > ZSTD_BLOCK_MAX || size > len - hlen) {
+            return -1;
+        }
+
+        if (type == ZSTD_LIT_RAW) {
+            memcpy(d->lit, p + hlen, regen);
+        } else {
+            for (v = 0; v < regen; v++) d->lit[v] = p[hlen];
+        }
+
+        *nlit = regen;
+        return hlen + size;
+    }
+
+    /* Huffman coded: sizes of 10, 14 or 18 bits each */
+    hlen = fmt < 2 ? 3 : fmt + 2;
+
+    if (len < hlen) {
+        return -1;
+    }
+
+    v = p[0] | p[1] << 8 | p[2] << 16;
+
+    if (hlen == 3) {
+        regen = (v >> 4) & 0x3ff;
+        size = v >> 14;
+    } else if (hlen == 4) {
+        v |= (uint32_t)p[3] << 24;
+        regen = (v >> 4) & 0x3fff;
+        size = v >> 18;
+    } else {
+        v |= (uint32_t)p[3] << 24;
+        regen = (v >> 4) & 0x3ffff;
+        size = v >> 22 | p[4] << 10;
+    }
+
+    if (regen > ZSTD_BLOCK_MAX || size > len - hlen) {
+        return -1;
+    }
+
+    total = hlen + size;
+    p += hlen;
+
+    if (type == ZSTD_LIT_COMPRESSED) {
+        if ((r = zstd_huf_table(d, p, size)) < 0) {
+            return -1;
+        }
+
+        p += r;
+        size -= r;
+    } else if (!(d->have & ZSTD_HAVE_HUF)) {
+        return -1;
+    }
+
+    *nlit = regen;
+
+    if (fmt == 0) {
+        return zstd_huf_stream(d, p, size, d->lit, regen) < 0 ? -1 : total;
+    }
+
+    /* four streams, the first three sizes in a jump table */
+    seg = (regen + 3) / 4;
+
+    if (size < 6 || regen < 3 * seg) {
+        return -1;
+    }
+
+    s1 = zstd_le16(p);
+    s2 = zstd_le16(p + 2);
+    s3 = zstd_le16(p + 4);
+    p += 6;
+    size -= 6;
+
+    if (s1 + s2 + s3 > size ||
+        zstd_huf_stream(d, p, s1, d->lit, seg) < 0 ||
+        zstd_huf_stream(d, p + s1, s2, d->lit + seg, seg) < 0 ||
+        zstd_huf_stream(d, p + s1 + s2, s3, d->lit + 2 * seg, seg) < 0 ||
+        zstd_huf_stream(d, p + s1 + s2 + s3, size - s1 - s2 - s3,
+            d->lit + 3 * seg, regen - 3 * seg) < 0)
+    {
+        return -1;
+    }
+
+    return total;
+}
+
+/**
+ * Set up the decoding table of one of the sequence codes.
+ * @param mode how the table is given
+ * @param p table description, if there is one
+ * @param len bytes available
+ * @param t table to set up
+ * @param log set to its accuracy log
+ * @param def predefined distribution
+ * @param def_log accuracy log of the predefined distribution
+ * @param ndef number of symbols in the predefined distribution
+ * @param nsym number of symbols allowed
+ * @param max_log largest accuracy log allowed
+ * @param flag ZSTD_HAVE_* bit of the table
+ * @returns bytes the description takes, or -1 if it is corrupt
+ */
+static int zstd_seq_table(struct zstd_dec *d, uint32_t mode,
+    const uint8_t *p, uint32_t len, struct zstd_fse *t, uint32_t *log,
+    const int16_t *def, uint32_t def_log, uint32_t ndef, uint32_t nsym,
+    uint32_t max_log, uint32_t flag)
+{
+    int16_t norm[ZSTD_ML_CODES];
+    uint32_t max_sym = nsym - 1;
+    int r = 0;
+
+    switch (mode) {
+    case ZSTD_SEQ_PREDEFINED:
+        zstd_fse_build(t, def, ndef, def_log);
+        *log = def_log;
+        break;
+    case ZSTD_SEQ_RLE:
+        if (len == 0 || p[0] >= nsym) {
+            return -1;
+        }
+
+        t[0].symbol = p[0];
+        t[0].bits = 0;
+        t[0].base = 0;
+        *log = 0;
+        r = 1;
+        break;
+    case ZSTD_SEQ_COMPRESSED:
+        if ((r = zstd_fse_count(p, len, norm, &max_sym, log, max_log)) < 0 ||
+            zstd_fse_build(t, norm, max_sym + 1, *log) < 0)
+        {
+            return -1;
+        }
+        break;
+    default:
+        /* the table of the previous block */
+        return d->have & flag ? 0 : -1;
+    }
+
+    d->have |= flag;
+
+    return r;
+}
+
+/**
+ * Carry out the sequences of a block: each copies literals, then a match.
+ * @param b the sequences bitstream, past the table descriptions
+ * @param nseq number of sequences
+ * @param lit next literal; moved past the literals used
+ * @param lit_end end of the literals
+ * @returns 0 on success, -1 if a sequence is corrupt or doesn't fit
+ */
+static int zstd_execute(struct zstd_dec *d, struct zstd_bits *b,
+    uint32_t nseq, const uint8_t **lit, const uint8_t *lit_end)
+{
+    const struct zstd_fse *ll_e, *of_e, *ml_e;
+    uint8_t *match;
+    uint32_t ll_state, of_state, ml_state, ll, ml, off, i;
+
+    ll_state = zstd_bits_read(b, d->ll_log);
+    of_state = zstd_bits_read(b, d->of_log);
+    ml_state = zstd_bits_read(b, d->ml_log);
+
+    while (nseq--) {
+        ll_e = &d->ll[ll_state];
+        of_e = &d->of[of_state];
+        ml_e = &d->ml[ml_state];
+
+        /* extra bits: offset, match length, literal length */
+        off = (1 << of_e->symbol) + zstd_bits_read(b, of_e->symbol);
+        ml = zstd_ml_base[ml_e->symbol] +
+            zstd_bits_read(b, zstd_ml_extra[ml_e->symbol]);
+        ll = zstd_ll_base[ll_e->symbol] +
+            zstd_bits_read(b, zstd_ll_extra[ll_e->symbol]);
+
+        /* then the states, but not after the last sequence */
+        if (nseq) {
+            ll_state = ll_e->base + zstd_bits_read(b, ll_e->bits);
+            ml_state = ml_e->base + zstd_bits_read(b, ml_e->bits);
+            of_state = of_e->base + zstd_bits_read(b, of_e->bits);
+        }
+
+        /* 1 to 3 are the recent offsets, shifted by one if there are no
+         * literals, the last being the most recent less one
+         */
+        if (off > 3) {
+            off -= 3;
+            d->rep[2] = d->rep[1];
+            d->rep[1] = d->rep[0];
+            d->rep[0] = off;
+        } else if ((i = off - (ll != 0)) == 0) {
+            off = d->rep[0];
+        } else {
+            off = i == 3 ? d->rep[0] - 1 : d->rep[i];
+
+            if (off == 0) {
+                return -1;
+            }
+
+            if (i > 1) d->rep[2] = d->rep[1];
+            d->rep[1] = d->rep[0];
+            d->rep[0] = off;
+        }
+
+        if (ll > lit_end - *lit || ll + ml > d->out_end - d->pos ||
+            off > d->pos + ll - d->frame || off > d->window)
+        {
+            return -1;
+        }
+
+        memcpy(d->pos, *lit, ll);
+        *lit += ll;
+        d->pos += ll;
+
+        match = d->pos - off;
+
+        if (off >= ml) {
+            memcpy(d->pos, match, ml);
+            d->pos += ml;
+        } else {
+            /* overlapping: repeats the last off bytes */
+            while (ml--) *d->pos++ = *match++;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Decode the sequences section of a compressed block and carry out the
+ * sequences, copying literals and matches to the output.
+ * @param p the section, to the end of the block
+ * @param len bytes in the section
+ * @param nlit number of literals in d->lit
+ * @returns 0 on success, -1 if it is corrupt or doesn't fit
+ */
+static int zstd_sequences(struct zstd_dec *d, const uint8_t *p, uint32_t len,
+    uint32_t nlit)
+{
+    struct zstd_bits b;
+    const uint8_t *lit = d->lit, *lit_end = d->lit + nlit;
+    uint8_t *block = d->pos;
+    uint32_t nseq, n, i;
+    int r;
+
+    if (len == 0) {
+        return -1;
+    }
+
+    nseq = p[0];
+    n = 1;
+
+    if (nseq == 255) {
+        if (len < 3) return -1;
+        nseq = (p[1] | p[2] << 8) + 0x7f00;
+        n = 3;
+    } else if (nseq >= 128) {
+        if (len < 2) return -1;
+        nseq = (nseq - 128) << 8 | p[1];
+        n = 2;
+    }
+
+    if (nseq == 0) {
+        if (n != len) {
+            return -1;
+        }
+    } else {
+        if (n == len || (p[n] & 3)) {
+            return -1;
+        }
+
+        i = p[n++];
+
+        if ((r = zstd_seq_table(d, i >> 6, p + n, len - n, d->ll, &d->ll_log,
+                zstd_ll_default, ZSTD_LL_DEFAULT_LOG, ZSTD_LL_CODES,
+                ZSTD_LL_CODES, ZSTD_LL_LOG_MAX, ZSTD_HAVE_LL)) < 0)
+        {
+            return -1;
+        }
+
+        n += r;
+
+        if ((r = zstd_seq_table(d, (i >> 4) & 3, p + n, len - n, d->of,
+                &d->of_log, zstd_of_default, ZSTD_OF_DEFAULT_LOG,
+                ZSTD_OF_DEFAULT_CODES, ZSTD_OF_CODES, ZSTD_OF_LOG_MAX,
+                ZSTD_HAVE_OF)) < 0)
+        {
+            return -1;
+        }
+
+        n += r;
+
+        if ((r = zstd_seq_table(d, (i >> 2) & 3, p + n, len - n, d->ml,
+                &d->ml_log, zstd_ml_default, ZSTD_ML_DEFAULT_LOG,
+                ZSTD_ML_CODES, ZSTD_ML_CODES, ZSTD_ML_LOG_MAX,
+                ZSTD_HAVE_ML)) < 0)
+        {
+            return -1;
+        }
+
+        n += r;
+
+        if (n > len || zstd_bits_init(&b, p + n, len - n) < 0 ||
+            zstd_execute(d, &b, nseq, &lit, lit_end) < 0 ||
+            !zstd_bits_done(&b))
+        {
+            return -1;
+        }
+    }
+
+    /* literals after the last sequence */
+    n = lit_end - lit;
+
+    if (n > d->out_end - d->pos) {
+        return -1;
+    }
+
+    memcpy(d->pos, lit, n);
+    d->pos += n;
+
+    return d->pos - block > ZSTD_BLOCK_MAX ? -1 : 0;
+}
+
+/* XXH64, with 64-bit values as two halves since the targets are 32-bit */
+
+static struct zstd_xxh xxh_add(struct zstd_xxh a, struct zstd_xxh b)
+{
+    a.lo += b.lo;
+    a.hi += b.hi + (a.lo < b.lo);
+
+    return a;
+}
+
+static struct zstd_xxh xxh_mul(struct zstd_xxh a, struct zstd_xxh b)
+{
+    struct zstd_xxh r;
+    uint32_t a0 = a.lo & 0xffff, a1 = a.lo >> 16;
+    uint32_t b0 = b.lo & 0xffff, b1 = b.lo >> 16;
+    uint32_t mid;
+
+    /* the high half of a.lo * b.lo, from 16-bit pieces */
+    mid = (a0 * b0 >> 16) + (a0 * b1 & 0xffff) + (a1 * b0 & 0xffff);
+
+    r.lo = a.lo * b.lo;
+    r.hi = a1 * b1 + (a0 * b1 >> 16) + (a1 * b0 >> 16) + (mid >> 16) +
+        a.lo * b.hi + a.hi * b.lo;
+
+    return r;
+}
+
+static struct zstd_xxh xxh_rotl(struct zstd_xxh a, uint32_t n)
+{
+    struct zstd_xxh r;
+
+    /* 0 < n < 32 */
+    r.lo = a.lo << n | a.hi >> (32 - n);
+    r.hi = a.hi << n | a.lo >> (32 - n);
+
+    return r;
+}
+
+static struct zstd_xxh xxh_round(struct zstd_xxh acc, const uint8_t *p)
+{
+    struct zstd_xxh lane;
+
+    lane.lo = zstd_le32(p);
+    lane.hi = zstd_le32(p + 4);
+
+    return xxh_mul(xxh_rotl(xxh_add(acc, xxh_mul(lane, xxh_p2)), 31),
+        xxh_p1);
+}
+
+static struct zstd_xxh xxh_merge(struct zstd_xxh h, struct zstd_xxh v)
+{
+    struct zstd_xxh zero = { 0, 0 };
+
+    v = xxh_mul(xxh_rotl(xxh_add(zero, xxh_mul(v, xxh_p2)), 31), xxh_p1);
+    h.lo ^= v.lo;
+    h.hi ^= v.hi;
+
+    return xxh_add(xxh_mul(h, xxh_p1), xxh_p4);
+}
+
+/**
+ * The low 32 bits of the XXH64 of a buffer, with seed 0: the content
+ * checksum of a frame.
+ */
+static uint32_t zstd_xxh64(const uint8_t *p, uint32_t len)
+{
+    struct zstd_xxh v[4], h, k;
+    const uint8_t *end = p + len;
+    int i;
+
+    if (len >= 32) {
+        v[0] = xxh_add(xxh_p1, xxh_p2);
+        v[1] = xxh_p2;
+        v[2].lo = v[2].hi = 0;
+        v[3].lo = 0x7a143579; /* -P1 */
+        v[3].hi = 0x61c8864e;
+
+        do {
+            for (i = 0; i < 4; i++, p += 8) {
+                v[i] = xxh_round(v[i], p);
+            }
+        } while (end - p >= 32);
+
+        h = xxh_add(xxh_add(xxh_rotl(v[0], 1), xxh_rotl(v[1], 7)),
+            xxh_add(xxh_rotl(v[2], 12), xxh_rotl(v[3], 18)));
+
+        for (i = 0; i < 4; i++) {
+            h = xxh_merge(h, v[i]);
+        }
+    } else {
+        h = xxh_p5;
+    }
+
+    k.lo = len;
+    k.hi = 0;
+    h = xxh_add(h, k);
+
+    for (; end - p >= 8; p += 8) {
+        k.lo = k.hi = 0;
+        k = xxh_round(k, p);
+        h.lo ^= k.lo;
+        h.hi ^= k.hi;
+        h = xxh_add(xxh_mul(xxh_rotl(h, 27), xxh_p1), xxh_p4);
+    }
+
+    if (end - p >= 4) {
+        k.lo = zstd_le32(p);
+        k.hi = 0;
+        k = xxh_mul(k, xxh_p1);
+        h.lo ^= k.lo;
+        h.hi ^= k.hi;
+        h = xxh_add(xxh_mul(xxh_rotl(h, 23), xxh_p2), xxh_p3);
+        p += 4;
+    }
+
+    for (; p < end; p++) {
+        k.lo = *p;
+        k.hi = 0;
+        k = xxh_mul(k, xxh_p5);
+        h.lo ^= k.lo;
+        h.hi ^= k.hi;
+        h = xxh_mul(xxh_rotl(h, 11), xxh_p1);
+    }
+
+    /* h ^= h >> 33; h *= P2; h ^= h >> 29; h *= P3; h ^= h >> 32 */
+    h.lo ^= h.hi >> 1;
+    h = xxh_mul(h, xxh_p2);
+    h.lo ^= h.lo >> 29 | h.hi << 3;
+    h.hi ^= h.hi >> 29;
+    h = xxh_mul(h, xxh_p3);
+    h.lo ^= h.hi;
+
+    return h.lo;
+}
+
+/**
+ * Decode a frame whose magic number has been read, to the decoder's
+ * output. Matches can't reach back past the start of the frame, nor
+ * further than its window size.
+ * @param d decoder
+ * @returns 0 on success, -1 if the frame is corrupt, unsupported or
+ * doesn't fit
+ */
+int zstd_frame(struct zstd_dec *d)
+{
+    static const uint8_t did_len[4] = { 0, 1, 2, 4 };
+    uint8_t hdr[14], *p;
+    const uint8_t *in;
+    uint32_t fhd, fcs_len, len, i, n, v, type, block_max, fcs = 0;
+    int c, last;
+
+    if ((c = zstd_dec_byte(d)) < 0 || (c & ZSTD_FHD_RESERVED)) {
+        return -1;
+    }
+
+    fhd = c;
+    fcs_len = fhd >> 6 ? 1 << (fhd >> 6) : fhd & ZSTD_FHD_SINGLE ? 1 : 0;
+    len = (fhd & ZSTD_FHD_SINGLE ? 0 : 1) + did_len[fhd & 3] + fcs_len;
+
+    for (i = 0; i < len; i++) {
+        if ((c = zstd_dec_byte(d)) < 0) return -1;
+        hdr[i] = c;
+    }
+
+    p = hdr;
+
+    /* window descriptor: a power of two and eighths of it */
+    if (!(fhd & ZSTD_FHD_SINGLE)) {
+        if ((*p >> 3) > 19) {
+            d->window = 0xffffffff; /* 1GB or more */
+        } else {
+            d->window = 1 << (10 + (*p >> 3));
+            d->window += (d->window >> 3) * (*p & 7);
+        }
+
+        p++;
+    }
+
+    for (v = 0, i = 0; i < did_len[fhd & 3]; i++) {
+        v |= *p++;
+    }
+
+    if (v) {
+        printf("\nzstd frame needs a dictionary.\n");
+        return -1;
+    }
+
+    /* frame content size, if given; the 2-byte form is offset by 256 */
+    for (i = 0; i < fcs_len; i++) {
+        if (i < 4) {
+            fcs |= (uint32_t)p[i] << (8 * i);
+        } else if (p[i]) {
+            fcs = 0xffffffff;
+        }
+    }
+
+    if (fcs_len == 2) {
+        fcs += 256;
+    }
+
+    if (fhd & ZSTD_FHD_SINGLE) {
+        d->window = fcs;
+    }
+
+    if (d->window > ZSTD_WINDOW_MAX) {
+        printf("\nzstd window of %d KB is over the limit of %d KB.\n",
+            d->window >> 10, ZSTD_WINDOW_MAX >> 10);
+        return -1;
+    }
+
+    if (fcs_len && fcs > d->out_end - d->pos) {
+        printf("\nzstd frame of %d bytes does not fit in memory.\n", fcs);
+        return -1;
+    }
+
+    d->frame = d->pos;
+    d->rep[0] = 1;
+    d->rep[1] = 4;
+    d->rep[2] = 8;
+    d->have = 0;
+
+    block_max = d->window < ZSTD_BLOCK_MAX ? d->window : ZSTD_BLOCK_MAX;
+
+    do {
+        for (v = 0, i = 0; i < 3; i++) {
+            if ((c = zstd_dec_byte(d)) < 0) return -1;
+            v |= c << (8 * i);
+        }
+
+        last = v & 1;
+        type = (v >> 1) & 3;
+        len = v >> 3;
+
+        if (len > block_max) {
+            return -1;
+        }
+
+        if (type == ZSTD_BLOCK_RAW) {
+            if (len > d->out_end - d->pos) {
+                return -1;
+            }
+
+            while (len) {
+                if (d->in == d->in_end && zstd_refill(d) < 0) {
+                    return -1;
+                }
+
+                n = d->in_end - d->in;
+                if (n > len) n = len;
+
+                memcpy(d->pos, d->in, n);
+                d->in += n;
+                d->pos += n;
+                len -= n;
+            }
+        } else if (type == ZSTD_BLOCK_RLE) {
+            if (len > d->out_end - d->pos || (c = zstd_dec_byte(d)) < 0) {
+                return -1;
+            }
+
+            while (len--) *d->pos++ = c;
+        } else if (type == ZSTD_BLOCK_COMPRESSED) {
+            in = zstd_take(d, len);
+
+            if (in == NULL || (c = zstd_literals(d, in, len, &n)) < 0 ||
+                zstd_sequences(d, in + c, len - c, n) < 0)
+            {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+
+        if (d->tick != NULL && d->pos >= d->tick_at) {
+            d->tick(d);
+        }
+    } while (!last);
+
+    if (fcs_len && d->pos - d->frame != fcs) {
+        return -1;
+    }
+
+    if (fhd & ZSTD_FHD_CHECKSUM) {
+        for (v = 0, i = 0; i < 4; i++) {
+            if ((c = zstd_dec_byte(d)) < 0) return -1;
+            v |= (uint32_t)c << (8 * i);
+        }
+
+        if (zstd_xxh64(d->frame, d->pos - d->frame) != v) {
+            printf("\nzstd frame failed its checksum.\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Read a little endian word from outside the frames.
+ * @returns 0 on success, -1 at the end of the input
+ */
+static int zstd_read32(struct zstd_dec *d, uint32_t *v)
+{
+    int c, i;
+
+    for (*v = 0, i = 0; i < 4; i++) {
+        if ((c = zstd_dec_byte(d)) < 0) {
+            return -1;
+        }
+
+        *v |= (uint32_t)c << (8 * i);
+    }
+
+    return 0;
+}
+
+/**
+ * Decode a Zstandard image to the decoder's output: frames one after
+ * another decode to one file, and skippable frames, which hold metadata of
+ * no interest here, are passed over.
+ * @param d decoder
+ * @returns 0 on success, -1 if the image is corrupt, unsupported or
+ * doesn't fit
+ */
+int zstd_decode(struct zstd_dec *d)
+{
+    uint32_t magic, len;
+
+    if (zstd_read32(d, &magic) < 0) {
+        printf("\nTruncated zstd image.\n");
+        return -1;
+    }
+
+    do {
+        if ((magic & ~15) == ZSTD_SKIPPABLE_MAGIC) {
+            if (zstd_read32(d, &len) < 0) {
+                printf("\nTruncated zstd image.\n");
+                return -1;
+            }
+
+            while (len--) {
+                if (zstd_dec_byte(d) < 0) {
+                    printf("\nTruncated zstd image.\n");
+                    return -1;
+                }
+            }
+
+            continue;
+        }
+
+        if (magic != ZSTD_MAGIC) {
+            printf("\nTrailing garbage after zstd data.\n");
+            return -1;
+        }
+
+        if (zstd_frame(d) < 0) {
+            printf("\nError in decoding zstd data.\n");
+            return -1;
+        }
+    } while (zstd_read32(d, &magic) == 0);
+
+    return 0;
+}